@@ -34,22 +34,22 @@
 #include "crypto.h"
 #include "key_cancellation.h"
 #include "keychain.h"
+#include "keychain_cache.h"
 #include "keychain_utils.h"
 #include "pfr_pointers.h"
 #include "ufm.h"
 
 
 /**
- * @brief This function validates Block 0.
- * This function validates the Magic number, PC length, PC Type, and
- * most importantly, hash of the protected content.
+ * @brief This function validates the fields of Block 0.
+ * This function validates the Magic number, PC length and PC Type. The hash of the
+ * protected content is checked separately by is_pc_hash_valid().
  *
  * @param b0 pointer to the block 0
- * @param protected_content the start address of protected content
  *
- * @return alt_u32 1 if this Block 0 is valid; 0, otherwise
+ * @return alt_u32 1 if the fields of this Block 0 are valid; 0, otherwise
  */
-static alt_u32 is_block0_valid(KCH_BLOCK0* b0, alt_u32* protected_content)
+static alt_u32 is_block0_header_valid(KCH_BLOCK0* b0)
 {
     // Verify magic number
     if (b0->magic != BLOCK0_MAGIC)
@@ -122,8 +122,40 @@ static alt_u32 is_block0_valid(KCH_BLOCK0* b0, alt_u32* protected_content)
         }
     }
 
+    return 1;
+}
+
+/**
+ * @brief This function verifies the hash of the protected content against the hash in Block 0.
+ * This is the most expensive check of a signature, since the protected content can be many megabytes.
+ *
+ * @param b0 pointer to the block 0
+ * @param protected_content the start address of protected content
+ *
+ * @return alt_u32 1 if the hash matches; 0, otherwise
+ */
+static alt_u32 is_pc_hash_valid(KCH_BLOCK0* b0, alt_u32* protected_content)
+{
     // Verify Hash256 of PC
-    return verify_sha((alt_u32*) b0->pc_hash256, protected_content, b0->pc_length);
+    CRYPTO_SHA_CONTEXT sha_ctx;
+    sha_init(&sha_ctx, b0->pc_length);
+    sha_update(&sha_ctx, protected_content, b0->pc_length);
+    return sha_final_and_verify(&sha_ctx, (alt_u32*) b0->pc_hash256);
+}
+
+/**
+ * @brief This function validates Block 0.
+ * This function validates the Magic number, PC length, PC Type, and
+ * most importantly, hash of the protected content.
+ *
+ * @param b0 pointer to the block 0
+ * @param protected_content the start address of protected content
+ *
+ * @return alt_u32 1 if this Block 0 is valid; 0, otherwise
+ */
+static alt_u32 is_block0_valid(KCH_BLOCK0* b0, alt_u32* protected_content)
+{
+    return is_block0_header_valid(b0) && is_pc_hash_valid(b0, protected_content);
 }
 
 /**
@@ -218,14 +250,27 @@ static alt_u32 is_csk_entry_valid(
         }
     }
 
+    // Skip the ECDSA if an identical CSK entry has already been verified with this root key
+    alt_u32 csk_entry_hash[PFR_CRYPTO_LENGTH / 4];
+    calculate_csk_entry_hash(csk_entry, csk_entry_hash);
+    if (is_csk_entry_hash_cached(csk_entry_hash))
+    {
+        return 1;
+    }
+
     // A signature over the hashed region using the Root Key in the previous entry must be valid.
     // The hashed region starts at the curve magic field
-    return verify_ecdsa_and_sha(prev_entry->pubkey_x,
+    if (verify_ecdsa_and_sha(prev_entry->pubkey_x,
             prev_entry->pubkey_y,
             csk_entry->sig_r,
             csk_entry->sig_s,
             &csk_entry->curve_magic,
-            BLOCK1_CSK_ENTRY_HASH_REGION_SIZE);
+            BLOCK1_CSK_ENTRY_HASH_REGION_SIZE))
+    {
+        add_csk_entry_hash_to_cache(csk_entry_hash);
+        return 1;
+    }
+    return 0;
 }
 
 /**
@@ -327,17 +372,52 @@ static alt_u32 is_key_can_cert_valid(KCH_CAN_CERT* cert)
     return cert->csk_id <= KCH_MAX_KEY_ID;
 }
 
+/**
+ * @brief This function runs the checks on a signed payload that don't need the crypto block.
+ *
+ * That includes the fields of Block 0, the Block 1 magic number and whether the CSK key has
+ * been cancelled. For key cancellation certificate, this function also validate the certificate
+ * content. These checks are cheap, so they are done before any hash or ECDSA calculation. That
+ * way, a payload that is rejected on these grounds costs no crypto time at all.
+ *
+ * @param signature the start address of the signed payload (i.e. beginning of a signature.)
+ *
+ * @return alt_u32 1 if all checks passed; 0, otherwise
+ */
+static alt_u32 is_signature_precheck_valid(KCH_SIGNATURE* signature)
+{
+    KCH_BLOCK0* b0 = (KCH_BLOCK0*) &signature->b0;
+    KCH_BLOCK1* b1 = (KCH_BLOCK1*) &signature->b1;
+
+    if (!is_block0_header_valid(b0) || (b1->magic != BLOCK1_MAGIC))
+    {
+        return 0;
+    }
+
+    if (b0->pc_type & KCH_PC_TYPE_KEY_CAN_CERT_MASK)
+    {
+        // Validate the content of key cancellation certificate
+        // Here, it is okay to read PC without first authenticating its signature, because
+        // Nios is simply checking values of the 128 bytes in PC.
+        return is_key_can_cert_valid((KCH_CAN_CERT*) incr_alt_u32_ptr((alt_u32*) signature, SIGNATURE_SIZE));
+    }
+
+    // The CSK key must not be cancelled
+    return is_csk_key_valid(get_kch_pc_type(b0), b1->csk_entry.key_id);
+}
+
 /**
  * @brief This function authenticate a given signed payload.
  * Please refer to the specification regarding the format of signed payload.
- * This function authenticate the Block 0 (containing hash of the payload) first,
- * then authenticate the Block 1 (containing signature over Block0).
- * For key cancellation certificate, this function also validate the certificate
- * content for security reasons.
+ * This function runs the checks that don't need the crypto block first. Then, it authenticates
+ * the Block 1 (containing signature over Block0). The hash of the protected content in Block 0
+ * is verified last, since that's the most expensive check.
  *
  * @param signature the start address of the signed payload (i.e. beginning of a signature.)
  *
  * @return alt_u32 1 if this keychain is valid; 0, otherwise
+ *
+ * @see is_signature_precheck_valid
  */
 static alt_u32 is_signature_valid(KCH_SIGNATURE* signature)
 {
@@ -346,24 +426,13 @@ static alt_u32 is_signature_valid(KCH_SIGNATURE* signature)
     KCH_BLOCK1* b1 = (KCH_BLOCK1*) &signature->b1;
     alt_u32* pc = incr_alt_u32_ptr((alt_u32*) signature, SIGNATURE_SIZE);
 
-    // Check if this is a key cancellation certificate
-    alt_u32 is_key_cancellation_cert = b0->pc_type & KCH_PC_TYPE_KEY_CAN_CERT_MASK;
-    // Additional check for key cancellation certificate
-    if (is_key_cancellation_cert)
+    if (!is_signature_precheck_valid(signature))
     {
-        // Validate the content of key cancellation certificate
-        // Here, it is okay to read PC without first authenticating its signature, because
-        // Nios is simply checking values of the 128 bytes in PC.
-        // Moving this block to after Block1/Block0 authentication would cause more code space,
-        // which is a scarce resource in this design.
-        if (!is_key_can_cert_valid((KCH_CAN_CERT*) pc))
-        {
-            return 0;
-        }
+        return 0;
     }
 
     // Validate block1 (contains the signature chain used to sign block0
-    if (is_block1_valid(b0, b1, is_key_cancellation_cert))
+    if (is_block1_valid(b0, b1, b0->pc_type & KCH_PC_TYPE_KEY_CAN_CERT_MASK))
     {
         // Validate block0 (contains hash of the protected content)
         return is_block0_valid(b0, pc);
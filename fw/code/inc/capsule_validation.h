@@ -34,7 +34,9 @@
 #include "authentication.h"
 #include "cpld_update.h"
 #include "pbc.h"
+#include "pbc_utils.h"
 #include "pfr_pointers.h"
+#include "spi_region_auth_cache.h"
 
 
 // Tracking number of failed update attempts from BMC/PCH
@@ -96,8 +98,9 @@ static alt_u32 is_pbc_valid(PBC_HEADER* pbc)
         return 0;
     }
 
-    // Check version
-    if (pbc->version != PBC_EXPECTED_VERSION)
+    // Check version. Both versions may be used in a delta capsule.
+    alt_u32 format_version = get_pbc_format_version(pbc);
+    if ((format_version != PBC_EXPECTED_VERSION) && (format_version != PBC_VERSION_PER_PAGE_LZ))
     {
         return 0;
     }
@@ -115,6 +118,12 @@ static alt_u32 is_pbc_valid(PBC_HEADER* pbc)
         return 0;
     }
 
+    // The page table of a version 3 PBC structure must be word aligned
+    if ((format_version == PBC_VERSION_PER_PAGE_LZ) && (pbc->bitmap_nbit % 32))
+    {
+        return 0;
+    }
+
     return 1;
 }
 
@@ -143,6 +152,8 @@ static alt_u32 are_signatures_in_capsule_valid(alt_u32* signed_capsule)
  * This includes validating expected data in the PBC structure and
  * verifying signatures in the capsule and PFM.
  *
+ * A delta capsule only carries part of an image. It is never a valid recovery capsule.
+ *
  * @param signed_capsule start address of a signed capsule
  * @return alt_u32 1 if the signed capsule is valid; 0, otherwise.
  */
@@ -152,11 +163,34 @@ static alt_u32 is_capsule_valid(alt_u32* signed_capsule)
     if (are_signatures_in_capsule_valid(signed_capsule))
     {
         // Check the compression structure definition
-        return is_pbc_valid(get_pbc_ptr_from_signed_capsule(signed_capsule));
+        PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+        return !is_delta_pbc(pbc) && is_pbc_valid(pbc);
     }
     return 0;
 }
 
+/**
+ * @brief Compare the hash of the active PFM against the given PFM hash.
+ * The @p spi_flash_type flash must be the current SPI flash.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ * @param pfm_hash the expected hash of the active PFM (i.e. pc_hash256 in Block 0 of the signed PFM)
+ * @return alt_u32 1 if the hashes match exactly; 0, otherwise
+ */
+static alt_u32 does_active_pfm_hash_match(SPI_FLASH_TYPE_ENUM spi_flash_type, const alt_u32* pfm_hash)
+{
+    KCH_BLOCK0* active_pfm_sig_b0 = (KCH_BLOCK0*) get_spi_active_pfm_ptr(spi_flash_type);
+    alt_u32* active_pfm_hash = active_pfm_sig_b0->pc_hash256;
+    for (alt_u32 word_i = 0; word_i < PFR_CRYPTO_LENGTH / 4; word_i++)
+    {
+        if (active_pfm_hash[word_i] != pfm_hash[word_i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 /**
  * @brief Compare staged firmware against active firmware.
  * Nios concludes that active firwmare and staged firmware are identical, if
@@ -167,22 +201,67 @@ static alt_u32 is_capsule_valid(alt_u32* signed_capsule)
  */
 static alt_u32 does_staged_fw_image_match_active_fw_image(SPI_FLASH_TYPE_ENUM spi_flash_type)
 {
-    KCH_BLOCK0* active_pfm_sig_b0 = (KCH_BLOCK0*) get_spi_active_pfm_ptr(spi_flash_type);
     KCH_BLOCK0* capsule_pfm_sig_b0 = (KCH_BLOCK0*) get_spi_flash_ptr_with_offset(get_staging_region_offset(spi_flash_type) + SIGNATURE_SIZE);
 
     // If the hashes of PFM match, the active image and staging image must be the same firmware.
-    alt_u32* active_pfm_hash = active_pfm_sig_b0->pc_hash256;
-    alt_u32* capsule_pfm_hash = capsule_pfm_sig_b0->pc_hash256;
-    for (alt_u32 word_i = 0; word_i < PFR_CRYPTO_LENGTH / 4; word_i++)
+    return does_active_pfm_hash_match(spi_flash_type, capsule_pfm_sig_b0->pc_hash256);
+}
+
+/**
+ * @brief Check that the update intent is allowed for this firmware update capsule.
+ *
+ * A delta capsule only holds the pages that differ from its base firmware. A recovery update would promote it
+ * to the recovery region, where it can't be used to recover the whole firmware. Hence, a delta capsule is only
+ * allowed in an active firmware update.
+ *
+ * @param signed_capsule pointer to the start address of a signed firmware update capsule
+ * @param update_intent The update intent value that triggered this update
+ *
+ * @return alt_u32 1 if the update intent is allowed; 0, otherwise.
+ */
+static alt_u32 is_capsule_update_intent_valid(alt_u32* signed_capsule, alt_u32 update_intent)
+{
+    return !(is_delta_pbc(get_pbc_ptr_from_signed_capsule(signed_capsule))
+            && (update_intent & MB_UPDATE_INTENT_FW_RECOVERY_UPDATE_MASK));
+}
+
+/**
+ * @brief Check that a firmware update capsule can be applied on the active firmware.
+ *
+ * A full capsule can always be applied. A delta capsule can only be applied when the active PFM of the target
+ * flash is the base PFM of the capsule. The target flash is given by the PC type of the capsule. It may not be
+ * the current SPI flash (e.g. in an out-of-band PCH update).
+ *
+ * @param signed_capsule pointer to the start address of a signed firmware update capsule
+ *
+ * @return alt_u32 1 if the capsule can be applied; 0, otherwise.
+ *
+ * @see is_capsule_update_intent_valid
+ */
+static alt_u32 is_capsule_base_valid(alt_u32* signed_capsule)
+{
+    PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+    if (!is_delta_pbc(pbc))
     {
-        if (active_pfm_hash[word_i] != capsule_pfm_hash[word_i])
-        {
-            // There's a hash mismatch. Image in capsule is different from active image.
-            return 0;
-        }
+        return 1;
     }
 
-    return 1;
+    SPI_FLASH_TYPE_ENUM target_spi_flash_type = SPI_FLASH_BMC;
+    if (((KCH_BLOCK0*) signed_capsule)->pc_type == KCH_PC_PFR_PCH_UPDATE_CAPSULE)
+    {
+        target_spi_flash_type = SPI_FLASH_PCH;
+    }
+
+    // Save the base PFM hash, before switching to the target flash
+    alt_u32 base_pfm_hash[PFR_CRYPTO_LENGTH / 4];
+    alt_u32_memcpy(base_pfm_hash, pbc->base_pfm_hash, PFR_CRYPTO_LENGTH);
+
+    SPI_FLASH_TYPE_ENUM cur_spi_flash_type = get_current_spi_flash_type();
+    switch_spi_flash(target_spi_flash_type);
+    alt_u32 is_base_active = does_active_pfm_hash_match(target_spi_flash_type, base_pfm_hash);
+    switch_spi_flash(cur_spi_flash_type);
+
+    return is_base_active;
 }
 
 /**
@@ -227,6 +306,43 @@ static alt_u32 does_pc_type_match_update_intent(KCH_BLOCK0* sig_b0, alt_u32 upda
     return 0;
 }
 
+/**
+ * @brief Check the SVN of an update capsule against the SVN policy.
+ *
+ * For a CPLD update capsule, the SVN in its protected content is validated against the CPLD SVN policy in UFM.
+ * For a firmware update capsule, the capsule PFM SVN is validated against the SVN policy stored in UFM. Also,
+ * if this is an active firmware update, its SVN must be the same as the SVN of recovery image. If user wishes
+ * to bump the SVN, a recovery firmware update, which update both active and recovery firmware, must be triggered.
+ * Key cancellation certificate and decommission capsule have no SVN.
+ *
+ * @param signed_capsule pointer to the start address of a signed capsule
+ * @param update_intent The update intent value that triggered this update
+ *
+ * @return alt_u32 1 if the SVN is acceptable; 0, otherwise.
+ */
+static alt_u32 is_capsule_svn_valid(alt_u32* signed_capsule, alt_u32 update_intent)
+{
+    KCH_BLOCK0* b0 = (KCH_BLOCK0*) signed_capsule;
+    if (b0->pc_type == KCH_PC_PFR_CPLD_UPDATE_CAPSULE)
+    {
+        CPLD_UPDATE_PC* cpld_update_pc = (CPLD_UPDATE_PC*) incr_alt_u32_ptr(signed_capsule, SIGNATURE_SIZE);
+        return is_svn_valid(UFM_SVN_POLICY_CPLD, cpld_update_pc->svn);
+    }
+
+    alt_u8 new_svn = get_capsule_pfm(signed_capsule)->svn;
+    if (b0->pc_type == KCH_PC_PFR_PCH_UPDATE_CAPSULE)
+    {
+        return is_svn_valid(UFM_SVN_POLICY_PCH, new_svn) &&
+                ((update_intent & MB_UPDATE_INTENT_PCH_RECOVERY_MASK) || (read_from_mailbox(MB_PCH_PFM_RECOVERY_SVN) == new_svn));
+    }
+    if (b0->pc_type == KCH_PC_PFR_BMC_UPDATE_CAPSULE)
+    {
+        return is_svn_valid(UFM_SVN_POLICY_BMC, new_svn) &&
+                ((update_intent & MB_UPDATE_INTENT_BMC_RECOVERY_MASK) || (read_from_mailbox(MB_BMC_PFM_RECOVERY_SVN) == new_svn));
+    }
+    return b0->pc_type & (KCH_PC_TYPE_KEY_CAN_CERT_MASK | KCH_PC_TYPE_DECOMM_CAP_MASK);
+}
+
 /**
  * @brief Pre-process the update capsule prior to performing the FW or CPLD update.
  *
@@ -236,15 +352,25 @@ static alt_u32 does_pc_type_match_update_intent(KCH_BLOCK0* sig_b0, alt_u32 upda
  * area is near the end of BMC SPI flash. Hashing the protected content would require CPLD to read beyond
  * the SPI AvMM memory space.
  *
- * After that, Nios authenticate the capsule signature. If that passes, Nios moves on to validate its content.
+ * Hashing a firmware update capsule takes seconds. A capsule that can be rejected by a cheap check must
+ * not cost that. Hence, Nios runs the checks that don't need the crypto block first: the Block 0 fields
+ * and CSK key cancellation of the capsule signature (and the PFM signature) and the compression structure
+ * header. These fields are read before they are authenticated, but they can only cause a rejection, which is
+ * reported as an authentication failure. The same fields are covered by the signatures that are verified
+ * afterwards.
+ *
+ * A delta capsule sent with a recovery update intent is rejected at this point too.
+ *
+ * In a firmware update capsule, the PFM is authenticated next. That is cheap, compared to the capsule hash.
+ * The SVN is then read from an authentic PFM, so an SVN rejection is reported as such before the capsule hash.
+ * The base PFM hash of a delta capsule is also checked before the capsule hash. A mismatch is reported with
+ * its own error code, although the compression structure header has not been authenticated yet.
+ * In a CPLD update capsule, the SVN is only checked after the capsule is authenticated.
+ *
+ * Once the capsule is authentic:
  * If this capsule is a key cancellation certificate, Nios cancels the key.
  * If this capsule is a decommission capsule, Nios erases UFM and then reconfig into CFM1 (Active Image).
- * If this capsule is a CPLD update capsule, this function returns 1 if its SVN is valid.
- * If this capsule is a firmware update capsule, Nios proceeds to check the signature of PFM. Once that passes,
- * SVN is then checked. The SVN checks here are more involved. The capsule PFM SVN is validated against the
- * SVN policy stored in UFM. Also, if this is an active firmware update, its SVN must be the same as the SVN
- * of recovery image. If user wishes to bump the SVN, a recovery firmware update, which update both active and
- * recovery firmware, must be triggered.
+ * If this capsule is a CPLD or firmware update capsule, this function returns 1.
  *
  * If any check fails, Nios logs a major/minor error and increments number of failed update attempts counter.
  *
@@ -255,8 +381,10 @@ static alt_u32 does_pc_type_match_update_intent(KCH_BLOCK0* sig_b0, alt_u32 upda
  * @return alt_u32 1 if Nios should proceed to perform the CPLD or FW update with the @p signed_capsule; 0, otherwise.
  *
  * @see act_on_update_intent
- * @see is_svn_valid
+ * @see is_capsule_svn_valid
  * @see does_pc_type_match_update_intent
+ * @see is_capsule_update_intent_valid
+ * @see is_signature_precheck_valid
  * @see is_signature_valid
  */
 static alt_u32 check_capsule_before_update(
@@ -265,16 +393,48 @@ static alt_u32 check_capsule_before_update(
     // This minor error code will be posted to the Mailbox, when any check failed
     alt_u32 update_event_minor_error = MINOR_ERROR_AUTHENTICATION_FAILED;
 
-    // The PC type of the capsule must match the update intent
     KCH_BLOCK0* b0 = (KCH_BLOCK0*) signed_capsule;
-    if (does_pc_type_match_update_intent(b0, update_intent))
+    alt_u32* capsule_pc = incr_alt_u32_ptr(signed_capsule, SIGNATURE_SIZE);
+    // In a firmware update capsule, the protected content starts with the signed PFM
+    KCH_SIGNATURE* capsule_pfm_sig = (KCH_SIGNATURE*) capsule_pc;
+    alt_u32 is_fw_update = ((b0->pc_type & (KCH_PC_TYPE_KEY_CAN_CERT_MASK | KCH_PC_TYPE_DECOMM_CAP_MASK)) == 0) &&
+            (b0->pc_type != KCH_PC_PFR_CPLD_UPDATE_CAPSULE);
+
+    // The PC type of the capsule must match the update intent
+    // Then, run the checks that don't need the crypto block
+    if (does_pc_type_match_update_intent(b0, update_intent)
+            && is_signature_precheck_valid((KCH_SIGNATURE*) signed_capsule)
+            && (!is_fw_update || (is_signature_precheck_valid(capsule_pfm_sig)
+                    && is_pbc_valid(get_pbc_ptr_from_signed_capsule(signed_capsule)))))
     {
+        if (is_fw_update && !is_capsule_update_intent_valid(signed_capsule, update_intent))
+        {
+            // This delta capsule can't be used for a recovery update
+            update_event_minor_error = MINOR_ERROR_INVALID_UPDATE_INTENT;
+        }
+        else if (is_fw_update && !is_signature_valid(capsule_pfm_sig))
+        {
+            // Failed PFM authentication
+        }
+        else if (is_fw_update && !is_capsule_svn_valid(signed_capsule, update_intent))
+        {
+            // Failed SVN check of the authentic capsule PFM
+            update_event_minor_error = MINOR_ERROR_INVALID_SVN;
+        }
+        else if (is_fw_update && !is_capsule_base_valid(signed_capsule))
+        {
+            // This delta capsule doesn't apply on the active firmware
+            update_event_minor_error = MINOR_ERROR_DELTA_CAPSULE_BASE_MISMATCH;
+        }
         // Validate Capsule signature
-        if (is_signature_valid((KCH_SIGNATURE*) signed_capsule))
+        else if (is_signature_valid((KCH_SIGNATURE*) signed_capsule))
         {
-            alt_u32* capsule_pc = incr_alt_u32_ptr(signed_capsule, SIGNATURE_SIZE);
-
-            if (b0->pc_type & KCH_PC_TYPE_KEY_CAN_CERT_MASK)
+            if (!is_capsule_svn_valid(signed_capsule, update_intent))
+            {
+                // Failed SVN check of the authentic CPLD update capsule
+                update_event_minor_error = MINOR_ERROR_INVALID_SVN;
+            }
+            else if (b0->pc_type & KCH_PC_TYPE_KEY_CAN_CERT_MASK)
             {
                 // If this is a key cancellation certificate, proceed to cancel this key.
                 cancel_key(get_kch_pc_type(b0), ((KCH_CAN_CERT*) capsule_pc)->csk_id);
@@ -289,49 +449,10 @@ static alt_u32 check_capsule_before_update(
                 ufm_erase_page(UFM_PFR_DATA_OFFSET);
                 perform_cfm_switch(CPLD_CFM1);
             }
-            else if (b0->pc_type == KCH_PC_PFR_CPLD_UPDATE_CAPSULE)
-            {
-                // This is a CPLD update
-                if (is_svn_valid(UFM_SVN_POLICY_CPLD, ((CPLD_UPDATE_PC*) capsule_pc)->svn))
-                {
-                    // Yes, this is a valid CPLD update capsule. Proceed with this CPLD update
-                    return 1;
-                }
-
-                // Failed SVN check
-                update_event_minor_error = MINOR_ERROR_INVALID_SVN;
-            }
             else
             {
-                // This is a firmware update
-
-                // Validate PFM signature and fields in compression structure header
-                if (is_signature_valid((KCH_SIGNATURE*) capsule_pc)
-                        && is_pbc_valid(get_pbc_ptr_from_signed_capsule(signed_capsule)))
-                {
-                    // Validate SVN
-                    alt_u8 new_svn = get_capsule_pfm(signed_capsule)->svn;
-
-                    // Check whether this SVN is allowed by looking at the UFM SVN policy
-                    if ((b0->pc_type == KCH_PC_PFR_PCH_UPDATE_CAPSULE) && is_svn_valid(UFM_SVN_POLICY_PCH, new_svn))
-                    {
-                        if ((update_intent & MB_UPDATE_INTENT_PCH_RECOVERY_MASK) || (read_from_mailbox(MB_PCH_PFM_RECOVERY_SVN) == new_svn))
-                        {
-                            // Yes, this is a valid firmware update capsule. Proceed with the update.
-                            return 1;
-                        }
-                    }
-                    else if ((b0->pc_type == KCH_PC_PFR_BMC_UPDATE_CAPSULE) && is_svn_valid(UFM_SVN_POLICY_BMC, new_svn))
-                    {
-                        if ((update_intent & MB_UPDATE_INTENT_BMC_RECOVERY_MASK) || (read_from_mailbox(MB_BMC_PFM_RECOVERY_SVN) == new_svn))
-                        {
-                            // Yes, this is a valid firmware update capsule. Proceed with the update.
-                            return 1;
-                        }
-                    }
-
-                    update_event_minor_error = MINOR_ERROR_INVALID_SVN;
-                }
+                // Yes, this is a valid CPLD or firmware update capsule. Proceed with the update.
+                return 1;
             }
         }
     }
@@ -351,6 +472,11 @@ static alt_u32 check_capsule_before_update(
  * For the second check, Nios compares the hashes of PFM in staged capsule and active image. If
  * they match, Nios says staged image matches active image and returns 1.
  *
+ * A delta capsule is rejected, since it can't be used as a recovery capsule.
+ *
+ * The staging capsule of a recovery update was authenticated in the T-1 cycle of its active update. If it has been
+ * write protected since, Nios doesn't hash it again.
+ *
  * @param spi_flash_type indicate BMC or PCH SPI flash device
  * @param skip_hash_check allow user to skip the second check
  *
@@ -361,7 +487,12 @@ static alt_u32 check_capsule_before_fw_recovery_update(SPI_FLASH_TYPE_ENUM spi_f
     switch_spi_flash(spi_flash_type);
 
     alt_u32* staging_capsule = get_spi_staging_region_ptr(spi_flash_type);
-    if (is_signature_valid((KCH_SIGNATURE*) staging_capsule))
+    alt_u32 staging_capsule_addr = get_staging_region_offset(spi_flash_type);
+    alt_u32 is_auth_cached = is_staging_capsule_auth_cached(spi_flash_type, staging_capsule_addr,
+            staging_capsule_addr + get_signed_payload_size(staging_capsule), ((KCH_BLOCK0*) staging_capsule)->pc_hash256);
+
+    if ((is_auth_cached || is_signature_valid((KCH_SIGNATURE*) staging_capsule)) &&
+            !is_delta_pbc(get_pbc_ptr_from_signed_capsule(staging_capsule)))
     {
         // Nios can trust this staging capsule now.
         // Next, check if the staged image is identical to the active image.
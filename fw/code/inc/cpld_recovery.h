@@ -36,6 +36,7 @@
 #include "spi_ctrl_utils.h"
 #include "ufm_utils.h"
 #include "authentication.h"
+#include "decompression_checkpoint.h"
 #include "tmin1_routines.h"
 
 /**
@@ -117,7 +118,7 @@ static void perform_cpld_recovery()
     reset_hw_watchdog();
 
     // Clear status word
-    ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+    erase_cpld_update_status_sector();
     alt_u32* cpld_recovery_capsule_ptr = get_spi_flash_ptr_with_offset(BMC_CPLD_RECOVERY_IMAGE_OFFSET);
     if(!is_signature_valid((KCH_SIGNATURE*) cpld_recovery_capsule_ptr))
     {
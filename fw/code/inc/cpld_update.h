@@ -33,6 +33,7 @@
 
 #include "authentication.h"
 #include "cpld_reconfig.h"
+#include "decompression_checkpoint.h"
 #include "global_state.h"
 #include "key_cancellation.h"
 #include "pfr_pointers.h"
@@ -158,7 +159,7 @@ static void perform_cpld_recovery_update()
     // No need to re-authenticate, since we've done that before update to CPLD active in ROM code.
     // Between now and then, the CPLD staging region is write protected.
     erase_spi_region(BMC_CPLD_RECOVERY_IMAGE_OFFSET, MAX_CPLD_UPDATE_CAPSULE_SIZE);
-    alt_u32_memcpy(get_spi_flash_ptr_with_offset(BMC_CPLD_RECOVERY_IMAGE_OFFSET), cpld_update_capsule_ptr, MAX_CPLD_UPDATE_CAPSULE_SIZE);
+    memcpy_to_spi_flash(get_spi_flash_ptr_with_offset(BMC_CPLD_RECOVERY_IMAGE_OFFSET), cpld_update_capsule_ptr, MAX_CPLD_UPDATE_CAPSULE_SIZE);
 
     // Update the CPLD SVN policy in NVRAM, if the input SVN in larger than what is in UFM
     CPLD_UPDATE_PC* cpld_update_protected_content = (CPLD_UPDATE_PC*) incr_alt_u32_ptr(cpld_update_capsule_ptr, SIGNATURE_SIZE);
@@ -167,7 +168,7 @@ static void perform_cpld_recovery_update()
     write_to_mailbox(MB_CPLD_SVN, get_ufm_svn(UFM_SVN_POLICY_CPLD));
 
     // Erase CPLD update status word and spi flash state
-    ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+    erase_cpld_update_status_sector();
     clear_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_READY_FOR_CPLD_RECOVERY_UPDATE_MASK);
 }
 
@@ -31,6 +31,7 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "io_counters.h"
 #include "pfr_pointers.h"
 #include "utils.h"
 
@@ -100,49 +101,103 @@ static const alt_u8 CRYPTO_EC_N[PFR_CRYPTO_LENGTH] = {
         0xbc, 0xe6, 0xfa, 0xad, 0xa7, 0x17, 0x9e, 0x84, 0xf3, 0xb9, 0xca, 0xc2, 0xfc, 0x63, 0x25, 0x51};
 
 /**
- * @brief This function calculates the SHA hash of the given data.
- * It sends all the inputs to the crypto block and the sha result can be retrieved through CSR interface.
+ * @brief Context of a SHA-only job on the crypto block.
+ * A SHA job can be fed with several non-contiguous data ranges through sha_update().
+ * The crypto block needs the total data size before the first data word arrives,
+ * hence that size has to be known when the job is started with sha_init().
  */
-static void calculate_sha(const alt_u32* data, alt_u32 data_size)
+typedef struct
+{
+    // Number of bytes that the crypto block still expects in this SHA job
+    alt_u32 remaining_size;
+} CRYPTO_SHA_CONTEXT;
+
+/**
+ * @brief Start a SHA-only job on the crypto block.
+ *
+ * @param ctx the SHA context
+ * @param total_data_size sum of the sizes of all data ranges that will be sent through sha_update()
+ */
+static void sha_init(CRYPTO_SHA_CONTEXT* ctx, alt_u32 total_data_size)
 {
     // Step 1: Write data size
-    IOWR_32DIRECT(CRYPTO_DATA_LEN_ADDR, 0, data_size);
+    IOWR_32DIRECT(CRYPTO_DATA_LEN_ADDR, 0, total_data_size);
 
     // Step 2: Set SHA-only start
     IOWR_32DIRECT(CRYPTO_CSR_ADDR, 0, CRYPTO_CSR_SHA_START_MSK);
 
+    ctx->remaining_size = total_data_size;
+}
+
+/**
+ * @brief Send a range of data to the crypto block, as part of the SHA job in @p ctx.
+ * The data is sent in PFR_CRYPTO_SAFE_COPY_DATA_SIZE chunk, so that HW timer is petted in time.
+ *
+ * @param ctx the SHA context
+ * @param data start address of the data range
+ * @param data_size size of the data range in bytes; must be multiple of 4
+ */
+static void sha_update(CRYPTO_SHA_CONTEXT* ctx, const alt_u32* data, alt_u32 data_size)
+{
+    // Nios must not send more data than what has been promised in sha_init()
+    PFR_ASSERT(data_size <= ctx->remaining_size);
+    ctx->remaining_size -= data_size;
+    count_io_ops(IO_COUNTER_BYTES_HASHED, data_size);
+
     // Step 3: Copy payload from SPI flash to CSR
-    // Step 4: Wait for SHA_DONE (SHA only)
     alt_u32* data_local_ptr = (alt_u32*) data;
-    while (!( (data_size == 0) && check_bit(CRYPTO_CSR_ADDR, CRYPTO_CSR_SHA_DONE_OFST) ))
+    while (data_size > PFR_CRYPTO_SAFE_COPY_DATA_SIZE)
     {
-        // Stay in this loop until payload copying is done and SHA computation is done.
+        alt_u32_memcpy_non_incr(CRYPTO_DATA_ADDR, data_local_ptr, PFR_CRYPTO_SAFE_COPY_DATA_SIZE);
+        data_local_ptr = incr_alt_u32_ptr(data_local_ptr, PFR_CRYPTO_SAFE_COPY_DATA_SIZE);
+        data_size -= PFR_CRYPTO_SAFE_COPY_DATA_SIZE;
 
-        // Perform step 3 in PFR_CRYPTO_SAFE_COPY_DATA_SIZE chunk
-        if (data_size > PFR_CRYPTO_SAFE_COPY_DATA_SIZE)
-        {
-            alt_u32_memcpy_non_incr(CRYPTO_DATA_ADDR, data_local_ptr, PFR_CRYPTO_SAFE_COPY_DATA_SIZE);
-            data_local_ptr = incr_alt_u32_ptr(data_local_ptr, PFR_CRYPTO_SAFE_COPY_DATA_SIZE);
-            data_size -= PFR_CRYPTO_SAFE_COPY_DATA_SIZE;
-        }
-        else if (data_size > 0)
-        {
-            alt_u32_memcpy_non_incr(CRYPTO_DATA_ADDR, data_local_ptr, data_size);
-            data_size = 0;
-        }
+        // Pet HW timer
+        reset_hw_watchdog();
+    }
+    alt_u32_memcpy_non_incr(CRYPTO_DATA_ADDR, data_local_ptr, data_size);
+}
+
+/**
+ * @brief Check whether the crypto block has completed the SHA job in @p ctx, without waiting.
+ * All the data promised in sha_init() must have been sent by now.
+ *
+ * @param ctx the SHA context
+ * @return 1 if the SHA result is ready; 0, otherwise.
+ */
+static alt_u32 is_sha_done(CRYPTO_SHA_CONTEXT* ctx)
+{
+    PFR_ASSERT(ctx->remaining_size == 0);
 
+    return check_bit(CRYPTO_CSR_ADDR, CRYPTO_CSR_SHA_DONE_OFST);
+}
+
+/**
+ * @brief Wait for the crypto block to complete the SHA job in @p ctx.
+ * All the data promised in sha_init() must have been sent by now.
+ * The SHA result can then be retrieved through CSR interface.
+ *
+ * @param ctx the SHA context
+ */
+static void sha_final(CRYPTO_SHA_CONTEXT* ctx)
+{
+    // Step 4: Wait for SHA_DONE (SHA only)
+    while (!is_sha_done(ctx))
+    {
         // Pet HW timer
         reset_hw_watchdog();
     }
 }
 
 /**
- * @brief This function calculates the SHA hash of the given data and
- * saves it at the destination address.
+ * @brief Complete the SHA job in @p ctx and save the SHA result at the destination address.
+ *
+ * @param ctx the SHA context
+ * @param dest_addr destination of the SHA result
  */
-static void calculate_and_save_sha(alt_u32* dest_addr, const alt_u32* data, alt_u32 data_size)
+static void sha_final_and_save(CRYPTO_SHA_CONTEXT* ctx, alt_u32* dest_addr)
 {
-    calculate_sha(data, data_size);
+    sha_final(ctx);
 
     for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
     {
@@ -151,15 +206,16 @@ static void calculate_and_save_sha(alt_u32* dest_addr, const alt_u32* data, alt_
 }
 
 /**
- * @brief This function verifies the expected SHA256 hash for a given data.
- * It sends all the inputs to the crypto block.
- * Once the crypto block is done, compare the expected hash against the calculated hash.
+ * @brief Complete the SHA job in @p ctx and compare the expected hash against the calculated hash.
+ *
+ * @param ctx the SHA context
+ * @param expected_hash the expected SHA result
  *
  * @return 1 if expected hash matches the calculated hash; 0, otherwise.
  */
-static alt_u32 verify_sha(const alt_u32* expected_hash, const alt_u32* data, alt_u32 data_size)
+static alt_u32 sha_final_and_verify(CRYPTO_SHA_CONTEXT* ctx, const alt_u32* expected_hash)
 {
-    calculate_sha(data, data_size);
+    sha_final(ctx);
 
     // Go through CSR word offset 0x08-0x0f to check the expected hash against the calculated hash.
     for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
@@ -173,14 +229,57 @@ static alt_u32 verify_sha(const alt_u32* expected_hash, const alt_u32* data, alt
 }
 
 /**
- * @brief This function verifies the expected SHA256 hash and EC signature for a given data.
+ * @brief This function calculates the SHA hash of the given data.
+ * It sends all the inputs to the crypto block and the sha result can be retrieved through CSR interface.
+ */
+static void calculate_sha(const alt_u32* data, alt_u32 data_size)
+{
+    CRYPTO_SHA_CONTEXT ctx;
+    sha_init(&ctx, data_size);
+    sha_update(&ctx, data, data_size);
+    sha_final(&ctx);
+}
+
+/**
+ * @brief This function calculates the SHA hash of the given data and
+ * saves it at the destination address.
+ */
+static void calculate_and_save_sha(alt_u32* dest_addr, const alt_u32* data, alt_u32 data_size)
+{
+    CRYPTO_SHA_CONTEXT ctx;
+    sha_init(&ctx, data_size);
+    sha_update(&ctx, data, data_size);
+    sha_final_and_save(&ctx, dest_addr);
+}
+
+/**
+ * @brief This function verifies the expected SHA256 hash for a given data.
+ * It sends all the inputs to the crypto block.
+ * Once the crypto block is done, compare the expected hash against the calculated hash.
+ *
+ * @return 1 if expected hash matches the calculated hash; 0, otherwise.
+ */
+static alt_u32 verify_sha(const alt_u32* expected_hash, const alt_u32* data, alt_u32 data_size)
+{
+    CRYPTO_SHA_CONTEXT ctx;
+    sha_init(&ctx, data_size);
+    sha_update(&ctx, data, data_size);
+    return sha_final_and_verify(&ctx, expected_hash);
+}
+
+/**
+ * @brief Start an EC and SHA job on the crypto block, without waiting for its result.
  * It sends all the inputs and NIST P-256 curve constants to the crypto block for calculation.
+ * Nios can do other work (except using the crypto block) until is_ecdsa_and_sha_done() returns 1.
  *
- * @return 1 if EC and SHA are good; 0, otherwise.
+ * @see verify_ecdsa_and_sha
  */
-static alt_u32 verify_ecdsa_and_sha(const alt_u32* cx, const alt_u32* cy,
+static void start_ecdsa_and_sha(const alt_u32* cx, const alt_u32* cy,
         const alt_u32* sig_r, const alt_u32* sig_s, const alt_u32* data, alt_u32 data_size)
 {
+    count_io_ops(IO_COUNTER_ECDSA_OPS, 1);
+    count_io_ops(IO_COUNTER_BYTES_HASHED, data_size);
+
     // Step 1: Write data size
     IOWR_32DIRECT(CRYPTO_DATA_LEN_ADDR, 0, data_size);
 
@@ -218,15 +317,47 @@ static alt_u32 verify_ecdsa_and_sha(const alt_u32* cx, const alt_u32* cy,
 
     // Step 12: Write S from flash to CSR
     alt_u32_memcpy_non_incr(CRYPTO_DATA_ADDR, sig_s, PFR_CRYPTO_LENGTH);
+}
+
+/**
+ * @brief Check whether the crypto block has completed the EC and SHA job, without waiting.
+ *
+ * @return 1 if the result is ready; 0, otherwise.
+ */
+static alt_u32 is_ecdsa_and_sha_done()
+{
+    return check_bit(CRYPTO_CSR_ADDR, CRYPTO_CSR_EC_SHA_DONE_OFST);
+}
+
+/**
+ * @brief Return the result of a completed EC and SHA job.
+ *
+ * @return 1 if EC and SHA are good; 0, otherwise.
+ */
+static alt_u32 is_ecdsa_and_sha_good()
+{
+    return check_bit(CRYPTO_CSR_ADDR, CRYPTO_CSR_EC_SHA_GOOD_OFST);
+}
+
+/**
+ * @brief This function verifies the expected SHA256 hash and EC signature for a given data.
+ * It sends all the inputs and NIST P-256 curve constants to the crypto block for calculation.
+ *
+ * @return 1 if EC and SHA are good; 0, otherwise.
+ */
+static alt_u32 verify_ecdsa_and_sha(const alt_u32* cx, const alt_u32* cy,
+        const alt_u32* sig_r, const alt_u32* sig_s, const alt_u32* data, alt_u32 data_size)
+{
+    start_ecdsa_and_sha(cx, cy, sig_r, sig_s, data, data_size);
 
     // Wait for done signals (EC and SHA)
-    while (!check_bit(CRYPTO_CSR_ADDR, CRYPTO_CSR_EC_SHA_DONE_OFST))
+    while (!is_ecdsa_and_sha_done())
     {
         reset_hw_watchdog();
     }
 
     // Return match result (EC and SHA)
-    return check_bit(CRYPTO_CSR_ADDR, CRYPTO_CSR_EC_SHA_GOOD_OFST);
+    return is_ecdsa_and_sha_good();
 }
 
 #endif /* WHITLEY_INC_CRYPTO_H_ */
@@ -0,0 +1,55 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file cycle_counter.h
+ * @brief Read the free-running count of system clock cycles in the timer bank.
+ *
+ * This only depends on pfr_sys.h, so that the lowest level utilities (e.g. the HW watchdog pet) can use it.
+ */
+
+#ifndef WHITLEY_INC_CYCLE_COUNTER_H_
+#define WHITLEY_INC_CYCLE_COUNTER_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+// The word after the last timer in the timer bank is a read-only free-running count of system clock cycles.
+#define U_TIMER_BANK_CYCLE_COUNTER_ADDR  __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_TIMER_BANK_AVMM_BRIDGE_BASE, 3)
+
+// The system clock runs at 50MHz
+#define SYS_CLK_CYCLES_PER_MS 50000
+
+/**
+ * @brief Read the free-running count of system clock cycles from the timer bank.
+ *
+ * The counter wraps around at 32 bits. The number of cycles between two reads is the
+ * difference of the two values in unsigned 32-bit arithmetic.
+ *
+ * @return alt_u32 current cycle count
+ */
+static PFR_ALT_INLINE alt_u32 PFR_ALT_ALWAYS_INLINE get_cycle_count()
+{
+    return IORD(U_TIMER_BANK_CYCLE_COUNTER_ADDR, 0);
+}
+
+#endif /* WHITLEY_INC_CYCLE_COUNTER_H_ */
@@ -31,12 +31,16 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "decompression_checkpoint.h"
 #include "keychain_utils.h"
 #include "pbc.h"
 #include "pbc_utils.h"
+#include "pfm_region_table.h"
 #include "pfm_utils.h"
 #include "pfr_pointers.h"
 #include "spi_rw_utils.h"
+#include "tmin1_job_runner.h"
+#include "tmin1_profile.h"
 #include "ufm_utils.h"
 
 /**
@@ -55,127 +59,710 @@ typedef enum
 } DECOMPRESSION_TYPE_MASK_ENUM;
 
 /**
- * @brief Decompress a SPI region from the a signed firmware update capsule.
- * First, Nios firmware find the bit that represents the first page of this 
- * SPI region in the compression bitmap and active bitmap. A pointer is used 
- * to skip pages in the compressed payload along the process. 
- *
- * Once Nios firmware reaches the correct bit, it checks the value of that bit. 
- * If the bit is 1 in the active bitmap, then Nios would erase that page. If the 
- * bit is 1 in the compression bitmap, then Nios would copy that page from the 
- * compressed payload and overwrite the corresponding page of this SPI region. 
- * This process ends when Nios finishes with the last page of this SPI region.
- * 
- * For every 8 pages it processed in compressed payload, Nios firmware would
- * pet the hardware watchdog timer to prevent timer expiry.
- * 
- * @param region_start_addr Start address of the SPI region
- * @param region_end_addr End address of the SPI region
- * @param signed_capsule pointer to the start of a signed firmware update capsule
+ * @brief Return 1 if every word of the page at the given SPI address reads 0xFFFFFFFF.
+ * Nios stops reading at the first word that is not blank.
+ *
+ * @param dest_addr address of the page in SPI flash
+ *
+ * @return 1 if the page is blank; 0, otherwise
  */
-static void decompress_spi_region_from_capsule(
-        alt_u32 region_start_addr, alt_u32 region_end_addr, alt_u32* signed_capsule)
+static alt_u32 is_spi_page_blank(alt_u32 dest_addr)
 {
-    alt_u32 region_start_bit = region_start_addr / PBC_EXPECTED_PAGE_SIZE;
-    alt_u32 region_end_bit = region_end_addr / PBC_EXPECTED_PAGE_SIZE;
+    alt_u32* dest_ptr = get_spi_flash_ptr_with_offset(dest_addr);
+    for (alt_u32 word_i = 0; word_i < (PBC_EXPECTED_PAGE_SIZE >> 2); word_i++)
+    {
+        if (dest_ptr[word_i] != 0xFFFFFFFF)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
 
-    // Destination address to be updated in SPI flash
-    alt_u32 dest_addr = region_start_addr;
+/**
+ * Range of pages that need to be erased but haven't been erased yet. Nios extends this range with
+ * the following pages, even across SPI regions, so that the erase planner can use the larger erase commands.
+ */
+typedef struct
+{
+    alt_u32 start_addr;
+    alt_u32 end_addr;
+} DECOMPRESSION_PENDING_ERASE;
 
-    // Pointers to various places in the capsule
-    PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
-    alt_u32* src_ptr = get_compressed_payload(pbc);
-    alt_u8* active_bitmap = (alt_u8*) get_active_bitmap(pbc);
-    alt_u8* comp_bitmap = (alt_u8*) get_compression_bitmap(pbc);
-
-    /*
-     * Erase
-     * Perform erase on the target SPI region first, according to the Active Bitmap.
-     * Coalesce the pages where possible to erase them at once. This allows 64KB Erase to be used.
-     */
-    // This records the first bit in this chunk of pages to be erased
-    alt_u32 erase_start_bit = 0xffffffff;
-    for (alt_u32 bit_in_bitmap = region_start_bit; bit_in_bitmap < region_end_bit; bit_in_bitmap++)
+/**
+ * @brief Erase the pending range of pages (if any) and empty the range.
+ *
+ * @param pending_erase pointer to the pending erase range
+ */
+static void flush_pending_erase(DECOMPRESSION_PENDING_ERASE* pending_erase)
+{
+    if (pending_erase->start_addr != pending_erase->end_addr)
+    {
+        erase_spi_region_with_bg_job(pending_erase->start_addr, pending_erase->end_addr - pending_erase->start_addr);
+    }
+    pending_erase->start_addr = pending_erase->end_addr;
+}
+
+/**
+ * @brief Add a page to the pending erase range. If this page is not adjacent to the range,
+ * the range is erased first and a new range is started from this page.
+ *
+ * @param pending_erase pointer to the pending erase range
+ * @param page_addr address of the page in SPI flash
+ */
+static void add_page_to_pending_erase(DECOMPRESSION_PENDING_ERASE* pending_erase, alt_u32 page_addr)
+{
+    if (page_addr != pending_erase->end_addr)
+    {
+        flush_pending_erase(pending_erase);
+        pending_erase->start_addr = page_addr;
+    }
+    pending_erase->end_addr = page_addr + PBC_EXPECTED_PAGE_SIZE;
+}
+
+// LZ compressed pages of a version 3 PBC structure are decoded this many bytes at a time
+#define PBC_LZ_CHUNK_SIZE SPI_FLASH_PAGE_SIZE
+
+/**
+ * State of the decoder of an LZ compressed page, in a version 3 PBC structure. The page is decoded one chunk
+ * at a time. A match may copy from earlier chunks, which are read back from the destination page.
+ */
+typedef struct
+{
+    alt_u8* src_ptr;
+    alt_u8* src_end_ptr;
+    // Destination page. It must hold the bytes decoded so far, up to the current chunk.
+    alt_u8* page_ptr;
+    // Number of bytes decoded so far
+    alt_u32 dest_i;
+    // Number of bytes left in the current literal run or match
+    alt_u32 run_len;
+    // Distance of the current match; 0 in a literal run
+    alt_u32 match_distance;
+} PBC_LZ_DECODER;
+
+/**
+ * @brief Start decoding an LZ compressed page of a version 3 PBC structure.
+ *
+ * @param decoder pointer to the LZ decoder
+ * @param src_ptr pointer to the LZ stream
+ * @param src_nbytes size of the LZ stream in bytes
+ * @param page_ptr pointer to the destination page of PBC_EXPECTED_PAGE_SIZE bytes
+ *
+ * @see PBC_VERSION_PER_PAGE_LZ
+ */
+static void init_pbc_lz_decoder(PBC_LZ_DECODER* decoder, alt_u8* src_ptr, alt_u32 src_nbytes, alt_u8* page_ptr)
+{
+    decoder->src_ptr = src_ptr;
+    decoder->src_end_ptr = src_ptr + src_nbytes;
+    decoder->page_ptr = page_ptr;
+    decoder->dest_i = 0;
+    decoder->run_len = 0;
+    decoder->match_distance = 0;
+}
+
+/**
+ * @brief Decode the next PBC_LZ_CHUNK_SIZE bytes of an LZ compressed page. Bytes before this chunk are read
+ * from the destination page. Hence, the previous chunks must be in the destination page already.
+ *
+ * The capsule has been authenticated at this point. Still, Nios never writes beyond the chunk, nor copies
+ * from before the start of the page. If the stream ends early, the rest of the page is filled with 0xFF.
+ *
+ * @param decoder pointer to the LZ decoder
+ * @param chunk pointer to a buffer of PBC_LZ_CHUNK_SIZE bytes
+ */
+static void decode_pbc_lz_chunk(PBC_LZ_DECODER* decoder, alt_u32* chunk)
+{
+    alt_u8* dest = (alt_u8*) chunk;
+    alt_u32 chunk_start = decoder->dest_i;
+    alt_u32 chunk_end = chunk_start + PBC_LZ_CHUNK_SIZE;
+
+    while (decoder->dest_i < chunk_end)
     {
-        alt_u8 active_bitmap_byte = active_bitmap[bit_in_bitmap >> 3];
-        if (active_bitmap_byte & (1 << (7 - (bit_in_bitmap % 8))))
+        if (decoder->run_len == 0)
         {
-            // Erase this page
-            if (erase_start_bit == 0xffffffff)
+            if (decoder->src_ptr >= decoder->src_end_ptr)
+            {
+                break;
+            }
+            alt_u32 token = *decoder->src_ptr++;
+            decoder->match_distance = 0;
+            if (token & PBC_LZ_MATCH_TOKEN_MASK)
             {
-                erase_start_bit = bit_in_bitmap;
+                // Copy from earlier in the page
+                alt_u8* src_ptr = decoder->src_ptr;
+                if (src_ptr + 2 > decoder->src_end_ptr)
+                {
+                    break;
+                }
+                alt_u32 distance = src_ptr[0] + (src_ptr[1] << 8) + 1;
+                if (distance > decoder->dest_i)
+                {
+                    break;
+                }
+                decoder->match_distance = distance;
+                decoder->src_ptr += 2;
+                decoder->run_len = (token & ~PBC_LZ_MATCH_TOKEN_MASK) + PBC_LZ_MIN_MATCH_LEN;
             }
+            else
+            {
+                // Literal bytes
+                decoder->run_len = token + 1;
+            }
+        }
+
+        if (decoder->match_distance)
+        {
+            alt_u32 copy_i = decoder->dest_i - decoder->match_distance;
+            dest[decoder->dest_i - chunk_start] =
+                    (copy_i < chunk_start) ? decoder->page_ptr[copy_i] : dest[copy_i - chunk_start];
         }
         else
         {
-            // Don't erase this page
-            if (erase_start_bit != 0xffffffff)
+            if (decoder->src_ptr >= decoder->src_end_ptr)
             {
-                // Pages [erase_start_bit, bit_in_bitmap) needs to be erased
-                alt_u32 erase_bits = bit_in_bitmap - erase_start_bit;
-                if (erase_bits)
-                {
-                    erase_spi_region(erase_start_bit * PBC_EXPECTED_PAGE_SIZE, erase_bits * PBC_EXPECTED_PAGE_SIZE);
-                    erase_start_bit = 0xffffffff;
-                }
+                break;
             }
+            dest[decoder->dest_i - chunk_start] = *decoder->src_ptr++;
+        }
+        decoder->dest_i++;
+        decoder->run_len--;
+    }
+
+    if (decoder->dest_i < chunk_end)
+    {
+        // The stream has ended. Nothing else is decoded from it.
+        decoder->src_ptr = decoder->src_end_ptr;
+        decoder->run_len = 0;
+        for (; decoder->dest_i < chunk_end; decoder->dest_i++)
+        {
+            dest[decoder->dest_i - chunk_start] = 0xFF;
+        }
+    }
+}
+
+/**
+ * Position of Nios in the bitmaps and the compressed payload of a PBC structure. Nios only moves this cursor forward,
+ * so that the compressed payload is read once when the SPI regions are processed in address order.
+ */
+typedef struct
+{
+    alt_u8* active_bitmap;
+    alt_u8* comp_bitmap;
+    alt_u32 bitmap_nbytes;
+    // 1 if this is a version 3 PBC structure
+    alt_u32 is_per_page_lz;
+    // Pointer to the start of the compressed payload. In version 3, that is the page table.
+    alt_u32* payload_ptr;
+    // Page that the cursor is at
+    alt_u32 cur_bit;
+    // Number of pages before the cursor that are marked in the compression bitmap
+    alt_u32 comp_page_index;
+} DECOMPRESSION_CURSOR;
+
+/**
+ * @brief Point the cursor at the first page of the PBC structure in a signed firmware update capsule.
+ *
+ * @param cursor pointer to the decompression cursor
+ * @param signed_capsule pointer to the start of a signed firmware update capsule
+ */
+static void init_decompression_cursor(DECOMPRESSION_CURSOR* cursor, alt_u32* signed_capsule)
+{
+    PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+    cursor->active_bitmap = (alt_u8*) get_active_bitmap(pbc);
+    cursor->comp_bitmap = (alt_u8*) get_compression_bitmap(pbc);
+    cursor->bitmap_nbytes = get_bitmap_size(pbc);
+    cursor->is_per_page_lz = (get_pbc_format_version(pbc) == PBC_VERSION_PER_PAGE_LZ);
+    cursor->payload_ptr = get_compressed_payload(pbc);
+    cursor->cur_bit = 0;
+    cursor->comp_page_index = 0;
+}
+
+/**
+ * @brief Locate the content of the page at the cursor. The page must be marked in the compression bitmap.
+ *
+ * In a version 2 PBC structure, the content is in the compressed payload. In a version 3 PBC structure, an LZ
+ * compressed page has no such content. Nios then starts the LZ decoder instead.
+ *
+ * @param cursor pointer to the decompression cursor
+ * @param decoder pointer to the LZ decoder, which is started for an LZ compressed page
+ * @param dest_ptr pointer to the destination page in SPI flash
+ * @return pointer to PBC_EXPECTED_PAGE_SIZE bytes of page content; 0 if the page has to be decoded
+ */
+static alt_u32* start_decompression_cursor_page(DECOMPRESSION_CURSOR* cursor, PBC_LZ_DECODER* decoder, alt_u32* dest_ptr)
+{
+    if (!cursor->is_per_page_lz)
+    {
+        return incr_alt_u32_ptr(cursor->payload_ptr, cursor->comp_page_index * PBC_EXPECTED_PAGE_SIZE);
+    }
+
+    alt_u32 page_offset = cursor->payload_ptr[cursor->comp_page_index];
+    alt_u32 page_nbytes = cursor->payload_ptr[cursor->comp_page_index + 1] - page_offset;
+    alt_u32* page_ptr = incr_alt_u32_ptr(cursor->payload_ptr, page_offset);
+    if (page_nbytes == PBC_EXPECTED_PAGE_SIZE)
+    {
+        // This page is stored as is
+        return page_ptr;
+    }
+    init_pbc_lz_decoder(decoder, (alt_u8*) page_ptr, page_nbytes, (alt_u8*) dest_ptr);
+    return 0;
+}
+
+/**
+ * @brief Return 1 if the page at the given SPI address has the same content as the page at the cursor.
+ * Nios stops reading at the first word that is different. An LZ compressed page is decoded one chunk at a time.
+ * As long as the chunks are identical, the decoder can read the earlier chunks from the destination.
+ *
+ * @param cursor pointer to the decompression cursor
+ * @param dest_addr address of the page in SPI flash
+ *
+ * @return 1 if the two pages are identical; 0, otherwise
+ */
+static alt_u32 is_spi_page_identical_to_cursor_page(DECOMPRESSION_CURSOR* cursor, alt_u32 dest_addr)
+{
+    alt_u32* dest_ptr = get_spi_flash_ptr_with_offset(dest_addr);
+    PBC_LZ_DECODER decoder;
+    alt_u32* src_ptr = start_decompression_cursor_page(cursor, &decoder, dest_ptr);
+    if (src_ptr)
+    {
+        return is_spi_flash_content_identical(dest_ptr, src_ptr, PBC_EXPECTED_PAGE_SIZE);
+    }
+
+    alt_u32 chunk[PBC_LZ_CHUNK_SIZE / 4];
+    for (alt_u32 chunk_offset = 0; chunk_offset < PBC_EXPECTED_PAGE_SIZE; chunk_offset += PBC_LZ_CHUNK_SIZE)
+    {
+        decode_pbc_lz_chunk(&decoder, chunk);
+        if (!is_spi_flash_content_identical(incr_alt_u32_ptr(dest_ptr, chunk_offset), chunk, PBC_LZ_CHUNK_SIZE))
+        {
+            return 0;
         }
     }
-    if (erase_start_bit != 0xffffffff)
+    return 1;
+}
+
+/**
+ * @brief Program the page at the cursor into the given SPI address, which must have been erased already.
+ * An LZ compressed page is decoded and programmed one chunk at a time. Nios waits for each chunk to be
+ * programmed, since the decoder may read it back for the next chunk.
+ *
+ * @param cursor pointer to the decompression cursor
+ * @param dest_addr address of the page in SPI flash
+ */
+static void copy_cursor_page_to_spi_flash(DECOMPRESSION_CURSOR* cursor, alt_u32 dest_addr)
+{
+    alt_u32* dest_ptr = get_spi_flash_ptr_with_offset(dest_addr);
+    PBC_LZ_DECODER decoder;
+    alt_u32* src_ptr = start_decompression_cursor_page(cursor, &decoder, dest_ptr);
+    if (src_ptr)
+    {
+        memcpy_to_spi_flash(dest_ptr, src_ptr, PBC_EXPECTED_PAGE_SIZE);
+        // Wait for the writes to complete, before moving on to next page
+        wait_for_spi_flash_with_bg_job();
+        return;
+    }
+
+    alt_u32 chunk[PBC_LZ_CHUNK_SIZE / 4];
+    for (alt_u32 chunk_offset = 0; chunk_offset < PBC_EXPECTED_PAGE_SIZE; chunk_offset += PBC_LZ_CHUNK_SIZE)
+    {
+        decode_pbc_lz_chunk(&decoder, chunk);
+        memcpy_to_spi_flash(incr_alt_u32_ptr(dest_ptr, chunk_offset), chunk, PBC_LZ_CHUNK_SIZE);
+        wait_for_spi_flash_with_bg_job();
+    }
+}
+
+/**
+ * @brief Check whether a page, that is marked in the active bitmap, needs to be erased.
+ * In differential decompression mode, a page is left untouched when it already has the expected content.
+ * That is the page content in compressed payload when the page is also marked in the compression bitmap,
+ * or a blank page otherwise. A blank page that is marked in the compression bitmap can be programmed
+ * without an erase either.
+ *
+ * @param dest_addr address of the page in SPI flash
+ * @param cursor pointer to the decompression cursor, which is at this page
+ * @param copy_this_page non-zero if this page is also marked in the compression bitmap
+ * @param is_diff_mode 1 for differential decompression; 0 to erase every page in the active bitmap
+ *
+ * @return 1 if the page should be erased; 0, otherwise
+ */
+static alt_u32 is_spi_page_erase_required(
+        alt_u32 dest_addr, DECOMPRESSION_CURSOR* cursor, alt_u32 copy_this_page, alt_u32 is_diff_mode)
+{
+    if (!is_diff_mode)
     {
-        // Erase to the end of the SPI region
-        alt_u32 erase_start_addr = erase_start_bit * PBC_EXPECTED_PAGE_SIZE;
-        erase_spi_region(erase_start_addr, region_end_addr - erase_start_addr);
+        return 1;
     }
+    if (copy_this_page && is_spi_page_identical_to_cursor_page(cursor, dest_addr))
+    {
+        return 0;
+    }
+    return !is_spi_page_blank(dest_addr);
+}
 
-    /*
-     * Copy
-     * Perform copy from compressed payload to the target SPI region, according to the Compression Bitmap.
-     * Nios go through the bitmap bit by bit and copy page by page.
-     * Nios starts from bit 0 of the bitmap. If any bit, before the bit representing the start of
-     * this SPI region, is set, Nios will skip that page in the compressed payload.
-     */
-    alt_u32 cur_bit = 0;
-    while(cur_bit < region_end_bit)
+/**
+ * @brief Return a mask of the bits in a 32-bit group of pages (as returned by get_pbc_bitmap_word()),
+ * that represent the pages in [start_bit, end_bit).
+ *
+ * @param word_index index of the 32-bit group of pages
+ * @param start_bit the first page in the range
+ * @param end_bit the end of the page range
+ */
+static alt_u32 get_bitmap_word_mask(alt_u32 word_index, alt_u32 start_bit, alt_u32 end_bit)
+{
+    alt_u32 first_bit = word_index << 5;
+    alt_u32 mask = 0xFFFFFFFF;
+    if (start_bit >= first_bit + 32 || end_bit <= first_bit)
     {
-        // Read a byte in compression bitmap and active bitmap
-        alt_u8 comp_bitmap_byte = *comp_bitmap;
-        comp_bitmap++;
+        return 0;
+    }
+    if (start_bit > first_bit)
+    {
+        mask >>= start_bit - first_bit;
+    }
+    if (end_bit < first_bit + 32)
+    {
+        mask &= ~(0xFFFFFFFF >> (end_bit - first_bit));
+    }
+    return mask;
+}
+
+/**
+ * @brief Move the cursor forward to the given page. Nios skips over the compressed payload of the pages
+ * in between, 32 pages at a time, by counting the set bits in the compression bitmap.
+ *
+ * If the given page is before the cursor (e.g. overlapping SPI regions), Nios starts over from the first page.
+ *
+ * @param cursor pointer to the decompression cursor
+ * @param target_bit the page to move to
+ */
+static void seek_decompression_cursor(DECOMPRESSION_CURSOR* cursor, alt_u32 target_bit)
+{
+    if (target_bit < cursor->cur_bit)
+    {
+        cursor->cur_bit = 0;
+        cursor->comp_page_index = 0;
+    }
+
+    while (cursor->cur_bit < target_bit)
+    {
+        alt_u32 word_index = cursor->cur_bit >> 5;
+        alt_u32 next_word_bit = (word_index + 1) << 5;
+        alt_u32 word = get_pbc_bitmap_word(cursor->comp_bitmap, cursor->bitmap_nbytes, word_index) &
+                get_bitmap_word_mask(word_index, cursor->cur_bit, target_bit);
+        cursor->comp_page_index += count_set_bits(word);
+
+        if (target_bit < next_word_bit)
+        {
+            cursor->cur_bit = target_bit;
+        }
+        else
+        {
+            cursor->cur_bit = next_word_bit;
+            // Reset HW timer after 32 SPI pages have been skipped
+            reset_hw_watchdog();
+        }
+    }
+}
+
+/**
+ * @brief Return non-zero if the given page is marked in the given bitmap.
+ */
+static alt_u32 is_page_marked_in_bitmap(alt_u8* bitmap, alt_u32 bit_in_bitmap)
+{
+    return bitmap[bit_in_bitmap >> 3] & (1 << (7 - (bit_in_bitmap % 8)));
+}
+
+/**
+ * @brief Return the first page marked in @p marked_pages, and clear it. Marked pages are processed in
+ * address order by counting the leading zeros.
+ *
+ * @param marked_pages pointer to a 32-bit group of pages (as returned by get_pbc_bitmap_word()); must be non-zero
+ * @param word_index index of the 32-bit group of pages
+ *
+ * @return the index of the page in the bitmap
+ */
+static alt_u32 pop_next_marked_page(alt_u32* marked_pages, alt_u32 word_index)
+{
+    alt_u32 bit_in_word = count_leading_zeros(*marked_pages);
+    *marked_pages &= ~(0x80000000 >> bit_in_word);
+    return (word_index << 5) + bit_in_word;
+}
 
-        // Process 8 bits (representing 8 pages)
-        for (alt_u8 bit_mask = 0b10000000; bit_mask > 0; bit_mask >>= 1)
+/**
+ * @brief Find the pages of a SPI region that need to be erased before decompressing the region from a
+ * signed firmware update capsule. These pages are added to the pending erase range. The erase may happen
+ * after this function returns.
+ *
+ * A page needs to be erased if its bit is 1 in the active bitmap. In differential decompression mode,
+ * Nios compares each page against the destination first. Pages that already hold the expected content
+ * are not erased.
+ *
+ * Nios reads the active bitmap 32 pages at a time and jumps from one marked page to the next. The
+ * cursor is moved forward to locate each page in the compressed payload.
+ *
+ * @param region_start_addr Start address of the SPI region
+ * @param region_end_addr End address of the SPI region
+ * @param cursor pointer to the decompression cursor
+ * @param pending_erase pointer to the pending erase range
+ * @param is_diff_mode 1 for differential decompression; 0 to erase every page in the active bitmap
+ *
+ * @see seek_decompression_cursor
+ */
+static void erase_spi_region_with_cursor(alt_u32 region_start_addr, alt_u32 region_end_addr,
+        DECOMPRESSION_CURSOR* cursor, DECOMPRESSION_PENDING_ERASE* pending_erase, alt_u32 is_diff_mode)
+{
+    alt_u32 region_start_bit = region_start_addr / PBC_EXPECTED_PAGE_SIZE;
+    alt_u32 region_end_bit = region_end_addr / PBC_EXPECTED_PAGE_SIZE;
+
+    // Process 32 pages at a time
+    for (alt_u32 word_index = region_start_bit >> 5; (word_index << 5) < region_end_bit; word_index++)
+    {
+        alt_u32 marked_pages = get_pbc_bitmap_word(cursor->active_bitmap, cursor->bitmap_nbytes, word_index) &
+                get_bitmap_word_mask(word_index, region_start_bit, region_end_bit);
+        while (marked_pages)
         {
-            alt_u32 copy_this_page = comp_bitmap_byte & bit_mask;
+            alt_u32 bit_in_bitmap = pop_next_marked_page(&marked_pages, word_index);
+            seek_decompression_cursor(cursor, bit_in_bitmap);
 
-            // The current page is part of the SPI region
-            if ((region_start_bit <= cur_bit) && (cur_bit < region_end_bit))
+            alt_u32 page_addr = bit_in_bitmap * PBC_EXPECTED_PAGE_SIZE;
+            alt_u32 copy_this_page = is_page_marked_in_bitmap(cursor->comp_bitmap, bit_in_bitmap);
+            if (is_spi_page_erase_required(page_addr, cursor, copy_this_page, is_diff_mode))
             {
-                if (copy_this_page)
-                {
-                    // Value of '1' indicates a copy operation is needed. Perform the copy.
-                    alt_u32_memcpy(get_spi_flash_ptr_with_offset(dest_addr), src_ptr, PBC_EXPECTED_PAGE_SIZE);
-                    // Wait for the writes to complete, before moving on to next page
-                    poll_status_reg_done();
-                }
-                // Done with this page. Increment for updating the next page.
-                dest_addr += PBC_EXPECTED_PAGE_SIZE;
+                add_page_to_pending_erase(pending_erase, page_addr);
             }
+        }
+
+        // Reset HW timer after 32 SPI pages have been processed
+        reset_hw_watchdog();
+    }
+}
+
+/**
+ * @brief Copy the pages of a SPI region from a signed firmware update capsule. The pages to be
+ * overwritten must have been erased already.
+ *
+ * Nios reads the compression bitmap 32 pages at a time and jumps from one marked page to the next. The
+ * cursor is moved forward to locate each page in the compressed payload. LZ compressed pages of a version 3
+ * PBC structure are decoded as they are copied.
+ *
+ * In differential decompression mode, pages that already hold the capsule content are not programmed again.
+ *
+ * @param region_start_addr Start address of the SPI region
+ * @param region_end_addr End address of the SPI region
+ * @param cursor pointer to the decompression cursor
+ * @param is_diff_mode 1 for differential decompression; 0 to program every page in the compression bitmap
+ *
+ * @see seek_decompression_cursor
+ */
+static void copy_spi_region_with_cursor(alt_u32 region_start_addr, alt_u32 region_end_addr, DECOMPRESSION_CURSOR* cursor,
+        alt_u32 is_diff_mode)
+{
+    alt_u32 region_start_bit = region_start_addr / PBC_EXPECTED_PAGE_SIZE;
+    alt_u32 region_end_bit = region_end_addr / PBC_EXPECTED_PAGE_SIZE;
+
+    // Process 32 pages at a time
+    for (alt_u32 word_index = region_start_bit >> 5; (word_index << 5) < region_end_bit; word_index++)
+    {
+        alt_u32 marked_pages = get_pbc_bitmap_word(cursor->comp_bitmap, cursor->bitmap_nbytes, word_index) &
+                get_bitmap_word_mask(word_index, region_start_bit, region_end_bit);
+        while (marked_pages)
+        {
+            alt_u32 bit_in_bitmap = pop_next_marked_page(&marked_pages, word_index);
+            seek_decompression_cursor(cursor, bit_in_bitmap);
 
-            if (copy_this_page)
+            alt_u32 dest_addr = bit_in_bitmap * PBC_EXPECTED_PAGE_SIZE;
+            // In differential decompression mode, skip the pages that already have the capsule content
+            if (!(is_diff_mode && is_spi_page_identical_to_cursor_page(cursor, dest_addr)))
             {
-                // This page has been processed, moving to the next page in the compressed payload
-                src_ptr = incr_alt_u32_ptr(src_ptr, PBC_EXPECTED_PAGE_SIZE);
+                copy_cursor_page_to_spi_flash(cursor, dest_addr);
             }
-
-            // Move on to the next page (i.e. next bit in the bitmap)
-            cur_bit++;
         }
 
-        // Reset HW timer after 8 SPI pages have been processed
+        // Reset HW timer after 32 SPI pages have been processed
         reset_hw_watchdog();
     }
 }
 
+/**
+ * @brief Find the pages of a SPI region that need to be erased before decompressing the region from a
+ * signed firmware update capsule. These pages are added to the pending erase range.
+ * Every page that is marked in the active bitmap is added.
+ *
+ * @param region_start_addr Start address of the SPI region
+ * @param region_end_addr End address of the SPI region
+ * @param signed_capsule pointer to the start of a signed firmware update capsule
+ * @param pending_erase pointer to the pending erase range
+ *
+ * @see erase_spi_region_with_cursor
+ */
+static void erase_spi_region_for_decompression(alt_u32 region_start_addr, alt_u32 region_end_addr,
+        alt_u32* signed_capsule, DECOMPRESSION_PENDING_ERASE* pending_erase)
+{
+    DECOMPRESSION_CURSOR cursor;
+    init_decompression_cursor(&cursor, signed_capsule);
+    erase_spi_region_with_cursor(region_start_addr, region_end_addr, &cursor, pending_erase, 0);
+}
+
+/**
+ * @brief Copy the pages of a SPI region from a signed firmware update capsule. The pages to be
+ * overwritten must have been erased already. Every page that is marked in the compression bitmap is programmed.
+ *
+ * @param region_start_addr Start address of the SPI region
+ * @param region_end_addr End address of the SPI region
+ * @param signed_capsule pointer to the start of a signed firmware update capsule
+ *
+ * @see copy_spi_region_with_cursor
+ */
+static void copy_spi_region_from_capsule(alt_u32 region_start_addr, alt_u32 region_end_addr, alt_u32* signed_capsule)
+{
+    DECOMPRESSION_CURSOR cursor;
+    init_decompression_cursor(&cursor, signed_capsule);
+    copy_spi_region_with_cursor(region_start_addr, region_end_addr, &cursor, 0);
+}
+
+/**
+ * @brief Decompress a SPI region from the a signed firmware update capsule.
+ * Nios erases the pages that are marked in the active bitmap, and then copies the pages that are
+ * marked in the compression bitmap from the compressed payload.
+ *
+ * While the flash device is busy with erase/program operations, Nios runs the T-1 background job
+ * (if any) on the other flash device.
+ *
+ * @param region_start_addr Start address of the SPI region
+ * @param region_end_addr End address of the SPI region
+ * @param signed_capsule pointer to the start of a signed firmware update capsule
+ *
+ * @see erase_spi_region_for_decompression
+ * @see copy_spi_region_from_capsule
+ */
+static void decompress_spi_region_from_capsule(
+        alt_u32 region_start_addr, alt_u32 region_end_addr, alt_u32* signed_capsule)
+{
+    DECOMPRESSION_PENDING_ERASE pending_erase = {0, 0};
+    erase_spi_region_for_decompression(region_start_addr, region_end_addr, signed_capsule, &pending_erase);
+    flush_pending_erase(&pending_erase);
+
+    copy_spi_region_from_capsule(region_start_addr, region_end_addr, signed_capsule);
+
+    // Free up the crypto block for the caller
+    pause_tmin1_bg_job();
+}
+
+/**
+ * @brief Return non-zero if the given SPI region should be decompressed in this type of decompression action.
+ * The staging region is never decompressed.
+ *
+ * @param entry a SPI region definition in the capsule PFM, as read into a PFM region table entry
+ * @param decomp_type indicate the type of this decompression action
+ * @param staging_region_addr start address of the staging region
+ */
+static alt_u32 is_spi_region_in_decompression(
+        PFM_REGION_TABLE_ENTRY* entry, DECOMPRESSION_TYPE_MASK_ENUM decomp_type, alt_u32 staging_region_addr)
+{
+    if (entry->flags & PFM_REGION_TABLE_FLAG_STATIC)
+    {
+        // Recover all regions that do not allow write
+        return decomp_type & DECOMPRESSION_STATIC_REGIONS_MASK;
+    }
+    if ((entry->flags & PFM_REGION_TABLE_FLAG_DYNAMIC) && entry->start_addr != staging_region_addr)
+    {
+        // This SPI region is a dynamic region and not staging region
+        // Recover all regions that allows write
+        return decomp_type & DECOMPRESSION_DYNAMIC_REGIONS_MASK;
+    }
+    return 0;
+}
+
+/**
+ * @brief Find the SPI region, with the lowest start address that is at least @p min_start_addr, among
+ * the SPI regions to be decompressed in this type of decompression action.
+ *
+ * Nios goes through all definitions of the capsule PFM to find each region in address order. That's a scan
+ * of the compiled table in RAM, unless the capsule PFM has too many definitions for the table.
+ *
+ * @param signed_capsule pointer to the start of a signed firmware update capsule
+ * @param capsule_pfm_table compiled table of the capsule PFM. Set to 0 to walk the capsule PFM body.
+ * @param decomp_type indicate the type of this decompression action
+ * @param staging_region_addr start address of the staging region
+ * @param min_start_addr the lowest start address to consider
+ * @param next_region the SPI region that is found
+ *
+ * @return 1 if a SPI region is found; 0 if there's none.
+ */
+static alt_u32 get_next_spi_region_in_decompression(alt_u32* signed_capsule, PFM_REGION_TABLE* capsule_pfm_table,
+        DECOMPRESSION_TYPE_MASK_ENUM decomp_type, alt_u32 staging_region_addr, alt_u32 min_start_addr,
+        PFM_REGION_TABLE_ENTRY* next_region)
+{
+    alt_u32 is_found = 0;
+
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, capsule_pfm_table, get_capsule_pfm(signed_capsule));
+    PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter);
+    while (entry)
+    {
+        if ((min_start_addr <= entry->start_addr) &&
+                (!is_found || (entry->start_addr < next_region->start_addr)) &&
+                is_spi_region_in_decompression(entry, decomp_type, staging_region_addr))
+        {
+            alt_u32_memcpy((alt_u32*) next_region, (alt_u32*) entry, sizeof(PFM_REGION_TABLE_ENTRY));
+            is_found = 1;
+        }
+        entry = get_next_pfm_region(&iter);
+    }
+    return is_found;
+}
+
+/**
+ * @brief Erase or copy the pages of a SPI region in one pass of a decompression, starting from the
+ * latest checkpoint. A checkpoint is recorded whenever the pass crosses a multiple of
+ * DECOMPRESSION_CHECKPOINT_INTERVAL. In the erase pass, the pending erase range is erased first.
+ *
+ * Differential decompression is not used while the checkpoint doesn't trust reads of the destination.
+ *
+ * @param region_start_addr Start address of the SPI region
+ * @param region_end_addr End address of the SPI region
+ * @param cursor pointer to the decompression cursor
+ * @param pending_erase pointer to the pending erase range
+ * @param checkpoint pointer to the decompression checkpoint
+ * @param is_diff_mode 1 for differential decompression; 0 to erase and program every page in the bitmaps
+ */
+static void decompress_spi_region_with_checkpoint(alt_u32 region_start_addr, alt_u32 region_end_addr,
+        DECOMPRESSION_CURSOR* cursor, DECOMPRESSION_PENDING_ERASE* pending_erase, DECOMPRESSION_CHECKPOINT* checkpoint,
+        alt_u32 is_diff_mode)
+{
+    alt_u32 chunk_start_addr = region_start_addr;
+    if (chunk_start_addr < checkpoint->done_addr)
+    {
+        chunk_start_addr = checkpoint->done_addr;
+    }
+
+    while (chunk_start_addr < region_end_addr)
+    {
+        alt_u32 chunk_end_addr = (chunk_start_addr + DECOMPRESSION_CHECKPOINT_INTERVAL) & ~(DECOMPRESSION_CHECKPOINT_INTERVAL - 1);
+        if (chunk_end_addr > region_end_addr)
+        {
+            chunk_end_addr = region_end_addr;
+        }
+
+        alt_u32 is_chunk_diff_mode = is_diff_mode && is_decompression_read_trusted(checkpoint);
+        if (checkpoint->phase == DECOMPRESSION_CHECKPOINT_PHASE_COPY)
+        {
+            copy_spi_region_with_cursor(chunk_start_addr, chunk_end_addr, cursor, is_chunk_diff_mode);
+        }
+        else
+        {
+            erase_spi_region_with_cursor(chunk_start_addr, chunk_end_addr, cursor, pending_erase, is_chunk_diff_mode);
+        }
+
+        if ((chunk_end_addr & (DECOMPRESSION_CHECKPOINT_INTERVAL - 1)) == 0)
+        {
+            // Everything below this address is done after the pending pages are erased
+            flush_pending_erase(pending_erase);
+            record_decompression_checkpoint(checkpoint, checkpoint->phase, chunk_end_addr);
+        }
+        chunk_start_addr = chunk_end_addr;
+    }
+}
+
 /**
  * @brief Decompress some types of SPI regions from a firmware update capsule.
  *
@@ -189,13 +776,23 @@ static void decompress_spi_region_from_capsule(
  * Requirements on PFM and Compression Structure Definition are included in the MAS. When there's more
  * code space available, some of these requirements can be turned into checks in T-1 authentication.
  *
+ * Nios records the progress in the UFM checkpoint journal. If a decompression of the same capsule was
+ * interrupted (e.g. by a power loss), Nios resumes from its last checkpoint instead of starting over.
+ *
+ * In differential decompression, Nios compares each page against the destination first. It only erases and
+ * programs the pages that differ from the capsule content.
+ *
+ * The SPI erase blank check is on during the decompression. Nios doesn't send an erase command to a sector
+ * that already reads blank, unless the checkpoint doesn't trust reads of the destination.
+ *
  * @param signed_capsule pointer to the start of a signed firmware update capsule
  * @param spi_flash_type indicate BMC or PCH SPI flash device
  * @param decomp_type indicate the type of this decompression action. This can be static region only
  * decompression, dynamic region only decompression, or decompression for both static and dynamic regions. 
+ * @param is_diff_mode 1 for differential decompression; 0 to erase and program every page in the bitmaps
  */
-static void decompress_capsule(
-        alt_u32* signed_capsule, SPI_FLASH_TYPE_ENUM spi_flash_type, DECOMPRESSION_TYPE_MASK_ENUM decomp_type)
+static void decompress_capsule(alt_u32* signed_capsule, SPI_FLASH_TYPE_ENUM spi_flash_type,
+        DECOMPRESSION_TYPE_MASK_ENUM decomp_type, alt_u32 is_diff_mode)
 {
     // Get addresses of active pfm and staging region
     alt_u32 active_pfm_addr = get_ufm_pfr_data()->bmc_active_pfm;
@@ -206,59 +803,63 @@ static void decompress_capsule(
         staging_region_addr = get_ufm_pfr_data()->pch_staging_region;
     }
 
-    // Iterate through all the SPI region definitions in PFM body
-    alt_u32* capsule_pfm_body = get_capsule_pfm(signed_capsule)->pfm_body;
-    while (1)
-    {
-        alt_u8 def_type = *((alt_u8*) capsule_pfm_body);
-        if (def_type == SMBUS_RULE_DEF_TYPE)
-        {
-            // Skip the SMBus rule definition
-            capsule_pfm_body = incr_alt_u32_ptr(capsule_pfm_body, SMBUS_RULE_DEF_SIZE);
-        }
-        else if (def_type == SPI_REGION_DEF_TYPE)
-        {
-            PFM_SPI_REGION_DEF* region_def = (PFM_SPI_REGION_DEF*) capsule_pfm_body;
+    // Decompression may be part of an update or a recovery. Its time is counted separately.
+    TMIN1_PHASE_ENUM prev_phase = switch_tmin1_phase(TMIN1_PHASE_DECOMPRESSION);
 
-            if (is_spi_region_static(region_def))
-            {
-                if (decomp_type & DECOMPRESSION_STATIC_REGIONS_MASK)
-                {
-                    // Recover all regions that do not allow write
-                    decompress_spi_region_from_capsule(region_def->start_addr, region_def->end_addr, signed_capsule);
-                }
-            }
-            else if (is_spi_region_dynamic(region_def) && region_def->start_addr != staging_region_addr)
-            {
-                // This SPI region is a dynamic region and not staging region
-                if (decomp_type & DECOMPRESSION_DYNAMIC_REGIONS_MASK)
-                {
-                    // Recover all regions that allows write
-                    decompress_spi_region_from_capsule(region_def->start_addr, region_def->end_addr, signed_capsule);
-                }
-            }
+    // Sectors that already read blank are not erased again. After an interrupted session, the checkpoint
+    // suspends the blank check until the erases that may have been cut short have been done again.
+    alt_u32 prev_blank_check = get_spi_erase_blank_check();
+    set_spi_erase_blank_check(1);
+    DECOMPRESSION_CHECKPOINT checkpoint;
+    start_decompression_checkpoint(&checkpoint, signed_capsule, spi_flash_type, decomp_type);
 
-            // Increment the pointer in PFM body appropriately
-            capsule_pfm_body = get_end_of_spi_region_def(region_def);
-        }
-        else
+    // Go through the SPI regions in address order twice.
+    // Nios erases the SPI regions in the first pass and copies to them in the second pass. Then, pages
+    // of adjacent SPI regions can be erased together. In each pass, Nios reads the bitmaps and the compressed
+    // payload once, from start to end.
+    // The capsule PFM body is read from flash once, into the PFM region table.
+    alt_u32* signed_capsule_pfm = incr_alt_u32_ptr(signed_capsule, SIGNATURE_SIZE);
+    PFM_REGION_TABLE* capsule_pfm_table = prepare_pfm_region_table(
+            get_capsule_pfm(signed_capsule), ((KCH_SIGNATURE*) signed_capsule_pfm)->b0.pc_hash256);
+
+    DECOMPRESSION_PENDING_ERASE pending_erase = {0, 0};
+    while (checkpoint.phase < DECOMPRESSION_CHECKPOINT_PHASE_PFM_COPY)
+    {
+        DECOMPRESSION_CURSOR cursor;
+        init_decompression_cursor(&cursor, signed_capsule);
+
+        PFM_REGION_TABLE_ENTRY region;
+        alt_u32 has_region = get_next_spi_region_in_decompression(
+                signed_capsule, capsule_pfm_table, decomp_type, staging_region_addr, 0, &region);
+        while (has_region)
         {
-            // Break when there is no more region/rule definition in PFM body
-            break;
+            decompress_spi_region_with_checkpoint(
+                    region.start_addr, region.end_addr, &cursor, &pending_erase, &checkpoint, is_diff_mode);
+            has_region = get_next_spi_region_in_decompression(signed_capsule, capsule_pfm_table,
+                    decomp_type, staging_region_addr, region.start_addr + 1, &region);
         }
+
+        // Erase the last range of pages before moving on to copy
+        flush_pending_erase(&pending_erase);
+        record_decompression_checkpoint(&checkpoint, checkpoint.phase + 1, 0);
     }
+    pause_tmin1_bg_job();
 
     // If this decompression involves static region, also copy the PFM (in capsule) to replace the active PFM
     if (decomp_type & DECOMPRESSION_STATIC_REGIONS_MASK)
     {
         // Erase the current PFM SPI region first
-        erase_spi_region(active_pfm_addr, SIGNED_PFM_MAX_SIZE);
+        erase_spi_region_with_bg_job(active_pfm_addr, SIGNED_PFM_MAX_SIZE);
+        pause_tmin1_bg_job();
 
         // Copy the capsule PFM over
-        alt_u32* signed_capsule_pfm = incr_alt_u32_ptr(signed_capsule, SIGNATURE_SIZE);
         alt_u32 nbytes = get_signed_payload_size(signed_capsule_pfm);
-        alt_u32_memcpy(get_spi_flash_ptr_with_offset(active_pfm_addr), signed_capsule_pfm, nbytes);
+        // The capsule PFM is now the active PFM. The table is keyed by the PFM hash, so it can be used right away.
+        memcpy_to_spi_flash(get_spi_flash_ptr_with_offset(active_pfm_addr), signed_capsule_pfm, nbytes);
     }
+    record_decompression_checkpoint(&checkpoint, DECOMPRESSION_CHECKPOINT_PHASE_DONE, 0);
+    set_spi_erase_blank_check(prev_blank_check);
+    switch_tmin1_phase(prev_phase);
 }
 
 #endif /* WHITLEY_INC_DECOMPRESSION_H */
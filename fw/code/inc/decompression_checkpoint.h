@@ -0,0 +1,342 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file decompression_checkpoint.h
+ * @brief Record the progress of a decompression in UFM, so that it can be resumed after a power loss.
+ *
+ * The checkpoint journal is a list of words in UFM. Since UFM bits can only be cleared without an erase,
+ * Nios only appends to the journal. Each decompression starts a session with a header: a tag word that
+ * identifies the target flash and the type of decompression, followed by the SHA-256 hash of the capsule
+ * protected content. Each following progress word holds a phase of the decompression and an address in SPI
+ * flash. Everything in the earlier phases, and everything below that address in this phase, has been done.
+ *
+ * The journal is erased when there's no room for a new session.
+ *
+ * A SPI erase or program that was cut short by a power loss can leave a page that reads as expected (e.g. all 0xFF)
+ * but holds weak bits. Hence, after an interrupted session, Nios doesn't trust such reads (i.e. no SPI erase blank
+ * check and no differential decompression) until the operations that may have been interrupted have been done again.
+ */
+
+#ifndef WHITLEY_INC_DECOMPRESSION_CHECKPOINT_H_
+#define WHITLEY_INC_DECOMPRESSION_CHECKPOINT_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "keychain.h"
+#include "pfr_pointers.h"
+#include "spi_common.h"
+#include "spi_rw_utils.h"
+#include "ufm_rw_utils.h"
+#include "ufm_utils.h"
+
+#define DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS (UFM_DECOMPRESSION_CHECKPOINT_SIZE / 4)
+
+// Tag word of a session. Progress words never have this top byte, because the SPI flash addresses are smaller.
+#define DECOMPRESSION_CHECKPOINT_TAG 0xDC000000
+#define DECOMPRESSION_CHECKPOINT_TAG_MASK 0xFF000000
+#define DECOMPRESSION_CHECKPOINT_TAG_SPI_FLASH_TYPE_OFST 8
+#define DECOMPRESSION_CHECKPOINT_TAG_SPI_FLASH_TYPE_MASK 0xFF00
+#define DECOMPRESSION_CHECKPOINT_HEADER_NWORDS (1 + SHA256_LENGTH / 4)
+
+// A new session is only started when there's room for this many words
+#define DECOMPRESSION_CHECKPOINT_MIN_SESSION_NWORDS (DECOMPRESSION_CHECKPOINT_HEADER_NWORDS + 128)
+
+// Nios records a checkpoint when the decompression crosses an address that is a multiple of this size
+#define DECOMPRESSION_CHECKPOINT_INTERVAL 0x100000
+
+// The phase is stored in the lower bits of a progress word. The upper bits hold a page aligned SPI address.
+#define DECOMPRESSION_CHECKPOINT_PHASE_MASK 0xF
+
+/**
+ * Phases of a decompression, in order.
+ */
+typedef enum
+{
+    DECOMPRESSION_CHECKPOINT_PHASE_ERASE    = 0x1,
+    DECOMPRESSION_CHECKPOINT_PHASE_COPY     = 0x2,
+    DECOMPRESSION_CHECKPOINT_PHASE_PFM_COPY = 0x3,
+    DECOMPRESSION_CHECKPOINT_PHASE_DONE     = 0xF,
+} DECOMPRESSION_CHECKPOINT_PHASE_ENUM;
+
+/**
+ * Latest checkpoint of a decompression, and where the next checkpoint goes in the journal.
+ */
+typedef struct
+{
+    // 1 if the checkpoints are recorded in UFM
+    alt_u32 is_enabled;
+    // Index of the first blank word in the journal
+    alt_u32 next_index;
+    alt_u32 phase;
+    alt_u32 done_addr;
+    // If not 0, a SPI erase or program may have been cut short by a power loss before this progress word.
+    // Reads of the destination are trusted again once a checkpoint past it has been recorded, or when the
+    // decompression is done.
+    alt_u32 untrusted_until_progress;
+    // 1 if the SPI erase blank check has been turned off until then
+    alt_u32 is_blank_check_suspended;
+} DECOMPRESSION_CHECKPOINT;
+
+/**
+ * @brief Return a pointer to the start of the checkpoint journal in UFM.
+ */
+static alt_u32* get_decompression_checkpoint_journal()
+{
+    return get_ufm_ptr_with_offset(UFM_DECOMPRESSION_CHECKPOINT_OFFSET);
+}
+
+/**
+ * @brief Read the journal to find the latest checkpoint and the first blank word.
+ * If the journal is empty, the latest checkpoint is in the done phase.
+ *
+ * @param checkpoint pointer to the checkpoint to fill in
+ * @return index of the tag word of the last session; DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS if there's none.
+ */
+static alt_u32 load_decompression_checkpoint(DECOMPRESSION_CHECKPOINT* checkpoint)
+{
+    alt_u32* journal = get_decompression_checkpoint_journal();
+    alt_u32 session_index = DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS;
+    alt_u32 progress = DECOMPRESSION_CHECKPOINT_PHASE_DONE;
+
+    alt_u32 index = 0;
+    while ((index < DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS) && (journal[index] != 0xFFFFFFFF))
+    {
+        if ((journal[index] & DECOMPRESSION_CHECKPOINT_TAG_MASK) == DECOMPRESSION_CHECKPOINT_TAG)
+        {
+            // Nothing has been done in this session yet
+            session_index = index;
+            progress = DECOMPRESSION_CHECKPOINT_PHASE_ERASE;
+            index += DECOMPRESSION_CHECKPOINT_HEADER_NWORDS;
+        }
+        else
+        {
+            progress = journal[index];
+            index++;
+        }
+    }
+
+    checkpoint->next_index = (index < DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS) ? index : DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS;
+    checkpoint->phase = progress & DECOMPRESSION_CHECKPOINT_PHASE_MASK;
+    checkpoint->done_addr = progress & ~DECOMPRESSION_CHECKPOINT_PHASE_MASK;
+    checkpoint->untrusted_until_progress = 0;
+    checkpoint->is_blank_check_suspended = 0;
+    return session_index;
+}
+
+/**
+ * @brief Don't trust reads of the destination until the decompression has gone past the given progress word.
+ * The SPI erase blank check is turned off until then, if it's on.
+ *
+ * @param checkpoint pointer to the checkpoint
+ * @param progress a progress word (i.e. phase and address) of the decompression
+ */
+static void distrust_reads_until_progress(DECOMPRESSION_CHECKPOINT* checkpoint, alt_u32 progress)
+{
+    checkpoint->untrusted_until_progress = progress;
+    if (get_spi_erase_blank_check())
+    {
+        set_spi_erase_blank_check(0);
+        checkpoint->is_blank_check_suspended = 1;
+    }
+}
+
+/**
+ * @brief Return 1 if Nios can trust that a page of the destination, which reads as expected, is fully erased or programmed.
+ */
+static alt_u32 is_decompression_read_trusted(DECOMPRESSION_CHECKPOINT* checkpoint)
+{
+    return checkpoint->untrusted_until_progress == 0;
+}
+
+/**
+ * @brief Move the checkpoint forward and append it to the journal.
+ *
+ * The last word of the journal is kept for the done phase, so that a session can always be closed.
+ * When the journal is full, the checkpoint is only kept in memory. The decompression can still be
+ * resumed from the last checkpoint in the journal.
+ *
+ * @param checkpoint pointer to the checkpoint
+ * @param phase the phase of the decompression
+ * @param done_addr everything below this SPI address in @p phase has been done
+ */
+static void record_decompression_checkpoint(DECOMPRESSION_CHECKPOINT* checkpoint, alt_u32 phase, alt_u32 done_addr)
+{
+    checkpoint->phase = phase;
+    checkpoint->done_addr = done_addr;
+
+    if (checkpoint->untrusted_until_progress)
+    {
+        alt_u32 untrusted_phase = checkpoint->untrusted_until_progress & DECOMPRESSION_CHECKPOINT_PHASE_MASK;
+        alt_u32 untrusted_addr = checkpoint->untrusted_until_progress & ~DECOMPRESSION_CHECKPOINT_PHASE_MASK;
+        if ((phase == DECOMPRESSION_CHECKPOINT_PHASE_DONE) || (phase > untrusted_phase) ||
+                ((phase == untrusted_phase) && (done_addr > untrusted_addr)))
+        {
+            // Everything that was in progress at the power loss has been done again
+            checkpoint->untrusted_until_progress = 0;
+            if (checkpoint->is_blank_check_suspended)
+            {
+                set_spi_erase_blank_check(1);
+                checkpoint->is_blank_check_suspended = 0;
+            }
+        }
+    }
+
+    alt_u32 journal_end = DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS - 1;
+    if (phase == DECOMPRESSION_CHECKPOINT_PHASE_DONE)
+    {
+        journal_end = DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS;
+    }
+
+    if (checkpoint->is_enabled && (checkpoint->next_index < journal_end))
+    {
+        alt_u32* journal = get_decompression_checkpoint_journal();
+        journal[checkpoint->next_index] = done_addr | phase;
+        checkpoint->next_index++;
+    }
+}
+
+/**
+ * @brief Start or resume the checkpoints of a decompression.
+ *
+ * If the last session in the journal was interrupted and it is for the same capsule, target flash
+ * and type of decompression, Nios resumes from its last checkpoint. Otherwise, the last session is
+ * closed and a new session is started.
+ *
+ * After an interrupted session, reads of the destination are not trusted. When resuming, that lasts until the next
+ * checkpoint, because the interrupted operation was between the last checkpoint and the next one. Otherwise, it
+ * lasts for the whole decompression.
+ *
+ * The CPLD update status word shares the UFM sector with the journal. If there's no room for a new
+ * session and a CPLD recovery update is in progress, the checkpoints of this decompression are not recorded.
+ *
+ * @param checkpoint pointer to the checkpoint
+ * @param signed_capsule pointer to the start of a signed firmware update capsule
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ * @param decomp_type indicate the type of this decompression action
+ */
+static void start_decompression_checkpoint(DECOMPRESSION_CHECKPOINT* checkpoint, alt_u32* signed_capsule,
+        SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 decomp_type)
+{
+    alt_u32* journal = get_decompression_checkpoint_journal();
+    alt_u32* capsule_hash = ((KCH_SIGNATURE*) signed_capsule)->b0.pc_hash256;
+    alt_u32 tag = DECOMPRESSION_CHECKPOINT_TAG | (spi_flash_type << DECOMPRESSION_CHECKPOINT_TAG_SPI_FLASH_TYPE_OFST) | decomp_type;
+
+    alt_u32 session_index = load_decompression_checkpoint(checkpoint);
+    checkpoint->is_enabled = 1;
+    if (checkpoint->phase != DECOMPRESSION_CHECKPOINT_PHASE_DONE)
+    {
+        alt_u32 is_same_session = (journal[session_index] == tag);
+        for (alt_u32 word_i = 0; word_i < (SHA256_LENGTH / 4); word_i++)
+        {
+            is_same_session &= (journal[session_index + 1 + word_i] == capsule_hash[word_i]);
+        }
+        if (is_same_session)
+        {
+            // A SPI erase or program may have been interrupted after the last checkpoint
+            distrust_reads_until_progress(checkpoint, checkpoint->done_addr | checkpoint->phase);
+            return;
+        }
+
+        // Another decompression was interrupted. It can't be resumed after this one.
+        record_decompression_checkpoint(checkpoint, DECOMPRESSION_CHECKPOINT_PHASE_DONE, 0);
+        distrust_reads_until_progress(checkpoint, DECOMPRESSION_CHECKPOINT_PHASE_DONE);
+    }
+
+    if (checkpoint->next_index + DECOMPRESSION_CHECKPOINT_MIN_SESSION_NWORDS > DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS)
+    {
+        if (is_cpld_rc_update_in_progress())
+        {
+            checkpoint->is_enabled = 0;
+        }
+        else
+        {
+            ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+            checkpoint->next_index = 0;
+        }
+    }
+
+    if (checkpoint->is_enabled)
+    {
+        journal[checkpoint->next_index] = tag;
+        alt_u32_memcpy(&journal[checkpoint->next_index + 1], capsule_hash, SHA256_LENGTH);
+        checkpoint->next_index += DECOMPRESSION_CHECKPOINT_HEADER_NWORDS;
+    }
+    checkpoint->phase = DECOMPRESSION_CHECKPOINT_PHASE_ERASE;
+    checkpoint->done_addr = 0;
+}
+
+/**
+ * @brief Close the last session in the journal, if it was interrupted and it targets the given flash.
+ *
+ * This must be called before the BMC/PCH can write to its flash. Afterwards, the content of the flash no
+ * longer matches the last checkpoint.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ */
+static void abandon_decompression_checkpoint(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    DECOMPRESSION_CHECKPOINT checkpoint;
+    alt_u32 session_index = load_decompression_checkpoint(&checkpoint);
+    if (checkpoint.phase != DECOMPRESSION_CHECKPOINT_PHASE_DONE)
+    {
+        alt_u32 tag = get_decompression_checkpoint_journal()[session_index];
+        if (((tag & DECOMPRESSION_CHECKPOINT_TAG_SPI_FLASH_TYPE_MASK) >> DECOMPRESSION_CHECKPOINT_TAG_SPI_FLASH_TYPE_OFST) == spi_flash_type)
+        {
+            checkpoint.is_enabled = 1;
+            record_decompression_checkpoint(&checkpoint, DECOMPRESSION_CHECKPOINT_PHASE_DONE, 0);
+        }
+    }
+}
+
+/**
+ * @brief Erase the CPLD update status word, and carry an interrupted session of the journal over the erase.
+ *
+ * The CPLD update status word shares the UFM sector with the journal. If the last session in the journal was
+ * interrupted, its header and its last checkpoint are written back after the sector erase. Otherwise, the next
+ * decompression would trust reads of pages that may have been cut short by the power loss. Completed sessions
+ * are dropped.
+ */
+static void erase_cpld_update_status_sector()
+{
+    DECOMPRESSION_CHECKPOINT checkpoint;
+    alt_u32 session_index = load_decompression_checkpoint(&checkpoint);
+    alt_u32* journal = get_decompression_checkpoint_journal();
+
+    alt_u32 session_header[DECOMPRESSION_CHECKPOINT_HEADER_NWORDS];
+    alt_u32 is_interrupted = (checkpoint.phase != DECOMPRESSION_CHECKPOINT_PHASE_DONE);
+    if (is_interrupted)
+    {
+        alt_u32_memcpy(session_header, &journal[session_index], DECOMPRESSION_CHECKPOINT_HEADER_NWORDS * 4);
+    }
+
+    ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+
+    if (is_interrupted)
+    {
+        alt_u32_memcpy(journal, session_header, DECOMPRESSION_CHECKPOINT_HEADER_NWORDS * 4);
+        journal[DECOMPRESSION_CHECKPOINT_HEADER_NWORDS] = checkpoint.done_addr | checkpoint.phase;
+    }
+}
+
+#endif /* WHITLEY_INC_DECOMPRESSION_CHECKPOINT_H_ */
@@ -31,6 +31,8 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "tmin1_profile.h"
+
 #define RECONFIG_REASON_POWER_UP_OR_SWITCH_TO_CFM0 0b010
 
 #define RECONFIG_STATE_REG_OFFSET 4
@@ -55,6 +57,8 @@ static void reset_hw_watchdog()
     // Reset the watchdog timer
     // The reset bit is bit[1] of the dual config IP
     IOWR(U_DUAL_CONFIG_BASE, 0, (1 << 1));
+
+    tick_tmin1_profile();
 }
 
 /**
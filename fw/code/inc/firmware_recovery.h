@@ -35,6 +35,7 @@
 #include "decompression.h"
 #include "global_state.h"
 #include "mailbox_utils.h"
+#include "pfm_region_table.h"
 #include "spi_ctrl_utils.h"
 #include "spi_flash_state.h"
 #include "ufm_utils.h"
@@ -159,54 +160,38 @@ static void perform_wdt_recovery(SPI_FLASH_TYPE_ENUM spi_flash_type)
             alt_u32 recovery_level = get_fw_recovery_level(spi_flash_type);
             perform_top_swap_for_pch_flash(spi_flash_type, recovery_level);
 
-            alt_u32* pfm_body_ptr = get_active_pfm(spi_flash_type)->pfm_body;
             alt_u32 should_recover_static_region = 0;
 
-            // Go through the PFM body
+            // Go through the PFM definitions
             // Recover the dynamic region, if RPLM indicates a recovery is needed for this recovery level.
             // Set the flag should_recover_static_region, if a static region definition, that has any RPLM bit 2-4 set, is found.
-            while (1)
+            PFM_REGION_ITER iter;
+            init_pfm_region_iter(&iter, get_active_pfm_region_table(spi_flash_type), get_active_pfm(spi_flash_type));
+            PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter);
+            while (entry)
             {
-                alt_u8 def_type = *((alt_u8*) pfm_body_ptr);
-                if (def_type == SMBUS_RULE_DEF_TYPE)
+                if (entry->flags & PFM_REGION_TABLE_FLAG_STATIC)
                 {
-                    // Skip the rule definition
-                    pfm_body_ptr = incr_alt_u32_ptr(pfm_body_ptr, SMBUS_RULE_DEF_SIZE);
-                }
-                else if (def_type == SPI_REGION_DEF_TYPE)
-                {
-                    PFM_SPI_REGION_DEF* region_def = (PFM_SPI_REGION_DEF*) pfm_body_ptr;
-
-                    if (is_spi_region_static(region_def))
-                    {
-                        if (region_def->protection_mask & SPI_REGION_PROTECT_MASK_RECOVER_BITS)
-                        {
-                            should_recover_static_region = 1;
-                        }
-                    }
-                    else if (is_spi_region_dynamic(region_def))
+                    if (entry->flags & SPI_REGION_PROTECT_MASK_RECOVER_BITS)
                     {
-                        if (region_def->protection_mask & recovery_level)
-                        {
-                            decompress_spi_region_from_capsule(region_def->start_addr, region_def->end_addr, signed_recovery_capsule);
-                        }
+                        should_recover_static_region = 1;
                     }
-
-                    // Increment the pointer in PFM body appropriately
-                    pfm_body_ptr = get_end_of_spi_region_def(region_def);
                 }
-                else
+                else if (entry->flags & PFM_REGION_TABLE_FLAG_DYNAMIC)
                 {
-                    // Break when there is no more region/rule definition in PFM body
-                    break;
+                    if (entry->flags & recovery_level)
+                    {
+                        decompress_spi_region_from_capsule(entry->start_addr, entry->end_addr, signed_recovery_capsule);
+                    }
                 }
+                entry = get_next_pfm_region(&iter);
             }
 
             if (should_recover_static_region)
             {
                 // If a static PFM entry has any of RPLM.BIT[4:2] set,
                 // WDT time out triggers T-1 static recovery (entire static portion of flashes).
-                decompress_capsule(signed_recovery_capsule, spi_flash_type, DECOMPRESSION_STATIC_REGIONS_MASK);
+                decompress_capsule(signed_recovery_capsule, spi_flash_type, DECOMPRESSION_STATIC_REGIONS_MASK, 1);
             }
 
             // Increment recovery level after performing a firmware recovery
@@ -39,6 +39,7 @@
 #include "platform_log.h"
 #include "spi_ctrl_utils.h"
 #include "spi_flash_state.h"
+#include "spi_region_auth_cache.h"
 #include "utils.h"
 #include "watchdog_timers.h"
 
@@ -96,6 +97,13 @@ static void perform_active_firmware_update(SPI_FLASH_TYPE_ENUM spi_flash_type, a
         // new active firmware is completed. This flag will remind Nios of the update to recovery region.
         set_spi_flash_state(spi_flash_type, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK);
 
+        // The staging capsule has just been authenticated. Save the result for the recovery update.
+        // It's only trusted then, if the staging capsule has been write protected since.
+        alt_u32 staging_capsule_addr = get_staging_region_offset(spi_flash_type);
+        set_staging_capsule_auth_cache(spi_flash_type, staging_capsule_addr,
+                staging_capsule_addr + get_signed_payload_size(signed_staging_capsule),
+                ((KCH_BLOCK0*) signed_staging_capsule)->pc_hash256);
+
         // Overwrite both static and dynamic regions in recovery update
         decomp_event = DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK;
     }
@@ -105,8 +113,8 @@ static void perform_active_firmware_update(SPI_FLASH_TYPE_ENUM spi_flash_type, a
         decomp_event = DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK;
     }
 
-    // Perform decompression
-    decompress_capsule(signed_staging_capsule, spi_flash_type, decomp_event);
+    // Perform decompression. Pages that are the same in the new firmware are left untouched.
+    decompress_capsule(signed_staging_capsule, spi_flash_type, decomp_event, 1);
 
     // Re-enable watchdog timers in case they were disabled after 3 WDT timeouts.
     if (spi_flash_type == SPI_FLASH_PCH)
@@ -124,22 +132,42 @@ static void perform_active_firmware_update(SPI_FLASH_TYPE_ENUM spi_flash_type, a
  * @brief Perform recovery firmware update for @p spi_flash_type flash.
  *
  * At this point, it is assumed that the staging capsule is authentic and matches the active
- * firmware. Nios simply copies the staging capsule and overwrite the recovery capsule. After
- * that, Nios update the SVN policy with the new SVN
+ * firmware. Nios copies the staging capsule and overwrite the recovery capsule. Only the sectors
+ * that differ from the old recovery capsule are rewritten. Then, Nios reads back the whole recovery
+ * capsule. If it doesn't match the staging capsule, Nios erases and programs every sector of the
+ * recovery capsule, and reads it back again. Once the recovery capsule matches the staging capsule,
+ * Nios update the SVN policy with the new SVN.
  *
  * @param spi_flash_type indicate BMC or PCH SPI flash device
  *
+ * @return 1 if the recovery capsule matches the staging capsule; 0, otherwise
+ *
  * @see perform_active_firmware_update
  * @see post_update_routine
  * @see process_pending_recovery_update
  */
-static void perform_firmware_recovery_update(SPI_FLASH_TYPE_ENUM spi_flash_type)
+static alt_u32 perform_firmware_recovery_update(SPI_FLASH_TYPE_ENUM spi_flash_type)
 {
     switch_spi_flash(spi_flash_type);
 
     // Copy staging capsule to overwrite recovery capsule
     alt_u32* staging_capsule = get_spi_staging_region_ptr(spi_flash_type);
-    memcpy_signed_payload(get_recovery_region_offset(spi_flash_type), staging_capsule);
+    alt_u32* recovery_capsule = get_spi_recovery_region_ptr(spi_flash_type);
+    alt_u32 recovery_region_addr = get_recovery_region_offset(spi_flash_type);
+    memcpy_signed_payload(recovery_region_addr, staging_capsule);
+
+    // The staging capsule is authentic. A recovery capsule that reads back the same is authentic too.
+    alt_u32 capsule_size = get_signed_payload_size(staging_capsule);
+    if (!is_spi_flash_content_identical(recovery_capsule, staging_capsule, capsule_size))
+    {
+        // Don't skip any sector this time, since some of them read as expected before
+        alt_u32 capsule_end_addr = (recovery_region_addr + capsule_size + SPI_FLASH_PAGE_SIZE_OF_4KB - 1) & ~(SPI_FLASH_PAGE_SIZE_OF_4KB - 1);
+        copy_spi_sector_run(recovery_region_addr, capsule_end_addr, staging_capsule, capsule_size);
+        if (!is_spi_flash_content_identical(recovery_capsule, staging_capsule, capsule_size))
+        {
+            return 0;
+        }
+    }
 
     // Update the SVN policy now that recovery update has completed
     PFM* staging_capsule_pfm = get_capsule_pfm(staging_capsule);
@@ -149,6 +177,7 @@ static void perform_firmware_recovery_update(SPI_FLASH_TYPE_ENUM spi_flash_type)
         svn_policy_type = UFM_SVN_POLICY_BMC;
     }
     write_ufm_svn(staging_capsule_pfm->svn, svn_policy_type);
+    return 1;
 }
 
 #endif /* WHITLEY_INC_FIRMWARE_UPDATE_H */
@@ -40,6 +40,7 @@
 #include "pfm_validation.h"
 #include "pfr_pointers.h"
 #include "spi_flash_state.h"
+#include "tmin1_profile.h"
 #include "ufm_utils.h"
 #include "ufm.h"
 
@@ -126,14 +127,17 @@ static void authenticate_and_recover_spi_flash(SPI_FLASH_TYPE_ENUM spi_flash_typ
     /*
      * Authentication of Active region and Recovery region
      */
-    alt_u32* active_pfm_ptr = get_spi_active_pfm_ptr(spi_flash_type);
     alt_u32* recovery_region_ptr = get_spi_recovery_region_ptr(spi_flash_type);
 
     // Verify the signature and content of the active section PFM
-    alt_u32 is_active_valid = is_active_region_valid(active_pfm_ptr);
+    // Static regions that were authenticated in a previous T-1 cycle and have been write protected since are not hashed again.
+    TMIN1_PHASE_ENUM prev_phase = switch_tmin1_phase(TMIN1_PHASE_ACTIVE_AUTH);
+    alt_u32 is_active_valid = is_active_region_valid_with_auth_cache(spi_flash_type);
 
     // Verify the signature of the recovery section capsule
+    switch_tmin1_phase(TMIN1_PHASE_RECOVERY_AUTH);
     alt_u32 is_recovery_valid = is_capsule_valid(recovery_region_ptr);
+    switch_tmin1_phase(prev_phase);
 
     // Check for FORCE_RECOVERY GPI signal
     alt_u32 require_force_recovery = !check_bit(U_GPI_1_ADDR, GPI_1_FM_PFR_FORCE_RECOVERY_N);
@@ -171,8 +175,12 @@ static void authenticate_and_recover_spi_flash(SPI_FLASH_TYPE_ENUM spi_flash_typ
              *
              * Corrective action required: Copy Staging capsule to overwrite Recovery capsule
              */
-            perform_firmware_recovery_update(spi_flash_type);
-            is_recovery_valid = 1;
+            is_recovery_valid = perform_firmware_recovery_update(spi_flash_type);
+            if (!is_recovery_valid)
+            {
+                // The recovery capsule doesn't read back the same as the staging capsule. Save the flash state.
+                set_spi_flash_state(spi_flash_type, SPI_FLASH_STATE_RECOVERY_FAILED_AUTH_MASK);
+            }
         }
         // Unable to recovery recovery image
         else if (is_active_valid)
@@ -217,7 +225,8 @@ static void authenticate_and_recover_spi_flash(SPI_FLASH_TYPE_ENUM spi_flash_typ
             log_recovery(LAST_RECOVERY_FORCED_ACTIVE_FW_RECOVERY);
 
             // Recover the entire active firmware upon forced recovery request.
-            decompress_capsule(recovery_region_ptr, spi_flash_type, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK);
+            // Every page is erased and programmed again, regardless of what the active firmware reads.
+            decompress_capsule(recovery_region_ptr, spi_flash_type, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 0);
             is_active_valid = 1;
         }
         else if (!is_active_valid)
@@ -226,7 +235,8 @@ static void authenticate_and_recover_spi_flash(SPI_FLASH_TYPE_ENUM spi_flash_typ
             log_tmin1_recovery_on_active_image(spi_flash_type);
 
             // Recover the entire active firmware when it failed authentication
-            decompress_capsule(recovery_region_ptr, spi_flash_type, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK);
+            // Only the pages that differ from the recovery capsule are erased and programmed.
+            decompress_capsule(recovery_region_ptr, spi_flash_type, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 1);
             is_active_valid = 1;
         }
     }
@@ -234,7 +244,9 @@ static void authenticate_and_recover_spi_flash(SPI_FLASH_TYPE_ENUM spi_flash_typ
     if (is_active_valid)
     {
         // If the active firmware passed authentication, then apply the protection specified in the active PFM.
+        switch_tmin1_phase(TMIN1_PHASE_RULES);
         apply_spi_write_protection_and_smbus_rules(spi_flash_type);
+        switch_tmin1_phase(prev_phase);
     }
 
     // Print the active & recovery PFM information to mailbox
@@ -35,9 +35,14 @@
 #include "gen_gpi_signals.h"
 #include "gen_gpo_controls.h"
 #include "mailbox_utils.h"
+#include "pfm_region_table.h"
 #include "rfnvram_utils.h"
 #include "smbus_relay_utils.h"
 #include "spi_ctrl_utils.h"
+#include "spi_region_auth_cache.h"
+#include "spi_we_mem_shadow.h"
+#include "t0_profile.h"
+#include "t0_scheduler.h"
 #include "ufm_rw_utils.h"
 #include "ufm_utils.h"
 #include "utils.h"
@@ -144,6 +149,23 @@ static void initialize_system()
     // Configure SPI master and SPI flash devices
     configure_spi_master_csr();
 
+    // SFDP of the flash devices will be read when Nios first drives the SPI busses in T-1
+    reset_spi_flash_caps(SPI_FLASH_BMC);
+    reset_spi_flash_caps(SPI_FLASH_PCH);
+
+    // Nothing has been authenticated yet
+    invalidate_spi_region_auth_cache(SPI_FLASH_BMC);
+    invalidate_spi_region_auth_cache(SPI_FLASH_PCH);
+    invalidate_pfm_region_table();
+
+    // Nios doesn't know what's in the write enable memory yet
+    invalidate_spi_we_mem_shadow(SPI_FLASH_BMC);
+    invalidate_spi_we_mem_shadow(SPI_FLASH_PCH);
+
+    // Start the T0 latency statistics from this power on
+    reset_t0_scheduler();
+    reset_t0_profile();
+
     if (!is_ufm_provisioned())
     {
         // Disable SPI filter, when system is unprovisioned.
@@ -0,0 +1,113 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file io_counters.h
+ * @brief Count the SPI flash and crypto operations that Nios performs in a T-1.
+ *
+ * The counters are cleared when Nios logs the entry to T-1. When Nios logs the entry to T0, they are
+ * published in the mailbox, where they stay until the next T-1 completes. The counters in RAM are exact.
+ * In the mailbox, each counter is a 16-bit value. Large counters are scaled down by a power of two first,
+ * and every counter saturates at 0xFFFF.
+ */
+
+#ifndef WHITLEY_INC_IO_COUNTERS_H_
+#define WHITLEY_INC_IO_COUNTERS_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "mailbox_enums.h"
+
+#define IO_COUNTER_MB_ENTRY_SIZE 2
+#define IO_COUNTER_MB_MAX_VALUE 0xFFFF
+
+/**
+ * Operations that are counted. Their order matches the layout in the mailbox.
+ */
+typedef enum
+{
+    // Bytes sent to the crypto block for SHA or ECDSA
+    IO_COUNTER_BYTES_HASHED       = 0,
+    IO_COUNTER_ECDSA_OPS          = 1,
+    IO_COUNTER_4KB_ERASES         = 2,
+    IO_COUNTER_32KB_ERASES        = 3,
+    IO_COUNTER_64KB_ERASES        = 4,
+    IO_COUNTER_PAGES_PROGRAMMED   = 5,
+    IO_COUNTER_STATUS_POLLS       = 6,
+    IO_COUNTER_SPI_FLASH_SWITCHES = 7,
+    IO_NUM_COUNTERS               = 8,
+} IO_COUNTER_ENUM;
+
+// Right shift applied to each counter before it's written to the mailbox.
+// Bytes hashed are reported in units of 4kB, pages programmed in kB and status polls in units of 256.
+static const alt_u32 io_counter_mb_shifts[IO_NUM_COUNTERS] = {12, 0, 0, 0, 0, 2, 8, 0};
+
+static alt_u32 io_counters[IO_NUM_COUNTERS];
+
+/**
+ * @brief Clear all counters.
+ */
+static void reset_io_counters()
+{
+    for (alt_u32 counter = 0; counter < IO_NUM_COUNTERS; counter++)
+    {
+        io_counters[counter] = 0;
+    }
+}
+
+/**
+ * @brief Add @p n operations to the given counter.
+ */
+static PFR_ALT_INLINE void PFR_ALT_ALWAYS_INLINE count_io_ops(IO_COUNTER_ENUM counter, alt_u32 n)
+{
+    io_counters[counter] += n;
+}
+
+/**
+ * @brief Return the mailbox value of the given counter.
+ */
+static alt_u32 get_io_counter_mb_value(IO_COUNTER_ENUM counter)
+{
+    alt_u32 value = io_counters[counter] >> io_counter_mb_shifts[counter];
+    if (value > IO_COUNTER_MB_MAX_VALUE)
+    {
+        return IO_COUNTER_MB_MAX_VALUE;
+    }
+    return value;
+}
+
+/**
+ * @brief Write all counters to the mailbox.
+ */
+static void publish_io_counters()
+{
+    for (alt_u32 counter = 0; counter < IO_NUM_COUNTERS; counter++)
+    {
+        alt_u32 value = get_io_counter_mb_value((IO_COUNTER_ENUM) counter);
+        alt_u32 mb_offset = MB_TMIN1_IO_COUNTERS + counter * IO_COUNTER_MB_ENTRY_SIZE;
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset, value & 0xFF);
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 1, value >> 8);
+    }
+}
+
+#endif /* WHITLEY_INC_IO_COUNTERS_H_ */
@@ -31,6 +31,7 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "keychain_cache.h"
 #include "keychain_utils.h"
 #include "pfr_pointers.h"
 #include "ufm_utils.h"
@@ -69,6 +70,9 @@ static void cancel_key(alt_u32 pc_type, alt_u32 key_id)
 
     // Cancel the key ID
     *key_cancel_ptr &= ~(0b1 << bit_offset);
+
+    // Previously verified CSK entries may use the cancelled key
+    invalidate_kch_verification_cache();
 }
 
 /**
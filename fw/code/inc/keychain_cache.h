@@ -0,0 +1,156 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file keychain_cache.h
+ * @brief Cache of Block 1 CSK entries that have already been verified.
+ *
+ * Verifying a CSK entry costs a full ECDSA round on the crypto block. In T-1, Nios authenticates
+ * the active PFM, the recovery capsule, the PFM inside the recovery capsule and the staging capsule,
+ * which are usually signed by the same CSK. Once a CSK entry has been verified, an identical entry
+ * found in a later signature skips the ECDSA. The cheap checks (e.g. magic numbers, permissions and
+ * key cancellation policy) and the root entry check are still performed on every signature.
+ *
+ * Only the SHA of each verified CSK entry (including its signature) is kept, so that the cache
+ * stays small in the Nios RAM. That SHA is a single short job on the crypto block.
+ *
+ * The cache is tied to the root key hash in UFM. All entries are dropped when that hash changes
+ * or when a CSK key is cancelled.
+ */
+
+#ifndef WHITLEY_INC_KEYCHAIN_CACHE_H_
+#define WHITLEY_INC_KEYCHAIN_CACHE_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "crypto.h"
+#include "keychain.h"
+#include "pfr_pointers.h"
+#include "ufm.h"
+#include "utils.h"
+
+// Maximum number of verified CSK entries kept in the cache
+#define KCH_CACHE_MAX_CSK_ENTRIES 4
+
+typedef struct
+{
+    // Root key hash in UFM when the cached CSK entries were verified
+    alt_u32 root_key_hash[PFR_CRYPTO_LENGTH / 4];
+    // Hashes of the CSK entries whose signatures have been verified with the root public key
+    alt_u32 num_csk_entries;
+    alt_u32 csk_entry_hashes[KCH_CACHE_MAX_CSK_ENTRIES][PFR_CRYPTO_LENGTH / 4];
+} KCH_VERIFICATION_CACHE;
+
+// Static variable to track the verified keychain entries
+static KCH_VERIFICATION_CACHE kch_verification_cache;
+
+/**
+ * @brief Drop all the verified CSK entries.
+ */
+static void invalidate_kch_verification_cache()
+{
+    kch_verification_cache.num_csk_entries = 0;
+}
+
+/**
+ * @brief Return 1 if the given words are identical.
+ */
+static alt_u32 is_kch_cache_data_equal(const alt_u32* data_a, const alt_u32* data_b, alt_u32 nbytes)
+{
+    for (alt_u32 word_i = 0; word_i < (nbytes >> 2); word_i++)
+    {
+        if (data_a[word_i] != data_b[word_i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Calculate the hash that identifies a CSK entry in the cache.
+ * The whole entry is hashed, including the signature from the root key.
+ *
+ * @param csk_entry pointer to a Block 1 CSK entry
+ * @param csk_entry_hash buffer of PFR_CRYPTO_LENGTH bytes to receive the hash
+ */
+static void calculate_csk_entry_hash(KCH_BLOCK1_CSK_ENTRY* csk_entry, alt_u32* csk_entry_hash)
+{
+    calculate_and_save_sha(csk_entry_hash, (alt_u32*) csk_entry, sizeof(KCH_BLOCK1_CSK_ENTRY));
+}
+
+/**
+ * @brief Return 1 if a CSK entry with the given hash has been verified with the root public key
+ * that matches the root key hash currently in UFM.
+ *
+ * If the root key hash in UFM has changed since the cached entries were verified, the cache is invalidated.
+ *
+ * @param csk_entry_hash hash of a Block 1 CSK entry, from calculate_csk_entry_hash()
+ * @return 1 if this CSK entry has been verified; 0, otherwise
+ */
+static alt_u32 is_csk_entry_hash_cached(const alt_u32* csk_entry_hash)
+{
+    if (!is_kch_cache_data_equal(kch_verification_cache.root_key_hash, get_ufm_pfr_data()->root_key_hash, PFR_CRYPTO_LENGTH))
+    {
+        invalidate_kch_verification_cache();
+        return 0;
+    }
+
+    for (alt_u32 entry_i = 0; entry_i < kch_verification_cache.num_csk_entries; entry_i++)
+    {
+        if (is_kch_cache_data_equal(kch_verification_cache.csk_entry_hashes[entry_i], csk_entry_hash, PFR_CRYPTO_LENGTH))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Record the hash of a CSK entry whose signature has just been verified with a root public key
+ * that matches the root key hash in UFM.
+ * When the cache is full, the most recently added entry is replaced.
+ *
+ * @param csk_entry_hash hash of a verified Block 1 CSK entry, from calculate_csk_entry_hash()
+ */
+static void add_csk_entry_hash_to_cache(const alt_u32* csk_entry_hash)
+{
+    if (!is_kch_cache_data_equal(kch_verification_cache.root_key_hash, get_ufm_pfr_data()->root_key_hash, PFR_CRYPTO_LENGTH))
+    {
+        alt_u32_memcpy(kch_verification_cache.root_key_hash, get_ufm_pfr_data()->root_key_hash, PFR_CRYPTO_LENGTH);
+        kch_verification_cache.num_csk_entries = 0;
+    }
+
+    alt_u32 entry_i = kch_verification_cache.num_csk_entries;
+    if (entry_i == KCH_CACHE_MAX_CSK_ENTRIES)
+    {
+        entry_i--;
+    }
+    else
+    {
+        kch_verification_cache.num_csk_entries++;
+    }
+    alt_u32_memcpy(kch_verification_cache.csk_entry_hashes[entry_i], csk_entry_hash, PFR_CRYPTO_LENGTH);
+}
+
+#endif /* WHITLEY_INC_KEYCHAIN_CACHE_H_ */
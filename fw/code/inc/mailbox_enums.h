@@ -90,6 +90,16 @@ typedef enum
     MB_BMC_PFM_RECOVERY_MINOR_VER = 0x1F,
     /* Hash value of CPLD RoT HW + FW; read-only for CPU/BMC */
     MB_CPLD_HASH = 0x20,
+    /* Minimum and maximum duration of each T0 handler and of the T0 loop (4 bytes each);
+       read-only for CPU/BMC */
+    MB_T0_PROFILE = 0x40,
+    /* Histogram of the T0 loop duration (4 bytes); read-only for CPU/BMC */
+    MB_T0_LOOP_HISTOGRAM = 0x5C,
+    /* Duration of the latest T-1 and of each of its phases, in milliseconds (2 bytes each);
+       read-only for CPU/BMC */
+    MB_TMIN1_PROFILE = 0x60,
+    /* SPI flash and crypto operations in the latest T-1 (2 bytes each); read-only for CPU/BMC */
+    MB_TMIN1_IO_COUNTERS = 0x70,
 } MB_REGFILE_OFFSET_ENUM;
 
 /**
@@ -204,6 +214,7 @@ typedef enum
     MB_UFM_PROV_RECONFIG_CPLD  = 0x0E,
     MB_UFM_PROV_ENABLE_PIT_L1  = 0x10,
     MB_UFM_PROV_ENABLE_PIT_L2  = 0x11,
+    MB_UFM_PROV_ENABLE_PIT_L2_CHUNKED = 0x12,
 } MB_UFM_PROV_CMD_ENUM;
 
 /**
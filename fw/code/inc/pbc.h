@@ -37,6 +37,37 @@
 #define PBC_EXPECTED_PATTERN_SIZE 0x0001
 #define PBC_EXPECTED_PATTERN 0xFF
 
+/**
+ * Version 3 of the compression structure stores each page in the compressed payload either as is, or
+ * compressed with an LZ77-style encoding.
+ *
+ * The compressed payload starts with a page table of (N + 1) words, where N is the number of pages
+ * marked in the compression bitmap. Word i is the byte offset of page i, from the start of the page table.
+ * The last word is the end of the compressed payload. A page of PBC_EXPECTED_PAGE_SIZE bytes is stored as is.
+ * Smaller pages are LZ streams that decode to PBC_EXPECTED_PAGE_SIZE bytes. All pages are word aligned.
+ * The number of bits in each bitmap must be a multiple of 32, so that the page table is word aligned.
+ *
+ * An LZ stream is a sequence of tokens:
+ *   0x00 - 0x7F: (token + 1) literal bytes follow.
+ *   0x80 - 0xFF: copy ((token & 0x7F) + PBC_LZ_MIN_MATCH_LEN) bytes from earlier in the page. The next two
+ *                bytes hold (distance - 1), least significant byte first. The copy may overlap its output.
+ */
+#define PBC_VERSION_PER_PAGE_LZ 0x3
+#define PBC_LZ_MATCH_TOKEN_MASK 0x80
+#define PBC_LZ_MIN_MATCH_LEN 3
+#define PBC_LZ_MAX_MATCH_LEN (0x7F + PBC_LZ_MIN_MATCH_LEN)
+#define PBC_LZ_MAX_LITERAL_LEN 0x80
+
+/**
+ * A delta capsule only carries the pages that differ from a base firmware image. It sets PBC_DELTA_VERSION_FLAG
+ * in the version field, on top of version 2 or 3. The base image is identified by the hash of its PFM (i.e. the
+ * pc_hash256 field in Block 0 of the signed PFM), which is stored in the header.
+ *
+ * The active bitmap only marks the pages that must be rewritten. Every other page of the base image is kept as is.
+ * Hence, a delta capsule can only be applied on top of its base image, and it can't be used as a recovery capsule.
+ */
+#define PBC_DELTA_VERSION_FLAG 0x100
+
 /**
  * Page Block Compression header structure
  *
@@ -52,7 +83,9 @@ typedef struct
     alt_u32 pattern;
     alt_u32 bitmap_nbit;
     alt_u32 payload_len;
-    alt_u32 _reserved[25];
+    // Only used in a delta capsule
+    alt_u32 base_pfm_hash[PFR_CRYPTO_LENGTH / 4];
+    alt_u32 _reserved[25 - PFR_CRYPTO_LENGTH / 4];
 } PBC_HEADER;
 
 #endif /* WHITLEY_INC_PBC_H_ */
@@ -34,6 +34,26 @@
 #include "pbc.h"
 #include "pfr_pointers.h"
 
+/**
+ * @brief Return the version of the PBC structure format (i.e. 2 or 3), without the delta capsule flag.
+ *
+ * @param pbc pointer to the start of a PBC_HEADER structure
+ */
+static PFR_ALT_INLINE alt_u32 PFR_ALT_ALWAYS_INLINE get_pbc_format_version(PBC_HEADER* pbc)
+{
+    return pbc->version & ~PBC_DELTA_VERSION_FLAG;
+}
+
+/**
+ * @brief Return non-zero if the PBC structure belongs to a delta capsule.
+ *
+ * @param pbc pointer to the start of a PBC_HEADER structure
+ */
+static PFR_ALT_INLINE alt_u32 PFR_ALT_ALWAYS_INLINE is_delta_pbc(PBC_HEADER* pbc)
+{
+    return pbc->version & PBC_DELTA_VERSION_FLAG;
+}
+
 /**
  * @brief Return the size of the bitmap in bytes. 
  * 
@@ -80,4 +100,30 @@ static alt_u32* get_compressed_payload(PBC_HEADER* pbc)
     return incr_alt_u32_ptr(compression_bitmap_addr, get_bitmap_size(pbc));
 }
 
+/**
+ * @brief Return 32 bits of a PBC bitmap, starting from bit (32 * @p word_index).
+ *
+ * In PBC bitmaps, the first page is represented by the most significant bit of the first byte. Hence,
+ * the returned word has the first of these 32 pages in bit 31. Bits beyond the end of the bitmap are 0.
+ * The bitmap is read byte by byte, since the compression bitmap may not be word aligned.
+ *
+ * @param bitmap pointer to the active or compression bitmap
+ * @param bitmap_nbytes the size of the bitmap in bytes
+ * @param word_index index of the 32-bit group of pages
+ * @return alt_u32 32 bits of the bitmap
+ */
+static alt_u32 get_pbc_bitmap_word(alt_u8* bitmap, alt_u32 bitmap_nbytes, alt_u32 word_index)
+{
+    alt_u32 word = 0;
+    for (alt_u32 byte_i = word_index * 4; byte_i < (word_index + 1) * 4; byte_i++)
+    {
+        word <<= 8;
+        if (byte_i < bitmap_nbytes)
+        {
+            word |= bitmap[byte_i];
+        }
+    }
+    return word;
+}
+
 #endif /* WHITLEY_INC_PBC_UTILS_H_ */
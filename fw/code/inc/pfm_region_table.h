@@ -0,0 +1,330 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file pfm_region_table.h
+ * @brief Compile the SPI region and SMBus rule definitions of a PFM into a table in RAM.
+ *
+ * The PFM body is a list of variable length definitions in SPI flash. Instead of walking it through the
+ * SPI flash AvMM window every time, Nios reads it once into a fixed size table, sorted by SPI start address.
+ * Each table entry keeps the SPI address range of a definition, its protection mask and some precomputed
+ * flags. The rest of a definition (e.g. the SMBus command whitelist or the expected hash of a SPI region)
+ * is still read from flash, through the offset of the definition in the PFM body.
+ *
+ * Nios keeps a single table. It holds the active PFM of the flash device that Nios is working on, or the PFM
+ * of the capsule being decompressed. The table is identified by the hash of its PFM (from the authenticated
+ * Block 0). It's only used when that matches the active PFM in flash. Otherwise, or when a PFM has more
+ * definitions than the table can hold, Nios walks the PFM body in SPI flash instead. The PFM definition
+ * iterator hides the difference from its users.
+ *
+ * The table only lives in RAM, so it's empty after every power cycle and CPLD reconfiguration.
+ */
+
+#ifndef WHITLEY_INC_PFM_REGION_TABLE_H_
+#define WHITLEY_INC_PFM_REGION_TABLE_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "keychain.h"
+#include "pfm.h"
+#include "pfr_pointers.h"
+#include "spi_common.h"
+#include "utils.h"
+
+// Maximum number of SPI region and SMBus rule definitions in a compiled PFM
+#define PFM_REGION_TABLE_MAX_ENTRIES 32
+
+// The lower byte of the entry flags is the protection mask of a SPI region definition
+#define PFM_REGION_TABLE_FLAG_SPI_REGION 0x100
+#define PFM_REGION_TABLE_FLAG_SMBUS_RULE 0x200
+// Read allowed, but not write allowed
+#define PFM_REGION_TABLE_FLAG_STATIC 0x400
+// Read and write allowed
+#define PFM_REGION_TABLE_FLAG_DYNAMIC 0x800
+// Static region with a SHA-256 hash in the PFM
+#define PFM_REGION_TABLE_FLAG_HASHED 0x1000
+
+typedef struct
+{
+    alt_u32 flags;
+    // SPI address range of a SPI region definition; both are 0 for a SMBus rule definition
+    alt_u32 start_addr;
+    alt_u32 end_addr;
+    // Byte offset of the definition from the start of the PFM body
+    alt_u32 def_offset;
+} PFM_REGION_TABLE_ENTRY;
+
+typedef struct
+{
+    // 1 if every definition of the PFM is in this table
+    alt_u32 is_compiled;
+    // Hash of the PFM (from its Block 0)
+    alt_u32 pfm_hash[PFR_CRYPTO_LENGTH / 4];
+    alt_u32 num_entries;
+    // Sorted by SPI start address. SMBus rule definitions come first, in PFM order.
+    PFM_REGION_TABLE_ENTRY entries[PFM_REGION_TABLE_MAX_ENTRIES];
+} PFM_REGION_TABLE;
+
+/**
+ * Go through the definitions of a PFM, either from its compiled table or from the PFM body in SPI flash.
+ */
+typedef struct
+{
+    // Table to go through; 0 when walking the PFM body
+    PFM_REGION_TABLE* table;
+    alt_u32* pfm_body;
+    // Index of the next table entry, or byte offset of the next definition in the PFM body
+    alt_u32 next;
+    // Current definition, when walking the PFM body
+    PFM_REGION_TABLE_ENTRY entry;
+} PFM_REGION_ITER;
+
+// Static variable to keep the compiled PFM. Only one PFM is in use at a time.
+static PFM_REGION_TABLE pfm_region_table;
+
+/******************************************************
+ *
+ * Helper functions to work with the static variables
+ *
+ ******************************************************/
+
+/**
+ * @brief Return the table that holds the compiled PFM.
+ */
+static PFM_REGION_TABLE* get_pfm_region_table()
+{
+    return &pfm_region_table;
+}
+
+/**
+ * @brief Drop the compiled PFM.
+ */
+static void invalidate_pfm_region_table()
+{
+    PFM_REGION_TABLE* table = get_pfm_region_table();
+    table->is_compiled = 0;
+    table->num_entries = 0;
+}
+
+/**
+ * @brief Check whether the table was compiled from the PFM with the given hash.
+ */
+static alt_u32 is_pfm_region_table_for_pfm(PFM_REGION_TABLE* table, alt_u32* pfm_hash)
+{
+    if (!table->is_compiled)
+    {
+        return 0;
+    }
+    for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+    {
+        if (table->pfm_hash[word_i] != pfm_hash[word_i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Return the compiled table of the active PFM in the given SPI flash device.
+ * This function assumes that Nios has switched to that flash device.
+ *
+ * @return the table; 0 if the active PFM in flash has not been compiled.
+ */
+static PFM_REGION_TABLE* get_active_pfm_region_table(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    PFM_REGION_TABLE* table = get_pfm_region_table();
+    KCH_SIGNATURE* active_pfm_sig = (KCH_SIGNATURE*) get_spi_active_pfm_ptr(spi_flash_type);
+    if (is_pfm_region_table_for_pfm(table, active_pfm_sig->b0.pc_hash256))
+    {
+        return table;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read the PFM definition at @p def_offset bytes into the PFM body into a table entry.
+ *
+ * @return the size of the definition in bytes; 0 if there's no more definition in the PFM body.
+ */
+static alt_u32 read_pfm_region_table_entry(PFM_REGION_TABLE_ENTRY* entry, alt_u32* pfm_body, alt_u32 def_offset)
+{
+    PFM_SPI_REGION_DEF* region_def = (PFM_SPI_REGION_DEF*) incr_alt_u32_ptr(pfm_body, def_offset);
+    entry->def_offset = def_offset;
+    entry->start_addr = 0;
+    entry->end_addr = 0;
+
+    alt_u8 def_type = region_def->def_type;
+    if (def_type == SMBUS_RULE_DEF_TYPE)
+    {
+        entry->flags = PFM_REGION_TABLE_FLAG_SMBUS_RULE;
+        return SMBUS_RULE_DEF_SIZE;
+    }
+    if (def_type != SPI_REGION_DEF_TYPE)
+    {
+        // There is no more region/rule definition in PFM body
+        return 0;
+    }
+
+    alt_u32 protection_mask = region_def->protection_mask;
+    alt_u32 hash_algorithm = region_def->hash_algorithm;
+    alt_u32 flags = PFM_REGION_TABLE_FLAG_SPI_REGION | protection_mask;
+    if (protection_mask & SPI_REGION_PROTECT_MASK_READ_ALLOWED)
+    {
+        if (protection_mask & SPI_REGION_PROTECT_MASK_WRITE_ALLOWED)
+        {
+            flags |= PFM_REGION_TABLE_FLAG_DYNAMIC;
+        }
+        else
+        {
+            flags |= PFM_REGION_TABLE_FLAG_STATIC;
+            if (hash_algorithm & PFM_HASH_ALGO_SHA256_MASK)
+            {
+                flags |= PFM_REGION_TABLE_FLAG_HASHED;
+            }
+        }
+    }
+    entry->flags = flags;
+    entry->start_addr = region_def->start_addr;
+    entry->end_addr = region_def->end_addr;
+
+    // A SPI region definition has variable length, depending on whether there's a hash present.
+    if (hash_algorithm == 0)
+    {
+        return SPI_REGION_DEF_MIN_SIZE;
+    }
+    return sizeof(PFM_SPI_REGION_DEF);
+}
+
+/**
+ * @brief Start going through the definitions of @p pfm.
+ *
+ * @param table compiled table of @p pfm. Set to 0 to walk the PFM body in SPI flash.
+ */
+static void init_pfm_region_iter(PFM_REGION_ITER* iter, PFM_REGION_TABLE* table, PFM* pfm)
+{
+    iter->table = table;
+    iter->pfm_body = pfm->pfm_body;
+    iter->next = 0;
+}
+
+/**
+ * @brief Move on to the next definition. Definitions from a compiled table are in SPI address order.
+ * Definitions from the PFM body are in PFM order.
+ *
+ * @return pointer to the entry of the definition; 0 if there's no more definition.
+ */
+static PFM_REGION_TABLE_ENTRY* get_next_pfm_region(PFM_REGION_ITER* iter)
+{
+    if (iter->table)
+    {
+        if (iter->next < iter->table->num_entries)
+        {
+            return &iter->table->entries[iter->next++];
+        }
+        return 0;
+    }
+
+    alt_u32 def_size = read_pfm_region_table_entry(&iter->entry, iter->pfm_body, iter->next);
+    if (def_size == 0)
+    {
+        return 0;
+    }
+    iter->next += def_size;
+    return &iter->entry;
+}
+
+/**
+ * @brief Return the pointer to the definition of a table entry, in the PFM body.
+ */
+static alt_u32* get_pfm_region_def(PFM_REGION_ITER* iter, PFM_REGION_TABLE_ENTRY* entry)
+{
+    return incr_alt_u32_ptr(iter->pfm_body, entry->def_offset);
+}
+
+/**
+ * @brief Walk the body of @p pfm once and fill in the table, sorted by SPI start address.
+ * If the PFM has more definitions than the table can hold, the table is left uncompiled.
+ *
+ * This function must only be called after the signature of the PFM has been verified.
+ *
+ * @param table the table to fill in
+ * @param pfm pointer to the PFM
+ * @param pfm_hash hash of the authenticated PFM (from its Block 0)
+ */
+static void compile_pfm_region_table(PFM_REGION_TABLE* table, PFM* pfm, alt_u32* pfm_hash)
+{
+    table->is_compiled = 0;
+    table->num_entries = 0;
+
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, 0, pfm);
+    PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter);
+    while (entry)
+    {
+        if (table->num_entries == PFM_REGION_TABLE_MAX_ENTRIES)
+        {
+            return;
+        }
+
+        // Insertion sort. Keep the PFM order among definitions with the same start address.
+        alt_u32 entry_i = table->num_entries;
+        while ((entry_i > 0) && (table->entries[entry_i - 1].start_addr > entry->start_addr))
+        {
+            alt_u32_memcpy((alt_u32*) &table->entries[entry_i], (alt_u32*) &table->entries[entry_i - 1],
+                    sizeof(PFM_REGION_TABLE_ENTRY));
+            entry_i--;
+        }
+        alt_u32_memcpy((alt_u32*) &table->entries[entry_i], (alt_u32*) entry, sizeof(PFM_REGION_TABLE_ENTRY));
+        table->num_entries++;
+
+        entry = get_next_pfm_region(&iter);
+    }
+
+    alt_u32_memcpy(table->pfm_hash, pfm_hash, PFR_CRYPTO_LENGTH);
+    table->is_compiled = 1;
+}
+
+/**
+ * @brief Compile the given PFM, unless it's already in the table.
+ * This function must only be called after the signature of the PFM has been verified.
+ *
+ * @param pfm pointer to the PFM
+ * @param pfm_hash hash of the authenticated PFM (from its Block 0)
+ * @return the table; 0 if the PFM has too many definitions.
+ */
+static PFM_REGION_TABLE* prepare_pfm_region_table(PFM* pfm, alt_u32* pfm_hash)
+{
+    PFM_REGION_TABLE* table = get_pfm_region_table();
+    if (!is_pfm_region_table_for_pfm(table, pfm_hash))
+    {
+        compile_pfm_region_table(table, pfm, pfm_hash);
+    }
+    if (table->is_compiled)
+    {
+        return table;
+    }
+    return 0;
+}
+
+#endif /* WHITLEY_INC_PFM_REGION_TABLE_H_ */
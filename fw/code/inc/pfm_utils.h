@@ -33,10 +33,13 @@
 
 #include "keychain.h"
 #include "pfm.h"
+#include "pfm_region_table.h"
 #include "smbus_relay_utils.h"
 #include "spi_ctrl_utils.h"
 #include "spi_flash_state.h"
+#include "spi_region_auth_cache.h"
 #include "spi_rw_utils.h"
+#include "spi_we_mem_shadow.h"
 #include "ufm_utils.h"
 #include "utils.h"
 
@@ -102,141 +105,108 @@ static alt_u32 is_spi_region_dynamic(PFM_SPI_REGION_DEF* spi_region_def)
 }
 
 /**
- * @brief Go through the PFM body to apply SPI write protection and SMBus rule.
+ * @brief Go through the PFM definitions to apply SPI write protection and SMBus rule.
  *
  * The entire SPI flash must be covered by the PFM, as required in architecture specification.
- * When validating PFM, Nios has already verified that all SPI regions does not overlap and addresses
- * are in ascending order. This is needed for correctness of this function.
+ * When validating PFM, Nios has already verified that all SPI regions does not overlap. Definitions are taken
+ * from the compiled PFM when it's available, which is sorted by address. Otherwise, addresses in the PFM body
+ * must be in ascending order. This is needed for correctness of this function.
  *
  * Writing 0s to appropriate location in the Write Enable Memory of the SPI control block would turn off write access.
- * Some SPI regions may share the same word in the write enable memory. Write enable memory is also read-only for Nios.
+ * Some SPI regions may share the same word in the write enable memory. Write enable memory is also write-only for Nios.
  * Therefore, Nios must process SPI regions definition in order to collect all the write protection rules in the same word,
- * before committing to the write enable memory.
+ * before committing to the write enable memory. Only the words that differ from the RAM shadow of the write enable
+ * memory are written.
  *
  * Nios currently only applies SMBus filtering rules from BMC PFM. SMBus filtering rules from PCH PFM are ignored.
+ * They are skipped when they have already been applied from the same BMC PFM.
  *
  * @see apply_smbus_rule
+ * @see commit_spi_we_mem_word
  */
 static void apply_spi_write_protection_and_smbus_rules(SPI_FLASH_TYPE_ENUM spi_flash_type)
 {
-    alt_u32* we_mem_ptr = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0);
-    if (spi_flash_type == SPI_FLASH_PCH)
-    {
-        we_mem_ptr = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 0);
-    }
-
     // Two or more SPI regions may share the same word in the write enable memory
     // Use these variables to track where Nios is in the write enable memory and the content of a shared word there.
     alt_u32 write_spi_rule_word = 0;
     alt_u32 write_spi_rule_word_pos = 0;
 
-    // Read the PFM
-    PFM* active_pfm = get_active_pfm(spi_flash_type);
-    alt_u32* pfm_body_ptr = active_pfm->pfm_body;
+    PFM_REGION_TABLE* table = get_active_pfm_region_table(spi_flash_type);
+    alt_u32* pfm_hash = table ? table->pfm_hash : 0;
 
-    // Go through the PFM Body
-    while (1)
+    // The SMBus rules are only applied again when the BMC PFM has changed
+    alt_u32 update_smbus_rules = 0;
+    if (spi_flash_type == SPI_FLASH_BMC)
     {
-        alt_u8 def_type = *((alt_u8*) pfm_body_ptr);
-        if (def_type == SMBUS_RULE_DEF_TYPE)
-        {
-            PFM_SMBUS_RULE_DEF* rule_def = (PFM_SMBUS_RULE_DEF*) pfm_body_ptr;
+        update_smbus_rules = start_smbus_rules_update(pfm_hash);
+    }
 
+    // Go through the PFM definitions
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, table, get_active_pfm(spi_flash_type));
+    PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter);
+    while (entry)
+    {
+        if (entry->flags & PFM_REGION_TABLE_FLAG_SMBUS_RULE)
+        {
             // Only Apply SMBus rule from BMC PFM
-            if (spi_flash_type == SPI_FLASH_BMC)
+            if (update_smbus_rules)
             {
-                apply_smbus_rule(rule_def);
+                apply_smbus_rule((PFM_SMBUS_RULE_DEF*) get_pfm_region_def(&iter, entry));
             }
-
-            // Move to next SMBus/SPI filter rule
-            pfm_body_ptr = incr_alt_u32_ptr(pfm_body_ptr, SMBUS_RULE_DEF_SIZE);
         }
-        else if (def_type == SPI_REGION_DEF_TYPE)
+        else
         {
-            PFM_SPI_REGION_DEF* region_def = (PFM_SPI_REGION_DEF*) pfm_body_ptr;
-            alt_u32 start_spi_addr = region_def->start_addr;
-            alt_u32 end_spi_addr = region_def->end_addr;
-
-            alt_u32 allow_write = 0;
-            if (region_def->protection_mask & SPI_REGION_PROTECT_MASK_WRITE_ALLOWED)
+            alt_u32 allow_write = entry->flags & SPI_REGION_PROTECT_MASK_WRITE_ALLOWED;
+            if (allow_write)
             {
-                allow_write = 1;
+                // Content of a writable region can't be trusted in the next T-1 cycle
+                invalidate_spi_region_auth_cache_for_writable_range(spi_flash_type, entry->start_addr, entry->end_addr);
             }
 
-            // 14 bits to get to 16kB chunks, 5 more bits because we have 32 (=2^5) bits in each word in the memory
-            alt_u32 start_word_pos = start_spi_addr >> (14 + 5);
-            // Grab the 5 address bits that tell us the starting bit position within the 32 bit word
-            alt_u32 start_bit_pos = (start_spi_addr >> 14) & 0x0000001f;
-            alt_u32 end_word_pos = end_spi_addr >> (14 + 5);
-            alt_u32 end_bit_pos = (end_spi_addr >> 14) & 0x0000001f;
-
-            for (alt_u32 iter = start_word_pos; iter <= end_word_pos; iter++)
+            // Go through the 16KB pages of this region, up to 32 pages (i.e. a word in write enable memory) at a time
+            alt_u32 page = entry->start_addr >> SPI_WE_MEM_PAGE_SHIFT;
+            alt_u32 end_page = entry->end_addr >> SPI_WE_MEM_PAGE_SHIFT;
+            while (page < end_page)
             {
-                alt_u32 word_pos_in_between_start_and_end = write_spi_rule_word_pos != start_word_pos && write_spi_rule_word_pos != end_word_pos;
-
-                // Track if Nios should commit the collected rule to write enable memory
-                // If the word is not fully constructed, Nios should not commit the rule.
-                alt_u32 commit_to_we_mem = word_pos_in_between_start_and_end;
-
-                if (word_pos_in_between_start_and_end)
+                // Commit the collected rules of the earlier words. Pages that are not covered by any region are read-only.
+                while (write_spi_rule_word_pos < (page >> 5))
                 {
-                    // Except for the first and last words, we can set/clear all bits in the word inside the region
+                    commit_spi_we_mem_word(spi_flash_type, write_spi_rule_word_pos, write_spi_rule_word);
                     write_spi_rule_word = 0;
-                    if (allow_write)
-                    {
-                        write_spi_rule_word = 0xFFFFFFFF;
-                    }
+                    write_spi_rule_word_pos++;
                 }
-                else
+
+                alt_u32 first_bit_pos = page & 0x1f;
+                alt_u32 nbits = 32 - first_bit_pos;
+                if (end_page - page < nbits)
                 {
-                    // Special handling for first and last words (including the case where first word == last word)
-                    alt_u32 first_bit_pos = start_bit_pos;
-                    alt_u32 last_bit_pos = end_bit_pos;
-                    if (write_spi_rule_word_pos != start_word_pos)
-                    {
-                        first_bit_pos = 0;
-
-                        // Re-initalize to all 0s.
-                        write_spi_rule_word = 0;
-                    }
-                    if (write_spi_rule_word_pos != end_word_pos)
-                    {
-                        // In this case, we want to write 0s till the end of the word (i.e. including bit[31])
-                        last_bit_pos = 32;
-                    }
-
-                    if (allow_write)
-                    {
-                        for (alt_u32 bit_pos = first_bit_pos; bit_pos < last_bit_pos; bit_pos++)
-                        {
-                            // This 16KB page is not writable. Write a 0 to this bit position.
-                            write_spi_rule_word |= (0b1 << bit_pos);
-                        }
-                    }
-
-                    // Only write to write enable memory when the full word is collected.
-                    commit_to_we_mem = last_bit_pos == 32;
+                    nbits = end_page - page;
                 }
-
-                // Save the collected rule and move on to the next 32 16KB pages
-                if (commit_to_we_mem)
+                if (allow_write)
                 {
-                    // Write the collected rule to write enable memory
-                    IOWR(we_mem_ptr, write_spi_rule_word_pos, write_spi_rule_word);
-
-                    // Move to the next word in write enable memory
-                    write_spi_rule_word_pos++;
+                    write_spi_rule_word |= get_spi_we_mem_bit_mask(first_bit_pos, nbits);
                 }
+                page += nbits;
             }
-
-            // Increment the pointer in PFM body appropriately
-            pfm_body_ptr = get_end_of_spi_region_def(region_def);
-        }
-        else
-        {
-            // Break when there is no more region/rule definition in PFM body
-            break;
         }
+
+        entry = get_next_pfm_region(&iter);
+    }
+
+    // Commit the rest of the write enable memory for this flash device
+    alt_u32 we_mem_nwords = get_spi_we_mem_nwords(spi_flash_type);
+    while (write_spi_rule_word_pos < we_mem_nwords)
+    {
+        commit_spi_we_mem_word(spi_flash_type, write_spi_rule_word_pos, write_spi_rule_word);
+        write_spi_rule_word = 0;
+        write_spi_rule_word_pos++;
+    }
+    validate_spi_we_mem_shadow(spi_flash_type);
+
+    if (update_smbus_rules)
+    {
+        finish_smbus_rules_update(pfm_hash);
     }
 }
 
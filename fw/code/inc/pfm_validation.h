@@ -34,8 +34,10 @@
 #include "authentication.h"
 #include "crypto.h"
 #include "pfm.h"
+#include "pfm_region_table.h"
 #include "pfm_utils.h"
 #include "pfr_pointers.h"
+#include "spi_region_auth_cache.h"
 
 /**
  * @brief Check if the SMBus device address in a rule definition is valid.
@@ -77,9 +79,47 @@ static alt_u32 is_spi_region_valid(PFM_SPI_REGION_DEF* region_def)
     if ((region_def->hash_algorithm & PFM_HASH_ALGO_SHA256_MASK) &&
             is_spi_region_static(region_def))
     {
-        return verify_sha(region_def->region_hash,
-                get_spi_flash_ptr_with_offset(region_def->start_addr),
-                region_def->end_addr - region_def->start_addr);
+        // Each static region has its own expected hash in the PFM, hence one SHA job per region
+        alt_u32 region_size = region_def->end_addr - region_def->start_addr;
+        CRYPTO_SHA_CONTEXT sha_ctx;
+        sha_init(&sha_ctx, region_size);
+        sha_update(&sha_ctx, get_spi_flash_ptr_with_offset(region_def->start_addr), region_size);
+        return sha_final_and_verify(&sha_ctx, region_def->region_hash);
+    }
+    return 1;
+}
+
+/**
+ * @brief Perform validation on a PFM defined SPI region, skipping the hash check if this
+ * region has been authenticated before against the same PFM.
+ *
+ * @param entry the SPI region definition, as read into a PFM region table entry
+ * @param region_def the SPI region definition in the PFM body
+ * @param auth_cache authentication cache of the SPI flash. Set to 0 to always hash the region.
+ * @return 1 if success else 0
+ */
+static alt_u32 is_spi_region_valid_with_auth_cache(
+        PFM_REGION_TABLE_ENTRY* entry, PFM_SPI_REGION_DEF* region_def, SPI_REGION_AUTH_CACHE* auth_cache)
+{
+    if (auth_cache == 0)
+    {
+        return is_spi_region_valid(region_def);
+    }
+
+    if (is_spi_region_auth_cached(auth_cache, entry->start_addr, entry->end_addr))
+    {
+        return 1;
+    }
+
+    if (!is_spi_region_valid(region_def))
+    {
+        return 0;
+    }
+
+    // Only static regions are write protected in T0. Their authentication results can be reused.
+    if (entry->flags & PFM_REGION_TABLE_FLAG_HASHED)
+    {
+        add_spi_region_auth_cache_entry(auth_cache, entry->start_addr, entry->end_addr);
     }
     return 1;
 }
@@ -87,37 +127,31 @@ static alt_u32 is_spi_region_valid(PFM_SPI_REGION_DEF* region_def)
 /**
  * @brief Iterate through PFM body to validate SPI region definition and SMBus rule definition.
  *
+ * @param pfm pointer to the start of a PFM data
+ * @param table compiled table of @p pfm. Set to 0 to walk the PFM body in SPI flash.
+ * @param auth_cache authentication cache of the SPI flash. Set to 0 to always hash the SPI regions.
  * @return 1 if success else 0
  */
-static alt_u32 is_pfm_body_valid(alt_u32* pfm_body_ptr)
+static alt_u32 is_pfm_body_valid(PFM* pfm, PFM_REGION_TABLE* table, SPI_REGION_AUTH_CACHE* auth_cache)
 {
-    // Go through the PFM Body
-    while (1)
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, table, pfm);
+    PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter);
+    while (entry)
     {
-        alt_u8 def_type = *((alt_u8*) pfm_body_ptr);
-        if (def_type == SMBUS_RULE_DEF_TYPE)
-        {
-            PFM_SMBUS_RULE_DEF* rule_def = (PFM_SMBUS_RULE_DEF*) pfm_body_ptr;
-            if (!is_smbus_rule_valid(rule_def))
-            {
-                return 0;
-            }
-            pfm_body_ptr = incr_alt_u32_ptr(pfm_body_ptr, SMBUS_RULE_DEF_SIZE);
-        }
-        else if (def_type == SPI_REGION_DEF_TYPE)
+        alt_u32* def_ptr = get_pfm_region_def(&iter, entry);
+        if (entry->flags & PFM_REGION_TABLE_FLAG_SMBUS_RULE)
         {
-            PFM_SPI_REGION_DEF* region_def = (PFM_SPI_REGION_DEF*) pfm_body_ptr;
-            if (!is_spi_region_valid(region_def))
+            if (!is_smbus_rule_valid((PFM_SMBUS_RULE_DEF*) def_ptr))
             {
                 return 0;
             }
-            pfm_body_ptr = get_end_of_spi_region_def(region_def);
         }
-        else
+        else if (!is_spi_region_valid_with_auth_cache(entry, (PFM_SPI_REGION_DEF*) def_ptr, auth_cache))
         {
-            // Break when there is no more region/rule definition in PFM body
-            break;
+            return 0;
         }
+        entry = get_next_pfm_region(&iter);
     }
 
     return 1;
@@ -127,14 +161,16 @@ static alt_u32 is_pfm_body_valid(alt_u32* pfm_body_ptr)
  * @brief Perform validation on a PFM data
  *
  * @param pfm_ptr a pointer to the start of a PFM data
+ * @param table compiled table of @p pfm. Set to 0 to walk the PFM body in SPI flash.
+ * @param auth_cache authentication cache of the SPI flash. Set to 0 to always hash the SPI regions.
  * @return 1 if success else 0
  */
-static alt_u32 is_pfm_valid(PFM* pfm)
+static alt_u32 is_pfm_valid(PFM* pfm, PFM_REGION_TABLE* table, SPI_REGION_AUTH_CACHE* auth_cache)
 {
     if (pfm->tag == PFM_MAGIC)
     {
         // Iterate through PFM SPI region and SMBus rule definitions and validate them
-        return is_pfm_body_valid(pfm->pfm_body);
+        return is_pfm_body_valid(pfm, table, auth_cache);
     }
 
     return 0;
@@ -152,7 +188,55 @@ static alt_u32 is_active_region_valid(alt_u32* active_addr)
 {
     // Verify the signature of the PFM first, then SPI region definitions and other content in PFM.
     return is_signature_valid((KCH_SIGNATURE*) active_addr) &&
-            is_pfm_valid((PFM*) incr_alt_u32_ptr(active_addr, SIGNATURE_SIZE));
+            is_pfm_valid((PFM*) incr_alt_u32_ptr(active_addr, SIGNATURE_SIZE), 0, 0);
+}
+
+/**
+ * @brief Perform validation on the active region PFM of the given SPI flash device.
+ * This is the same as is_active_region_valid(), except that static SPI regions which
+ * have been authenticated against the same PFM in a previous T-1 cycle are not hashed again.
+ *
+ * The cached results are only used while the SPI filter of this flash device is enabled.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ * @return 1 if the active region is valid; 0, otherwise.
+ *
+ * @see spi_region_auth_cache.h
+ * @see pfm_region_table.h
+ */
+static alt_u32 is_active_region_valid_with_auth_cache(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    alt_u32* active_addr = get_spi_active_pfm_ptr(spi_flash_type);
+    KCH_SIGNATURE* active_pfm_sig = (KCH_SIGNATURE*) active_addr;
+
+    // Verify the signature of the PFM first. The PFM hash in Block 0 can be trusted afterwards.
+    if (!is_signature_valid(active_pfm_sig))
+    {
+        invalidate_pfm_region_table();
+        return 0;
+    }
+
+    SPI_REGION_AUTH_CACHE* auth_cache = 0;
+    if (is_spi_region_auth_cache_usable(spi_flash_type))
+    {
+        prepare_spi_region_auth_cache(spi_flash_type, active_pfm_sig->b0.pc_hash256);
+        auth_cache = get_spi_region_auth_cache(spi_flash_type);
+    }
+    else
+    {
+        invalidate_spi_region_auth_cache(spi_flash_type);
+    }
+
+    // The PFM body is only read from flash once per PFM. Later T-1 cycles and the other users go through its table.
+    PFM* active_pfm = (PFM*) incr_alt_u32_ptr(active_addr, SIGNATURE_SIZE);
+    PFM_REGION_TABLE* table = prepare_pfm_region_table(active_pfm, active_pfm_sig->b0.pc_hash256);
+
+    if (!is_pfm_valid(active_pfm, table, auth_cache))
+    {
+        invalidate_pfm_region_table();
+        return 0;
+    }
+    return 1;
 }
 
 
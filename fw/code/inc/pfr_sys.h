@@ -141,6 +141,12 @@ typedef enum
 #define BMC_CPLD_RECOVERY_IMAGE_OFFSET 0x7F00000
 #define BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM (BMC_CPLD_RECOVERY_IMAGE_OFFSET >> 19)
 
+// Reserved area for the PIT L2 chunk hash tables (only used in chunked firmware sealing)
+// This is a hard-coded value. It's the 64KB right below the CPLD recovery image. The BMC flash layout must leave
+// this area out of every SPI region that Nios erases (e.g. recovered regions and CPLD recovery image).
+#define BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET 0x7EF0000
+#define BMC_PIT_L2_CHUNK_HASH_TABLE_SIZE 0x10000
+
 /*******************************************************************
  * CPLD Update Settings
  *******************************************************************/
@@ -164,6 +170,10 @@ typedef enum
 // so we are using a whole sector to store the CPLD update status word
 #define UFM_CPLD_UPDATE_STATUS_SECTOR_ID 0b010
 
+// The rest of that sector, from its second page, stores the decompression checkpoint journal
+#define UFM_DECOMPRESSION_CHECKPOINT_OFFSET (U_UFM_DATA_SECTOR2_START_ADDR + UFM_FLASH_PAGE_SIZE)
+#define UFM_DECOMPRESSION_CHECKPOINT_SIZE (U_UFM_DATA_SECTOR2_END_ADDR + 1 - UFM_DECOMPRESSION_CHECKPOINT_OFFSET)
+
 // CFM
 typedef enum
 {
@@ -23,6 +23,12 @@
 /**
  * @file pit_utils.h
  * @brief Responsible to support Protect-in-Transit feature.
+ *
+ * In PIT L2 (Firmware Sealing), Nios stores one hash for the entire PCH flash and one hash for the entire
+ * BMC flash in UFM. Alternatively, in chunked firmware sealing, Nios hashes each 1MB chunk of the flash
+ * separately and stores these chunk hashes in a reserved area of BMC flash. Only the Merkle root of each
+ * chunk hash table (i.e. hash of all the chunk hashes) is stored in UFM. Upon mismatch, Nios can then
+ * report the first chunk that has changed.
  */
 
 #ifndef WHITLEY_INC_PIT_UTILS_H_
@@ -33,6 +39,7 @@
 
 #include "crypto.h"
 #include "pfr_pointers.h"
+#include "platform_log.h"
 #include "rfnvram_utils.h"
 #include "spi_rw_utils.h"
 #include "timer_utils.h"
@@ -69,6 +76,193 @@ static void perform_pit_l1_check()
     }
 }
 
+// Size of a SPI flash chunk in chunked firmware sealing
+#define PIT_L2_CHUNK_SIZE 0x100000
+// Number of bytes sent to the crypto block between watchdog resets
+#define PIT_L2_HASH_SLICE_SIZE 0x10000
+
+// Chunk hash tables in BMC flash. Each table starts at a 4KB boundary.
+#define PIT_L2_PCH_CHUNK_HASH_TABLE_OFFSET BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET
+#define PIT_L2_BMC_CHUNK_HASH_TABLE_OFFSET (BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET + SPI_FLASH_PAGE_SIZE_OF_4KB)
+
+/**
+ * @brief Return the number of chunks in the given flash device.
+ */
+static alt_u32 get_pit_l2_num_chunks(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return BMC_SPI_FLASH_SIZE / PIT_L2_CHUNK_SIZE;
+    }
+    return PCH_SPI_FLASH_SIZE / PIT_L2_CHUNK_SIZE;
+}
+
+/**
+ * @brief Return the offset (in BMC flash) of the chunk hash table for the given flash device.
+ */
+static alt_u32 get_pit_l2_chunk_hash_table_offset(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return PIT_L2_BMC_CHUNK_HASH_TABLE_OFFSET;
+    }
+    return PIT_L2_PCH_CHUNK_HASH_TABLE_OFFSET;
+}
+
+/**
+ * @brief Return 1 if the slice at @p slice_addr of the given flash device is the reserved area for chunk hash tables.
+ * The reserved area is exactly one slice (PIT_L2_HASH_SLICE_SIZE) and it's aligned to a slice.
+ */
+static alt_u32 is_pit_l2_chunk_hash_table_slice(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 slice_addr)
+{
+    return (spi_flash_type == SPI_FLASH_BMC) && (slice_addr == BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET);
+}
+
+/**
+ * @brief Hash a chunk of the given flash device, in slices, so that the HW watchdog
+ * can be reset periodically. The reserved area for chunk hash tables is excluded from the hash.
+ *
+ * Nios must have selected @p spi_flash_type before calling this function.
+ *
+ * @param ctx the SHA context
+ * @param spi_flash_type indicate BMC or PCH flash
+ * @param chunk_i index of the chunk
+ */
+static void hash_pit_l2_chunk(CRYPTO_SHA_CONTEXT* ctx, SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 chunk_i)
+{
+    alt_u32 chunk_addr = chunk_i * PIT_L2_CHUNK_SIZE;
+    alt_u32 chunk_size = PIT_L2_CHUNK_SIZE;
+    if ((spi_flash_type == SPI_FLASH_BMC) && (chunk_addr <= BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET) &&
+            (BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET < chunk_addr + PIT_L2_CHUNK_SIZE))
+    {
+        chunk_size -= BMC_PIT_L2_CHUNK_HASH_TABLE_SIZE;
+    }
+
+    sha_init(ctx, chunk_size);
+    for (alt_u32 slice_offset = 0; slice_offset < PIT_L2_CHUNK_SIZE; slice_offset += PIT_L2_HASH_SLICE_SIZE)
+    {
+        if (is_pit_l2_chunk_hash_table_slice(spi_flash_type, chunk_addr + slice_offset))
+        {
+            continue;
+        }
+        sha_update(ctx, get_spi_flash_ptr_with_offset(chunk_addr + slice_offset), PIT_L2_HASH_SLICE_SIZE);
+        reset_hw_watchdog();
+    }
+}
+
+/**
+ * @brief Seal the firmware in the given flash device with chunk hashes.
+ *
+ * Nios writes the hash of each chunk to the chunk hash table in BMC flash. Then, Nios saves the
+ * Merkle root (i.e. hash of the chunk hash table) to UFM.
+ *
+ * @param spi_flash_type indicate BMC or PCH flash
+ * @param ufm_root_hash pointer to the firmware hash in UFM
+ */
+static void seal_pit_l2_fw_chunks(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32* ufm_root_hash)
+{
+    alt_u32 table_offset = get_pit_l2_chunk_hash_table_offset(spi_flash_type);
+    alt_u32 table_size = get_pit_l2_num_chunks(spi_flash_type) * PFR_CRYPTO_LENGTH;
+
+    switch_spi_flash(SPI_FLASH_BMC);
+    erase_spi_region(table_offset, table_size);
+
+    for (alt_u32 chunk_i = 0; chunk_i < get_pit_l2_num_chunks(spi_flash_type); chunk_i++)
+    {
+        CRYPTO_SHA_CONTEXT sha_ctx;
+        alt_u32 chunk_hash[PFR_CRYPTO_LENGTH / 4];
+
+        switch_spi_flash(spi_flash_type);
+        hash_pit_l2_chunk(&sha_ctx, spi_flash_type, chunk_i);
+        sha_final_and_save(&sha_ctx, chunk_hash);
+
+        // Write the chunk hash to the table
+        switch_spi_flash(SPI_FLASH_BMC);
+        alt_u32* table_entry_ptr = get_spi_flash_ptr_with_offset(table_offset + chunk_i * PFR_CRYPTO_LENGTH);
+        for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+        {
+            table_entry_ptr[word_i] = chunk_hash[word_i];
+            poll_status_reg_done();
+        }
+    }
+
+    // Save the Merkle root in UFM
+    calculate_and_save_sha(ufm_root_hash, get_spi_flash_ptr_with_offset(table_offset), table_size);
+}
+
+/**
+ * @brief Verify the chunk hashes of the given flash device against its firmware seal.
+ *
+ * Nios first verifies the chunk hash table against the Merkle root in UFM. Then, Nios hashes each chunk
+ * and compares it against the table. Nios stops at the first chunk that doesn't match.
+ *
+ * @param spi_flash_type indicate BMC or PCH flash
+ * @param ufm_root_hash pointer to the firmware hash in UFM
+ * @param mismatched_chunk_i set to the index of the first mismatched chunk, or MINOR_ERROR_PIT_L2_CHUNK_HASH_TABLE_MISMATCH
+ *
+ * @return 1 if all the chunks match the seal; 0, otherwise
+ */
+static alt_u32 is_pit_l2_fw_chunks_valid(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32* ufm_root_hash, alt_u32* mismatched_chunk_i)
+{
+    alt_u32 table_offset = get_pit_l2_chunk_hash_table_offset(spi_flash_type);
+
+    switch_spi_flash(SPI_FLASH_BMC);
+    if (!verify_sha(ufm_root_hash, get_spi_flash_ptr_with_offset(table_offset), get_pit_l2_num_chunks(spi_flash_type) * PFR_CRYPTO_LENGTH))
+    {
+        *mismatched_chunk_i = MINOR_ERROR_PIT_L2_CHUNK_HASH_TABLE_MISMATCH;
+        return 0;
+    }
+
+    for (alt_u32 chunk_i = 0; chunk_i < get_pit_l2_num_chunks(spi_flash_type); chunk_i++)
+    {
+        CRYPTO_SHA_CONTEXT sha_ctx;
+        alt_u32 expected_chunk_hash[PFR_CRYPTO_LENGTH / 4];
+
+        // Read the expected chunk hash from the table
+        switch_spi_flash(SPI_FLASH_BMC);
+        alt_u32_memcpy(expected_chunk_hash, get_spi_flash_ptr_with_offset(table_offset + chunk_i * PFR_CRYPTO_LENGTH), PFR_CRYPTO_LENGTH);
+
+        switch_spi_flash(spi_flash_type);
+        hash_pit_l2_chunk(&sha_ctx, spi_flash_type, chunk_i);
+        if (!sha_final_and_verify(&sha_ctx, expected_chunk_hash))
+        {
+            *mismatched_chunk_i = chunk_i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Verify the firmware in the given flash device against its firmware seal.
+ * In chunked firmware sealing, the first mismatched chunk is reported in the minor error code.
+ *
+ * @param spi_flash_type indicate BMC or PCH flash
+ * @param ufm_fw_hash pointer to the firmware hash in UFM
+ *
+ * @return 1 if the firmware matches the seal; 0, otherwise
+ */
+static alt_u32 is_pit_l2_fw_seal_valid(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32* ufm_fw_hash)
+{
+    if (check_ufm_status(UFM_STATUS_PIT_L2_CHUNKED_BIT_MASK))
+    {
+        alt_u32 mismatched_chunk_i = 0;
+        if (!is_pit_l2_fw_chunks_valid(spi_flash_type, ufm_fw_hash, &mismatched_chunk_i))
+        {
+            log_errors(MAJOR_ERROR_PIT_L2_FW_SEAL_MISMATCH, mismatched_chunk_i);
+            return 0;
+        }
+        return 1;
+    }
+
+    switch_spi_flash(spi_flash_type);
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return verify_sha(ufm_fw_hash, get_spi_flash_ptr(), BMC_SPI_FLASH_SIZE);
+    }
+    return verify_sha(ufm_fw_hash, get_spi_flash_ptr(), PCH_SPI_FLASH_SIZE);
+}
+
 /**
  * @brief If the PIT L2 is enabled and firmware hashes are stored, enforce the Firmware Sealing
  * protection. If the PIT L2 is enabled but firmware hashes have not been stored, Nios calculates
@@ -92,8 +286,7 @@ static void perform_pit_l2_check()
 
                 // Compute PCH firmware hash
                 // If the hash doesn't match the stored hash, hang in T-1
-                switch_spi_flash(SPI_FLASH_PCH);
-                if (!verify_sha(ufm_data->pit_pch_fw_hash, get_spi_flash_ptr(), PCH_SPI_FLASH_SIZE))
+                if (!is_pit_l2_fw_seal_valid(SPI_FLASH_PCH, ufm_data->pit_pch_fw_hash))
                 {
                     // Remain in T-1 mode if there's a hash mismatch
                     log_platform_state(PLATFORM_STATE_PIT_L2_PCH_HASH_MISMATCH_LOCKDOWN);
@@ -102,8 +295,7 @@ static void perform_pit_l2_check()
 
                 // Compute BMC firmware hash
                 // If the hash doesn't match the stored hash, hang in T-1
-                switch_spi_flash(SPI_FLASH_BMC);
-                if (!verify_sha(ufm_data->pit_bmc_fw_hash, get_spi_flash_ptr(), BMC_SPI_FLASH_SIZE))
+                if (!is_pit_l2_fw_seal_valid(SPI_FLASH_BMC, ufm_data->pit_bmc_fw_hash))
                 {
                     // Remain in T-1 mode if there's a hash mismatch
                     log_platform_state(PLATFORM_STATE_PIT_L2_BMC_HASH_MISMATCH_LOCKDOWN);
@@ -119,13 +311,22 @@ static void perform_pit_l2_check()
             else
             {
                 // Pending PIT hash to be stored
-                // Compute and store PCH flash hash
-                switch_spi_flash(SPI_FLASH_PCH);
-                calculate_and_save_sha(ufm_data->pit_pch_fw_hash, get_spi_flash_ptr(), PCH_SPI_FLASH_SIZE);
+                if (check_ufm_status(UFM_STATUS_PIT_L2_CHUNKED_BIT_MASK))
+                {
+                    // Compute and store chunk hashes for both flashes
+                    seal_pit_l2_fw_chunks(SPI_FLASH_PCH, ufm_data->pit_pch_fw_hash);
+                    seal_pit_l2_fw_chunks(SPI_FLASH_BMC, ufm_data->pit_bmc_fw_hash);
+                }
+                else
+                {
+                    // Compute and store PCH flash hash
+                    switch_spi_flash(SPI_FLASH_PCH);
+                    calculate_and_save_sha(ufm_data->pit_pch_fw_hash, get_spi_flash_ptr(), PCH_SPI_FLASH_SIZE);
 
-                // Compute and store BMC flash hash
-                switch_spi_flash(SPI_FLASH_BMC);
-                calculate_and_save_sha(ufm_data->pit_bmc_fw_hash, get_spi_flash_ptr(), BMC_SPI_FLASH_SIZE);
+                    // Compute and store BMC flash hash
+                    switch_spi_flash(SPI_FLASH_BMC);
+                    calculate_and_save_sha(ufm_data->pit_bmc_fw_hash, get_spi_flash_ptr(), BMC_SPI_FLASH_SIZE);
+                }
 
                 // Indicate that the firmware hashes have been stored
                 set_ufm_status(UFM_STATUS_PIT_HASH_STORED_BIT_MASK);
@@ -31,18 +31,32 @@
 #include "pfr_sys.h"
 
 #include "global_state.h"
+#include "io_counters.h"
 #include "mailbox_utils.h"
+#include "tmin1_profile.h"
 #include "watchdog_timers.h"
 
 
 /**
  * @brief This function logs platform state to mailbox and
  * global state (which drives the 7-seg display content on platform).
+ * The entries to T-1 and T0 also start and end the T-1 profile and I/O counters.
  */
 static void log_platform_state(const STATUS_PLATFORM_STATE_ENUM state)
 {
     write_to_mailbox(MB_PLATFORM_STATE, (alt_u32) state);
     set_global_state(state);
+
+    if (state == PLATFORM_STATE_ENTER_TMIN1)
+    {
+        start_tmin1_profile();
+        reset_io_counters();
+    }
+    else if (state == PLATFORM_STATE_ENTER_T0)
+    {
+        finish_tmin1_profile();
+        publish_io_counters();
+    }
 }
 
 /**
@@ -23,6 +23,13 @@
 /**
  * @file smbus_relay_utils.h
  * @brief Responsible for configuring SMBus relays.
+ *
+ * Nios remembers the hash of the BMC PFM that the SMBus rules were last applied from. If the BMC PFM hasn't
+ * changed since the last time, nothing is written to the command enable memories. Otherwise, the whitelists of
+ * the new PFM are written and the rules that are gone are cleared.
+ *
+ * The command enable memories are write-only for Nios. Nios remembers which words of each whitelist are not 0,
+ * so that a word that is 0 in both the old and new whitelist is not written.
  */
 
 #ifndef WHITLEY_INC_SMBUS_UTILS_H_
@@ -34,7 +41,32 @@
 #include "gen_gpo_controls.h"
 #include "pfm.h"
 #include "pfr_pointers.h"
+#include "utils.h"
+
+typedef struct
+{
+    // Hash of the BMC PFM that the command whitelists were applied from; all 0s if it's unknown.
+    alt_u32 pfm_hash[PFR_CRYPTO_LENGTH / 4];
+    // Bit (rule ID - 1) of a relay is set if that rule has been applied in an ongoing update
+    alt_u32 updated_rules[NUM_RELAYS];
+    // Bit i is set if word i of the whitelist of that relay and rule ID is not 0 in the command enable memory
+    alt_u8 nonzero_words[NUM_RELAYS][MAX_I2C_ADDRESSES_PER_RELAY];
+} SMBUS_RELAY_APPLIED_RULES;
+
+// Static variable to track the rules in the SMBus relays' command enable memory
+static SMBUS_RELAY_APPLIED_RULES smbus_relay_applied_rules;
 
+/**
+ * @brief Forget the applied SMBus rules. This must be done along with clearing the command enable memories.
+ */
+static void reset_smbus_relay_applied_rules()
+{
+    alt_u32* rules_ptr = (alt_u32*) &smbus_relay_applied_rules;
+    for (alt_u32 word_i = 0; word_i < (sizeof(SMBUS_RELAY_APPLIED_RULES) / 4); word_i++)
+    {
+        rules_ptr[word_i] = 0;
+    }
+}
 
 /**
  * @brief Set/Clear FILTER_DISABLE bit for all relays
@@ -75,11 +107,42 @@ static void init_smbus_relays()
         relay2_mem[i] = 0;
         relay3_mem[i] = 0;
     }
+    reset_smbus_relay_applied_rules();
 
     // Disable SMBus filtering in system initialization
     set_filter_disable_all(1);
 }
 
+/**
+ * @brief Start applying the SMBus rules of the BMC PFM.
+ *
+ * @param pfm_hash hash of the authenticated BMC PFM; 0 if it's unknown
+ * @return 1 if the rules must be applied; 0 if they have already been applied from this PFM.
+ *
+ * @see finish_smbus_rules_update
+ */
+static alt_u32 start_smbus_rules_update(alt_u32* pfm_hash)
+{
+    if (pfm_hash)
+    {
+        alt_u32 is_same_pfm = 1;
+        for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+        {
+            is_same_pfm &= (smbus_relay_applied_rules.pfm_hash[word_i] == pfm_hash[word_i]);
+        }
+        if (is_same_pfm)
+        {
+            return 0;
+        }
+    }
+
+    for (alt_u32 relay_i = 0; relay_i < NUM_RELAYS; relay_i++)
+    {
+        smbus_relay_applied_rules.updated_rules[relay_i] = 0;
+    }
+    return 1;
+}
+
 /**
  * @brief Extract command whitelist from the PFM SMBus rule definition and copy it to
  * the relay's command enable memory.
@@ -90,6 +153,9 @@ static void init_smbus_relays()
  * lowest address of the command enable memory. The whiltelist of rule ID 2 is located
  * immediately after that and so on.
  *
+ * The whitelist is written word by word. A word that is 0 in both the old and new whitelist is skipped.
+ * The filters can stay enabled, since no command that is allowed by both the old and new rule is blocked.
+ *
  * @param rule_def SMBus rule definition
  */
 static void apply_smbus_rule(PFM_SMBUS_RULE_DEF* rule_def)
@@ -97,9 +163,71 @@ static void apply_smbus_rule(PFM_SMBUS_RULE_DEF* rule_def)
     alt_u32 rule_offset = (rule_def->rule_id - 1) * SMBUS_NUM_BYTE_IN_WHITELIST;
     alt_u32* base_addr = get_relay_base_ptr(rule_def->bus_id);
     base_addr = incr_alt_u32_ptr(base_addr, rule_offset);
+    alt_u32* cmd_whitelist = (alt_u32*) rule_def->cmd_whitelist;
+
+    alt_u32 relay_i = rule_def->bus_id - 1;
+    alt_u32 rule_i = rule_def->rule_id - 1;
+    if ((relay_i < NUM_RELAYS) && (rule_i < MAX_I2C_ADDRESSES_PER_RELAY))
+    {
+        alt_u8* nonzero_words = &smbus_relay_applied_rules.nonzero_words[relay_i][rule_i];
+        alt_u8 new_nonzero_words = 0;
+        for (alt_u32 word_i = 0; word_i < (SMBUS_NUM_BYTE_IN_WHITELIST / 4); word_i++)
+        {
+            if (cmd_whitelist[word_i] || (*nonzero_words & (0b1 << word_i)))
+            {
+                base_addr[word_i] = cmd_whitelist[word_i];
+            }
+            if (cmd_whitelist[word_i])
+            {
+                new_nonzero_words |= (0b1 << word_i);
+            }
+        }
+        *nonzero_words = new_nonzero_words;
+        smbus_relay_applied_rules.updated_rules[relay_i] |= (0b1 << rule_i);
+    }
+    else
+    {
+        // Memcpy the entire command whitelist to the specific location in the command enable memory.
+        alt_u32_memcpy(base_addr, cmd_whitelist, SMBUS_NUM_BYTE_IN_WHITELIST);
+    }
+}
 
-    // Memcpy the entire command whitelist to the specific location in the command enable memory.
-    alt_u32_memcpy(base_addr, (alt_u32*) rule_def->cmd_whitelist, SMBUS_NUM_BYTE_IN_WHITELIST);
+/**
+ * @brief Finish applying the SMBus rules of the BMC PFM.
+ * Rules that came from the previous BMC PFM, but are not in this one, are cleared. Clearing a
+ * whitelist only blocks more commands, so this is done after the new rules are in place.
+ *
+ * @param pfm_hash hash of the authenticated BMC PFM; 0 if it's unknown
+ */
+static void finish_smbus_rules_update(alt_u32* pfm_hash)
+{
+    for (alt_u32 relay_i = 0; relay_i < NUM_RELAYS; relay_i++)
+    {
+        for (alt_u32 rule_i = 0; rule_i < MAX_I2C_ADDRESSES_PER_RELAY; rule_i++)
+        {
+            if (smbus_relay_applied_rules.updated_rules[relay_i] & (0b1 << rule_i))
+            {
+                continue;
+            }
+
+            // Only the words that are not 0 need to be cleared
+            alt_u8* nonzero_words = &smbus_relay_applied_rules.nonzero_words[relay_i][rule_i];
+            alt_u32* base_addr = incr_alt_u32_ptr(get_relay_base_ptr(relay_i + 1), rule_i * SMBUS_NUM_BYTE_IN_WHITELIST);
+            for (alt_u32 word_i = 0; word_i < (SMBUS_NUM_BYTE_IN_WHITELIST / 4); word_i++)
+            {
+                if (*nonzero_words & (0b1 << word_i))
+                {
+                    base_addr[word_i] = 0;
+                }
+            }
+            *nonzero_words = 0;
+        }
+    }
+
+    for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+    {
+        smbus_relay_applied_rules.pfm_hash[word_i] = pfm_hash ? pfm_hash[word_i] : 0;
+    }
 }
 
 #endif /* WHITLEY_INC_SMBUS_UTILS_H_ */
@@ -69,12 +69,16 @@ typedef enum
     SPI_CMD_EXIT_4B_ADDR_MODE = 0xE9,
     // 4KB sector erase
     SPI_CMD_4KB_SECTOR_ERASE = 0x20,
+    // 32KB sector erase
+    SPI_CMD_32KB_SECTOR_ERASE = 0x52,
     // 64KB sector erase
     SPI_CMD_64KB_SECTOR_ERASE = 0xD8,
     // Read status reg
     SPI_CMD_READ_STATUS_REG = 0x05,
     // Read flash device chip ID
     SPI_CMD_READ_ID = 0x9F,
+    // Read Serial Flash Discoverable Parameters (SFDP)
+    SPI_CMD_READ_SFDP = 0x5A,
 } SPI_COMMAND_ENUM;
 
 /**
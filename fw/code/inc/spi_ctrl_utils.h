@@ -50,10 +50,79 @@ static void reset_spi_flash(alt_u32 spi_flash_rst_n_gpo)
     sleep_20ms(1);
 }
 
+/**
+ * @brief Read a DWORD from the Serial Flash Discoverable Parameters (SFDP) of the current flash device.
+ *
+ * @param sfdp_addr byte address in the SFDP address space
+ * @return the DWORD at @p sfdp_addr
+ */
+static alt_u32 read_sfdp_dword(alt_u32 sfdp_addr)
+{
+    // 8 dummy cycles, 4 data bytes, read data, 3 address bytes, Read SFDP command
+    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_SETTING_OFST, 0x84B00 | SPI_CMD_READ_SFDP);
+    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_ADDRESS_OFST, sfdp_addr);
+    trigger_spi_send_cmd();
+    return read_from_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_READ_DATA0_OFST);
+}
+
+/**
+ * @brief Read the Basic Flash Parameter Table (BFPT) from the given flash device and save its capabilities.
+ * This is only done once for each flash device. If the flash device doesn't have SFDP, Nios keeps
+ * using the default settings.
+ *
+ * The SPI control block is configured with the new read instruction afterwards.
+ *
+ * @param spi_flash_type indicates BMC or PCH flash
+ *
+ * @see parse_sfdp_bfpt
+ */
+static void discover_spi_flash_caps(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    SPI_FLASH_CAPS* caps = get_spi_flash_caps(spi_flash_type);
+    if (caps->is_discovered)
+    {
+        return;
+    }
+    caps->is_discovered = 1;
+
+    switch_spi_flash(spi_flash_type);
+
+    // SFDP is always read in single I/O mode
+    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST, 0x00000);
+    if (read_sfdp_dword(0) == SFDP_SIGNATURE)
+    {
+        // The first parameter header points to the BFPT. Its ID is 0xFF00.
+        alt_u32 param_header_dw1 = read_sfdp_dword(SFDP_FIRST_PARAM_HEADER_ADDR);
+        alt_u32 param_header_dw2 = read_sfdp_dword(SFDP_FIRST_PARAM_HEADER_ADDR + 4);
+        alt_u32 num_dwords = param_header_dw1 >> 24;
+        if (((param_header_dw1 & 0xFF) == 0x00) && ((param_header_dw2 >> 24) == 0xFF) &&
+                (num_dwords >= SFDP_BFPT_MIN_NUM_DWORDS))
+        {
+            if (num_dwords > SFDP_BFPT_MAX_NUM_DWORDS)
+            {
+                num_dwords = SFDP_BFPT_MAX_NUM_DWORDS;
+            }
+
+            alt_u32 bfpt[SFDP_BFPT_MAX_NUM_DWORDS];
+            alt_u32 bfpt_addr = param_header_dw2 & 0xFFFFFF;
+            for (alt_u32 dword_i = 0; dword_i < num_dwords; dword_i++)
+            {
+                bfpt[dword_i] = read_sfdp_dword(bfpt_addr + dword_i * 4);
+            }
+            parse_sfdp_bfpt(caps, get_spi_erase_time_table(spi_flash_type), bfpt, num_dwords);
+        }
+    }
+
+    // Restore the operating protocols and apply the new read instruction
+    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST, SPI_OPERATING_PROTOCOLS_DEFAULT);
+    switch_spi_flash(spi_flash_type);
+}
+
 /**
  * @brief Prepare for CPLD SPI master to drive the indicated SPI bus.
  * This function sets the appropriate GPO control bit and sends a command
- * to request flash device to enter 4-byte addressing mode.
+ * to request flash device to enter 4-byte addressing mode. The first time Nios
+ * drives this SPI bus, it also reads the SFDP of the flash device.
  *
  * The assumption here is that the external agent (e.g. BMC/PCH) is in reset.
  *
@@ -84,6 +153,9 @@ static void takeover_spi_ctrl(SPI_FLASH_TYPE_ENUM spi_flash_type)
     // Write enable command is required prior to sending the enter/exit 4-byte mode commands
     execute_one_byte_spi_cmd(SPI_CMD_WRITE_ENABLE);
     execute_one_byte_spi_cmd(SPI_CMD_ENTER_4B_ADDR_MODE);
+
+    // Read the erase times and read instruction of this flash device, when Nios first drives the SPI bus
+    discover_spi_flash_caps(spi_flash_type);
 }
 
 /**
@@ -0,0 +1,194 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file spi_erase_planner.h
+ * @brief Choose the sequence of erase commands that takes the least time to erase a SPI region.
+ *
+ * A SPI flash device supports erase commands of different sizes. The larger erase commands take
+ * longer, but less time per byte. Nios picks the erase commands for a SPI region based on the typical
+ * erase time of each command on the target flash device. An erase command must never erase data
+ * outside of the target SPI region.
+ */
+
+#ifndef WHITLEY_INC_SPI_ERASE_PLANNER_H_
+#define WHITLEY_INC_SPI_ERASE_PLANNER_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "spi_common.h"
+
+#define SPI_FLASH_PAGE_SIZE_OF_4KB 0x1000
+#define SPI_FLASH_PAGE_SIZE_OF_32KB 0x8000
+#define SPI_FLASH_PAGE_SIZE_OF_64KB 0x10000
+
+/**
+ * Typical time (in microseconds) of each erase command on a SPI flash device.
+ * A time of 0 indicates that the flash device doesn't support that erase command.
+ * All flash devices must support the 4KB erase.
+ */
+typedef struct
+{
+    alt_u32 erase_4kb_time_us;
+    alt_u32 erase_32kb_time_us;
+    alt_u32 erase_64kb_time_us;
+} SPI_ERASE_TIME_TABLE;
+
+// Typical erase times of the SPI flash devices on the reference platform.
+// These are used until the erase times have been read from the flash device.
+#define BMC_SPI_ERASE_TIME_TABLE_DEFAULT {50000, 110000, 150000}
+#define PCH_SPI_ERASE_TIME_TABLE_DEFAULT {30000, 150000, 280000}
+
+static SPI_ERASE_TIME_TABLE bmc_spi_erase_time_table = BMC_SPI_ERASE_TIME_TABLE_DEFAULT;
+static SPI_ERASE_TIME_TABLE pch_spi_erase_time_table = PCH_SPI_ERASE_TIME_TABLE_DEFAULT;
+
+/**
+ * @brief Return the erase time table of the given SPI flash device.
+ */
+static SPI_ERASE_TIME_TABLE* get_spi_erase_time_table(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return &bmc_spi_erase_time_table;
+    }
+    return &pch_spi_erase_time_table;
+}
+
+/**
+ * @brief Restore the default erase time table of the given SPI flash device.
+ */
+static void reset_spi_erase_time_table(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        SPI_ERASE_TIME_TABLE default_table = BMC_SPI_ERASE_TIME_TABLE_DEFAULT;
+        bmc_spi_erase_time_table = default_table;
+    }
+    else
+    {
+        SPI_ERASE_TIME_TABLE default_table = PCH_SPI_ERASE_TIME_TABLE_DEFAULT;
+        pch_spi_erase_time_table = default_table;
+    }
+}
+
+/**
+ * @brief Return the number of bytes erased by the given erase command.
+ */
+static alt_u32 get_spi_erase_size(SPI_COMMAND_ENUM erase_cmd)
+{
+    if (erase_cmd == SPI_CMD_64KB_SECTOR_ERASE)
+    {
+        return SPI_FLASH_PAGE_SIZE_OF_64KB;
+    }
+    if (erase_cmd == SPI_CMD_32KB_SECTOR_ERASE)
+    {
+        return SPI_FLASH_PAGE_SIZE_OF_32KB;
+    }
+    return SPI_FLASH_PAGE_SIZE_OF_4KB;
+}
+
+/**
+ * @brief Return the typical time (in microseconds) of the given erase command.
+ */
+static alt_u32 get_spi_erase_time_us(const SPI_ERASE_TIME_TABLE* erase_time_table, SPI_COMMAND_ENUM erase_cmd)
+{
+    if (erase_cmd == SPI_CMD_64KB_SECTOR_ERASE)
+    {
+        return erase_time_table->erase_64kb_time_us;
+    }
+    if (erase_cmd == SPI_CMD_32KB_SECTOR_ERASE)
+    {
+        return erase_time_table->erase_32kb_time_us;
+    }
+    return erase_time_table->erase_4kb_time_us;
+}
+
+/**
+ * @brief Return the least time (in microseconds) to erase an aligned 32KB block, using 4KB or 32KB erases.
+ */
+static alt_u32 get_min_spi_32kb_block_erase_time_us(const SPI_ERASE_TIME_TABLE* erase_time_table)
+{
+    alt_u32 time_us = 8 * erase_time_table->erase_4kb_time_us;
+    if (erase_time_table->erase_32kb_time_us && (erase_time_table->erase_32kb_time_us <= time_us))
+    {
+        time_us = erase_time_table->erase_32kb_time_us;
+    }
+    return time_us;
+}
+
+/**
+ * @brief Return the erase command that should be used at @p spi_addr, to erase [spi_addr, region_end_addr)
+ * in the least time, without erasing beyond @p region_end_addr.
+ *
+ * Erase sectors are aligned to their size. Hence, an aligned 64KB block is either erased by a 64KB erase
+ * or by the erase commands of its two 32KB halves, and similarly for a 32KB block. Nios picks the larger
+ * erase command when it is supported and takes no longer than erasing the smaller blocks one by one.
+ *
+ * @param spi_addr the next address to be erased. This is expected to be 4KB aligned.
+ * @param region_end_addr end address of the target SPI region
+ * @param erase_time_table erase time table of the target SPI flash
+ *
+ * @return a SPI command for 4KB, 32KB or 64KB erase
+ */
+static SPI_COMMAND_ENUM get_planned_spi_erase_cmd(
+        alt_u32 spi_addr, alt_u32 region_end_addr, const SPI_ERASE_TIME_TABLE* erase_time_table)
+{
+    alt_u32 remaining_nbytes = region_end_addr - spi_addr;
+    alt_u32 min_32kb_block_time_us = get_min_spi_32kb_block_erase_time_us(erase_time_table);
+
+    if ((remaining_nbytes >= SPI_FLASH_PAGE_SIZE_OF_64KB) && ((spi_addr & (SPI_FLASH_PAGE_SIZE_OF_64KB - 1)) == 0) &&
+            erase_time_table->erase_64kb_time_us && (erase_time_table->erase_64kb_time_us <= 2 * min_32kb_block_time_us))
+    {
+        return SPI_CMD_64KB_SECTOR_ERASE;
+    }
+    if ((remaining_nbytes >= SPI_FLASH_PAGE_SIZE_OF_32KB) && ((spi_addr & (SPI_FLASH_PAGE_SIZE_OF_32KB - 1)) == 0) &&
+            erase_time_table->erase_32kb_time_us && (erase_time_table->erase_32kb_time_us == min_32kb_block_time_us))
+    {
+        return SPI_CMD_32KB_SECTOR_ERASE;
+    }
+    return SPI_CMD_4KB_SECTOR_ERASE;
+}
+
+/**
+ * @brief Return the typical time (in microseconds) to erase [region_start_addr, region_end_addr) with the
+ * erase commands chosen by get_planned_spi_erase_cmd().
+ *
+ * @param region_start_addr start address of the target SPI region
+ * @param region_end_addr end address of the target SPI region
+ * @param erase_time_table erase time table of the target SPI flash
+ */
+static alt_u32 get_planned_spi_erase_time_us(
+        alt_u32 region_start_addr, alt_u32 region_end_addr, const SPI_ERASE_TIME_TABLE* erase_time_table)
+{
+    alt_u32 time_us = 0;
+    alt_u32 spi_addr = region_start_addr;
+    while (spi_addr < region_end_addr)
+    {
+        SPI_COMMAND_ENUM erase_cmd = get_planned_spi_erase_cmd(spi_addr, region_end_addr, erase_time_table);
+        time_us += get_spi_erase_time_us(erase_time_table, erase_cmd);
+        spi_addr += get_spi_erase_size(erase_cmd);
+    }
+    return time_us;
+}
+
+#endif /* WHITLEY_INC_SPI_ERASE_PLANNER_H_ */
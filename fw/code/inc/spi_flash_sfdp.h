@@ -0,0 +1,194 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file spi_flash_sfdp.h
+ * @brief Capabilities of the SPI flash devices, as described by their Serial Flash Discoverable Parameters (SFDP).
+ *
+ * Nios reads the Basic Flash Parameter Table (BFPT, JESD216) from each flash device once, when it first takes over
+ * the SPI bus. Nios then updates the erase time table used by the erase planner. When the board uses quad I/O
+ * (USE_QUAD_IO), Nios also takes the opcode and dummy cycles of 1-4-4 fast reads from the BFPT. The operating
+ * protocols of the SPI control block are never changed. Hence, other multi I/O read modes are not used.
+ *
+ * Until then, or when a flash device doesn't have SFDP, Nios uses the default settings below.
+ */
+
+#ifndef WHITLEY_INC_SPI_FLASH_SFDP_H_
+#define WHITLEY_INC_SPI_FLASH_SFDP_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "spi_common.h"
+#include "spi_erase_planner.h"
+
+#define SFDP_SIGNATURE 0x50444653
+
+// Address of the first parameter header in SFDP. JESD216 requires it to describe the BFPT.
+#define SFDP_FIRST_PARAM_HEADER_ADDR 0x8
+
+// BFPT from JESD216 has 9 DWORDs. Nios doesn't use any DWORD after the 16th (JESD216B).
+#define SFDP_BFPT_MIN_NUM_DWORDS 9
+#define SFDP_BFPT_MAX_NUM_DWORDS 16
+
+// 1-4-4 (command-address-data) fast read is supported, in BFPT DWORD 1
+#define SFDP_BFPT_DW1_144_FAST_READ_MASK 0x00200000
+
+#ifdef USE_QUAD_IO
+// Address and data of reads and writes are sent in quad I/O
+#define SPI_OPERATING_PROTOCOLS_DEFAULT 0x22220
+// opcode = 0xEB with dummy cycles of the respective flash device
+#define BMC_SPI_READ_INSTRUCTION_DEFAULT SPI_FLASH_QUAD_READ_PROTOCOL_MICRON
+#define PCH_SPI_READ_INSTRUCTION_DEFAULT SPI_FLASH_QUAD_READ_PROTOCOL_MACRONIX
+#else
+#define SPI_OPERATING_PROTOCOLS_DEFAULT 0x00000
+// opcode = 0x03 (read), no dummy cycles
+#define BMC_SPI_READ_INSTRUCTION_DEFAULT 0x00000003
+#define PCH_SPI_READ_INSTRUCTION_DEFAULT 0x00000003
+#endif
+
+typedef struct
+{
+    // 1 if Nios has attempted to read SFDP from this flash device
+    alt_u32 is_discovered;
+    // Value for the read instruction CSR (i.e. opcode and dummy cycles of memory mapped reads)
+    alt_u32 read_instruction;
+} SPI_FLASH_CAPS;
+
+static SPI_FLASH_CAPS bmc_spi_flash_caps = {0, BMC_SPI_READ_INSTRUCTION_DEFAULT};
+static SPI_FLASH_CAPS pch_spi_flash_caps = {0, PCH_SPI_READ_INSTRUCTION_DEFAULT};
+
+/**
+ * @brief Return the capabilities of the given SPI flash device.
+ */
+static SPI_FLASH_CAPS* get_spi_flash_caps(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return &bmc_spi_flash_caps;
+    }
+    return &pch_spi_flash_caps;
+}
+
+/**
+ * @brief Restore the default capabilities of the given SPI flash device. Nios will read SFDP again
+ * when it next takes over the SPI bus.
+ */
+static void reset_spi_flash_caps(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    SPI_FLASH_CAPS* caps = get_spi_flash_caps(spi_flash_type);
+    caps->is_discovered = 0;
+    caps->read_instruction = (spi_flash_type == SPI_FLASH_BMC) ?
+            BMC_SPI_READ_INSTRUCTION_DEFAULT : PCH_SPI_READ_INSTRUCTION_DEFAULT;
+
+    reset_spi_erase_time_table(spi_flash_type);
+}
+
+#ifdef USE_QUAD_IO
+/**
+ * @brief Use the 1-4-4 fast read mode described by the 16-bit field in BFPT DWORD 3.
+ * The field has the number of wait states in bits [4:0], the number of mode clocks in bits [7:5]
+ * and the opcode in bits [15:8]. The SPI control block sends the mode clocks as dummy cycles.
+ *
+ * @param caps pointer to the capabilities of the flash device
+ * @param read_mode_field the 16-bit field from BFPT
+ */
+static void set_sfdp_quad_fast_read_mode(SPI_FLASH_CAPS* caps, alt_u32 read_mode_field)
+{
+    alt_u32 dummy_cycles = (read_mode_field & 0x1F) + ((read_mode_field >> 5) & 0x7);
+    caps->read_instruction = (dummy_cycles << 8) | ((read_mode_field >> 8) & 0xFF);
+}
+#endif
+
+/**
+ * @brief Update the capabilities of a flash device and its erase time table from its BFPT.
+ *
+ * With USE_QUAD_IO, the board already relies on quad I/O (e.g. the QE bit is set). Nios then uses the
+ * opcode and dummy cycles of the 1-4-4 fast read mode, if the flash device supports it.
+ *
+ * Only erase types that match the erase commands used by Nios (i.e. 0x20, 0x52 and 0xD8) are used by the erase planner.
+ *
+ * @param caps pointer to the capabilities of the flash device
+ * @param erase_time_table pointer to the erase time table of the flash device
+ * @param bfpt pointer to the BFPT DWORDs read from the flash device
+ * @param num_dwords number of BFPT DWORDs in @p bfpt
+ */
+static void parse_sfdp_bfpt(SPI_FLASH_CAPS* caps, SPI_ERASE_TIME_TABLE* erase_time_table,
+        const alt_u32* bfpt, alt_u32 num_dwords)
+{
+#ifdef USE_QUAD_IO
+    /*
+     * Fast read mode
+     */
+    if (bfpt[0] & SFDP_BFPT_DW1_144_FAST_READ_MASK)
+    {
+        set_sfdp_quad_fast_read_mode(caps, bfpt[2] & 0xFFFF);
+    }
+#endif
+
+    /*
+     * Erase types
+     * BFPT DWORD 8 and 9 have the size (2^N bytes) and opcode of four erase types.
+     * BFPT DWORD 10 has the typical erase time of each erase type (JESD216A and later).
+     */
+    SPI_ERASE_TIME_TABLE sfdp_table = {erase_time_table->erase_4kb_time_us, 0, 0};
+    for (alt_u32 erase_type_i = 0; erase_type_i < 4; erase_type_i++)
+    {
+        alt_u32 erase_type = bfpt[7 + (erase_type_i >> 1)] >> ((erase_type_i & 1) * 16);
+        alt_u32 size_exp = erase_type & 0xFF;
+        alt_u32 opcode = (erase_type >> 8) & 0xFF;
+
+        alt_u32* time_us_ptr = 0;
+        alt_u32 default_time_us = 0;
+        if ((size_exp == 12) && (opcode == SPI_CMD_4KB_SECTOR_ERASE))
+        {
+            time_us_ptr = &sfdp_table.erase_4kb_time_us;
+            default_time_us = erase_time_table->erase_4kb_time_us;
+        }
+        else if ((size_exp == 15) && (opcode == SPI_CMD_32KB_SECTOR_ERASE))
+        {
+            time_us_ptr = &sfdp_table.erase_32kb_time_us;
+            default_time_us = erase_time_table->erase_32kb_time_us;
+        }
+        else if ((size_exp == 16) && (opcode == SPI_CMD_64KB_SECTOR_ERASE))
+        {
+            time_us_ptr = &sfdp_table.erase_64kb_time_us;
+            default_time_us = erase_time_table->erase_64kb_time_us;
+        }
+
+        if (time_us_ptr)
+        {
+            *time_us_ptr = default_time_us;
+            if (num_dwords >= 10)
+            {
+                // Each erase time has a count in bits [4:0] and units in bits [6:5]: 1ms, 16ms, 128ms or 1s
+                alt_u32 time_field = (bfpt[9] >> (4 + 7 * erase_type_i)) & 0x7F;
+                alt_u32 units = time_field >> 5;
+                alt_u32 unit_us = (units == 0) ? 1000 : (units == 1) ? 16000 : (units == 2) ? 128000 : 1000000;
+                *time_us_ptr = ((time_field & 0x1F) + 1) * unit_us;
+            }
+        }
+    }
+    *erase_time_table = sfdp_table;
+}
+
+#endif /* WHITLEY_INC_SPI_FLASH_SFDP_H_ */
@@ -0,0 +1,284 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file spi_region_auth_cache.h
+ * @brief Cache the authentication results of write-protected static SPI regions across T-1 cycles.
+ *
+ * In T0, static SPI regions are write protected by the SPI filter. Their content can only be
+ * changed by Nios (e.g. during recovery or update in T-1). Hence, once a static region passed the
+ * hash check against an authentic PFM, Nios can skip re-hashing it in subsequent T-1 cycles, as long as:
+ *   - the active PFM is still the same (compared by the PFM hash from its authenticated Block 0),
+ *   - Nios has not erased any part of the region, and
+ *   - no part of the region has ever been made writable in the SPI filter, and
+ *   - the flash device has not gone through a watchdog timer recovery or an unexpected (i.e. BMC) reset.
+ *
+ * The cache also holds the authenticated staging capsule of a firmware update, while its recovery update is
+ * pending. Nios write protects that capsule until the recovery update. In the T-1 cycle of the recovery update,
+ * the capsule is trusted without hashing it again, if the write enable memory shows that it has been read-only since.
+ *
+ * The cache only lives in RAM, so it's empty after every power cycle and CPLD reconfiguration.
+ */
+
+#ifndef WHITLEY_INC_SPI_REGION_AUTH_CACHE_H_
+#define WHITLEY_INC_SPI_REGION_AUTH_CACHE_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "gen_gpo_controls.h"
+#include "spi_common.h"
+#include "spi_we_mem_shadow.h"
+#include "utils.h"
+
+// Maximum number of authenticated static SPI regions tracked per flash device.
+// The caches share the Nios RAM with code, stack and other data. Any other static region is hashed in every T-1 cycle.
+#define SPI_REGION_AUTH_CACHE_MAX_ENTRIES 8
+
+// The SPI filter write enable memory has 1 bit per 16KB page
+#define SPI_REGION_AUTH_CACHE_WE_PAGE_MASK 0x3FFF
+
+typedef struct
+{
+    // Hash of the active PFM, against which the cached SPI regions were authenticated
+    alt_u32 pfm_hash[PFR_CRYPTO_LENGTH / 4];
+    alt_u32 num_entries;
+    alt_u32 start_addr[SPI_REGION_AUTH_CACHE_MAX_ENTRIES];
+    alt_u32 end_addr[SPI_REGION_AUTH_CACHE_MAX_ENTRIES];
+    // Hash of the protected content (from Block 0) of the authenticated staging capsule
+    alt_u32 staging_capsule_hash[PFR_CRYPTO_LENGTH / 4];
+    // SPI address range of the authenticated staging capsule; the end address is 0 when there's none
+    alt_u32 staging_capsule_start_addr;
+    alt_u32 staging_capsule_end_addr;
+} SPI_REGION_AUTH_CACHE;
+
+// Static variables to track the authenticated static regions of flash devices
+static SPI_REGION_AUTH_CACHE bmc_region_auth_cache;
+static SPI_REGION_AUTH_CACHE pch_region_auth_cache;
+
+/******************************************************
+ *
+ * Helper functions to work with the static variables
+ *
+ ******************************************************/
+
+static SPI_REGION_AUTH_CACHE* get_spi_region_auth_cache(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return &bmc_region_auth_cache;
+    }
+    // spi_flash_type == SPI_FLASH_PCH
+    return &pch_region_auth_cache;
+}
+
+/**
+ * @brief Return the cache of the SPI flash device that Nios is currently connected to.
+ *
+ * @see switch_spi_flash
+ */
+static SPI_REGION_AUTH_CACHE* get_current_spi_region_auth_cache()
+{
+    if (check_bit(U_GPO_1_ADDR, GPO_1_SPI_MASTER_BMC_PCHN))
+    {
+        return &bmc_region_auth_cache;
+    }
+    return &pch_region_auth_cache;
+}
+
+/**
+ * @brief Check whether cached authentication results can be trusted for the given SPI flash device.
+ * That's the case as long as its SPI filter is enabled, since that is what keeps the static regions
+ * write protected in T0.
+ */
+static alt_u32 is_spi_region_auth_cache_usable(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return !check_bit(U_GPO_1_ADDR, GPO_1_BMC_SPI_FILTER_DISABLE);
+    }
+    // spi_flash_type == SPI_FLASH_PCH
+    return !check_bit(U_GPO_1_ADDR, GPO_1_PCH_SPI_FILTER_DISABLE);
+}
+
+/**
+ * @brief Drop all cached authentication results of the given SPI flash device.
+ */
+static void invalidate_spi_region_auth_cache(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    SPI_REGION_AUTH_CACHE* cache = get_spi_region_auth_cache(spi_flash_type);
+    cache->num_entries = 0;
+    cache->staging_capsule_end_addr = 0;
+    for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+    {
+        cache->pfm_hash[word_i] = 0;
+    }
+}
+
+/**
+ * @brief Drop all cached entries that overlap with the SPI address range [@p start_addr, @p end_addr).
+ */
+static void invalidate_spi_region_auth_cache_range(SPI_REGION_AUTH_CACHE* cache, alt_u32 start_addr, alt_u32 end_addr)
+{
+    alt_u32 entry_i = 0;
+    while (entry_i < cache->num_entries)
+    {
+        if ((cache->start_addr[entry_i] < end_addr) && (start_addr < cache->end_addr[entry_i]))
+        {
+            // Fill the hole with the last entry; order of entries doesn't matter
+            cache->num_entries--;
+            cache->start_addr[entry_i] = cache->start_addr[cache->num_entries];
+            cache->end_addr[entry_i] = cache->end_addr[cache->num_entries];
+        }
+        else
+        {
+            entry_i++;
+        }
+    }
+}
+
+/**
+ * @brief Drop the cached staging capsule if it overlaps with the SPI address range [@p start_addr, @p end_addr).
+ */
+static void invalidate_staging_capsule_auth_cache_range(SPI_REGION_AUTH_CACHE* cache, alt_u32 start_addr, alt_u32 end_addr)
+{
+    if ((cache->staging_capsule_start_addr < end_addr) && (start_addr < cache->staging_capsule_end_addr))
+    {
+        cache->staging_capsule_end_addr = 0;
+    }
+}
+
+/**
+ * @brief Drop all cached entries that overlap with a SPI region that is being made writable in the SPI filter.
+ * Since the write enable memory has a granularity of 16KB, the range is expanded to 16KB boundaries.
+ */
+static void invalidate_spi_region_auth_cache_for_writable_range(
+        SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 start_addr, alt_u32 end_addr)
+{
+    invalidate_spi_region_auth_cache_range(get_spi_region_auth_cache(spi_flash_type),
+            start_addr & ~SPI_REGION_AUTH_CACHE_WE_PAGE_MASK,
+            (end_addr + SPI_REGION_AUTH_CACHE_WE_PAGE_MASK) & ~SPI_REGION_AUTH_CACHE_WE_PAGE_MASK);
+}
+
+/**
+ * @brief Prepare the cache for authenticating the SPI regions of the given PFM.
+ * If the PFM differs from the one that the cached results were obtained with, all cached results are dropped.
+ * This function must only be called after the signature of the PFM has been verified.
+ *
+ * @param pfm_hash hash of the authenticated PFM (from its Block 0)
+ */
+static void prepare_spi_region_auth_cache(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32* pfm_hash)
+{
+    SPI_REGION_AUTH_CACHE* cache = get_spi_region_auth_cache(spi_flash_type);
+    for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+    {
+        if (cache->pfm_hash[word_i] != pfm_hash[word_i])
+        {
+            // The staging capsule doesn't depend on the active PFM. Keep it.
+            cache->num_entries = 0;
+            alt_u32_memcpy(cache->pfm_hash, pfm_hash, PFR_CRYPTO_LENGTH);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Check whether the SPI region [@p start_addr, @p end_addr) has been authenticated.
+ *
+ * @return 1 if there's a cached result for this exact region; 0, otherwise.
+ */
+static alt_u32 is_spi_region_auth_cached(SPI_REGION_AUTH_CACHE* cache, alt_u32 start_addr, alt_u32 end_addr)
+{
+    for (alt_u32 entry_i = 0; entry_i < cache->num_entries; entry_i++)
+    {
+        if ((cache->start_addr[entry_i] == start_addr) && (cache->end_addr[entry_i] == end_addr))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Record that the SPI region [@p start_addr, @p end_addr) has been authenticated.
+ * When the cache is full, the result is simply not recorded and the region will be hashed again next time.
+ */
+static void add_spi_region_auth_cache_entry(SPI_REGION_AUTH_CACHE* cache, alt_u32 start_addr, alt_u32 end_addr)
+{
+    if (cache->num_entries < SPI_REGION_AUTH_CACHE_MAX_ENTRIES)
+    {
+        cache->start_addr[cache->num_entries] = start_addr;
+        cache->end_addr[cache->num_entries] = end_addr;
+        cache->num_entries++;
+    }
+}
+
+/**
+ * @brief Record that the staging capsule at SPI address range [@p start_addr, @p end_addr) has been authenticated.
+ * The caller must keep this range write protected for as long as this result is needed.
+ *
+ * @param capsule_hash hash of the protected content of the authenticated capsule (from its Block 0)
+ */
+static void set_staging_capsule_auth_cache(
+        SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 start_addr, alt_u32 end_addr, alt_u32* capsule_hash)
+{
+    SPI_REGION_AUTH_CACHE* cache = get_spi_region_auth_cache(spi_flash_type);
+    alt_u32_memcpy(cache->staging_capsule_hash, capsule_hash, PFR_CRYPTO_LENGTH);
+    cache->staging_capsule_start_addr = start_addr;
+    cache->staging_capsule_end_addr = end_addr;
+}
+
+/**
+ * @brief Check whether the staging capsule at SPI address range [@p start_addr, @p end_addr) has been authenticated,
+ * and it has not been writable since.
+ *
+ * Besides the cached result, the SPI filter must be enabled and the whole capsule must be read-only according to
+ * the RAM shadow of the write enable memory. Nios can't read the write enable memory itself, so this decision only
+ * relies on what Nios has written there.
+ *
+ * @param capsule_hash hash of the protected content, as read from Block 0 of the staging capsule
+ * @return 1 if the staging capsule can be trusted without hashing it; 0, otherwise.
+ */
+static alt_u32 is_staging_capsule_auth_cached(
+        SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 start_addr, alt_u32 end_addr, alt_u32* capsule_hash)
+{
+    SPI_REGION_AUTH_CACHE* cache = get_spi_region_auth_cache(spi_flash_type);
+    if ((cache->staging_capsule_end_addr == 0) ||
+            (cache->staging_capsule_start_addr != start_addr) ||
+            (cache->staging_capsule_end_addr != end_addr) ||
+            !is_spi_region_auth_cache_usable(spi_flash_type) ||
+            !is_spi_we_mem_range_write_protected(spi_flash_type, start_addr, end_addr))
+    {
+        return 0;
+    }
+
+    for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+    {
+        if (cache->staging_capsule_hash[word_i] != capsule_hash[word_i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#endif /* WHITLEY_INC_SPI_REGION_AUTH_CACHE_H_ */
@@ -31,13 +31,27 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "io_counters.h"
 #include "keychain_utils.h"
 #include "pfr_pointers.h"
 #include "spi_common.h"
+#include "spi_erase_planner.h"
+#include "spi_flash_sfdp.h"
+#include "spi_region_auth_cache.h"
+#include "spi_we_mem_shadow.h"
 #include "utils.h"
 
-#define SPI_FLASH_PAGE_SIZE_OF_4KB 0x1000
-#define SPI_FLASH_PAGE_SIZE_OF_64KB 0x10000
+// Page program size of the SPI flash devices
+#define SPI_FLASH_PAGE_SIZE 0x100
+
+// Number of bytes copied through the Nios RAM buffer at a time, when copying between the two SPI flashes.
+#define SPI_FLASH_COPY_BUFFER_SIZE SPI_FLASH_PAGE_SIZE
+
+// When set to 1, erase_spi_region() skips the erase command on sectors that are already blank (i.e. all 0xFF).
+// This is off by default. A sector whose erase was cut short by a power loss can read all 0xFF and still not be
+// fully erased, so the caller must know that no erase was interrupted in the target range. decompress_capsule()
+// turns it on, because its checkpoint journal tells whether an erase may have been interrupted.
+static alt_u32 spi_erase_blank_check_enabled = 0;
 
 static PFR_ALT_INLINE void PFR_ALT_ALWAYS_INLINE write_to_spi_ctrl_1_csr(
         SPI_CONTROL_1_CSR_OFFSET_ENUM offset, alt_u32 data)
@@ -79,11 +93,15 @@ static alt_u32 read_spi_chip_id()
  * Set GPO_1_SPI_MASTER_BMC_PCHN to 1 to have CPLD master talk to the BMC flash
  * Set to 0 to have CPLD master talk to the PCH Flash
  *
+ * The SPI control block is then configured with the read instruction of that flash device.
+ *
  * @param spi_flash_type indicates BMC or PCH flash
  */
 static void switch_spi_flash(
         SPI_FLASH_TYPE_ENUM spi_flash_type)
 {
+    count_io_ops(IO_COUNTER_SPI_FLASH_SWITCHES, 1);
+
     if (spi_flash_type == SPI_FLASH_BMC)
     {
         set_bit(U_GPO_1_ADDR, GPO_1_SPI_MASTER_BMC_PCHN);
@@ -92,16 +110,23 @@ static void switch_spi_flash(
     {
         clear_bit(U_GPO_1_ADDR, GPO_1_SPI_MASTER_BMC_PCHN);
     }
-#ifdef USE_QUAD_IO
-    if (spi_flash_type == SPI_FLASH_BMC/*read_spi_chip_id() == SPI_FLASH_MICRON*/)
-    {
-        write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_READ_INSTRUCTION_OFST, SPI_FLASH_QUAD_READ_PROTOCOL_MICRON);
-    }
-    else /*if (read_spi_chip_id() == SPI_FLASH_MACRONIX)*/
+
+    // Use the read instruction of this flash device
+    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_READ_INSTRUCTION_OFST, get_spi_flash_caps(spi_flash_type)->read_instruction);
+}
+
+/**
+ * @brief Return the SPI flash device that Nios is currently connected to.
+ *
+ * @see switch_spi_flash
+ */
+static SPI_FLASH_TYPE_ENUM get_current_spi_flash_type()
+{
+    if (check_bit(U_GPO_1_ADDR, GPO_1_SPI_MASTER_BMC_PCHN))
     {
-        write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_READ_INSTRUCTION_OFST, SPI_FLASH_QUAD_READ_PROTOCOL_MACRONIX);
+        return SPI_FLASH_BMC;
     }
-#endif
+    return SPI_FLASH_PCH;
 }
 
 /**
@@ -120,22 +145,29 @@ static void write_one_byte_spi_cmd(SPI_COMMAND_ENUM spi_cmd)
  */
 static alt_u32 read_spi_status_register()
 {
-#ifdef USE_QUAD_IO
-    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST, 0x22220);
-#else
-    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST, 0x00000);
-#endif
+    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST, SPI_OPERATING_PROTOCOLS_DEFAULT);
     write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_SETTING_OFST, 0x1800 | SPI_CMD_READ_STATUS_REG);
     trigger_spi_send_cmd();
     return read_from_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_READ_DATA0_OFST);
 }
 
 /**
- * @brief Poll the status register and return when Write in Progress (WIP) bit becomes 1.
+ * @brief Check whether the flash device is still busy with a previous erase or program operation.
+ *
+ * @return 1 if the Write in Progress (WIP) bit is set; 0, otherwise.
+ */
+static alt_u32 is_spi_flash_busy()
+{
+    count_io_ops(IO_COUNTER_STATUS_POLLS, 1);
+    return (read_spi_status_register() & SPI_STATUS_WIP_BIT_MASK) != 0;
+}
+
+/**
+ * @brief Poll the status register and return when Write in Progress (WIP) bit becomes 0.
  */
 static void poll_status_reg_done()
 {
-    while (read_spi_status_register() & SPI_STATUS_WIP_BIT_MASK)
+    while (is_spi_flash_busy())
     {
         reset_hw_watchdog();
     }
@@ -160,24 +192,118 @@ static void execute_one_byte_spi_cmd(SPI_COMMAND_ENUM spi_cmd)
 }
 
 /**
- * @brief Erase either a 4kB or 64kB sector of the flash.
+ * @brief Return the erase command that erases [spi_addr, region_end_addr) in the least time on the current
+ * flash device, without erasing beyond @p region_end_addr.
  *
- * After this erase, you can write to addresses in this sector through the memory mapped interface.
- * Note that sector address is a FLASH address (starts at 0) not the AVMM address
- * (which starts at some base offset address).
+ * @see get_planned_spi_erase_cmd
+ */
+static SPI_COMMAND_ENUM get_spi_erase_cmd(alt_u32 spi_addr, alt_u32 region_end_addr)
+{
+    return get_planned_spi_erase_cmd(spi_addr, region_end_addr, get_spi_erase_time_table(get_current_spi_flash_type()));
+}
+
+/**
+ * @brief Send a command to erase a 4kB, 32kB or 64kB sector of the flash, without waiting for it to complete.
+ * Nios may switch to the other flash device while this erase is in progress. Nios must wait until
+ * is_spi_flash_busy() returns 0 before it accesses this flash device again.
  *
  * @param addr_in_flash an address in the target SPI flash
- * @param erase_cmd a SPI command for 4kB or 64kB erase. Nios expects one of SPI_CMD_4KB_SECTOR_ERASE | SPI_CMD_32KB_SECTOR_ERASE | SPI_CMD_64KB_SECTOR_ERASE.
+ * @param erase_cmd a SPI command for 4kB, 32kB or 64kB erase.
+ *
+ * @see execute_spi_erase_cmd
  */
-static void execute_spi_erase_cmd(alt_u32 addr_in_flash, SPI_COMMAND_ENUM erase_cmd)
+static void start_spi_erase_cmd(alt_u32 addr_in_flash, SPI_COMMAND_ENUM erase_cmd)
 {
+    // Content of the erased sector is no longer authenticated
+    invalidate_spi_region_auth_cache_range(
+            get_current_spi_region_auth_cache(), addr_in_flash, addr_in_flash + get_spi_erase_size(erase_cmd));
+    invalidate_staging_capsule_auth_cache_range(
+            get_current_spi_region_auth_cache(), addr_in_flash, addr_in_flash + get_spi_erase_size(erase_cmd));
+
+    if (erase_cmd == SPI_CMD_4KB_SECTOR_ERASE)
+    {
+        count_io_ops(IO_COUNTER_4KB_ERASES, 1);
+    }
+    else if (erase_cmd == SPI_CMD_32KB_SECTOR_ERASE)
+    {
+        count_io_ops(IO_COUNTER_32KB_ERASES, 1);
+    }
+    else
+    {
+        count_io_ops(IO_COUNTER_64KB_ERASES, 1);
+    }
+
     execute_one_byte_spi_cmd(SPI_CMD_WRITE_ENABLE);
     // Zero dummy cycles, zero data bytes, 4 address bytes, erase command
     write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_SETTING_OFST, 0x0400 | erase_cmd);
     // Set the FLASH Address Register with the address of the sector to erase
     write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_ADDRESS_OFST, addr_in_flash);
-    // Execute the command and wait for it to finish
-    execute_spi_cmd();
+    // Execute the command
+    trigger_spi_send_cmd();
+}
+
+/**
+ * @brief Erase a 4kB, 32kB or 64kB sector of the flash.
+ *
+ * After this erase, you can write to addresses in this sector through the memory mapped interface.
+ * Note that sector address is a FLASH address (starts at 0) not the AVMM address
+ * (which starts at some base offset address).
+ *
+ * @param addr_in_flash an address in the target SPI flash
+ * @param erase_cmd a SPI command for 4kB, 32kB or 64kB erase. Nios expects one of SPI_CMD_4KB_SECTOR_ERASE | SPI_CMD_32KB_SECTOR_ERASE | SPI_CMD_64KB_SECTOR_ERASE.
+ */
+static void execute_spi_erase_cmd(alt_u32 addr_in_flash, SPI_COMMAND_ENUM erase_cmd)
+{
+    start_spi_erase_cmd(addr_in_flash, erase_cmd);
+    // Wait for the erase to finish
+    poll_status_reg_done();
+}
+
+/**
+ * @brief Set whether erase_spi_region() skips the erase command on sectors that are already blank.
+ *
+ * @param enable 1 to enable the blank check; 0 to always send the erase command
+ */
+static void set_spi_erase_blank_check(alt_u32 enable)
+{
+    spi_erase_blank_check_enabled = enable;
+}
+
+/**
+ * @brief Return 1 if erase_spi_region() skips the erase command on sectors that are already blank.
+ */
+static alt_u32 get_spi_erase_blank_check()
+{
+    return spi_erase_blank_check_enabled;
+}
+
+/**
+ * @brief Return 1 if the erase command for the given sector can be skipped. This is the case when
+ * blank check is enabled and every word of the sector reads 0xFFFFFFFF through the memory mapped interface.
+ *
+ * Nios stops reading at the first word that is not blank.
+ *
+ * @param addr_in_flash start address of the target sector
+ * @param erase_cmd a SPI command for 4kB, 32kB or 64kB erase.
+ *
+ * @return 1 if the sector is already blank; 0, otherwise
+ */
+static alt_u32 is_spi_erase_skippable(alt_u32 addr_in_flash, SPI_COMMAND_ENUM erase_cmd)
+{
+    if (!spi_erase_blank_check_enabled)
+    {
+        return 0;
+    }
+
+    alt_u32* sector_ptr = get_spi_flash_ptr_with_offset(addr_in_flash);
+    for (alt_u32 word_i = 0; word_i < (get_spi_erase_size(erase_cmd) >> 2); word_i++)
+    {
+        if (sector_ptr[word_i] != 0xFFFFFFFF)
+        {
+            return 0;
+        }
+    }
+    return 1;
 }
 
 /**
@@ -185,6 +311,10 @@ static void execute_spi_erase_cmd(alt_u32 addr_in_flash, SPI_COMMAND_ENUM erase_
  * This function assumes that Nios has set the right muxes to talk to the device.
  * Also, the SPI region start and end addresses are expected to be 4KB aligned.
  *
+ * The erase commands are chosen to erase the region in the least time, based on the erase time table of
+ * the current flash device.
+ * Sectors that are already blank are not erased again, unless blank check has been disabled.
+ *
  * @param region_start_addr Start address of the target SPI region
  * @param nbytes size (in byte) of the target SPI region
  */
@@ -194,24 +324,78 @@ static void erase_spi_region(alt_u32 region_start_addr, alt_u32 nbytes)
     alt_u32 region_end_addr = region_start_addr + nbytes;
     while (spi_addr < region_end_addr)
     {
-        if (((region_end_addr - spi_addr) >= SPI_FLASH_PAGE_SIZE_OF_64KB) && ((spi_addr & 0xFFFF) == 0))
+        SPI_COMMAND_ENUM erase_cmd = get_spi_erase_cmd(spi_addr, region_end_addr);
+        if (!is_spi_erase_skippable(spi_addr, erase_cmd))
         {
-            // The target SPI Region is at least 64KB in size and aligns to 0x10000 boundary.
-            // Send 64KB erase command
-            execute_spi_erase_cmd(spi_addr, SPI_CMD_64KB_SECTOR_ERASE);
-            spi_addr += SPI_FLASH_PAGE_SIZE_OF_64KB;
+            execute_spi_erase_cmd(spi_addr, erase_cmd);
         }
-        else
+        spi_addr += get_spi_erase_size(erase_cmd);
+    }
+}
+
+/**
+ * @brief Program data into erased SPI flash through the memory mapped interface.
+ *
+ * @param dest_flash_ptr pointer to the destination in the current SPI flash
+ * @param src_ptr the address to read from
+ * @param nbytes number of bytes (must be multiples of 4) to write
+ */
+static void memcpy_to_spi_flash(alt_u32* dest_flash_ptr, const alt_u32* src_ptr, alt_u32 nbytes)
+{
+    count_io_ops(IO_COUNTER_PAGES_PROGRAMMED, (nbytes + SPI_FLASH_PAGE_SIZE - 1) / SPI_FLASH_PAGE_SIZE);
+    alt_u32_memcpy(dest_flash_ptr, src_ptr, nbytes);
+}
+
+/**
+ * @brief Return 1 if the content of the current SPI flash at @p dest_flash_ptr is the same as @p src_ptr.
+ * Nios stops reading at the first word that is different.
+ *
+ * @param dest_flash_ptr pointer to the destination in the current SPI flash
+ * @param src_ptr the address to compare against
+ * @param nbytes number of bytes (must be multiples of 4) to compare
+ *
+ * @return 1 if the two are identical; 0, otherwise
+ */
+static alt_u32 is_spi_flash_content_identical(alt_u32* dest_flash_ptr, const alt_u32* src_ptr, alt_u32 nbytes)
+{
+    for (alt_u32 word_i = 0; word_i < (nbytes >> 2); word_i++)
+    {
+        if (dest_flash_ptr[word_i] != src_ptr[word_i])
         {
-            // Otherwise, send 4KB erase command
-            execute_spi_erase_cmd(spi_addr, SPI_CMD_4KB_SECTOR_ERASE);
-            spi_addr += SPI_FLASH_PAGE_SIZE_OF_4KB;
+            return 0;
         }
     }
+    return 1;
+}
+
+/**
+ * @brief Erase and program a run of sectors, that differ from the signed payload, at the given destination.
+ *
+ * @param run_start_addr start address of the run in the current SPI flash
+ * @param run_end_addr end address of the run in the current SPI flash
+ * @param src_ptr pointer to the content of the run in the signed payload
+ * @param copy_nbytes number of bytes to program; this is less than the run size at the end of the payload
+ */
+static void copy_spi_sector_run(alt_u32 run_start_addr, alt_u32 run_end_addr, alt_u32* src_ptr, alt_u32 copy_nbytes)
+{
+    if (run_start_addr != run_end_addr)
+    {
+        erase_spi_region(run_start_addr, run_end_addr - run_start_addr);
+        memcpy_to_spi_flash(get_spi_flash_ptr_with_offset(run_start_addr), src_ptr, copy_nbytes);
+
+        // Pet CPLD HW timer
+        reset_hw_watchdog();
+    }
 }
 
 /**
- * @brief Use custom memcpy to copy the signed payload to a given destination address.
+ * @brief Copy the signed payload to a given destination address in the current SPI flash.
+ *
+ * Largest signed payload is BMC firmware capsule (max 32 MB), and it's often copied over an older version
+ * of itself. Hence, Nios compares the destination against the payload in 4KB sectors, and only erases and
+ * programs the sectors that differ. Adjacent sectors that differ are erased together, so that the larger erase
+ * commands can be used. Nios pets the HW timer after every sector compare and every erase/program of a run of
+ * sectors.
  *
  * @param spi_dest_addr pointer to destination address in the SPI address range
  * @param signed_payload pointer to the start address of the signed payload
@@ -220,29 +404,47 @@ static void memcpy_signed_payload(alt_u32 spi_dest_addr, alt_u32* signed_payload
 {
     alt_u32 nbytes = get_signed_payload_size(signed_payload);
 
-    // Erase destination area first
-    erase_spi_region(spi_dest_addr, nbytes);
-
-    // Copy entire signed payload to destination location
-    // Largest signed payload is BMC firmware capsule (max 32 MB).
-    // Always copy signed payload in four pieces and pet the HW timer in between.
-    // Then CPLD HW timer most likely won't timeout in this function, based on platform testing results.
-    alt_u32 quarter_nbytes = nbytes >> 2;
-    for (alt_u32 i = 0; i < 4; i++)
+    // [run_start_addr, run_end_addr) is the run of sectors that differ from the payload
+    alt_u32 run_start_addr = spi_dest_addr;
+    alt_u32 run_end_addr = spi_dest_addr;
+    for (alt_u32 offset = 0; offset < nbytes; offset += SPI_FLASH_PAGE_SIZE_OF_4KB)
     {
-        alt_u32_memcpy(get_spi_flash_ptr_with_offset(spi_dest_addr),
-                       incr_alt_u32_ptr(signed_payload, i * quarter_nbytes),
-                       quarter_nbytes);
-        spi_dest_addr += quarter_nbytes;
+        alt_u32 sector_addr = spi_dest_addr + offset;
+        alt_u32 sector_nbytes = nbytes - offset;
+        if (sector_nbytes > SPI_FLASH_PAGE_SIZE_OF_4KB)
+        {
+            sector_nbytes = SPI_FLASH_PAGE_SIZE_OF_4KB;
+        }
+
+        if (is_spi_flash_content_identical(
+                get_spi_flash_ptr_with_offset(sector_addr), incr_alt_u32_ptr(signed_payload, offset), sector_nbytes))
+        {
+            // This sector ends the run
+            copy_spi_sector_run(run_start_addr, run_end_addr,
+                    incr_alt_u32_ptr(signed_payload, run_start_addr - spi_dest_addr), run_end_addr - run_start_addr);
+            run_start_addr = sector_addr + SPI_FLASH_PAGE_SIZE_OF_4KB;
+        }
+        run_end_addr = sector_addr + SPI_FLASH_PAGE_SIZE_OF_4KB;
 
         // Pet CPLD HW timer
         reset_hw_watchdog();
     }
+
+    // The last run may end with a partial sector
+    if (run_start_addr < run_end_addr)
+    {
+        copy_spi_sector_run(run_start_addr, run_end_addr,
+                incr_alt_u32_ptr(signed_payload, run_start_addr - spi_dest_addr), spi_dest_addr + nbytes - run_start_addr);
+    }
 }
 
 /**
  * @brief Copy a binary blob from one SPI flash to the other.
  *
+ * Nios reads up to SPI_FLASH_COPY_BUFFER_SIZE bytes from the source SPI flash into a RAM buffer,
+ * switches to the destination SPI flash once and writes the whole buffer there. Then, Nios polls
+ * the status register once before switching back to the source SPI flash for the next chunk.
+ *
  * It's assumed that size has been authenticated, as part of the update capsule
  * authentication, before it's used. Then, it's guaranteed that (dest_spi_addr + size)
  * and (src_spi_addr + size) will not overflow the designated region on the SPI flash.
@@ -256,6 +458,8 @@ static void memcpy_signed_payload(alt_u32 spi_dest_addr, alt_u32* signed_payload
 static void copy_between_flashes(alt_u32 dest_spi_addr, alt_u32 src_spi_addr,
         SPI_FLASH_TYPE_ENUM dest_spi_type, SPI_FLASH_TYPE_ENUM src_spi_type, alt_u32 size)
 {
+    alt_u32 buffer[SPI_FLASH_COPY_BUFFER_SIZE / 4];
+
     switch_spi_flash(dest_spi_type);
     // Get a pointer to the destination SPI flash at offset dest_spi_addr
     alt_u32* dest_flash_ptr = get_spi_flash_ptr_with_offset(dest_spi_addr);
@@ -268,14 +472,20 @@ static void copy_between_flashes(alt_u32 dest_spi_addr, alt_u32 src_spi_addr,
     alt_u32* src_flash_ptr = get_spi_flash_ptr_with_offset(src_spi_addr);
 
     // Copy the binary like this: BMC -> CPLD, CPLD -> PCH
-    for (alt_u32 word_i = 0; word_i < (size / 4); word_i++)
+    for (alt_u32 chunk_offset = 0; chunk_offset < size; chunk_offset += SPI_FLASH_COPY_BUFFER_SIZE)
     {
-        // Read a word from source SPI flash
-        alt_u32 tmp = src_flash_ptr[word_i];
+        alt_u32 chunk_size = size - chunk_offset;
+        if (chunk_size > SPI_FLASH_COPY_BUFFER_SIZE)
+        {
+            chunk_size = SPI_FLASH_COPY_BUFFER_SIZE;
+        }
+
+        // Read a chunk from source SPI flash
+        alt_u32_memcpy(buffer, incr_alt_u32_ptr(src_flash_ptr, chunk_offset), chunk_size);
         switch_spi_flash(dest_spi_type);
 
-        // Write the word to destination SPI flash
-        dest_flash_ptr[word_i] = tmp;
+        // Write the chunk to destination SPI flash
+        memcpy_to_spi_flash(incr_alt_u32_ptr(dest_flash_ptr, chunk_offset), buffer, chunk_size);
         poll_status_reg_done();
         switch_spi_flash(src_spi_type);
     }
@@ -288,23 +498,23 @@ static void copy_between_flashes(alt_u32 dest_spi_addr, alt_u32 src_spi_addr,
  * @brief Set the CPLD recovery region to read only.
  *
  * Nios should not rely on BMC PFM to mark this SPI region with correct permission.
+ * The lock is always written, regardless of the shadow of the write enable memory.
  */
 static void write_protect_cpld_recovery_region()
 {
-    alt_u32* we_mem_ptr = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0);
-    IOWR(we_mem_ptr, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM, 0x0);
-    IOWR(we_mem_ptr, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM + 1, 0x0);
+    write_spi_we_mem_word(SPI_FLASH_BMC, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM, 0x0);
+    write_spi_we_mem_word(SPI_FLASH_BMC, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM + 1, 0x0);
 }
 
 /**
  * @brief Set the CPLD staging region to read only.
+ * The lock is always written, regardless of the shadow of the write enable memory.
  */
 static void write_protect_cpld_staging_region()
 {
-    alt_u32* we_mem_ptr = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0);
     alt_u32 bmc_cpld_staging_capsule_location_in_we_mem = (get_ufm_pfr_data()->bmc_staging_region + BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET) >> 19;
-    IOWR(we_mem_ptr, bmc_cpld_staging_capsule_location_in_we_mem, 0x0);
-    IOWR(we_mem_ptr, bmc_cpld_staging_capsule_location_in_we_mem + 1, 0x0);
+    write_spi_we_mem_word(SPI_FLASH_BMC, bmc_cpld_staging_capsule_location_in_we_mem, 0x0);
+    write_spi_we_mem_word(SPI_FLASH_BMC, bmc_cpld_staging_capsule_location_in_we_mem + 1, 0x0);
 }
 
 #endif /* WHITLEY_INC_SPI_RW_UTILS_H */
@@ -0,0 +1,249 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file spi_we_mem_shadow.h
+ * @brief Keep a copy of the SPI filter write enable memory in RAM.
+ *
+ * The write enable memory has 1 bit per 16KB page of the SPI flash. A bit of 1 means the page is writable.
+ * The write enable memory is write-only; the SPI filter doesn't support reads from it. Hence, Nios never reads it
+ * back, and keeps a shadow copy of what it has written instead. A word
+ * of the write enable memory is only written when its new value differs from the shadow. In most T-1 cycles,
+ * the protection layout is the same as in the previous cycle and nothing is written.
+ *
+ * The shadow only lives in RAM. It's not valid after a power cycle or CPLD reconfiguration, until the write
+ * protection has been applied from a PFM once.
+ */
+
+#ifndef WHITLEY_INC_SPI_WE_MEM_SHADOW_H_
+#define WHITLEY_INC_SPI_WE_MEM_SHADOW_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "spi_common.h"
+#include "utils.h"
+
+// 14 bits to get to 16KB pages, 5 more bits because there are 32 (=2^5) pages in each word
+#define SPI_WE_MEM_PAGE_SHIFT 14
+#define SPI_WE_MEM_WORD_SHIFT (SPI_WE_MEM_PAGE_SHIFT + 5)
+
+#define BMC_SPI_WE_MEM_NWORDS (BMC_SPI_FLASH_SIZE >> SPI_WE_MEM_WORD_SHIFT)
+#define PCH_SPI_WE_MEM_NWORDS (PCH_SPI_FLASH_SIZE >> SPI_WE_MEM_WORD_SHIFT)
+
+// Static variables to track the content of the write enable memory of the flash devices
+static alt_u32 bmc_spi_we_mem_shadow[BMC_SPI_WE_MEM_NWORDS];
+static alt_u32 pch_spi_we_mem_shadow[PCH_SPI_WE_MEM_NWORDS];
+static alt_u32 bmc_spi_we_mem_shadow_is_valid = 0;
+static alt_u32 pch_spi_we_mem_shadow_is_valid = 0;
+
+/******************************************************
+ *
+ * Helper functions to work with the static variables
+ *
+ ******************************************************/
+
+static alt_u32* get_spi_we_mem_shadow(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return bmc_spi_we_mem_shadow;
+    }
+    // spi_flash_type == SPI_FLASH_PCH
+    return pch_spi_we_mem_shadow;
+}
+
+static alt_u32* get_spi_we_mem_shadow_is_valid(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return &bmc_spi_we_mem_shadow_is_valid;
+    }
+    // spi_flash_type == SPI_FLASH_PCH
+    return &pch_spi_we_mem_shadow_is_valid;
+}
+
+/**
+ * @brief Return the number of words in the write enable memory that cover the given SPI flash device.
+ */
+static alt_u32 get_spi_we_mem_nwords(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return BMC_SPI_WE_MEM_NWORDS;
+    }
+    // spi_flash_type == SPI_FLASH_PCH
+    return PCH_SPI_WE_MEM_NWORDS;
+}
+
+/**
+ * @brief Return the pointer to the start of the write enable memory in the SPI filter of the given SPI flash device.
+ */
+static alt_u32* get_spi_we_mem_ptr(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0);
+    }
+    // spi_flash_type == SPI_FLASH_PCH
+    return __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 0);
+}
+
+/**
+ * @brief Forget the content of the write enable memory of the given SPI flash device.
+ * Every word is written in the next call to commit_spi_we_mem_word().
+ */
+static void invalidate_spi_we_mem_shadow(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    *get_spi_we_mem_shadow_is_valid(spi_flash_type) = 0;
+}
+
+/**
+ * @brief Mark the shadow as valid. This must only be called after every word has been committed once.
+ */
+static void validate_spi_we_mem_shadow(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    *get_spi_we_mem_shadow_is_valid(spi_flash_type) = 1;
+}
+
+/**
+ * @brief Return a mask with @p nbits bits set, starting from bit @p first_bit.
+ * Without a per-bit loop, this sets all the pages in a word that are covered by a SPI region.
+ *
+ * @param first_bit position of the lowest bit to set (0 - 31)
+ * @param nbits number of bits to set (1 - 32, and @p first_bit + @p nbits <= 32)
+ */
+static alt_u32 get_spi_we_mem_bit_mask(alt_u32 first_bit, alt_u32 nbits)
+{
+    if (nbits == 32)
+    {
+        return 0xFFFFFFFF;
+    }
+    return ((0b1 << nbits) - 1) << first_bit;
+}
+
+/**
+ * @brief Write a word of the write enable memory unconditionally, and keep the shadow in sync.
+ * Words beyond the size of the SPI flash device are not tracked.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ * @param word_pos position of the word in the write enable memory
+ * @param word new value of the word; bit N is for the 16KB page N in this word
+ */
+static void write_spi_we_mem_word(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 word_pos, alt_u32 word)
+{
+    IOWR(get_spi_we_mem_ptr(spi_flash_type), word_pos, word);
+    if (word_pos < get_spi_we_mem_nwords(spi_flash_type))
+    {
+        get_spi_we_mem_shadow(spi_flash_type)[word_pos] = word;
+    }
+}
+
+/**
+ * @brief Write a word of the write enable memory, if it's different from what was last written there.
+ * Words beyond the size of the SPI flash device are not tracked and always written.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ * @param word_pos position of the word in the write enable memory
+ * @param word new value of the word; bit N is for the 16KB page N in this word
+ */
+static void commit_spi_we_mem_word(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 word_pos, alt_u32 word)
+{
+    if ((word_pos >= get_spi_we_mem_nwords(spi_flash_type))
+            || !(*get_spi_we_mem_shadow_is_valid(spi_flash_type))
+            || (get_spi_we_mem_shadow(spi_flash_type)[word_pos] != word))
+    {
+        write_spi_we_mem_word(spi_flash_type, word_pos, word);
+    }
+}
+
+/**
+ * @brief Make the 16KB pages that cover the SPI address range [@p start_addr, @p end_addr) read-only.
+ * The other pages keep the rules in the shadow. Hence, the shadow must be valid.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ * @param start_addr start address of the range
+ * @param end_addr end address (exclusive) of the range
+ */
+static void write_protect_spi_we_mem_range(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 start_addr, alt_u32 end_addr)
+{
+    alt_u32* shadow = get_spi_we_mem_shadow(spi_flash_type);
+    alt_u32 page = start_addr >> SPI_WE_MEM_PAGE_SHIFT;
+    alt_u32 end_page = (end_addr + (0b1 << SPI_WE_MEM_PAGE_SHIFT) - 1) >> SPI_WE_MEM_PAGE_SHIFT;
+    while ((page < end_page) && ((page >> 5) < get_spi_we_mem_nwords(spi_flash_type)))
+    {
+        alt_u32 first_bit_pos = page & 0x1f;
+        alt_u32 nbits = 32 - first_bit_pos;
+        if (end_page - page < nbits)
+        {
+            nbits = end_page - page;
+        }
+        alt_u32 word_pos = page >> 5;
+        commit_spi_we_mem_word(spi_flash_type, word_pos, shadow[word_pos] & ~get_spi_we_mem_bit_mask(first_bit_pos, nbits));
+        page += nbits;
+    }
+}
+
+/**
+ * @brief Check whether all the 16KB pages that cover the SPI address range [@p start_addr, @p end_addr) are
+ * read-only in the write enable memory, according to the shadow.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ * @param start_addr start address of the range
+ * @param end_addr end address (exclusive) of the range
+ * @return 1 if the shadow is valid and the whole range is read-only; 0, otherwise.
+ */
+static alt_u32 is_spi_we_mem_range_write_protected(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 start_addr, alt_u32 end_addr)
+{
+    if (!(*get_spi_we_mem_shadow_is_valid(spi_flash_type)))
+    {
+        return 0;
+    }
+
+    alt_u32* shadow = get_spi_we_mem_shadow(spi_flash_type);
+    alt_u32 page = start_addr >> SPI_WE_MEM_PAGE_SHIFT;
+    alt_u32 end_page = (end_addr + (0b1 << SPI_WE_MEM_PAGE_SHIFT) - 1) >> SPI_WE_MEM_PAGE_SHIFT;
+    while (page < end_page)
+    {
+        alt_u32 word_pos = page >> 5;
+        if (word_pos >= get_spi_we_mem_nwords(spi_flash_type))
+        {
+            // This range goes beyond the flash device
+            return 0;
+        }
+
+        alt_u32 first_bit_pos = page & 0x1f;
+        alt_u32 nbits = 32 - first_bit_pos;
+        if (end_page - page < nbits)
+        {
+            nbits = end_page - page;
+        }
+        if (shadow[word_pos] & get_spi_we_mem_bit_mask(first_bit_pos, nbits))
+        {
+            return 0;
+        }
+        page += nbits;
+    }
+    return 1;
+}
+
+#endif /* WHITLEY_INC_SPI_WE_MEM_SHADOW_H_ */
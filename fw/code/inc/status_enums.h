@@ -105,10 +105,11 @@ typedef enum
  */
 typedef enum
 {
-    MAJOR_ERROR_BMC_AUTH_FAILED        = 0x01,
-    MAJOR_ERROR_PCH_AUTH_FAILED        = 0x02,
-    MAJOR_ERROR_UPDATE_FROM_PCH_FAILED = 0x03,
-    MAJOR_ERROR_UPDATE_FROM_BMC_FAILED = 0x04,
+    MAJOR_ERROR_BMC_AUTH_FAILED         = 0x01,
+    MAJOR_ERROR_PCH_AUTH_FAILED         = 0x02,
+    MAJOR_ERROR_UPDATE_FROM_PCH_FAILED  = 0x03,
+    MAJOR_ERROR_UPDATE_FROM_BMC_FAILED  = 0x04,
+    MAJOR_ERROR_PIT_L2_FW_SEAL_MISMATCH = 0x05,
 } STATUS_MAJOR_ERROR_ENUM;
 
 /**
@@ -128,6 +129,11 @@ typedef enum
  * Define the value indicating minor error code observed on the system.
  * This set of minor code is associated with firmware update failure.
  * Hence, this is paired with the MAJOR_ERROR_UPDATE_FROM_PCH_FAILED and MAJOR_ERROR_UPDATE_FROM_BMC_FAILED
+ *
+ * MINOR_ERROR_INVALID_SVN is only reported when the SVN has been authenticated (i.e. the capsule PFM of a firmware
+ * update capsule, or the whole CPLD update capsule). MINOR_ERROR_DELTA_CAPSULE_BASE_MISMATCH is reported before the
+ * capsule signature is verified. A delta capsule sent with a recovery update intent is reported with
+ * MINOR_ERROR_INVALID_UPDATE_INTENT.
  */
 typedef enum
 {
@@ -137,6 +143,17 @@ typedef enum
     MINOR_ERROR_EXCEEDED_MAX_FAILED_ATTEMPTS             = 0x04,
     MINOR_ERROR_ACTIVE_FW_UPDATE_NOT_ALLOWED             = 0x05,
     MINOR_ERROR_RECOVERY_FW_UPDATE_AUTH_FAILED           = 0x06,
+    MINOR_ERROR_DELTA_CAPSULE_BASE_MISMATCH              = 0x07,
 } STATUS_MINOR_ERROR_FW_CPLD_UPDATE_ENUM;
 
+/**
+ * Define the value indicating minor error code observed on the system.
+ * This is paired with MAJOR_ERROR_PIT_L2_FW_SEAL_MISMATCH in chunked firmware sealing.
+ * Any other value of the minor error is the index of the first SPI flash chunk that has changed.
+ */
+typedef enum
+{
+    MINOR_ERROR_PIT_L2_CHUNK_HASH_TABLE_MISMATCH         = 0xFF,
+} STATUS_MINOR_ERROR_PIT_L2_ENUM;
+
 #endif /* WHITLEY_INC_STATUS_ENUMS_H_ */
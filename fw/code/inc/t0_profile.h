@@ -0,0 +1,214 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file t0_profile.h
+ * @brief Measure how long each T0 handler, and each spin of the T0 loop, takes.
+ *
+ * Nios reads the free-running cycle counter in the timer bank before and after each handler that runs.
+ * For each handler and for the whole spin, it keeps the minimum and maximum number of cycles and a
+ * histogram in RAM. A measurement is dropped if Nios went through T-1 in the middle of it, since that
+ * time is not spent in the T0 loop.
+ *
+ * The minimum and maximum of each entry, and the histogram of the whole spin, are published in the
+ * mailbox periodically.
+ */
+
+#ifndef WHITLEY_INC_T0_PROFILE_H_
+#define WHITLEY_INC_T0_PROFILE_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "mailbox_utils.h"
+#include "t0_scheduler.h"
+#include "timer_utils.h"
+#include "utils.h"
+
+// There's one entry per T0 task, and one for the whole spin of the T0 loop
+#define T0_PROFILE_LOOP T0_NUM_TASKS
+#define T0_PROFILE_NUM_ENTRIES (T0_NUM_TASKS + 1)
+
+// Bucket 0 counts the measurements below 2^8 cycles. Each following bucket covers 16 times more cycles.
+// The last bucket counts everything above.
+#define T0_PROFILE_HISTOGRAM_NUM_BUCKETS 4
+#define T0_PROFILE_HISTOGRAM_FIRST_BUCKET_BITS 8
+#define T0_PROFILE_HISTOGRAM_BUCKET_BITS 4
+
+// In the mailbox, each entry has a 16-bit minimum and a 16-bit maximum, in units of 16 cycles.
+// Larger values are saturated. Histogram counts are saturated at 8 bits.
+#define T0_PROFILE_MB_ENTRY_SIZE 4
+#define T0_PROFILE_MB_CYCLES_SHIFT 4
+#define T0_PROFILE_MB_MAX_VALUE 0xFFFF
+#define T0_PROFILE_MB_MAX_COUNT 0xFF
+
+// Number of T0 loop spins between two updates of the mailbox
+#define T0_PROFILE_PUBLISH_PERIOD 256
+
+typedef struct
+{
+    alt_u32 min_cycles[T0_PROFILE_NUM_ENTRIES];
+    alt_u32 max_cycles[T0_PROFILE_NUM_ENTRIES];
+    alt_u32 histogram[T0_PROFILE_NUM_ENTRIES][T0_PROFILE_HISTOGRAM_NUM_BUCKETS];
+} T0_PROFILE;
+
+/**
+ * A measurement in progress
+ */
+typedef struct
+{
+    alt_u32 start_cycle;
+    // Used to detect a trip to T-1 during the measurement
+    alt_u32 num_t0_entries;
+} T0_PROFILE_SAMPLE;
+
+static T0_PROFILE t0_profile;
+
+/**
+ * @brief Clear all measurements.
+ */
+static void reset_t0_profile()
+{
+    for (alt_u32 entry = 0; entry < T0_PROFILE_NUM_ENTRIES; entry++)
+    {
+        t0_profile.min_cycles[entry] = 0xFFFFFFFF;
+        t0_profile.max_cycles[entry] = 0;
+        for (alt_u32 bucket = 0; bucket < T0_PROFILE_HISTOGRAM_NUM_BUCKETS; bucket++)
+        {
+            t0_profile.histogram[entry][bucket] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Return the histogram bucket of a measurement.
+ */
+static alt_u32 get_t0_profile_histogram_bucket(alt_u32 cycles)
+{
+    alt_u32 nbits = 32 - count_leading_zeros(cycles);
+    if (nbits <= T0_PROFILE_HISTOGRAM_FIRST_BUCKET_BITS)
+    {
+        return 0;
+    }
+    alt_u32 bucket = 1 + (nbits - T0_PROFILE_HISTOGRAM_FIRST_BUCKET_BITS - 1) / T0_PROFILE_HISTOGRAM_BUCKET_BITS;
+    if (bucket >= T0_PROFILE_HISTOGRAM_NUM_BUCKETS)
+    {
+        return T0_PROFILE_HISTOGRAM_NUM_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+/**
+ * @brief Add a measurement to the given entry.
+ *
+ * @param entry a T0 task or T0_PROFILE_LOOP
+ * @param cycles number of cycles measured
+ */
+static void record_t0_profile_cycles(alt_u32 entry, alt_u32 cycles)
+{
+    if (cycles < t0_profile.min_cycles[entry])
+    {
+        t0_profile.min_cycles[entry] = cycles;
+    }
+    if (cycles > t0_profile.max_cycles[entry])
+    {
+        t0_profile.max_cycles[entry] = cycles;
+    }
+    t0_profile.histogram[entry][get_t0_profile_histogram_bucket(cycles)]++;
+}
+
+/**
+ * @brief Start a measurement.
+ *
+ * @param sample the measurement
+ */
+static void start_t0_profile_sample(T0_PROFILE_SAMPLE* sample)
+{
+    sample->num_t0_entries = t0_scheduler.num_t0_entries;
+    sample->start_cycle = get_cycle_count();
+}
+
+/**
+ * @brief Finish a measurement and add it to the given entry.
+ * The measurement is dropped if Nios has entered T0 again since it started.
+ *
+ * @param entry a T0 task or T0_PROFILE_LOOP
+ * @param sample the measurement
+ */
+static void end_t0_profile_sample(alt_u32 entry, T0_PROFILE_SAMPLE* sample)
+{
+    alt_u32 cycles = get_cycle_count() - sample->start_cycle;
+    if (sample->num_t0_entries == t0_scheduler.num_t0_entries)
+    {
+        record_t0_profile_cycles(entry, cycles);
+    }
+}
+
+/**
+ * @brief Convert a number of cycles to the mailbox format.
+ */
+static alt_u32 get_t0_profile_mb_value(alt_u32 cycles)
+{
+    cycles >>= T0_PROFILE_MB_CYCLES_SHIFT;
+    if (cycles > T0_PROFILE_MB_MAX_VALUE)
+    {
+        return T0_PROFILE_MB_MAX_VALUE;
+    }
+    return cycles;
+}
+
+/**
+ * @brief Write the measurements to the mailbox.
+ *
+ * Entries without any measurement are reported with a minimum and maximum of 0.
+ */
+static void publish_t0_profile()
+{
+    for (alt_u32 entry = 0; entry < T0_PROFILE_NUM_ENTRIES; entry++)
+    {
+        alt_u32 min_value = 0;
+        alt_u32 max_value = 0;
+        if (t0_profile.max_cycles[entry] >= t0_profile.min_cycles[entry])
+        {
+            min_value = get_t0_profile_mb_value(t0_profile.min_cycles[entry]);
+            max_value = get_t0_profile_mb_value(t0_profile.max_cycles[entry]);
+        }
+
+        alt_u32 mb_offset = MB_T0_PROFILE + entry * T0_PROFILE_MB_ENTRY_SIZE;
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset, min_value & 0xFF);
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 1, min_value >> 8);
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 2, max_value & 0xFF);
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 3, max_value >> 8);
+    }
+
+    for (alt_u32 bucket = 0; bucket < T0_PROFILE_HISTOGRAM_NUM_BUCKETS; bucket++)
+    {
+        alt_u32 count = t0_profile.histogram[T0_PROFILE_LOOP][bucket];
+        if (count > T0_PROFILE_MB_MAX_COUNT)
+        {
+            count = T0_PROFILE_MB_MAX_COUNT;
+        }
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, MB_T0_LOOP_HISTOGRAM + bucket, count);
+    }
+}
+
+#endif /* WHITLEY_INC_T0_PROFILE_H_ */
@@ -80,6 +80,9 @@ static PFR_ALT_INLINE void PFR_ALT_ALWAYS_INLINE mb_process_reconfig_cpld_ufm_cm
  *
  * PIT L1 command can only be enabled if the PIT ID has been provisioned.
  *
+ * ENABLE_PIT_L2_CHUNKED command is the same as ENABLE_PIT_L2 command, except that
+ * firmware is sealed with per-chunk hashes. Please see pit_utils.h for more details.
+ *
  * There are two conditions where ENABLE_PIT_L2 command would be rejected:
  * - PIT L2 has been enabled before. This is an one-time operation. User needs to
  * erase provisioning, before enabling PIT L2 again.
@@ -109,7 +112,7 @@ static void mb_process_enable_pit_ufm_cmd(alt_u32 ufm_cmd)
             mb_set_ufm_provision_status(MB_UFM_PROV_CMD_ERROR_MASK);
         }
     }
-    else if (ufm_cmd == MB_UFM_PROV_ENABLE_PIT_L2)
+    else if ((ufm_cmd == MB_UFM_PROV_ENABLE_PIT_L2) || (ufm_cmd == MB_UFM_PROV_ENABLE_PIT_L2_CHUNKED))
     {
         if (check_ufm_status(UFM_STATUS_PIT_L2_ENABLE_BIT_MASK) ||
                 !check_ufm_status(UFM_STATUS_PIT_L1_ENABLE_BIT_MASK))
@@ -120,6 +123,10 @@ static void mb_process_enable_pit_ufm_cmd(alt_u32 ufm_cmd)
         }
         else
         {
+            if (ufm_cmd == MB_UFM_PROV_ENABLE_PIT_L2_CHUNKED)
+            {
+                set_ufm_status(UFM_STATUS_PIT_L2_CHUNKED_BIT_MASK);
+            }
             set_ufm_status(UFM_STATUS_PIT_L2_ENABLE_BIT_MASK);
 
             // Update status such that ENABLE_PIT_L2 command appears to be completed successfully
@@ -34,6 +34,9 @@
 #include "gen_gpo_controls.h"
 #include "gen_gpi_signals.h"
 #include "platform_log.h"
+#include "spi_region_auth_cache.h"
+#include "t0_profile.h"
+#include "t0_scheduler.h"
 #include "t0_watchdog_handler.h"
 #include "t0_provisioning.h"
 #include "t0_update.h"
@@ -59,6 +62,9 @@ static void bmc_reset_handler()
         // Clear IBB detection since we are now in the process of reacting to the reset.
         set_bit(U_GPO_1_ADDR, GPO_1_BMC_SPI_CLEAR_IBB_DETECTED);
 
+        // BMC was reset without Nios being involved. Re-authenticate its entire flash.
+        invalidate_spi_region_auth_cache(SPI_FLASH_BMC);
+
         // Perform BMC only reset to re-authenticate its flash
         log_panic(LAST_PANIC_BMC_RESET_DETECTED);
         perform_bmc_only_reset();
@@ -155,22 +161,49 @@ static void check_for_hpfr_panic_event()
  * If hierarchical PFR is supported, Nios firmware also checks whether other CPLDs
  * have any panic event.
  *
+ * The mailbox handlers and the boot monitoring are polled periodically, according to the
+ * T0 scheduler. PLTRST and BMC reset are detected from a single read of the GPI signals in
+ * every spin. A PLTRST also wakes up the update intent handler, so that deferred updates are
+ * picked up in the same spin. So does a change in the boot progress, which also wakes up the
+ * post-update flow.
+ *
+ * The duration of each handler and of each spin is measured with the T0 profile.
+ *
  * @see mb_ufm_provisioning_handler()
  * @see check_for_hpfr_panic_event()
  * @see watchdog_routine()
  * @see mb_update_intent_handler()
  * @see bmc_reset_handler()
  * @see post_update_routine()
+ * @see is_t0_task_due()
+ * @see end_t0_profile_sample()
  */
 static void perform_t0_operations()
 {
+    T0_PROFILE_SAMPLE loop_sample;
+    T0_PROFILE_SAMPLE task_sample;
+
+    start_t0_scheduler();
+
     while (1)
     {
+        start_t0_profile_sample(&loop_sample);
+
         // Pet the HW watchdog
         reset_hw_watchdog();
 
         // Check UFM provisioning request
-        mb_ufm_provisioning_handler();
+        if (is_t0_task_due(T0_TASK_PROVISIONING))
+        {
+            start_t0_profile_sample(&task_sample);
+            alt_u32 has_ufm_cmd = mb_has_ufm_cmd_trigger();
+            record_t0_task_poll(T0_TASK_PROVISIONING, has_ufm_cmd);
+            if (has_ufm_cmd)
+            {
+                mb_ufm_provisioning_handler();
+            }
+            end_t0_profile_sample(T0_TASK_PROVISIONING, &task_sample);
+        }
 
         // Monitor HPFR event if HPFR is supported
         check_for_hpfr_panic_event();
@@ -178,22 +211,82 @@ static void perform_t0_operations()
         // Activities for provisioned system
         if (is_ufm_provisioned())
         {
+            // Sample the GPI signals once in this spin
+            alt_u32 gpi_1 = IORD_32DIRECT(U_GPI_1_ADDR, 0);
+
             // Detect PLTRST
-            platform_reset_handler();
+            alt_u32 has_pltrst = (gpi_1 >> GPI_1_PLTRST_DETECTED_REARM_ACM_TIMER) & 0b1;
+            record_t0_task_poll(T0_TASK_PLTRST, has_pltrst);
+            if (has_pltrst)
+            {
+                start_t0_profile_sample(&task_sample);
+                platform_reset_handler();
+                end_t0_profile_sample(T0_TASK_PLTRST, &task_sample);
+
+                // Deferred updates may be released by this platform reset
+                wake_t0_task(T0_TASK_UPDATE_INTENT);
+            }
 
             // Monitor BMC/ME/ACM/BIOS boot progress
-            watchdog_routine();
+            if (is_t0_task_due(T0_TASK_WATCHDOG))
+            {
+                alt_u32 prev_wdt_boot_status = wdt_boot_status;
+                record_t0_task_poll(T0_TASK_WATCHDOG, 1);
+                start_t0_profile_sample(&task_sample);
+                watchdog_routine();
+                end_t0_profile_sample(T0_TASK_WATCHDOG, &task_sample);
+
+                // Updates are usually requested, and post-update flows resumed, right after a boot completes
+                if (wdt_boot_status != prev_wdt_boot_status)
+                {
+                    wake_t0_task(T0_TASK_UPDATE_INTENT);
+                    wake_t0_task(T0_TASK_POST_UPDATE);
+                }
+            }
 
             // Check updates
-            mb_update_intent_handler();
+            if (is_t0_task_due(T0_TASK_UPDATE_INTENT))
+            {
+                start_t0_profile_sample(&task_sample);
+                alt_u32 has_update_intent =
+                        read_from_mailbox(MB_BMC_UPDATE_INTENT) | read_from_mailbox(MB_PCH_UPDATE_INTENT);
+                record_t0_task_poll(T0_TASK_UPDATE_INTENT, has_update_intent);
+                if (has_update_intent)
+                {
+                    mb_update_intent_handler();
+                }
+                end_t0_profile_sample(T0_TASK_UPDATE_INTENT, &task_sample);
+            }
 
-            // Monitor BMC reset
-            bmc_reset_handler();
+            // Monitor BMC reset. IBB access is ignored while BMC is booting.
+            alt_u32 has_bmc_reset = (wdt_boot_status & WDT_BMC_BOOT_DONE_MASK)
+                    && ((gpi_1 >> GPI_1_BMC_SPI_IBB_ACCESS_DETECTED) & 0b1);
+            record_t0_task_poll(T0_TASK_BMC_RESET, has_bmc_reset);
+            if (has_bmc_reset)
+            {
+                start_t0_profile_sample(&task_sample);
+                bmc_reset_handler();
+                end_t0_profile_sample(T0_TASK_BMC_RESET, &task_sample);
+            }
 
             // Finish up any firmware/CPLD update in progress
-            post_update_routine();
+            if (is_t0_task_due(T0_TASK_POST_UPDATE))
+            {
+                record_t0_task_poll(T0_TASK_POST_UPDATE, 1);
+                start_t0_profile_sample(&task_sample);
+                post_update_routine();
+                end_t0_profile_sample(T0_TASK_POST_UPDATE, &task_sample);
+            }
+        }
+
+        end_t0_profile_sample(T0_PROFILE_LOOP, &loop_sample);
+        if ((t0_scheduler.tick % T0_PROFILE_PUBLISH_PERIOD) == 0)
+        {
+            publish_t0_profile();
         }
 
+        advance_t0_scheduler();
+
 #ifdef USE_SYSTEM_MOCK
         if (SYSTEM_MOCK::get()->should_exec_code_block(
                 SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS))
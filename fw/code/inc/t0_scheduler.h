@@ -0,0 +1,186 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file t0_scheduler.h
+ * @brief Decide which T0 handlers run in each spin of the T0 loop, and track their worst-case response latency.
+ *
+ * All timers in the timer bank are used by the watchdogs. The scheduler counts time in T0 loop spins
+ * instead. Each polled handler has a period in spins. Handlers that react to a GPI edge (e.g. PLTRST or
+ * BMC IBB access) are checked with a single read of the GPI register in every spin and only run when
+ * their signal is set.
+ *
+ * For each task, the scheduler records the worst-case number of spins between the previous poll and the poll
+ * that picked up an event. That is an upper bound of how long an event waited before Nios reacted to it.
+ */
+
+#ifndef WHITLEY_INC_T0_SCHEDULER_H_
+#define WHITLEY_INC_T0_SCHEDULER_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "utils.h"
+
+// Poll periods, in T0 loop spins
+#define T0_PROVISIONING_POLL_PERIOD 8
+#define T0_WATCHDOG_POLL_PERIOD 2
+#define T0_UPDATE_INTENT_POLL_PERIOD 8
+#define T0_POST_UPDATE_POLL_PERIOD 8
+
+/**
+ * Tasks of the T0 loop
+ */
+typedef enum
+{
+    T0_TASK_PROVISIONING  = 0,
+    T0_TASK_PLTRST        = 1,
+    T0_TASK_WATCHDOG      = 2,
+    T0_TASK_UPDATE_INTENT = 3,
+    T0_TASK_BMC_RESET     = 4,
+    T0_TASK_POST_UPDATE   = 5,
+    T0_NUM_TASKS          = 6,
+} T0_TASK_ENUM;
+
+typedef struct
+{
+    // Number of T0 loop spins since the power on
+    alt_u32 tick;
+    // Number of entries to T0 since the power on
+    alt_u32 num_t0_entries;
+    // Number of spins until the next poll of each task
+    alt_u32 countdown[T0_NUM_TASKS];
+    // Spin of the last poll of each task
+    alt_u32 last_poll_tick[T0_NUM_TASKS];
+    // Worst-case response latency of each task, in spins
+    alt_u32 max_latency[T0_NUM_TASKS];
+} T0_SCHEDULER;
+
+// Tasks that are triggered by a GPI signal are checked in every spin
+static const alt_u32 t0_task_poll_periods[T0_NUM_TASKS] = {
+        T0_PROVISIONING_POLL_PERIOD,
+        1,
+        T0_WATCHDOG_POLL_PERIOD,
+        T0_UPDATE_INTENT_POLL_PERIOD,
+        1,
+        T0_POST_UPDATE_POLL_PERIOD,
+};
+
+static T0_SCHEDULER t0_scheduler;
+
+/**
+ * @brief Reset the scheduler and its latency statistics.
+ */
+static void reset_t0_scheduler()
+{
+    t0_scheduler.tick = 0;
+    t0_scheduler.num_t0_entries = 0;
+    for (alt_u32 task = 0; task < T0_NUM_TASKS; task++)
+    {
+        t0_scheduler.countdown[task] = 0;
+        t0_scheduler.last_poll_tick[task] = 0;
+        t0_scheduler.max_latency[task] = 0;
+    }
+}
+
+/**
+ * @brief Make every task due in the next spin. This is called when Nios enters T0, since anything
+ * may have changed while Nios was in T-1.
+ */
+static void start_t0_scheduler()
+{
+    t0_scheduler.num_t0_entries++;
+    for (alt_u32 task = 0; task < T0_NUM_TASKS; task++)
+    {
+        t0_scheduler.countdown[task] = 0;
+        t0_scheduler.last_poll_tick[task] = t0_scheduler.tick;
+    }
+}
+
+/**
+ * @brief Move the scheduler to the next spin of the T0 loop.
+ */
+static PFR_ALT_INLINE void PFR_ALT_ALWAYS_INLINE advance_t0_scheduler()
+{
+    t0_scheduler.tick++;
+}
+
+/**
+ * @brief Check whether the given periodic task should be polled in this spin.
+ * If so, schedule its next poll.
+ *
+ * @param task the T0 task
+ * @return 1 if the task is due; 0, otherwise.
+ */
+static alt_u32 is_t0_task_due(T0_TASK_ENUM task)
+{
+    if (t0_scheduler.countdown[task])
+    {
+        t0_scheduler.countdown[task]--;
+        return 0;
+    }
+    t0_scheduler.countdown[task] = t0_task_poll_periods[task] - 1;
+    return 1;
+}
+
+/**
+ * @brief Make the given task due in the next check, regardless of its period.
+ * This is used when an edge triggered event implies work for a polled task.
+ *
+ * @param task the T0 task
+ */
+static void wake_t0_task(T0_TASK_ENUM task)
+{
+    t0_scheduler.countdown[task] = 0;
+}
+
+/**
+ * @brief Record a poll of the given task.
+ *
+ * If the poll picked up an event, the number of spins since the previous poll is a candidate for the
+ * worst-case response latency of this task.
+ *
+ * @param task the T0 task
+ * @param has_event 1 if the poll found an event to react to
+ */
+static void record_t0_task_poll(T0_TASK_ENUM task, alt_u32 has_event)
+{
+    if (has_event)
+    {
+        alt_u32 latency = t0_scheduler.tick - t0_scheduler.last_poll_tick[task];
+        if (latency > t0_scheduler.max_latency[task])
+        {
+            t0_scheduler.max_latency[task] = latency;
+        }
+    }
+    t0_scheduler.last_poll_tick[task] = t0_scheduler.tick;
+}
+
+/**
+ * @brief Return the worst-case response latency of the given task, in T0 loop spins.
+ */
+static alt_u32 get_t0_task_max_latency(T0_TASK_ENUM task)
+{
+    return t0_scheduler.max_latency[task];
+}
+
+#endif /* WHITLEY_INC_T0_SCHEDULER_H_ */
@@ -38,7 +38,18 @@
 #include "spi_flash_state.h"
 
 /**
- * @brief Monitor PCH update intent register and transition to T-1 mode to perform the update if necessary.
+ * Devices that must be held in reset in T-1, to perform the requested updates
+ */
+typedef enum
+{
+    TMIN1_RESET_NONE_MASK     = 0b00,
+    TMIN1_RESET_BMC_MASK      = 0b01,
+    TMIN1_RESET_PCH_MASK      = 0b10,
+    TMIN1_RESET_PLATFORM_MASK = 0b11,
+} TMIN1_RESET_MASK_ENUM;
+
+/**
+ * @brief Check the PCH update intent register and find out which reset is required to perform the update.
  *
  * This function reads the PCH update intent from the mailbox first.
  *
@@ -50,14 +61,16 @@
  * - It's a CPLD update and maximum failed CPLD update attempts have been reached.
  * - It's a active firmware update and the PCH recovery image is corrupted
  *
- * Once all these checks have passed, Nios firmware proceed to trigger the update.
- * If it's a PCH active firmware update, Nios performs a PCH-only reset. Otherwise, Nios brings down the whole platform.
+ * Once all these checks have passed, the update can be triggered.
+ * If it's a PCH active firmware update, only the PCH needs to be reset. Otherwise, the whole platform needs to be reset.
  * The actual update is done as part of the T-1 operations.
  *
- * @see act_on_update_intent
+ * @return the devices that must be reset to perform the update; TMIN1_RESET_NONE_MASK if there's no update to perform.
+ *
+ * @see mb_update_intent_handler
  * @see perform_tmin1_operations_for_pch
  */
-static void mb_update_intent_handler_for_pch()
+static alt_u32 mb_update_intent_handler_for_pch()
 {
     // Read the update intent
     alt_u32 update_intent = read_from_mailbox(MB_PCH_UPDATE_INTENT);
@@ -75,7 +88,7 @@ static void mb_update_intent_handler_for_pch()
             // This update intent is not actionable or valid.
             log_update_failure(SPI_FLASH_PCH, MINOR_ERROR_INVALID_UPDATE_INTENT);
             write_to_mailbox(MB_PCH_UPDATE_INTENT, 0);
-            return;
+            return TMIN1_RESET_NONE_MASK;
         }
 
         if (num_failed_update_attempts_from_pch >= MAX_FAILED_UPDATE_ATTEMPTS_FROM_PCH)
@@ -83,7 +96,7 @@ static void mb_update_intent_handler_for_pch()
             // If there are too many failed firmware update attempts, reject this update.
             log_update_failure(SPI_FLASH_PCH, MINOR_ERROR_EXCEEDED_MAX_FAILED_ATTEMPTS);
             write_to_mailbox(MB_PCH_UPDATE_INTENT, 0);
-            return;
+            return TMIN1_RESET_NONE_MASK;
         }
 
         if (check_spi_flash_state(SPI_FLASH_PCH, SPI_FLASH_STATE_RECOVERY_FAILED_AUTH_MASK))
@@ -95,7 +108,7 @@ static void mb_update_intent_handler_for_pch()
             {
                 log_update_failure(SPI_FLASH_PCH, MINOR_ERROR_ACTIVE_FW_UPDATE_NOT_ALLOWED);
                 write_to_mailbox(MB_PCH_UPDATE_INTENT, 0);
-                return;
+                return TMIN1_RESET_NONE_MASK;
             }
 
             // Allow update to recovery image directly
@@ -112,24 +125,18 @@ static void mb_update_intent_handler_for_pch()
         /*
          * Proceed to transition to T-1 mode and perform the update
          */
-        // Log panic event
-        log_panic(LAST_PANIC_PCH_UPDATE_INTENT);
-
-        // Enter T-1 mode to do the update there
         if (update_intent & MB_UPDATE_INTENT_PCH_ACTIVE_MASK)
         {
             // Only bring down PCH if only PCH active firmware is being updated
-            perform_pch_only_reset();
-        }
-        else
-        {
-            perform_platform_reset();
+            return TMIN1_RESET_PCH_MASK;
         }
+        return TMIN1_RESET_PLATFORM_MASK;
     }
+    return TMIN1_RESET_NONE_MASK;
 }
 
 /**
- * @brief Monitor BMC update intent register and transition to T-1 mode to perform the update if necessary.
+ * @brief Check the BMC update intent register and find out which reset is required to perform the update.
  *
  * This function reads the BMC update intent from the mailbox first.
  *
@@ -141,14 +148,16 @@ static void mb_update_intent_handler_for_pch()
  * - It's a CPLD update and maximum failed CPLD update attempts have been reached.
  * - It's a BMC active firmware update and the BMC recovery image is corrupted
  *
- * Once all these checks have passed, Nios firmware proceed to trigger the update.
- * If it's a BMC active firmware update, Nios performs a BMC-only reset. Otherwise, Nios brings down the whole platform.
+ * Once all these checks have passed, the update can be triggered.
+ * If it's a BMC active firmware update, only the BMC needs to be reset. Otherwise, the whole platform needs to be reset.
  * The actual update is done as part of the T-1 operations.
  *
- * @see act_on_update_intent
+ * @return the devices that must be reset to perform the update; TMIN1_RESET_NONE_MASK if there's no update to perform.
+ *
+ * @see mb_update_intent_handler
  * @see perform_tmin1_operations_for_bmc
  */
-static void mb_update_intent_handler_for_bmc()
+static alt_u32 mb_update_intent_handler_for_bmc()
 {
     // Read the update intent
     alt_u32 update_intent = read_from_mailbox(MB_BMC_UPDATE_INTENT);
@@ -166,7 +175,7 @@ static void mb_update_intent_handler_for_bmc()
             // This update intent is not actionable or valid.
             log_update_failure(SPI_FLASH_BMC, MINOR_ERROR_INVALID_UPDATE_INTENT);
             write_to_mailbox(MB_BMC_UPDATE_INTENT, 0);
-            return;
+            return TMIN1_RESET_NONE_MASK;
         }
 
         if (num_failed_update_attempts_from_bmc >= MAX_FAILED_UPDATE_ATTEMPTS_FROM_BMC)
@@ -174,7 +183,7 @@ static void mb_update_intent_handler_for_bmc()
             // If there are too many failed firmware/CPLD update attempts, reject this update.
             log_update_failure(SPI_FLASH_BMC, MINOR_ERROR_EXCEEDED_MAX_FAILED_ATTEMPTS);
             write_to_mailbox(MB_BMC_UPDATE_INTENT, 0);
-            return;
+            return TMIN1_RESET_NONE_MASK;
         }
 
         if (check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_RECOVERY_FAILED_AUTH_MASK))
@@ -186,7 +195,7 @@ static void mb_update_intent_handler_for_bmc()
             {
                 log_update_failure(SPI_FLASH_BMC, MINOR_ERROR_ACTIVE_FW_UPDATE_NOT_ALLOWED);
                 write_to_mailbox(MB_BMC_UPDATE_INTENT, 0);
-                return;
+                return TMIN1_RESET_NONE_MASK;
             }
 
             // Allow update to recovery image directly
@@ -207,38 +216,69 @@ static void mb_update_intent_handler_for_bmc()
             {
                 log_update_failure(SPI_FLASH_BMC, MINOR_ERROR_ACTIVE_FW_UPDATE_NOT_ALLOWED);
                 write_to_mailbox(MB_BMC_UPDATE_INTENT, 0);
-                return;
+                return TMIN1_RESET_NONE_MASK;
             }
         }
 
         /*
          * Proceed to transition to T-1 mode and perform the update
          */
-        // Log panic event
-        log_panic(LAST_PANIC_BMC_UPDATE_INTENT);
-
-        // Enter T-1 mode to do the update there
         if (update_intent & MB_UPDATE_INTENT_BMC_REQUIRE_PLATFORM_RESET_MASK)
         {
-            perform_platform_reset();
-        }
-        else
-        {
-            // Only bring down BMC if only BMC active firmware is being updated
-            perform_bmc_only_reset();
+            return TMIN1_RESET_PLATFORM_MASK;
         }
+        // Only bring down BMC if only BMC active firmware is being updated
+        return TMIN1_RESET_BMC_MASK;
     }
+    return TMIN1_RESET_NONE_MASK;
 }
 
 /**
- * @brief Monitor the PCH and BMC update intent fields in the mailbox register file.
+ * @brief Monitor the PCH and BMC update intent fields in the mailbox register file, and transition to T-1 mode
+ * to perform the updates if necessary.
+ *
+ * Both update intents are checked before any reset. All the pending updates are batched into a single T-1 cycle:
+ * If only the BMC (or only the PCH) needs to be reset, Nios performs a BMC-only (or PCH-only) reset. Otherwise,
+ * e.g. when there are updates for both BMC and PCH firmware, Nios brings down the whole platform once. In that T-1
+ * cycle, Nios updates the BMC firmware and then the PCH firmware. A CPLD update, if any, is performed last.
+ *
+ * An update intent that fails its checks is rejected on its own, with the error logged against its device.
  *
- * @see mb_update_intent_handler_for(SPI_FLASH_TYPE_ENUM)
+ * @see mb_update_intent_handler_for_bmc
+ * @see mb_update_intent_handler_for_pch
+ * @see act_on_cpld_update_intent
  */
 static void mb_update_intent_handler()
 {
-    mb_update_intent_handler_for_bmc();
-    mb_update_intent_handler_for_pch();
+    alt_u32 bmc_reset_mask = mb_update_intent_handler_for_bmc();
+    alt_u32 reset_mask = bmc_reset_mask | mb_update_intent_handler_for_pch();
+
+    if (reset_mask)
+    {
+        // Log one panic event for this T-1 cycle
+        if (bmc_reset_mask)
+        {
+            log_panic(LAST_PANIC_BMC_UPDATE_INTENT);
+        }
+        else
+        {
+            log_panic(LAST_PANIC_PCH_UPDATE_INTENT);
+        }
+
+        // Enter T-1 mode to do the updates there
+        if (reset_mask == TMIN1_RESET_BMC_MASK)
+        {
+            perform_bmc_only_reset();
+        }
+        else if (reset_mask == TMIN1_RESET_PCH_MASK)
+        {
+            perform_pch_only_reset();
+        }
+        else
+        {
+            perform_platform_reset();
+        }
+    }
 }
 
 /**
@@ -37,6 +37,7 @@
 #include "mailbox_utils.h"
 #include "platform_log.h"
 #include "spi_ctrl_utils.h"
+#include "spi_region_auth_cache.h"
 #include "transition.h"
 #include "utils.h"
 #include "watchdog_timers.h"
@@ -84,6 +85,9 @@ static void trigger_pch_wdt_recovery(
         // Other states can be erased: recovery updates are abandoned and Nios will redo authentication. 
         pch_flash_state = SPI_FLASH_STATE_REQUIRE_WDT_RECOVERY_MASK;
 
+        // The firmware failed to boot. Don't trust any previous authentication result.
+        invalidate_spi_region_auth_cache(SPI_FLASH_PCH);
+
         perform_platform_reset();
     }
     else
@@ -115,6 +119,9 @@ static void trigger_bmc_wdt_recovery(
         // Other states can be erased: recovery updates are abandoned and Nios will redo authentication. 
         bmc_flash_state = SPI_FLASH_STATE_REQUIRE_WDT_RECOVERY_MASK;
 
+        // The firmware failed to boot. Don't trust any previous authentication result.
+        invalidate_spi_region_auth_cache(SPI_FLASH_BMC);
+
         perform_platform_reset();
     }
     else
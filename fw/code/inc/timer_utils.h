@@ -31,6 +31,7 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "cycle_counter.h"
 #include "utils.h"
 
 /*
@@ -44,6 +45,8 @@
 #define U_TIMER_BANK_TIMER2_ADDR  __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_TIMER_BANK_AVMM_BRIDGE_BASE, 1)
 #define U_TIMER_BANK_TIMER3_ADDR  __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_TIMER_BANK_AVMM_BRIDGE_BASE, 2)
 
+// The word after the last timer is the cycle counter (see cycle_counter.h)
+
 #define U_TIMER_BANK_TIMER_VALUE_MASK    0x000FFFFF
 #define U_TIMER_BANK_TIMER_ACTIVE_MASK   0x10000000
 #define U_TIMER_BANK_TIMER_ACTIVE_BIT    28
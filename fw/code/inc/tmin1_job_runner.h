@@ -0,0 +1,285 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file tmin1_job_runner.h
+ * @brief Cooperative background job that authenticates SPI regions while Nios waits on the other flash device in T-1.
+ *
+ * An erase or program operation keeps a SPI flash device busy for a long time (e.g. a 64KB erase takes
+ * ~150ms), and the device cannot be read in the meantime. The other flash device and the crypto block
+ * are idle though. When Nios waits on a busy flash device through the helpers in this file, it switches
+ * to the other flash device and hashes one slice of its static SPI regions at a time. Verified regions
+ * are recorded in the SPI region authentication cache, so that the subsequent authentication of that
+ * flash device does not hash them again.
+ *
+ * There's only one background job at a time. Callers of the cooperative helpers must call
+ * pause_tmin1_bg_job() before they use the crypto block, since a SHA job may be in progress.
+ *
+ * @see spi_region_auth_cache.h
+ */
+
+#ifndef WHITLEY_INC_TMIN1_JOB_RUNNER_H_
+#define WHITLEY_INC_TMIN1_JOB_RUNNER_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "authentication.h"
+#include "crypto.h"
+#include "keychain.h"
+#include "pfm.h"
+#include "pfm_utils.h"
+#include "pfr_pointers.h"
+#include "spi_region_auth_cache.h"
+#include "spi_rw_utils.h"
+#include "utils.h"
+
+// Number of bytes hashed by the background job each time Nios finds the busy flash device still busy
+#define TMIN1_BG_JOB_SLICE_SIZE 0x1000
+
+typedef enum
+{
+    TMIN1_BG_JOB_IDLE,
+    // A job has been requested, but the signature of the active PFM hasn't been verified yet
+    TMIN1_BG_JOB_PENDING_PFM_AUTH,
+    TMIN1_BG_JOB_HASHING_SPI_REGIONS,
+} TMIN1_BG_JOB_STATE_ENUM;
+
+typedef struct
+{
+    TMIN1_BG_JOB_STATE_ENUM state;
+    SPI_FLASH_TYPE_ENUM spi_flash_type;
+    // Next definition to look at in the active PFM body
+    alt_u32* pfm_body_ptr;
+    // SPI region that is being hashed; 0 when no SHA job is in progress
+    PFM_SPI_REGION_DEF* region_def;
+    // Next SPI address to send to the crypto block
+    alt_u32 next_addr;
+    CRYPTO_SHA_CONTEXT sha_ctx;
+} TMIN1_BG_AUTH_JOB;
+
+// Static variable to track the background job
+static TMIN1_BG_AUTH_JOB tmin1_bg_auth_job;
+
+/**
+ * @brief Request static SPI regions of the active firmware in @p spi_flash_type flash to be authenticated in
+ * the background. The work happens only when Nios waits on the other flash device through the cooperative helpers.
+ */
+static void request_tmin1_bg_spi_region_auth(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    tmin1_bg_auth_job.state = TMIN1_BG_JOB_PENDING_PFM_AUTH;
+    tmin1_bg_auth_job.spi_flash_type = spi_flash_type;
+    tmin1_bg_auth_job.region_def = 0;
+}
+
+/**
+ * @brief Verify the signature of the active PFM, which is the source of the expected hashes.
+ * If this fails, the job is dropped. The foreground authentication will deal with the bad PFM.
+ * This function assumes that Nios has switched to the flash device of the background job.
+ */
+static void start_tmin1_bg_spi_region_auth()
+{
+    SPI_FLASH_TYPE_ENUM spi_flash_type = tmin1_bg_auth_job.spi_flash_type;
+    alt_u32* active_addr = get_spi_active_pfm_ptr(spi_flash_type);
+    KCH_SIGNATURE* active_pfm_sig = (KCH_SIGNATURE*) active_addr;
+    PFM* active_pfm = (PFM*) incr_alt_u32_ptr(active_addr, SIGNATURE_SIZE);
+
+    tmin1_bg_auth_job.state = TMIN1_BG_JOB_IDLE;
+    if (is_spi_region_auth_cache_usable(spi_flash_type)
+            && is_signature_valid(active_pfm_sig)
+            && (active_pfm->tag == PFM_MAGIC))
+    {
+        prepare_spi_region_auth_cache(spi_flash_type, active_pfm_sig->b0.pc_hash256);
+        tmin1_bg_auth_job.pfm_body_ptr = active_pfm->pfm_body;
+        tmin1_bg_auth_job.state = TMIN1_BG_JOB_HASHING_SPI_REGIONS;
+    }
+}
+
+/**
+ * @brief Look for the next static SPI region that has not been authenticated, and start a SHA job for it.
+ *
+ * @return 1 if a SHA job has been started; 0 if there's no more SPI region to authenticate.
+ */
+static alt_u32 start_next_tmin1_bg_region_hash()
+{
+    SPI_REGION_AUTH_CACHE* auth_cache = get_spi_region_auth_cache(tmin1_bg_auth_job.spi_flash_type);
+
+    while (1)
+    {
+        alt_u8 def_type = *((alt_u8*) tmin1_bg_auth_job.pfm_body_ptr);
+        if (def_type == SMBUS_RULE_DEF_TYPE)
+        {
+            tmin1_bg_auth_job.pfm_body_ptr = incr_alt_u32_ptr(tmin1_bg_auth_job.pfm_body_ptr, SMBUS_RULE_DEF_SIZE);
+        }
+        else if (def_type == SPI_REGION_DEF_TYPE)
+        {
+            PFM_SPI_REGION_DEF* region_def = (PFM_SPI_REGION_DEF*) tmin1_bg_auth_job.pfm_body_ptr;
+            tmin1_bg_auth_job.pfm_body_ptr = get_end_of_spi_region_def(region_def);
+
+            if ((region_def->hash_algorithm & PFM_HASH_ALGO_SHA256_MASK) && is_spi_region_static(region_def)
+                    && !is_spi_region_auth_cached(auth_cache, region_def->start_addr, region_def->end_addr))
+            {
+                tmin1_bg_auth_job.region_def = region_def;
+                tmin1_bg_auth_job.next_addr = region_def->start_addr;
+                sha_init(&tmin1_bg_auth_job.sha_ctx, region_def->end_addr - region_def->start_addr);
+                return 1;
+            }
+        }
+        else
+        {
+            // Break when there is no more region/rule definition in PFM body
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Send up to @p nbytes of the SPI region in progress to the crypto block. If that completes
+ * the SPI region, check its hash and record the result in the authentication cache.
+ * This function assumes that Nios has switched to the flash device of the background job.
+ */
+static void feed_tmin1_bg_region_hash(alt_u32 nbytes)
+{
+    PFM_SPI_REGION_DEF* region_def = tmin1_bg_auth_job.region_def;
+    alt_u32 size = region_def->end_addr - tmin1_bg_auth_job.next_addr;
+    if (size > nbytes)
+    {
+        size = nbytes;
+    }
+
+    sha_update(&tmin1_bg_auth_job.sha_ctx, get_spi_flash_ptr_with_offset(tmin1_bg_auth_job.next_addr), size);
+    tmin1_bg_auth_job.next_addr += size;
+
+    if (tmin1_bg_auth_job.next_addr == region_def->end_addr)
+    {
+        // A bad region is simply not recorded. The foreground authentication will catch it.
+        if (sha_final_and_verify(&tmin1_bg_auth_job.sha_ctx, region_def->region_hash))
+        {
+            add_spi_region_auth_cache_entry(get_spi_region_auth_cache(tmin1_bg_auth_job.spi_flash_type),
+                    region_def->start_addr, region_def->end_addr);
+        }
+        tmin1_bg_auth_job.region_def = 0;
+    }
+}
+
+/**
+ * @brief Do one slice of work for the background job, while @p busy_spi_flash_type flash is busy.
+ * Nios is connected to @p busy_spi_flash_type flash again when this function returns.
+ *
+ * @return 1 if some work has been done; 0 if there's nothing to do.
+ */
+static alt_u32 run_tmin1_bg_job_slice(SPI_FLASH_TYPE_ENUM busy_spi_flash_type)
+{
+    // Nios can't read from the busy flash device
+    if ((tmin1_bg_auth_job.state == TMIN1_BG_JOB_IDLE) || (tmin1_bg_auth_job.spi_flash_type == busy_spi_flash_type))
+    {
+        return 0;
+    }
+
+    switch_spi_flash(tmin1_bg_auth_job.spi_flash_type);
+
+    if (tmin1_bg_auth_job.state == TMIN1_BG_JOB_PENDING_PFM_AUTH)
+    {
+        start_tmin1_bg_spi_region_auth();
+    }
+    else if ((tmin1_bg_auth_job.region_def == 0) && !start_next_tmin1_bg_region_hash())
+    {
+        // All static regions have been authenticated
+        tmin1_bg_auth_job.state = TMIN1_BG_JOB_IDLE;
+    }
+    else
+    {
+        feed_tmin1_bg_region_hash(TMIN1_BG_JOB_SLICE_SIZE);
+    }
+
+    switch_spi_flash(busy_spi_flash_type);
+
+    // Pet HW timer
+    reset_hw_watchdog();
+    return 1;
+}
+
+/**
+ * @brief Complete the SPI region that the background job is hashing, so that the crypto block is free.
+ * The rest of the background job is resumed in the next cooperative wait.
+ */
+static void pause_tmin1_bg_job()
+{
+    if (tmin1_bg_auth_job.region_def)
+    {
+        SPI_FLASH_TYPE_ENUM cur_spi_flash_type = get_current_spi_flash_type();
+        switch_spi_flash(tmin1_bg_auth_job.spi_flash_type);
+        feed_tmin1_bg_region_hash(tmin1_bg_auth_job.region_def->end_addr - tmin1_bg_auth_job.next_addr);
+        switch_spi_flash(cur_spi_flash_type);
+    }
+}
+
+/**
+ * @brief Stop the background job. Whatever has been authenticated so far stays in the authentication cache.
+ */
+static void stop_tmin1_bg_job()
+{
+    pause_tmin1_bg_job();
+    tmin1_bg_auth_job.state = TMIN1_BG_JOB_IDLE;
+}
+
+/**
+ * @brief Wait for the current flash device to complete its erase/program operation,
+ * while running the background job on the other flash device.
+ */
+static void wait_for_spi_flash_with_bg_job()
+{
+    SPI_FLASH_TYPE_ENUM busy_spi_flash_type = get_current_spi_flash_type();
+    while (is_spi_flash_busy())
+    {
+        if (!run_tmin1_bg_job_slice(busy_spi_flash_type))
+        {
+            reset_hw_watchdog();
+        }
+    }
+}
+
+/**
+ * @brief Same as erase_spi_region(), except that the background job runs while each sector is being erased.
+ *
+ * @param region_start_addr Start address of the target SPI region
+ * @param nbytes size (in byte) of the target SPI region
+ *
+ * @see erase_spi_region
+ */
+static void erase_spi_region_with_bg_job(alt_u32 region_start_addr, alt_u32 nbytes)
+{
+    alt_u32 spi_addr = region_start_addr;
+    alt_u32 region_end_addr = region_start_addr + nbytes;
+    while (spi_addr < region_end_addr)
+    {
+        SPI_COMMAND_ENUM erase_cmd = get_spi_erase_cmd(spi_addr, region_end_addr);
+        if (!is_spi_erase_skippable(spi_addr, erase_cmd))
+        {
+            start_spi_erase_cmd(spi_addr, erase_cmd);
+            wait_for_spi_flash_with_bg_job();
+        }
+        spi_addr += get_spi_erase_size(erase_cmd);
+    }
+}
+
+#endif /* WHITLEY_INC_TMIN1_JOB_RUNNER_H_ */
@@ -0,0 +1,214 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * @file tmin1_profile.h
+ * @brief Measure how long the latest T-1 took, and how long Nios spent in each phase of it.
+ *
+ * The profile starts when Nios logs the entry to T-1 and ends when Nios logs the entry to T0. In between,
+ * the T-1 flow switches between phases (e.g. authentication or decompression). Phases may be nested; for
+ * example, a decompression happens within an update. Time is counted towards the innermost phase only.
+ *
+ * Time is measured with the cycle counter in the timer bank, which wraps around after about 85 seconds. A single
+ * phase may last longer than that (e.g. the decompression of a whole BMC region). Hence, the time is accumulated
+ * in milliseconds, and the current stretch is closed on every HW watchdog pet, which happens at least once a second.
+ *
+ * When the profile ends, the durations are published in the mailbox in milliseconds. The previous results
+ * stay in the mailbox until the next T-1 completes.
+ */
+
+#ifndef WHITLEY_INC_TMIN1_PROFILE_H_
+#define WHITLEY_INC_TMIN1_PROFILE_H_
+
+// Always include pfr_sys.h first
+#include "pfr_sys.h"
+
+#include "cycle_counter.h"
+#include "mailbox_enums.h"
+
+// In the mailbox, each duration is a 16-bit number of milliseconds. Larger values are saturated.
+#define TMIN1_PROFILE_MB_ENTRY_SIZE 2
+#define TMIN1_PROFILE_MB_MAX_VALUE 0xFFFF
+
+// Close the current stretch once it's longer than this, well before the cycle counter wraps around.
+#define TMIN1_PROFILE_MAX_STRETCH_CYCLES (SYS_CLK_CYCLES_PER_MS * 1000)
+
+/**
+ * Phases of T-1. Their order matches the layout in the mailbox.
+ */
+typedef enum
+{
+    // Time that's not in any of the phases below. The whole T-1 is reported in place of this phase.
+    TMIN1_PHASE_NONE          = 0,
+    TMIN1_PHASE_PIT           = 1,
+    TMIN1_PHASE_WDT_RECOVERY  = 2,
+    TMIN1_PHASE_UPDATE        = 3,
+    TMIN1_PHASE_ACTIVE_AUTH   = 4,
+    TMIN1_PHASE_RECOVERY_AUTH = 5,
+    TMIN1_PHASE_DECOMPRESSION = 6,
+    TMIN1_PHASE_RULES         = 7,
+    TMIN1_NUM_PHASES          = 8,
+} TMIN1_PHASE_ENUM;
+
+typedef struct
+{
+    // 1 if Nios is in T-1 and the profile is running
+    alt_u32 is_running;
+    TMIN1_PHASE_ENUM phase;
+    alt_u32 phase_start_cycle;
+    // Number of whole milliseconds spent in each phase
+    alt_u32 ms[TMIN1_NUM_PHASES];
+    // Remaining number of cycles (less than a millisecond) spent in each phase
+    alt_u32 cycles[TMIN1_NUM_PHASES];
+} TMIN1_PROFILE;
+
+static TMIN1_PROFILE tmin1_profile;
+
+/**
+ * @brief Add the time since the last phase switch (or watchdog pet) to the current phase.
+ */
+static void close_tmin1_profile_stretch()
+{
+    alt_u32 now = get_cycle_count();
+    alt_u32 stretch_cycles = now - tmin1_profile.phase_start_cycle;
+    TMIN1_PHASE_ENUM phase = tmin1_profile.phase;
+
+    tmin1_profile.ms[phase] += stretch_cycles / SYS_CLK_CYCLES_PER_MS;
+    tmin1_profile.cycles[phase] += stretch_cycles % SYS_CLK_CYCLES_PER_MS;
+    if (tmin1_profile.cycles[phase] >= SYS_CLK_CYCLES_PER_MS)
+    {
+        tmin1_profile.ms[phase]++;
+        tmin1_profile.cycles[phase] -= SYS_CLK_CYCLES_PER_MS;
+    }
+    tmin1_profile.phase_start_cycle = now;
+}
+
+/**
+ * @brief Close the current stretch if it's getting long, so that the cycle counter can't wrap around in it.
+ *
+ * This is called on every HW watchdog pet.
+ */
+static void tick_tmin1_profile()
+{
+    if (tmin1_profile.is_running &&
+            ((get_cycle_count() - tmin1_profile.phase_start_cycle) >= TMIN1_PROFILE_MAX_STRETCH_CYCLES))
+    {
+        close_tmin1_profile_stretch();
+    }
+}
+
+/**
+ * @brief Clear the T-1 profile in RAM and stop measuring.
+ */
+static void reset_tmin1_profile()
+{
+    for (alt_u32 phase = 0; phase < TMIN1_NUM_PHASES; phase++)
+    {
+        tmin1_profile.ms[phase] = 0;
+        tmin1_profile.cycles[phase] = 0;
+    }
+    tmin1_profile.phase = TMIN1_PHASE_NONE;
+    tmin1_profile.is_running = 0;
+}
+
+/**
+ * @brief Start the profile of a T-1. Results of the previous T-1 are cleared from RAM.
+ */
+static void start_tmin1_profile()
+{
+    reset_tmin1_profile();
+    tmin1_profile.phase_start_cycle = get_cycle_count();
+    tmin1_profile.is_running = 1;
+}
+
+/**
+ * @brief Switch the T-1 flow to the given phase.
+ *
+ * Nothing is measured outside of T-1.
+ *
+ * @param phase the new phase
+ * @return the previous phase, to be restored when the new phase ends
+ */
+static TMIN1_PHASE_ENUM switch_tmin1_phase(TMIN1_PHASE_ENUM phase)
+{
+    TMIN1_PHASE_ENUM prev_phase = tmin1_profile.phase;
+    if (tmin1_profile.is_running)
+    {
+        close_tmin1_profile_stretch();
+    }
+    tmin1_profile.phase = phase;
+    return prev_phase;
+}
+
+/**
+ * @brief Saturate a number of milliseconds to the size of a mailbox entry.
+ */
+static alt_u32 get_tmin1_profile_mb_value(alt_u32 ms)
+{
+    if (ms > TMIN1_PROFILE_MB_MAX_VALUE)
+    {
+        return TMIN1_PROFILE_MB_MAX_VALUE;
+    }
+    return ms;
+}
+
+/**
+ * @brief End the profile of a T-1 and publish it in the mailbox.
+ *
+ * The first entry in the mailbox is the whole T-1. It's followed by one entry per phase.
+ */
+static void finish_tmin1_profile()
+{
+    if (!tmin1_profile.is_running)
+    {
+        return;
+    }
+    close_tmin1_profile_stretch();
+    tmin1_profile.phase = TMIN1_PHASE_NONE;
+    tmin1_profile.is_running = 0;
+
+    // The whole T-1 is the sum of all phases, including the remainders below a millisecond
+    alt_u32 total_ms = 0;
+    alt_u32 total_cycles = 0;
+    for (alt_u32 phase = 0; phase < TMIN1_NUM_PHASES; phase++)
+    {
+        total_ms += tmin1_profile.ms[phase];
+        total_cycles += tmin1_profile.cycles[phase];
+    }
+    total_ms += total_cycles / SYS_CLK_CYCLES_PER_MS;
+
+    for (alt_u32 phase = 0; phase < TMIN1_NUM_PHASES; phase++)
+    {
+        alt_u32 ms = tmin1_profile.ms[phase];
+        if (phase == TMIN1_PHASE_NONE)
+        {
+            ms = total_ms;
+        }
+        ms = get_tmin1_profile_mb_value(ms);
+
+        alt_u32 mb_offset = MB_TMIN1_PROFILE + phase * TMIN1_PROFILE_MB_ENTRY_SIZE;
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset, ms & 0xFF);
+        IOWR(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 1, ms >> 8);
+    }
+}
+
+#endif /* WHITLEY_INC_TMIN1_PROFILE_H_ */
@@ -31,6 +31,7 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "decompression_checkpoint.h"
 #include "flash_validation.h"
 #include "gen_gpo_controls.h"
 #include "gen_gpi_signals.h"
@@ -39,6 +40,8 @@
 #include "smbus_relay_utils.h"
 #include "spi_ctrl_utils.h"
 #include "timer_utils.h"
+#include "tmin1_job_runner.h"
+#include "tmin1_profile.h"
 #include "tmin1_update.h"
 #include "watchdog_timers.h"
 
@@ -75,6 +78,8 @@ static void tmin1_boot_bmc()
         clear_bit(U_GPO_1_ADDR, GPO_1_BMC_SPI_ADDR_MODE_SET_3B);
 
         // Flip the external mux
+        // Once BMC can write to its flash, an interrupted decompression can't be resumed
+        abandon_decompression_checkpoint(SPI_FLASH_BMC);
         release_spi_ctrl(SPI_FLASH_BMC);
 
         /*
@@ -125,6 +130,8 @@ static void tmin1_boot_pch()
             check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_ALL_REGIONS_FAILED_AUTH_MASK)))
     {
         // Release SPI flash control to PCH
+        // Once PCH can write to its flash, an interrupted decompression can't be resumed
+        abandon_decompression_checkpoint(SPI_FLASH_PCH);
         release_spi_ctrl(SPI_FLASH_PCH);
 
 #ifndef PLATFORM_WILSON_CITY_FAB2
@@ -217,15 +224,19 @@ static void perform_tmin1_operations_for_bmc()
     wdt_boot_status &= ~WDT_BMC_BOOT_DONE_MASK;
 
     // Perform WDT recovery if there was a watchdog timeout in the previous T0 mode.
+    switch_tmin1_phase(TMIN1_PHASE_WDT_RECOVERY);
     perform_wdt_recovery(SPI_FLASH_BMC);
 
     // Perform updates as requested in the BMC update intent register
+    switch_tmin1_phase(TMIN1_PHASE_UPDATE);
     act_on_bmc_update_intent();
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
 
     // Perform authentication and possibly recovery on the BMC flash
     authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
 
     // Manually write protect the cpld recovery region inside the BMC spi flash
+    switch_tmin1_phase(TMIN1_PHASE_RULES);
     write_protect_cpld_recovery_region();
 
     // If there's an ongoing CPLD update, write protect the CPLD UPDATE staging region in BMC flash
@@ -233,6 +244,10 @@ static void perform_tmin1_operations_for_bmc()
     {
         write_protect_cpld_staging_region();
     }
+
+    // If there's a pending recovery firmware update, write protect its staging capsule in BMC flash
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
 }
 
 /**
@@ -263,13 +278,21 @@ static void perform_tmin1_operations_for_pch()
     wdt_boot_status &= ~WDT_PCH_BOOT_DONE_MASK;
 
     // Perform WDT recovery if there was a watchdog timeout in the previous T0 mode.
+    switch_tmin1_phase(TMIN1_PHASE_WDT_RECOVERY);
     perform_wdt_recovery(SPI_FLASH_PCH);
 
     // Perform updates as requested in the PCH update intent register
+    switch_tmin1_phase(TMIN1_PHASE_UPDATE);
     act_on_pch_update_intent();
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
 
     // Perform authentication and possibly recovery on the PCH flash
     authenticate_and_recover_spi_flash(SPI_FLASH_PCH);
+
+    // If there's a pending recovery firmware update, write protect its staging capsule in PCH flash
+    switch_tmin1_phase(TMIN1_PHASE_RULES);
+    write_protect_staging_capsule(SPI_FLASH_PCH);
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
 }
 
 /**
@@ -288,6 +311,7 @@ static void perform_tmin1_operations_for_pch()
  * 4. Perform authentication and recovery of all critical regions of platform FW storage (PCH flash and BMC flash). 
  * If the active firmware is valid, Nios firmware enables the SPI filtering and store SMBus command filtering rules
  * according to the active PFM.
+ * 5. Perform any CPLD update as indicated in BMC update intent register.
  */
 static void perform_tmin1_operations()
 {
@@ -300,20 +324,33 @@ static void perform_tmin1_operations()
 #endif
 
     // If a level of Protect-in-Transit is enabled, perform appropriate protection
+    switch_tmin1_phase(TMIN1_PHASE_PIT);
     perform_pit_protection();
 
     // Preparation for OOB PCH FW update (e.g. authenticate capsule and move it to PCH flash)
     // OOB PCH FW update requires both BMC and PCH in reset.
+    switch_tmin1_phase(TMIN1_PHASE_UPDATE);
     prep_for_oob_pch_fw_update();
 
     // Recovery update is supposed to happen only when both BMC and PCH are in reset.
     // Process any pending recovery update
     process_pending_recovery_update(SPI_FLASH_BMC);
     process_pending_recovery_update(SPI_FLASH_PCH);
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
+
+    // While BMC flash is busy with erase/program operations (e.g. BMC recovery or update),
+    // authenticate the static regions in PCH flash in the background.
+    request_tmin1_bg_spi_region_auth(SPI_FLASH_PCH);
 
     // Do BMC T-1 routine first. If there's any OOB PCH update request, the updated firmware version will be reflected in mailbox.
     perform_tmin1_operations_for_bmc();
+    stop_tmin1_bg_job();
     perform_tmin1_operations_for_pch();
+
+    // CPLD update causes reconfiguration. Do it after all the firmware updates in this T-1 cycle.
+    switch_tmin1_phase(TMIN1_PHASE_UPDATE);
+    act_on_cpld_update_intent();
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
 }
 
 #endif /* WHITLEY_INC_TMIN1_ROUTINES_H_ */
@@ -34,6 +34,8 @@
 #include "capsule_validation.h"
 #include "mailbox_utils.h"
 #include "spi_flash_state.h"
+#include "spi_region_auth_cache.h"
+#include "spi_we_mem_shadow.h"
 
 
 /**
@@ -50,15 +52,12 @@
  * This function looks for a match with any firmware update encoding first. BMC firmware update is processed first.
  * Before getting to this function, Nios should have processed any OOB PCH firmware update request.
  *
- * After processing the firmware updates, this function proceeds to check CPLD update. If there's a CPLD update
- * request, but a PCH/BMC recovery firmware update is in progress, then defer this CPLD update. The CPLD update intent
- * will be written back to BMC update intent register. This is done so that CPLD won't lose track of the
- * recovery firmware update. Update intents and internal global variables will be reset after switching to a 
- * different CPLD image for performing CPLD update. If there's no recovery firmware update in progress, perform the
- * CPLD update.
+ * Since CPLD update causes reconfiguration, it is done last in the T-1 cycle, after the PCH firmware update.
+ * The CPLD update intent is written back to BMC update intent register for act_on_cpld_update_intent().
  * 
  * @see mb_update_intent_handler
  * @see prep_for_oob_pch_fw_update
+ * @see act_on_cpld_update_intent
  */
 static void act_on_bmc_update_intent()
 {
@@ -84,30 +83,48 @@ static void act_on_bmc_update_intent()
         }
     }
 
-    // Since CPLD update causes reconfiguration, CPLD update needs to be checked last.
-    if (update_intent & MB_UPDATE_INTENT_CPLD_MASK)
+    // Since CPLD update causes reconfiguration, CPLD update is done last in this T-1 cycle.
+    // Write the CPLD update intent back to the mailbox register
+    write_to_mailbox(MB_BMC_UPDATE_INTENT, update_intent & MB_UPDATE_INTENT_CPLD_MASK);
+}
+
+/**
+ * @brief Perform the CPLD update requested in the BMC update intent register.
+ *
+ * This is called at the end of a T-1 cycle with both BMC and PCH in reset, after the BMC and PCH firmware updates.
+ * Hence, the firmware and CPLD updates that are requested together are done in the same T-1 cycle.
+ *
+ * If a PCH/BMC recovery firmware update is in progress, then defer this CPLD update. The CPLD update intent
+ * is left in BMC update intent register. This is done so that CPLD won't lose track of the
+ * recovery firmware update. Update intents and internal global variables will be reset after switching to a
+ * different CPLD image for performing CPLD update. If there's no recovery firmware update in progress, perform the
+ * CPLD update.
+ *
+ * @see act_on_bmc_update_intent
+ * @see trigger_cpld_update
+ */
+static void act_on_cpld_update_intent()
+{
+    alt_u32 update_intent = read_from_mailbox(MB_BMC_UPDATE_INTENT);
+
+    // This is an out-of-band CPLD update
+    if ((update_intent & MB_UPDATE_INTENT_CPLD_MASK)
+            && !check_spi_flash_state(SPI_FLASH_PCH, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK)
+            && !check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK))
     {
-        // This is an out-of-band CPLD update
-        if (check_spi_flash_state(SPI_FLASH_PCH, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK)
-                || check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK)
-                || (read_from_mailbox(MB_PCH_UPDATE_INTENT) & MB_UPDATE_INTENT_PCH_FW_UPDATE_MASK))
-        {
-            // If there's any firmware update pending, wait till that recovery update is completed.
-            // Write the update intent back to the mailbox register
-            write_to_mailbox(MB_BMC_UPDATE_INTENT, update_intent & MB_UPDATE_INTENT_CPLD_MASK);
-        }
-        else
-        {
-            // In BMC flash, there's a designated offset for CPLD update capsule.
-            alt_u32* signed_cpld_capsule = incr_alt_u32_ptr(signed_capsule, BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET);
+        write_to_mailbox(MB_BMC_UPDATE_INTENT, 0);
 
-            // Check the update capsule for CPLD update
-            if (check_capsule_before_update(SPI_FLASH_BMC, signed_cpld_capsule, update_intent & MB_UPDATE_INTENT_CPLD_MASK))
-            {
-                // The CPLD capsule passed authentication, so proceed with this CPLD update.
-                // This function call will end with a CPLD reconfiguration, so the Nios process will terminate here.
-                trigger_cpld_update(update_intent & MB_UPDATE_INTENT_CPLD_RECOVERY_MASK);
-            }
+        // In BMC flash, there's a designated offset for CPLD update capsule.
+        switch_spi_flash(SPI_FLASH_BMC);
+        alt_u32* signed_cpld_capsule = incr_alt_u32_ptr(
+                get_spi_staging_region_ptr(SPI_FLASH_BMC), BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET);
+
+        // Check the update capsule for CPLD update
+        if (check_capsule_before_update(SPI_FLASH_BMC, signed_cpld_capsule, update_intent & MB_UPDATE_INTENT_CPLD_MASK))
+        {
+            // The CPLD capsule passed authentication, so proceed with this CPLD update.
+            // This function call will end with a CPLD reconfiguration, so the Nios process will terminate here.
+            trigger_cpld_update(update_intent & MB_UPDATE_INTENT_CPLD_RECOVERY_MASK);
         }
     }
 }
@@ -157,12 +174,9 @@ static void process_pending_recovery_update(SPI_FLASH_TYPE_ENUM spi_flash_type)
     // Check for pending firmware recovery update
     if (check_spi_flash_state(spi_flash_type, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK))
     {
-        // There's a pending recovery update
-        if (check_capsule_before_fw_recovery_update(spi_flash_type, 0))
-        {
-            perform_firmware_recovery_update(spi_flash_type);
-        }
-        else
+        // There's a pending recovery update. It fails if the staging capsule fails authentication, or if the
+        // recovery capsule doesn't read back the same as the staging capsule.
+        if (!check_capsule_before_fw_recovery_update(spi_flash_type, 0) || !perform_firmware_recovery_update(spi_flash_type))
         {
             // Increment failed update attempts
             incr_failed_update_attempts(spi_flash_type);
@@ -181,6 +195,36 @@ static void process_pending_recovery_update(SPI_FLASH_TYPE_ENUM spi_flash_type)
     }
 }
 
+/**
+ * @brief Keep the staging capsule of a pending recovery firmware update write protected, until the recovery update.
+ *
+ * This must be called after the write protection rules of the active PFM have been applied. If the staging capsule
+ * of a pending recovery update has been authenticated, Nios makes its 16KB pages read-only on top of those rules.
+ * The recovery update can then trust the authentication result. Hence, while a recovery update is pending, the
+ * BMC or host can't write to those pages of the staging region, even if the active PFM allows it.
+ * Otherwise (e.g. the recovery update is done or has failed), the cached result is dropped and the staging region
+ * is left as the active PFM specifies.
+ *
+ * @param spi_flash_type indicate BMC or PCH SPI flash device
+ *
+ * @see perform_active_firmware_update
+ * @see check_capsule_before_fw_recovery_update
+ */
+static void write_protect_staging_capsule(SPI_FLASH_TYPE_ENUM spi_flash_type)
+{
+    SPI_REGION_AUTH_CACHE* cache = get_spi_region_auth_cache(spi_flash_type);
+    if (cache->staging_capsule_end_addr
+            && check_spi_flash_state(spi_flash_type, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK)
+            && *get_spi_we_mem_shadow_is_valid(spi_flash_type))
+    {
+        write_protect_spi_we_mem_range(spi_flash_type, cache->staging_capsule_start_addr, cache->staging_capsule_end_addr);
+    }
+    else
+    {
+        cache->staging_capsule_end_addr = 0;
+    }
+}
+
 /**
  * @brief When there's an out-of-band PCH firmware update request, Nios needs to copy PCH update capsule
  * from BMC SPI flash to PCH SPI flash.
@@ -33,6 +33,7 @@
 
 #include "tmin1_routines.h"
 #include "hierarchical_pfr.h"
+#include "t0_scheduler.h"
 
 /**
  * @brief Prepare the platform to enter T-1 mode.
@@ -113,6 +114,9 @@ static void perform_entry_to_t0()
     tmin1_boot_bmc_and_pch();
 
     log_platform_state(PLATFORM_STATE_ENTER_T0);
+
+    // Anything may have changed in T-1. Poll all T0 handlers in the next spin.
+    start_t0_scheduler();
 }
 
 /**
@@ -175,6 +179,8 @@ static void perform_entry_to_t0_bmc_only()
     if (!check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_ALL_REGIONS_FAILED_AUTH_MASK))
     {
         // Release SPI flash control to BMC
+        // Once BMC can write to its flash, an interrupted decompression can't be resumed
+        abandon_decompression_checkpoint(SPI_FLASH_BMC);
         release_spi_ctrl(SPI_FLASH_BMC);
 
         // Release reset on BMC
@@ -214,6 +220,9 @@ static void perform_bmc_only_reset()
     perform_entry_to_t0_bmc_only();
 
     log_platform_state(PLATFORM_STATE_ENTER_T0);
+
+    // Anything may have changed in T-1. Poll all T0 handlers in the next spin.
+    start_t0_scheduler();
 }
 
 /********************************************
@@ -281,6 +290,9 @@ static void perform_pch_only_reset()
     tmin1_boot_pch();
 
     log_platform_state(PLATFORM_STATE_ENTER_T0);
+
+    // Anything may have changed in T-1. Poll all T0 handlers in the next spin.
+    start_t0_scheduler();
 }
 
 #endif /* WHITLEY_INC_TRANSITION_H_ */
@@ -46,6 +46,7 @@
 #define UFM_STATUS_PIT_L2_ENABLE_BIT_MASK             0b1000000
 #define UFM_STATUS_PIT_HASH_STORED_BIT_MASK           0b10000000
 #define UFM_STATUS_PIT_L2_PASSED_BIT_MASK             0b100000000
+#define UFM_STATUS_PIT_L2_CHUNKED_BIT_MASK            0b1000000000
 
 // If root key hash, pch and bmc offsets are provisioned, we say CPLD has been provisioned
 #define UFM_STATUS_PROVISIONED_BIT_MASK               0b000001110
@@ -62,13 +63,16 @@
  *    - Bit6 = 0: Enable PIT level 2 protection
  *    - Bit7 = 0: PIT Platform firmware (BMC/PCH) hash stored
  *    - Bit8 = 0: PIT L2 protection passed and disabled
+ *    - Bit9 = 0: PIT L2 uses chunked firmware sealing
  * 2. OEM PFM authentication root key
  * 3. Start address of Active region PFM, Recovery region and Staging region for PCH SPI flash
  * 4. Start address of Active region PFM, Recovery region and Staging region for BMC SPI flash
  * 5. PIT ID
  *    - Identification used in Protect-in-Transit level 1 verification.
  * 6. PIT PCH FW HASH. This is used for PIT Level 2 "FW Sealing" protection.
+ *    - In chunked firmware sealing, this is the Merkle root of the PCH chunk hashes.
  * 7. PIT BMC FW HASH. This is used for PIT Level 2 "FW Sealing" protection.
+ *    - In chunked firmware sealing, this is the Merkle root of the BMC chunk hashes.
  * 8. PFR SVN enforcement policies.
  *    - Track the minimum SVN that is acceptable for an update
  *    - This is a 64-bit bitfield. This bitfield translate to a number within 0-64, inclusive.
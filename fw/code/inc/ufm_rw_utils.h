@@ -31,6 +31,7 @@
 // Always include pfr_sys.h first
 #include "pfr_sys.h"
 
+#include "mailbox_utils.h"
 #include "pfr_pointers.h"
 
 
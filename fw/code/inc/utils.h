@@ -175,4 +175,61 @@ static void alt_u32_memcpy_non_incr(alt_u32* dest_ptr, const alt_u32* src_ptr, c
     }
 }
 
+/**
+ * @brief Return the number of bits that are set in the given word.
+ * Nios doesn't have a popcount instruction. This is the branch-free parallel bit count.
+ *
+ * @param word the word to count
+ * @return number of set bits
+ */
+static alt_u32 count_set_bits(alt_u32 word)
+{
+    word = word - ((word >> 1) & 0x55555555);
+    word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+    word = (word + (word >> 4)) & 0x0F0F0F0F;
+    return (word * 0x01010101) >> 24;
+}
+
+/**
+ * @brief Return the number of leading zero bits (from bit 31) in the given word.
+ * Nios doesn't have a count-leading-zeros instruction. This is a 5-step binary search.
+ *
+ * @param word the word to scan
+ * @return number of leading zero bits; 32 if @p word is 0.
+ */
+static alt_u32 count_leading_zeros(alt_u32 word)
+{
+    if (word == 0)
+    {
+        return 32;
+    }
+
+    alt_u32 n = 0;
+    if ((word & 0xFFFF0000) == 0)
+    {
+        n += 16;
+        word <<= 16;
+    }
+    if ((word & 0xFF000000) == 0)
+    {
+        n += 8;
+        word <<= 8;
+    }
+    if ((word & 0xF0000000) == 0)
+    {
+        n += 4;
+        word <<= 4;
+    }
+    if ((word & 0xC0000000) == 0)
+    {
+        n += 2;
+        word <<= 2;
+    }
+    if ((word & 0x80000000) == 0)
+    {
+        n += 1;
+    }
+    return n;
+}
+
 #endif /* WHITLEY_INC_PFR_UTILS_H */
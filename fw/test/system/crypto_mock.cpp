@@ -33,6 +33,7 @@
 // Test headers
 #include "bsp_mock.h"
 #include "crypto_mock.h"
+#include "system_mock.h"
 
 // Code headers
 
@@ -47,7 +48,10 @@ CRYPTO_MOCK::CRYPTO_MOCK() :
     m_cur_transfer_size(0),
     m_crypto_data_idx(0),
     m_num_done_read_before_done(0),
-    m_crypto_calc_pass(false)
+    m_crypto_calc_pass(false),
+    m_sha_job_count(0),
+    m_ecdsa_job_count(0),
+    m_data_word_count(0)
 {
 
     // Clear all vectors
@@ -127,6 +131,11 @@ alt_u32 CRYPTO_MOCK::get_mem_word(void* addr)
 
             return ret;
         }
+        else if (m_crypto_state != CRYPTO_STATE::WAIT_CRYPTO_START)
+        {
+            // Nios must send all the data, declared in CRYPTO_DATA_LEN_ADDR, before polling for done
+            PFR_INTERNAL_ERROR("Polling crypto CSR before all data has been sent");
+        }
     }
     else if (addr_int == CRYPTO_DATA_ADDR)
     {
@@ -193,6 +202,7 @@ void CRYPTO_MOCK::set_mem_word(void* addr, alt_u32 data)
             m_crypto_state = CRYPTO_STATE::ACCEPT_SHA_DATA;
             m_ec_or_sha = EC_OR_SHA_STATE::SHA_AND_EC;
             m_cur_transfer_size = m_data_length;
+            m_ecdsa_job_count++;
         }
         else if (data & CRYPTO_CSR_SHA_START_MSK)
         {
@@ -200,6 +210,7 @@ void CRYPTO_MOCK::set_mem_word(void* addr, alt_u32 data)
             m_crypto_state = CRYPTO_STATE::ACCEPT_SHA_DATA;
             m_ec_or_sha = EC_OR_SHA_STATE::SHA_ONLY;
             m_cur_transfer_size = m_data_length;
+            m_sha_job_count++;
         }
     }
     else if (addr_int == CRYPTO_DATA_LEN_ADDR)
@@ -219,6 +230,10 @@ void CRYPTO_MOCK::set_mem_word(void* addr, alt_u32 data)
     }
     else if (addr_int == CRYPTO_DATA_ADDR)
     {
+        // Nios reads each data word (typically from SPI flash) before sending it
+        SYSTEM_MOCK::get()->advance_sim_time_ns(SIM_TIME_NS_CRYPTO_DATA_WORD);
+        m_data_word_count++;
+
         if (m_crypto_state == CRYPTO_STATE::ACCEPT_SHA_DATA)
         {
             m_cur_transfer_size -= 4;
@@ -280,8 +295,12 @@ void CRYPTO_MOCK::set_mem_word(void* addr, alt_u32 data)
 
 void CRYPTO_MOCK::reset()
 {
+    m_crypto_state = CRYPTO_STATE::WAIT_CRYPTO_START;
     m_data_length = 0;
     m_cur_transfer_size = 0;
+    m_sha_job_count = 0;
+    m_ecdsa_job_count = 0;
+    m_data_word_count = 0;
 
     // Resize the sha data to reallocate
     m_sha_data.resize(0);
@@ -49,6 +49,12 @@ public:
 
     bool is_addr_in_range(void* addr) override;
 
+    // Number of SHA-only jobs started since the last reset
+    alt_u32 get_sha_job_count() { return m_sha_job_count; }
+    alt_u32 get_ecdsa_job_count() { return m_ecdsa_job_count; }
+    // Number of words written to CRYPTO_DATA_ADDR since the last reset
+    alt_u32 get_data_word_count() { return m_data_word_count; }
+
 private:
     enum class CRYPTO_STATE
     {
@@ -81,6 +87,9 @@ private:
     alt_u32 m_num_done_read_before_done;
     alt_u32 m_calculated_sha[PFR_CRYPTO_LENGTH / 4];
     bool m_crypto_calc_pass;
+    alt_u32 m_sha_job_count;
+    alt_u32 m_ecdsa_job_count;
+    alt_u32 m_data_word_count;
 };
 
 #endif /* INC_SYSTEM_CRYPTO_MOCK_H */
@@ -0,0 +1,200 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+// Standard headers
+#include <algorithm>
+#include <cstring>
+
+// Test headers
+#include "pbc_encoder.h"
+
+// Number of bits in the hash of 3-byte sequences
+#define PBC_ENCODER_HASH_BITS 12
+
+static alt_u32 hash_3_bytes(const alt_u8* ptr)
+{
+    alt_u32 word = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16);
+    return (word * 2654435761u) >> (32 - PBC_ENCODER_HASH_BITS);
+}
+
+static void flush_literals(std::vector<alt_u8>& stream, const alt_u8* literal_ptr, alt_u32 nbytes)
+{
+    while (nbytes)
+    {
+        alt_u32 len = std::min<alt_u32>(nbytes, PBC_LZ_MAX_LITERAL_LEN);
+        stream.push_back(alt_u8(len - 1));
+        stream.insert(stream.end(), literal_ptr, literal_ptr + len);
+        literal_ptr += len;
+        nbytes -= len;
+    }
+}
+
+std::vector<alt_u8> PBC_ENCODER::compress_page(const alt_u8* page)
+{
+    // Greedy LZ77 with the most recent position of each 3-byte hash as the only match candidate
+    std::vector<alt_u8> stream;
+    std::vector<int> last_pos(1 << PBC_ENCODER_HASH_BITS, -1);
+
+    alt_u32 literal_start = 0;
+    alt_u32 pos = 0;
+    while (pos + PBC_LZ_MIN_MATCH_LEN <= PBC_EXPECTED_PAGE_SIZE)
+    {
+        alt_u32 hash = hash_3_bytes(page + pos);
+        int candidate = last_pos[hash];
+        last_pos[hash] = pos;
+
+        alt_u32 len = 0;
+        if (candidate >= 0)
+        {
+            alt_u32 max_len = std::min<alt_u32>(PBC_LZ_MAX_MATCH_LEN, PBC_EXPECTED_PAGE_SIZE - pos);
+            while ((len < max_len) && (page[candidate + len] == page[pos + len]))
+            {
+                len++;
+            }
+        }
+
+        if (len < PBC_LZ_MIN_MATCH_LEN)
+        {
+            pos++;
+            continue;
+        }
+
+        flush_literals(stream, page + literal_start, pos - literal_start);
+        alt_u32 distance = pos - candidate - 1;
+        stream.push_back(alt_u8(PBC_LZ_MATCH_TOKEN_MASK | (len - PBC_LZ_MIN_MATCH_LEN)));
+        stream.push_back(alt_u8(distance & 0xFF));
+        stream.push_back(alt_u8(distance >> 8));
+
+        // Index the positions inside the match
+        for (alt_u32 i = pos + 1; (i < pos + len) && (i + PBC_LZ_MIN_MATCH_LEN <= PBC_EXPECTED_PAGE_SIZE); i++)
+        {
+            last_pos[hash_3_bytes(page + i)] = i;
+        }
+        pos += len;
+        literal_start = pos;
+    }
+    flush_literals(stream, page + literal_start, PBC_EXPECTED_PAGE_SIZE - literal_start);
+    return stream;
+}
+
+std::vector<alt_u32> PBC_ENCODER::convert_to_per_page_lz(const PBC_HEADER* pbc)
+{
+    alt_u32 bitmap_nbytes = pbc->bitmap_nbit / 8;
+    const alt_u8* comp_bitmap = reinterpret_cast<const alt_u8*>(pbc + 1) + bitmap_nbytes;
+    const alt_u8* payload = comp_bitmap + bitmap_nbytes;
+
+    alt_u32 num_pages = 0;
+    for (alt_u32 bit_i = 0; bit_i < pbc->bitmap_nbit; bit_i++)
+    {
+        if (comp_bitmap[bit_i >> 3] & (1 << (7 - (bit_i % 8))))
+        {
+            num_pages++;
+        }
+    }
+
+    // Page table, followed by the word aligned pages
+    std::vector<alt_u8> page_table_and_data((num_pages + 1) * 4);
+    std::vector<alt_u32> page_offsets;
+    for (alt_u32 page_i = 0; page_i < num_pages; page_i++)
+    {
+        page_offsets.push_back(page_table_and_data.size());
+
+        const alt_u8* page = payload + page_i * PBC_EXPECTED_PAGE_SIZE;
+        std::vector<alt_u8> stream = compress_page(page);
+        if (((stream.size() + 3) & ~3u) < PBC_EXPECTED_PAGE_SIZE)
+        {
+            page_table_and_data.insert(page_table_and_data.end(), stream.begin(), stream.end());
+            page_table_and_data.resize((page_table_and_data.size() + 3) & ~3u, 0);
+        }
+        else
+        {
+            page_table_and_data.insert(page_table_and_data.end(), page, page + PBC_EXPECTED_PAGE_SIZE);
+        }
+    }
+    page_offsets.push_back(page_table_and_data.size());
+    std::memcpy(page_table_and_data.data(), page_offsets.data(), page_offsets.size() * 4);
+
+    // Header and bitmaps are the same, except for the version and payload length
+    alt_u32 header_and_bitmaps_nbytes = sizeof(PBC_HEADER) + 2 * bitmap_nbytes;
+    std::vector<alt_u32> pbc_v3((header_and_bitmaps_nbytes + page_table_and_data.size()) / 4);
+    alt_u8* pbc_v3_bytes = reinterpret_cast<alt_u8*>(pbc_v3.data());
+    std::memcpy(pbc_v3_bytes, pbc, header_and_bitmaps_nbytes);
+    std::memcpy(pbc_v3_bytes + header_and_bitmaps_nbytes, page_table_and_data.data(), page_table_and_data.size());
+
+    PBC_HEADER* header = reinterpret_cast<PBC_HEADER*>(pbc_v3_bytes);
+    header->version = PBC_VERSION_PER_PAGE_LZ;
+    header->payload_len = page_table_and_data.size();
+    return pbc_v3;
+}
+
+std::vector<alt_u32> PBC_ENCODER::convert_to_delta(const PBC_HEADER* pbc, const alt_u32* base_image, const alt_u32* base_pfm_hash)
+{
+    alt_u32 bitmap_nbytes = pbc->bitmap_nbit / 8;
+    const alt_u8* active_bitmap = reinterpret_cast<const alt_u8*>(pbc + 1);
+    const alt_u8* comp_bitmap = active_bitmap + bitmap_nbytes;
+    const alt_u8* payload = comp_bitmap + bitmap_nbytes;
+    const alt_u8* base_bytes = reinterpret_cast<const alt_u8*>(base_image);
+
+    std::vector<alt_u8> delta_bitmaps(2 * bitmap_nbytes, 0);
+    std::vector<alt_u8> delta_payload;
+    std::vector<alt_u8> blank_page(PBC_EXPECTED_PAGE_SIZE, PBC_EXPECTED_PATTERN);
+    alt_u32 comp_page_i = 0;
+    for (alt_u32 bit_i = 0; bit_i < pbc->bitmap_nbit; bit_i++)
+    {
+        alt_u8 mask = 1 << (7 - (bit_i % 8));
+        if (!(active_bitmap[bit_i >> 3] & mask))
+        {
+            continue;
+        }
+
+        // A page in the active bitmap ends up with its payload, or blank if it's not in the compression bitmap
+        const alt_u8* new_page = blank_page.data();
+        if (comp_bitmap[bit_i >> 3] & mask)
+        {
+            new_page = payload + comp_page_i * PBC_EXPECTED_PAGE_SIZE;
+            comp_page_i++;
+        }
+        if (std::memcmp(new_page, base_bytes + bit_i * PBC_EXPECTED_PAGE_SIZE, PBC_EXPECTED_PAGE_SIZE) == 0)
+        {
+            continue;
+        }
+
+        delta_bitmaps[bit_i >> 3] |= mask;
+        if (new_page != blank_page.data())
+        {
+            delta_bitmaps[bitmap_nbytes + (bit_i >> 3)] |= mask;
+            delta_payload.insert(delta_payload.end(), new_page, new_page + PBC_EXPECTED_PAGE_SIZE);
+        }
+    }
+
+    std::vector<alt_u32> pbc_delta((sizeof(PBC_HEADER) + delta_bitmaps.size() + delta_payload.size()) / 4);
+    alt_u8* pbc_delta_bytes = reinterpret_cast<alt_u8*>(pbc_delta.data());
+    std::memcpy(pbc_delta_bytes, pbc, sizeof(PBC_HEADER));
+    std::memcpy(pbc_delta_bytes + sizeof(PBC_HEADER), delta_bitmaps.data(), delta_bitmaps.size());
+    std::memcpy(pbc_delta_bytes + sizeof(PBC_HEADER) + delta_bitmaps.size(), delta_payload.data(), delta_payload.size());
+
+    PBC_HEADER* header = reinterpret_cast<PBC_HEADER*>(pbc_delta_bytes);
+    header->version = pbc->version | PBC_DELTA_VERSION_FLAG;
+    header->payload_len = delta_payload.size();
+    std::memcpy(header->base_pfm_hash, base_pfm_hash, PFR_CRYPTO_LENGTH);
+    return pbc_delta;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+
+#ifndef SYSTEM_PBC_ENCODER_H
+#define SYSTEM_PBC_ENCODER_H
+
+// Standard headers
+#include <vector>
+
+// Mock headers
+#include "alt_types_mock.h"
+
+// PFR system
+#include "pfr_sys.h"
+#include "pbc.h"
+
+/**
+ * Host-side encoder for the version 3 compression structure (see PBC_VERSION_PER_PAGE_LZ) and for
+ * delta capsules (see PBC_DELTA_VERSION_FLAG).
+ */
+class PBC_ENCODER
+{
+public:
+    // Return the LZ stream of a page of PBC_EXPECTED_PAGE_SIZE bytes.
+    static std::vector<alt_u8> compress_page(const alt_u8* page);
+
+    // Return a version 3 compression structure with the same bitmaps and page content as
+    // the given version 2 compression structure. Pages that don't shrink are stored as is.
+    static std::vector<alt_u32> convert_to_per_page_lz(const PBC_HEADER* pbc);
+
+    // Return a delta compression structure that turns the given base image into the image of the given
+    // version 2 compression structure. Pages that are the same in both images are dropped from the bitmaps.
+    static std::vector<alt_u32> convert_to_delta(const PBC_HEADER* pbc, const alt_u32* base_image, const alt_u32* base_pfm_hash);
+};
+
+#endif /* SYSTEM_PBC_ENCODER_H */
@@ -20,9 +20,13 @@
  * DEALINGS IN THE SOFTWARE.
  ******************************************************************************/
 
+// Standard headers
+#include <algorithm>
+
 // Test headers
 #include "bsp_mock.h"
 #include "spi_control_mock.h"
+#include "system_mock.h"
 
 // Code headers
 #include "spi_common.h"
@@ -36,6 +40,40 @@ SPI_CONTROL_MOCK* SPI_CONTROL_MOCK::s_inst = nullptr;
     __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_CSR_AVMM_BRIDGE_0_BASE, SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_SETTING_OFST)
 #define SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_ADDRESS_ADDR \
     __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_CSR_AVMM_BRIDGE_0_BASE, SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_ADDRESS_OFST)
+#define SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_READ_DATA0_ADDR \
+    __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_CSR_AVMM_BRIDGE_0_BASE, SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_READ_DATA0_OFST)
+
+// SFDP header and the first parameter header, which points to a BFPT of 16 DWORDs at address 0x10
+#define SFDP_MOCK_BFPT_ADDR 0x10
+static const alt_u32 SFDP_MOCK_HEADER[] = {0x50444653, 0xFF000106, 0x10010600, 0xFF000000 | SFDP_MOCK_BFPT_ADDR};
+
+// Erase types in BFPT DWORD 8 and 9: 4KB (0x20), 32KB (0x52) and 64KB (0xD8)
+#define SFDP_MOCK_BFPT_DW8 0x520F200C
+#define SFDP_MOCK_BFPT_DW9 0x0000D810
+// Typical erase times of the three erase types in BFPT DWORD 10. Each time field is (units << 5 | (count - 1)).
+#define SFDP_MOCK_BFPT_DW10(erase_4kb_field, erase_32kb_field, erase_64kb_field) \
+    (((erase_4kb_field) << 4) | ((erase_32kb_field) << 11) | ((erase_64kb_field) << 18))
+
+// Micron: 1-4-4 fast read with 8 wait states and 2 mode clocks, no QE bit.
+// Erase times are 48ms (4KB), 112ms (32KB) and 144ms (64KB).
+static const alt_u32 SFDP_MOCK_MICRON_BFPT[] = {
+    0xFFF320E5, 0x1FFFFFFF, 0x6B08EB48, 0xBB083B08, 0xFFFFFFEE, 0xFF00FFFF, 0xFF00FFFF, SFDP_MOCK_BFPT_DW8,
+    SFDP_MOCK_BFPT_DW9, SFDP_MOCK_BFPT_DW10(0x22, 0x26, 0x28), 0x00000080, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000};
+
+// Macronix: 1-4-4 fast read with 4 wait states and 2 mode clocks, QE is bit 6 of status register 1.
+// Erase times are 30ms (4KB), 144ms (32KB) and 288ms (64KB).
+static const alt_u32 SFDP_MOCK_MACRONIX_BFPT[] = {
+    0xFFF320E5, 0x1FFFFFFF, 0x6B08EB44, 0xBB043B08, 0xFFFFFFEE, 0xFF00FFFF, 0xFF00FFFF, SFDP_MOCK_BFPT_DW8,
+    SFDP_MOCK_BFPT_DW9, SFDP_MOCK_BFPT_DW10(0x1D, 0x28, 0x31), 0x00000080, 0x00000000,
+    0x00000000, 0x00000000, 0x00200000, 0x00000000};
+
+// Winbond: 1-4-4 fast read with 4 wait states and 2 mode clocks, QE is bit 1 of status register 2.
+// Erase times are 48ms (4KB), 112ms (32KB) and 144ms (64KB).
+static const alt_u32 SFDP_MOCK_WINBOND_BFPT[] = {
+    0xFFF320E5, 0x1FFFFFFF, 0x6B08EB44, 0xBB803B08, 0xFFFFFFEE, 0xFF00FFFF, 0xFF00FFFF, SFDP_MOCK_BFPT_DW8,
+    SFDP_MOCK_BFPT_DW9, SFDP_MOCK_BFPT_DW10(0x22, 0x26, 0x28), 0x00000080, 0x00000000,
+    0x00000000, 0x00000000, 0x00400000, 0x00000000};
 
 // Return the singleton instance of spi flash mock
 SPI_CONTROL_MOCK* SPI_CONTROL_MOCK::get()
@@ -51,7 +89,13 @@ SPI_CONTROL_MOCK* SPI_CONTROL_MOCK::get()
 SPI_CONTROL_MOCK::SPI_CONTROL_MOCK()
 {
     m_4kb_erase_counter = 0;
+    m_32kb_erase_counter = 0;
     m_64kb_erase_counter = 0;
+    m_blank_sector_erase_counter = 0;
+    m_we_mem_write_counter = 0;
+    clear_busy_state();
+    m_bmc_sfdp_profile = SFDP_PROFILE::MICRON_MT25Q;
+    m_pch_sfdp_profile = SFDP_PROFILE::MACRONIX_MX25L;
 }
 
 SPI_CONTROL_MOCK::~SPI_CONTROL_MOCK() {}
@@ -65,7 +109,96 @@ void SPI_CONTROL_MOCK::reset()
     m_spi_master_csr.reset();
 
     m_4kb_erase_counter = 0;
+    m_32kb_erase_counter = 0;
     m_64kb_erase_counter = 0;
+    m_blank_sector_erase_counter = 0;
+    m_we_mem_write_counter = 0;
+    clear_busy_state();
+    m_bmc_sfdp_profile = SFDP_PROFILE::MICRON_MT25Q;
+    m_pch_sfdp_profile = SFDP_PROFILE::MACRONIX_MX25L;
+}
+
+void SPI_CONTROL_MOCK::clear_busy_state()
+{
+    m_bmc_busy_until_ns = 0;
+    m_pch_busy_until_ns = 0;
+    m_last_erase_ptr = nullptr;
+    m_last_erase_nbytes = 0;
+    m_last_erase_done_ns = 0;
+}
+
+void SPI_CONTROL_MOCK::interrupt_erase_in_progress()
+{
+    if (m_last_erase_ptr && (SYSTEM_MOCK::get()->get_sim_time_ns() < m_last_erase_done_ns))
+    {
+        alt_u32 nwords = m_last_erase_nbytes >> 2;
+        std::fill(m_last_erase_ptr + nwords / 2, m_last_erase_ptr + nwords, 0x5A5A5A5A);
+    }
+    clear_busy_state();
+}
+
+alt_u64* SPI_CONTROL_MOCK::get_busy_until_ns_of_selected_flash()
+{
+    if (NIOS_GPIO_MOCK::get()->check_bit(U_GPO_1_ADDR, GPO_1_SPI_MASTER_BMC_PCHN))
+    {
+        return &m_bmc_busy_until_ns;
+    }
+    return &m_pch_busy_until_ns;
+}
+
+void SPI_CONTROL_MOCK::set_sfdp_profile(SPI_FLASH_TYPE_ENUM spi_flash_type, SFDP_PROFILE profile)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        m_bmc_sfdp_profile = profile;
+    }
+    else
+    {
+        m_pch_sfdp_profile = profile;
+    }
+}
+
+SPI_CONTROL_MOCK::SFDP_PROFILE SPI_CONTROL_MOCK::get_sfdp_profile_of_selected_flash()
+{
+    if (NIOS_GPIO_MOCK::get()->check_bit(U_GPO_1_ADDR, GPO_1_SPI_MASTER_BMC_PCHN))
+    {
+        return m_bmc_sfdp_profile;
+    }
+    return m_pch_sfdp_profile;
+}
+
+alt_u32 SPI_CONTROL_MOCK::get_sfdp_dword(SFDP_PROFILE profile, alt_u32 sfdp_addr)
+{
+    const alt_u32* bfpt = nullptr;
+    if (profile == SFDP_PROFILE::MICRON_MT25Q)
+    {
+        bfpt = SFDP_MOCK_MICRON_BFPT;
+    }
+    else if (profile == SFDP_PROFILE::MACRONIX_MX25L)
+    {
+        bfpt = SFDP_MOCK_MACRONIX_BFPT;
+    }
+    else if (profile == SFDP_PROFILE::WINBOND_W25Q)
+    {
+        bfpt = SFDP_MOCK_WINBOND_BFPT;
+    }
+    else
+    {
+        // Read SFDP command is not supported
+        return 0xFFFFFFFF;
+    }
+
+    alt_u32 dword_i = sfdp_addr >> 2;
+    if (sfdp_addr < SFDP_MOCK_BFPT_ADDR)
+    {
+        return SFDP_MOCK_HEADER[dword_i];
+    }
+    dword_i -= SFDP_MOCK_BFPT_ADDR >> 2;
+    if (dword_i < 16)
+    {
+        return bfpt[dword_i];
+    }
+    return 0xFFFFFFFF;
 }
 
 bool SPI_CONTROL_MOCK::is_addr_in_range(void* addr)
@@ -73,15 +206,33 @@ bool SPI_CONTROL_MOCK::is_addr_in_range(void* addr)
     return m_bmc_we_mem.is_addr_in_range(addr) || m_pch_we_mem.is_addr_in_range(addr) || m_spi_master_csr.is_addr_in_range(addr);
 }
 
-alt_u32 SPI_CONTROL_MOCK::get_mem_word(void* addr)
+void SPI_CONTROL_MOCK::erase_sector(alt_u32* sector_start_ptr, alt_u32 nbytes)
 {
-    if (m_bmc_we_mem.is_addr_in_range(addr))
+    alt_u32* sector_end_ptr = sector_start_ptr + (nbytes >> 2);
+    if (std::all_of(sector_start_ptr, sector_end_ptr, [](alt_u32 word) { return word == 0xFFFFFFFF; }))
     {
-        return m_bmc_we_mem.get_mem_word(addr);
+        m_blank_sector_erase_counter++;
     }
-    else if (m_pch_we_mem.is_addr_in_range(addr))
+    std::fill(sector_start_ptr, sector_end_ptr, 0xFFFFFFFF);
+    m_last_erase_ptr = sector_start_ptr;
+    m_last_erase_nbytes = nbytes;
+}
+
+alt_u32 SPI_CONTROL_MOCK::get_we_mem_word(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 word_pos)
+{
+    if (spi_flash_type == SPI_FLASH_BMC)
+    {
+        return m_bmc_we_mem.get_mem_word(__IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, word_pos));
+    }
+    return m_pch_we_mem.get_mem_word(__IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, word_pos));
+}
+
+alt_u32 SPI_CONTROL_MOCK::get_mem_word(void* addr)
+{
+    if (m_bmc_we_mem.is_addr_in_range(addr) || m_pch_we_mem.is_addr_in_range(addr))
     {
-        return m_pch_we_mem.get_mem_word(addr);
+        // The SPI filter doesn't support reads from the write enable memory
+        PFR_INTERNAL_ERROR("It is illegal to read from the write enable memory");
     }
     return m_spi_master_csr.get_mem_word(addr);
 }
@@ -91,10 +242,12 @@ void SPI_CONTROL_MOCK::set_mem_word(void* addr, alt_u32 data)
     if (m_bmc_we_mem.is_addr_in_range(addr))
     {
         m_bmc_we_mem.set_mem_word(addr, data);
+        m_we_mem_write_counter++;
     }
     else if (m_pch_we_mem.is_addr_in_range(addr))
     {
         m_pch_we_mem.set_mem_word(addr, data);
+        m_we_mem_write_counter++;
     }
     // In CSR memory range
     m_spi_master_csr.set_mem_word(addr, data);
@@ -114,19 +267,43 @@ void SPI_CONTROL_MOCK::set_mem_word(void* addr, alt_u32 data)
             // Go through list of supported command
             if (spi_command == SPI_CMD_4KB_SECTOR_ERASE)
             {
-                alt_u32* spi_region_start_addr = spi_ptr + (spi_addr >> 2);
-                alt_u32* spi_region_end_addr = spi_region_start_addr + (0x1000 >> 2);
-                std::fill(spi_region_start_addr, spi_region_end_addr, 0xFFFFFFFF);
-
+                erase_sector(spi_ptr + (spi_addr >> 2), 0x1000);
                 m_4kb_erase_counter++;
+                *get_busy_until_ns_of_selected_flash() = SYSTEM_MOCK::get()->get_sim_time_ns() + SIM_TIME_NS_SPI_4KB_ERASE;
+                m_last_erase_done_ns = *get_busy_until_ns_of_selected_flash();
+            }
+            else if (spi_command == SPI_CMD_32KB_SECTOR_ERASE)
+            {
+                erase_sector(spi_ptr + (spi_addr >> 2), 0x8000);
+                m_32kb_erase_counter++;
+                *get_busy_until_ns_of_selected_flash() = SYSTEM_MOCK::get()->get_sim_time_ns() + SIM_TIME_NS_SPI_32KB_ERASE;
+                m_last_erase_done_ns = *get_busy_until_ns_of_selected_flash();
             }
             else if (spi_command == SPI_CMD_64KB_SECTOR_ERASE)
             {
-                alt_u32* spi_region_start_addr = spi_ptr + (spi_addr >> 2);
-                alt_u32* spi_region_end_addr = spi_region_start_addr + (0x10000 >> 2);
-                std::fill(spi_region_start_addr, spi_region_end_addr, 0xFFFFFFFF);
-
+                erase_sector(spi_ptr + (spi_addr >> 2), 0x10000);
                 m_64kb_erase_counter++;
+                *get_busy_until_ns_of_selected_flash() = SYSTEM_MOCK::get()->get_sim_time_ns() + SIM_TIME_NS_SPI_64KB_ERASE;
+                m_last_erase_done_ns = *get_busy_until_ns_of_selected_flash();
+            }
+            else if (spi_command == SPI_CMD_READ_STATUS_REG)
+            {
+                alt_u32 status = 0;
+                if (SYSTEM_MOCK::get()->is_sim_time_enabled())
+                {
+                    // Report Write In Progress until the erase completes in simulated time
+                    SYSTEM_MOCK::get()->advance_sim_time_ns(SIM_TIME_NS_SPI_STATUS_READ);
+                    if (SYSTEM_MOCK::get()->get_sim_time_ns() < *get_busy_until_ns_of_selected_flash())
+                    {
+                        status |= SPI_STATUS_WIP_BIT_MASK;
+                    }
+                }
+                m_spi_master_csr.set_mem_word(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_READ_DATA0_ADDR, status);
+            }
+            else if (spi_command == SPI_CMD_READ_SFDP)
+            {
+                m_spi_master_csr.set_mem_word(SPI_CONTROL_1_CSR_CS_FLASH_COMMAND_READ_DATA0_ADDR,
+                        get_sfdp_dword(get_sfdp_profile_of_selected_flash(), spi_addr));
             }
         }
     }
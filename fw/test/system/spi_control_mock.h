@@ -53,7 +53,33 @@ public:
     bool is_addr_in_range(void* addr) override;
 
     alt_u32 get_4kb_erase_count() {return m_4kb_erase_counter;}
+    alt_u32 get_32kb_erase_count() {return m_32kb_erase_counter;}
     alt_u32 get_64kb_erase_count() {return m_64kb_erase_counter;}
+    // Number of erase commands sent to sectors that were already blank
+    alt_u32 get_blank_sector_erase_count() {return m_blank_sector_erase_counter;}
+    // Number of words written to the write enable memories
+    alt_u32 get_we_mem_write_count() {return m_we_mem_write_counter;}
+    // Content of a word in the write enable memory. Nios can't read the write enable memory; this is for unittests only.
+    alt_u32 get_we_mem_word(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 word_pos);
+
+    // Mark both SPI flash devices as idle (i.e. no erase in progress) in simulated time
+    void clear_busy_state();
+
+    // Leave undefined content in the second half of the sector, if its erase hasn't completed in simulated time.
+    // Then, mark both SPI flash devices as idle.
+    void interrupt_erase_in_progress();
+
+    // SFDP content reported by a SPI flash device. By default, BMC flash is a Micron device and
+    // PCH flash is a Macronix device.
+    enum class SFDP_PROFILE
+    {
+        MICRON_MT25Q,
+        MACRONIX_MX25L,
+        WINBOND_W25Q,
+        // Device without SFDP
+        NONE,
+    };
+    void set_sfdp_profile(SPI_FLASH_TYPE_ENUM spi_flash_type, SFDP_PROFILE profile);
 
 private:
     // Singleton inst
@@ -71,7 +97,31 @@ private:
 
     // Counters
     alt_u32 m_4kb_erase_counter;
+    alt_u32 m_32kb_erase_counter;
     alt_u32 m_64kb_erase_counter;
+    alt_u32 m_blank_sector_erase_counter;
+    alt_u32 m_we_mem_write_counter;
+
+    // Simulated time when the erase in progress completes on each SPI flash device
+    alt_u64 m_bmc_busy_until_ns;
+    alt_u64 m_pch_busy_until_ns;
+    alt_u64* get_busy_until_ns_of_selected_flash();
+
+    // The last erased sector and the simulated time when its erase completes
+    alt_u32* m_last_erase_ptr;
+    alt_u32 m_last_erase_nbytes;
+    alt_u64 m_last_erase_done_ns;
+
+    // SFDP profile of each SPI flash device
+    SFDP_PROFILE m_bmc_sfdp_profile;
+    SFDP_PROFILE m_pch_sfdp_profile;
+    SFDP_PROFILE get_sfdp_profile_of_selected_flash();
+
+    // Return the SFDP DWORD at the given address, for the given profile
+    alt_u32 get_sfdp_dword(SFDP_PROFILE profile, alt_u32 sfdp_addr);
+
+    // Fill the sector with 0xFF and count the erase of a sector that is already blank
+    void erase_sector(alt_u32* sector_start_ptr, alt_u32 nbytes);
 
     // Instance of the SPI flash mock
     SPI_FLASH_MOCK* m_spi_flash_mock_inst = SPI_FLASH_MOCK::get();
@@ -70,7 +70,9 @@ SYSTEM_MOCK::SYSTEM_MOCK() : m_assert_abort_or_throw(true), m_malloc_rwdata_offs
     m_memory_mocks.push_back(std::make_unique<MAILBOX_MOCK>());
 
     // Create the crypto block
-    m_memory_mocks.push_back(std::make_unique<CRYPTO_MOCK>());
+    std::unique_ptr<CRYPTO_MOCK> crypto_mock = std::make_unique<CRYPTO_MOCK>();
+    m_crypto_mock_inst = crypto_mock.get();
+    m_memory_mocks.push_back(std::move(crypto_mock));
 
     // Create the timer
     m_memory_mocks.push_back(std::make_unique<TIMER_MOCK>());
@@ -162,6 +164,14 @@ void SYSTEM_MOCK::reset()
     m_t_minus_1_bmc_only_counter = 0;
     m_t_minus_1_pch_only_counter = 0;
 
+    // Disable simulated time
+    m_sim_time_enabled = false;
+    m_sim_time_ns = 0;
+    m_power_loss_at_ns = 0;
+
+    // Restart the cycle counter
+    m_avmm_access_count = 0;
+
     // Reset the UFM & CFM
     m_ufm_mock_inst->reset();
 }
@@ -203,6 +213,7 @@ alt_u32 SYSTEM_MOCK::get_mem_word(void* addr, bool nocallbacks)
 
     if (!nocallbacks)
     {
+        m_avmm_access_count++;
         for (auto fn : m_read_write_callbacks)
         {
             fn(READ_OR_WRITE::READ, addr, ret);
@@ -248,6 +259,7 @@ void SYSTEM_MOCK::set_mem_word(void* addr, alt_u32 data, bool nocallbacks)
 
     if (!nocallbacks)
     {
+        m_avmm_access_count++;
         for (auto fn : m_read_write_callbacks)
         {
             fn(READ_OR_WRITE::WRITE, addr, data);
@@ -290,6 +302,10 @@ alt_u32 SYSTEM_MOCK::get_spi_cmd_count(SPI_COMMAND_ENUM spi_cmd)
     {
         return m_spi_control_mock_inst->get_4kb_erase_count();
     }
+    else if (spi_cmd == SPI_CMD_32KB_SECTOR_ERASE)
+    {
+        return m_spi_control_mock_inst->get_32kb_erase_count();
+    }
     else if (spi_cmd == SPI_CMD_64KB_SECTOR_ERASE)
     {
         return m_spi_control_mock_inst->get_64kb_erase_count();
@@ -298,6 +314,57 @@ alt_u32 SYSTEM_MOCK::get_spi_cmd_count(SPI_COMMAND_ENUM spi_cmd)
     return 0;
 }
 
+alt_u32 SYSTEM_MOCK::get_crypto_sha_job_count()
+{
+    return m_crypto_mock_inst->get_sha_job_count();
+}
+
+alt_u32 SYSTEM_MOCK::get_crypto_ecdsa_job_count()
+{
+    return m_crypto_mock_inst->get_ecdsa_job_count();
+}
+
+alt_u32 SYSTEM_MOCK::get_crypto_data_word_count()
+{
+    return m_crypto_mock_inst->get_data_word_count();
+}
+
+alt_u32 SYSTEM_MOCK::get_spi_blank_sector_erase_count()
+{
+    return m_spi_control_mock_inst->get_blank_sector_erase_count();
+}
+
+alt_u32 SYSTEM_MOCK::get_spi_we_mem_write_count()
+{
+    return m_spi_control_mock_inst->get_we_mem_write_count();
+}
+
+alt_u32 SYSTEM_MOCK::get_spi_we_mem_word(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 word_pos)
+{
+    return m_spi_control_mock_inst->get_we_mem_word(spi_flash_type, word_pos);
+}
+
+void SYSTEM_MOCK::set_spi_flash_sfdp_profile(SPI_FLASH_TYPE_ENUM spi_flash_type, SPI_CONTROL_MOCK::SFDP_PROFILE profile)
+{
+    m_spi_control_mock_inst->set_sfdp_profile(spi_flash_type, profile);
+}
+
+void SYSTEM_MOCK::enable_sim_time()
+{
+    m_sim_time_enabled = true;
+    m_sim_time_ns = 0;
+
+    // Start with idle SPI flash devices
+    m_spi_control_mock_inst->clear_busy_state();
+}
+
+void SYSTEM_MOCK::inject_power_loss()
+{
+    m_power_loss_at_ns = 0;
+    m_spi_control_mock_inst->interrupt_erase_in_progress();
+    throw POWER_LOSS();
+}
+
 /**
  * @brief Reset some portion of System Mock to simulate what would happen
  * after a CPLD reconfiguration. Mailbox registers, for example, are being
@@ -420,4 +487,3 @@ void SYSTEM_MOCK::write_words_to_x86_mem(alt_u32* x86_dest_mem_ptr,
         x86_dest_mem_ptr[i] = get_mem_word((void*) (nios_src_mem_ptr + i), true);
     }
 }
-
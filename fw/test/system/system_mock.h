@@ -52,7 +52,19 @@
 // Use Nios RAM as a scratchpad for simple NIOS RW testing
 #define NIOS_SCRATCHPAD_ADDR __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_NIOS_RAM_BASE, 0)
 
+// Typical timings of the devices on the platform, used by the simulated time
+#define SIM_TIME_NS_CRYPTO_DATA_WORD 250
+#define SIM_TIME_NS_SPI_STATUS_READ 5000
+#define SIM_TIME_NS_SPI_4KB_ERASE 50000000
+#define SIM_TIME_NS_SPI_32KB_ERASE 110000000
+#define SIM_TIME_NS_SPI_64KB_ERASE 150000000
+
+// Cost model of the cycle counter in the timer bank
+#define SIM_TIME_NS_PER_CYCLE 20
+#define SIM_CYCLES_PER_AVMM_ACCESS 8
+
 // Forward class definitions
+class CRYPTO_MOCK;
 
 // Class Definitions
 class SYSTEM_MOCK
@@ -191,6 +203,64 @@ public:
      */
     alt_u32 get_spi_cmd_count(SPI_COMMAND_ENUM spi_cmd);
 
+    /*
+     * Crypto block mock utility
+     */
+    alt_u32 get_crypto_sha_job_count();
+    alt_u32 get_crypto_ecdsa_job_count();
+    alt_u32 get_crypto_data_word_count();
+
+    /*
+     * SPI control mock utility
+     */
+    alt_u32 get_spi_blank_sector_erase_count();
+    alt_u32 get_spi_we_mem_write_count();
+    alt_u32 get_spi_we_mem_word(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 word_pos);
+    void set_spi_flash_sfdp_profile(SPI_FLASH_TYPE_ENUM spi_flash_type, SPI_CONTROL_MOCK::SFDP_PROFILE profile);
+
+    /*
+     * Simulated time
+     * When enabled, slow operations (i.e. SPI erase, SPI status register read and sending data to
+     * the crypto block) advance a simulated clock. A SPI flash device reports busy in its status register
+     * until its erase operation completes in simulated time. This allows unittests to compare the duration
+     * of different flows. Simulated time is disabled upon reset.
+     */
+    void enable_sim_time();
+    bool is_sim_time_enabled() { return m_sim_time_enabled; }
+    alt_u64 get_sim_time_ns() { return m_sim_time_ns; }
+    void advance_sim_time_ns(alt_u64 ns)
+    {
+        if (m_sim_time_enabled)
+        {
+            m_sim_time_ns += ns;
+            if (m_power_loss_at_ns && (m_sim_time_ns >= m_power_loss_at_ns))
+            {
+                inject_power_loss();
+            }
+        }
+    }
+
+    /*
+     * Cycle counter
+     * The free-running cycle counter in the timer bank advances with the simulated time, and by a fixed
+     * number of cycles for every AVMM access from Nios. Hence, the duration that Nios measures for a flow
+     * is deterministic, even when simulated time is disabled.
+     */
+    alt_u32 get_cycle_count()
+    {
+        return (alt_u32) (m_sim_time_ns / SIM_TIME_NS_PER_CYCLE + m_avmm_access_count * SIM_CYCLES_PER_AVMM_ACCESS);
+    }
+
+    /*
+     * Power loss injection
+     * When simulated time reaches the given time, the SPI erase in progress (if any) is interrupted
+     * and POWER_LOSS is thrown. Content of SPI flash and UFM is kept, as it would be on the platform.
+     * A time of 0 disables the injection. The injection is disabled upon reset and after each power loss.
+     */
+    struct POWER_LOSS {};
+    void set_power_loss_at_sim_time_ns(alt_u64 ns) { m_power_loss_at_ns = ns; }
+    void inject_power_loss();
+
     // Mock SMBus relays
     std::unique_ptr<SMBUS_RELAY_MOCK> smbus_relay_mock_ptr = std::make_unique<SMBUS_RELAY_MOCK>();
 
@@ -212,6 +282,14 @@ private:
     alt_u32 m_t_minus_1_bmc_only_counter = 0;
     alt_u32 m_t_minus_1_pch_only_counter = 0;
 
+    // Simulated time
+    bool m_sim_time_enabled = false;
+    alt_u64 m_sim_time_ns = 0;
+    alt_u64 m_power_loss_at_ns = 0;
+
+    // Number of AVMM accesses from Nios, for the cycle counter
+    alt_u64 m_avmm_access_count = 0;
+
     // Vector of memory mocks
     std::vector<std::unique_ptr<MEMORY_MOCK_IF>> m_memory_mocks;
 
@@ -223,6 +301,9 @@ private:
             m_read_write_callbacks;
 
     // Mock instances
+    // Mock crypto block (owned by m_memory_mocks)
+    CRYPTO_MOCK* m_crypto_mock_inst;
+
     // Mock SPI flashes
     SPI_FLASH_MOCK* m_spi_flash_mock_inst = SPI_FLASH_MOCK::get();
     // Mock SPI Control block
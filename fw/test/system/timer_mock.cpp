@@ -24,6 +24,7 @@
 
 // Test headers
 #include "bsp_mock.h"
+#include "system_mock.h"
 #include "timer_mock.h"
 
 // Code headers
@@ -144,6 +145,10 @@ alt_u32 TIMER_MOCK::get_mem_word(void* addr)
     {
         return m_timer_bank_timer3;
     }
+    if ((std::uintptr_t) addr == (U_TIMER_BANK_AVMM_BRIDGE_BASE + (3 << 2)))
+    {
+        return SYSTEM_MOCK::get()->get_cycle_count();
+    }
     else
     {
         PFR_INTERNAL_ERROR("Undefined handler for address");
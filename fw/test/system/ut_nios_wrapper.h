@@ -41,13 +41,16 @@
 #include "gen_gpo_controls.h"
 #include "gen_smbus_relay_config.h"
 #include "global_state.h"
+#include "io_counters.h"
 #include "keychain.h"
+#include "keychain_cache.h"
 #include "keychain_utils.h"
 #include "mailbox_enums.h"
 #include "mailbox_utils.h"
 #include "pbc.h"
 #include "pbc_utils.h"
 #include "pfm.h"
+#include "pfm_region_table.h"
 #include "pfm_utils.h"
 #include "pfm_validation.h"
 #include "pfr_main.h"
@@ -60,13 +63,19 @@
 #include "spi_common.h"
 #include "spi_ctrl_utils.h"
 #include "spi_flash_state.h"
+#include "spi_region_auth_cache.h"
 #include "spi_rw_utils.h"
+#include "spi_we_mem_shadow.h"
 #include "status_enums.h"
 #include "t0_provisioning.h"
+#include "t0_profile.h"
 #include "t0_routines.h"
+#include "t0_scheduler.h"
 #include "t0_update.h"
 #include "t0_watchdog_handler.h"
 #include "timer_utils.h"
+#include "tmin1_job_runner.h"
+#include "tmin1_profile.h"
 #include "tmin1_routines.h"
 #include "transition.h"
 #include "ufm.h"
@@ -318,12 +327,6 @@ static alt_u32 ut_is_blocking_update_from(SPI_FLASH_TYPE_ENUM spi_flash_type)
  */
 static alt_u32 ut_is_16kb_page_writable(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_u32 addr)
 {
-    alt_u32* we_mem = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 0);
-    if (spi_flash_type == SPI_FLASH_BMC)
-    {
-        we_mem = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0);
-    }
-
     // 14 bits to get to 16kB chunks, 5 more bits because we have 32 (=2^5) bits in each word in the
     // memory
     alt_u32 word_pos = addr >> (14 + 5);
@@ -331,7 +334,26 @@ static alt_u32 ut_is_16kb_page_writable(SPI_FLASH_TYPE_ENUM spi_flash_type, alt_
     alt_u32 bit_pos = (addr >> 14) & 0x0000001f;
 
     // If bit == 1 in WE memory, it means that this page is writable.
-    return check_bit(we_mem + word_pos, bit_pos);
+    // Nios can't read the write enable memory, so peek at the content in the mock.
+    return (SYSTEM_MOCK::get()->get_spi_we_mem_word(spi_flash_type, word_pos) >> bit_pos) & 0b1;
+}
+
+/**
+ * @brief Leave an interrupted session of another decompression in the checkpoint journal, as if it had lost power.
+ * The next decompression doesn't trust reads of its destination. It erases and programs every page in the bitmaps.
+ */
+static void ut_interrupt_other_decompression()
+{
+    DECOMPRESSION_CHECKPOINT checkpoint;
+    load_decompression_checkpoint(&checkpoint);
+
+    // No decompression has this tag, since its type of decompression is 0
+    alt_u32* journal = get_decompression_checkpoint_journal();
+    journal[checkpoint.next_index] = DECOMPRESSION_CHECKPOINT_TAG;
+    for (alt_u32 word_i = 1; word_i < DECOMPRESSION_CHECKPOINT_HEADER_NWORDS; word_i++)
+    {
+        journal[checkpoint.next_index + word_i] = 0;
+    }
 }
 
 static void ut_reset_fw_recovery_levels()
@@ -346,12 +368,88 @@ static void ut_reset_fw_spi_flash_state()
     pch_flash_state = 0;
 }
 
+static void ut_reset_spi_region_auth_cache()
+{
+    invalidate_spi_region_auth_cache(SPI_FLASH_BMC);
+    invalidate_spi_region_auth_cache(SPI_FLASH_PCH);
+}
+
+static void ut_reset_pfm_region_tables()
+{
+    invalidate_pfm_region_table();
+}
+
+static void ut_reset_smbus_relay_applied_rules()
+{
+    reset_smbus_relay_applied_rules();
+}
+
+static void ut_reset_spi_we_mem_shadows()
+{
+    invalidate_spi_we_mem_shadow(SPI_FLASH_BMC);
+    invalidate_spi_we_mem_shadow(SPI_FLASH_PCH);
+}
+
+static void ut_reset_t0_scheduler()
+{
+    reset_t0_scheduler();
+}
+
+static void ut_reset_t0_profile()
+{
+    reset_t0_profile();
+}
+
+static void ut_reset_tmin1_profile()
+{
+    reset_tmin1_profile();
+}
+
+static void ut_reset_io_counters()
+{
+    reset_io_counters();
+}
+
+static void ut_reset_kch_verification_cache()
+{
+    invalidate_kch_verification_cache();
+}
+
+static void ut_reset_spi_erase_blank_check()
+{
+    set_spi_erase_blank_check(0);
+}
+
+static void ut_reset_spi_flash_caps()
+{
+    reset_spi_flash_caps(SPI_FLASH_BMC);
+    reset_spi_flash_caps(SPI_FLASH_PCH);
+}
+
+static void ut_reset_tmin1_bg_job()
+{
+    tmin1_bg_auth_job.state = TMIN1_BG_JOB_IDLE;
+    tmin1_bg_auth_job.region_def = 0;
+}
+
 static void ut_reset_nios_fw()
 {
     ut_reset_watchdog_timers();
     ut_reset_failed_update_attempts();
     ut_reset_fw_recovery_levels();
     ut_reset_fw_spi_flash_state();
+    ut_reset_spi_region_auth_cache();
+    ut_reset_pfm_region_tables();
+    ut_reset_spi_we_mem_shadows();
+    ut_reset_smbus_relay_applied_rules();
+    ut_reset_tmin1_bg_job();
+    ut_reset_t0_scheduler();
+    ut_reset_t0_profile();
+    ut_reset_tmin1_profile();
+    ut_reset_io_counters();
+    ut_reset_kch_verification_cache();
+    ut_reset_spi_erase_blank_check();
+    ut_reset_spi_flash_caps();
 }
 
 static void ut_setup_for_recovery_main()
@@ -82,3 +82,63 @@ TEST_F(AuthenticationTest, test_authenticate_signed_key_cancellation_certificate
     SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, KEY_CAN_CERT_PCH_PFM_KEY2, KEY_CAN_CERT_FILE_SIZE);
     EXPECT_TRUE(is_signature_valid((KCH_SIGNATURE*) get_spi_flash_ptr()));
 }
+
+TEST_F(AuthenticationTest, test_verified_csk_entries_are_cached)
+{
+    invalidate_kch_verification_cache();
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, SIGNED_PFM_BIOS_FILE, SIGNED_PFM_BIOS_FILE_SIZE);
+    KCH_SIGNATURE* sig = (KCH_SIGNATURE*) get_spi_flash_ptr();
+
+    // First authentication: hashes of root key, CSK entry and protected content; ECDSA for both CSK entry and Block 0 entry
+    alt_u32 sha_jobs_before = SYSTEM_MOCK::get()->get_crypto_sha_job_count();
+    alt_u32 ecdsa_jobs_before = SYSTEM_MOCK::get()->get_crypto_ecdsa_job_count();
+    EXPECT_TRUE(is_signature_valid(sig));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_sha_job_count() - sha_jobs_before, alt_u32(3));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_ecdsa_job_count() - ecdsa_jobs_before, alt_u32(2));
+
+    // Second authentication: the same hashes, but only the Block 0 entry ECDSA
+    sha_jobs_before = SYSTEM_MOCK::get()->get_crypto_sha_job_count();
+    ecdsa_jobs_before = SYSTEM_MOCK::get()->get_crypto_ecdsa_job_count();
+    EXPECT_TRUE(is_signature_valid(sig));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_sha_job_count() - sha_jobs_before, alt_u32(3));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_ecdsa_job_count() - ecdsa_jobs_before, alt_u32(1));
+
+    // Cancelling any key drops the cache
+    cancel_key(KCH_PC_PFR_PCH_PFM, (sig->b1.csk_entry.key_id + 1) % (KCH_MAX_KEY_ID + 1));
+    ecdsa_jobs_before = SYSTEM_MOCK::get()->get_crypto_ecdsa_job_count();
+    EXPECT_TRUE(is_signature_valid(sig));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_ecdsa_job_count() - ecdsa_jobs_before, alt_u32(2));
+
+    // The cached CSK entry must not be used for a PC type that has cancelled this key
+    cancel_key(KCH_PC_PFR_PCH_PFM, sig->b1.csk_entry.key_id);
+    EXPECT_FALSE(is_signature_valid(sig));
+}
+
+TEST_F(AuthenticationTest, test_cached_entries_do_not_hide_tampering)
+{
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, SIGNED_PFM_BIOS_FILE, SIGNED_PFM_BIOS_FILE_SIZE);
+    KCH_SIGNATURE* sig = (KCH_SIGNATURE*) get_spi_flash_ptr();
+    EXPECT_TRUE(is_signature_valid(sig));
+
+    // Tamper the CSK entry signature
+    sig->b1.csk_entry.sig_r[0] ^= 0x1;
+    EXPECT_FALSE(is_signature_valid(sig));
+    sig->b1.csk_entry.sig_r[0] ^= 0x1;
+    EXPECT_TRUE(is_signature_valid(sig));
+
+    // Tamper the CSK public key
+    sig->b1.csk_entry.pubkey_x[0] ^= 0x1;
+    EXPECT_FALSE(is_signature_valid(sig));
+    sig->b1.csk_entry.pubkey_x[0] ^= 0x1;
+    EXPECT_TRUE(is_signature_valid(sig));
+
+    // Tamper the root public key
+    sig->b1.root_entry.pubkey_y[0] ^= 0x1;
+    EXPECT_FALSE(is_signature_valid(sig));
+    sig->b1.root_entry.pubkey_y[0] ^= 0x1;
+    EXPECT_TRUE(is_signature_valid(sig));
+
+    // A different root key hash in UFM invalidates the cache
+    get_ufm_pfr_data()->root_key_hash[0] ^= 0x1;
+    EXPECT_FALSE(is_signature_valid(sig));
+}
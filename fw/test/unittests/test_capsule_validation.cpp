@@ -26,6 +26,7 @@
 
 // Include the SYSTEM MOCK and PFR headers
 #include "ut_nios_wrapper.h"
+#include "testdata_info.h"
 
 class CapsuleValidationTest : public testing::Test
 {
@@ -78,6 +79,24 @@ TEST_F(CapsuleValidationTest, test_is_pbc_valid)
 
     PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(m_flash_x86_ptr);
     EXPECT_TRUE(is_pbc_valid(pbc));
+
+    // Version 3 has per-page LZ compression
+    pbc->version = PBC_VERSION_PER_PAGE_LZ;
+    EXPECT_TRUE(is_pbc_valid(pbc));
+
+    pbc->version = PBC_VERSION_PER_PAGE_LZ + 1;
+    EXPECT_FALSE(is_pbc_valid(pbc));
+
+    // Both versions may be used in a delta capsule
+    pbc->version = PBC_EXPECTED_VERSION | PBC_DELTA_VERSION_FLAG;
+    EXPECT_TRUE(is_pbc_valid(pbc));
+    EXPECT_TRUE(is_delta_pbc(pbc));
+
+    pbc->version = PBC_VERSION_PER_PAGE_LZ | PBC_DELTA_VERSION_FLAG;
+    EXPECT_TRUE(is_pbc_valid(pbc));
+
+    pbc->version = (PBC_VERSION_PER_PAGE_LZ + 1) | PBC_DELTA_VERSION_FLAG;
+    EXPECT_FALSE(is_pbc_valid(pbc));
 }
 
 TEST_F(CapsuleValidationTest, test_authenticate_signed_capsule_bmc)
@@ -152,3 +171,131 @@ TEST_F(CapsuleValidationTest, test_authenticate_pch_fw_capsule_with_bad_pattern_
 
     delete[] pch_update_capsule;
 }
+
+/**
+ * @brief A valid firmware update capsule goes through the crypto block in full.
+ */
+TEST_F(CapsuleValidationTest, test_check_capsule_before_update_hashes_valid_capsule)
+{
+    SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
+    sys->load_to_flash(m_spi_flash_in_use, SIGNED_CAPSULE_BMC_FILE, SIGNED_CAPSULE_BMC_FILE_SIZE);
+    write_to_mailbox(MB_BMC_PFM_RECOVERY_SVN, BMC_UPDATE_CAPSULE_PFM_SVN);
+
+    alt_u32 data_words_before = sys->get_crypto_data_word_count();
+    EXPECT_TRUE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_ACTIVE_MASK));
+    EXPECT_GE(sys->get_crypto_data_word_count() - data_words_before, alt_u32((SIGNED_CAPSULE_BMC_FILE_SIZE - SIGNATURE_SIZE) / 4));
+}
+
+/**
+ * @brief A firmware update capsule with an unacceptable SVN is rejected after its PFM is authenticated,
+ * without hashing the rest of the capsule.
+ */
+TEST_F(CapsuleValidationTest, test_check_capsule_before_update_rejects_bad_svn_without_capsule_hash)
+{
+    SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
+    sys->load_to_flash(m_spi_flash_in_use, SIGNED_CAPSULE_BMC_FILE, SIGNED_CAPSULE_BMC_FILE_SIZE);
+    alt_u32 max_pfm_nwords = SIGNED_PFM_MAX_SIZE / 4;
+
+    // An active firmware update must have the same SVN as the recovery firmware
+    write_to_mailbox(MB_BMC_PFM_RECOVERY_SVN, BMC_UPDATE_CAPSULE_PFM_SVN + 1);
+
+    alt_u32 data_words_before = sys->get_crypto_data_word_count();
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_ACTIVE_MASK));
+    EXPECT_LE(sys->get_crypto_data_word_count() - data_words_before, max_pfm_nwords);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_INVALID_SVN));
+
+    // The SVN is below the SVN policy
+    write_to_mailbox(MB_BMC_PFM_RECOVERY_SVN, BMC_UPDATE_CAPSULE_PFM_SVN);
+    write_ufm_svn(BMC_UPDATE_CAPSULE_PFM_SVN + 1, UFM_SVN_POLICY_BMC);
+    data_words_before = sys->get_crypto_data_word_count();
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_RECOVERY_MASK));
+    EXPECT_LE(sys->get_crypto_data_word_count() - data_words_before, max_pfm_nwords);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_INVALID_SVN));
+}
+
+/**
+ * @brief A forged SVN in the capsule PFM is reported as an authentication failure, not as an SVN failure.
+ */
+TEST_F(CapsuleValidationTest, test_check_capsule_before_update_reports_forged_svn_as_auth_failure)
+{
+    SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
+    sys->load_to_flash(m_spi_flash_in_use, SIGNED_CAPSULE_BMC_FILE, SIGNED_CAPSULE_BMC_FILE_SIZE);
+    write_to_mailbox(MB_BMC_PFM_RECOVERY_SVN, BMC_UPDATE_CAPSULE_PFM_SVN);
+
+    // This SVN doesn't match the recovery firmware, but the PFM signature no longer matches either
+    get_capsule_pfm(m_flash_x86_ptr)->svn = BMC_UPDATE_CAPSULE_PFM_SVN + 1;
+
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_ACTIVE_MASK));
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_AUTHENTICATION_FAILED));
+}
+
+/**
+ * @brief A capsule signed with a cancelled CSK key, or sent with the wrong update intent, is rejected
+ * before any crypto operation.
+ */
+TEST_F(CapsuleValidationTest, test_check_capsule_before_update_rejects_cancelled_key_without_crypto)
+{
+    SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
+    sys->load_to_flash(m_spi_flash_in_use, SIGNED_CAPSULE_BMC_FILE, SIGNED_CAPSULE_BMC_FILE_SIZE);
+    write_to_mailbox(MB_BMC_PFM_RECOVERY_SVN, BMC_UPDATE_CAPSULE_PFM_SVN);
+    alt_u32 data_words_before = sys->get_crypto_data_word_count();
+
+    // The capsule is for BMC firmware
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_PCH_ACTIVE_MASK));
+    EXPECT_EQ(sys->get_crypto_data_word_count(), data_words_before);
+
+    KCH_SIGNATURE* capsule_sig = (KCH_SIGNATURE*) m_flash_x86_ptr;
+    cancel_key(get_kch_pc_type(&capsule_sig->b0), capsule_sig->b1.csk_entry.key_id);
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_ACTIVE_MASK));
+    EXPECT_EQ(sys->get_crypto_data_word_count(), data_words_before);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_AUTHENTICATION_FAILED));
+}
+
+/**
+ * @brief A delta capsule is only accepted in an active firmware update on top of its base firmware.
+ * A recovery update intent is rejected before any crypto operation. A wrong base is rejected before the capsule is hashed.
+ */
+TEST_F(CapsuleValidationTest, test_check_capsule_before_update_with_delta_capsule)
+{
+    SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
+    sys->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+    sys->load_to_flash(m_spi_flash_in_use, SIGNED_CAPSULE_BMC_FILE, SIGNED_CAPSULE_BMC_FILE_SIZE);
+    write_to_mailbox(MB_BMC_PFM_RECOVERY_SVN, BMC_UPDATE_CAPSULE_PFM_SVN);
+    switch_spi_flash(m_spi_flash_in_use);
+
+    // Turn the capsule into a delta capsule on top of the active BMC firmware
+    alt_u32* bmc_flash_x86_ptr = sys->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    KCH_BLOCK0* active_pfm_sig_b0 = (KCH_BLOCK0*) &bmc_flash_x86_ptr[get_ufm_pfr_data()->bmc_active_pfm >> 2];
+    PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(m_flash_x86_ptr);
+    pbc->version |= PBC_DELTA_VERSION_FLAG;
+    std::copy(active_pfm_sig_b0->pc_hash256, active_pfm_sig_b0->pc_hash256 + PFR_CRYPTO_LENGTH / 4, pbc->base_pfm_hash);
+
+    // A delta capsule is never a valid recovery capsule. A recovery update intent is rejected before any crypto operation.
+    EXPECT_FALSE(is_capsule_valid(m_flash_x86_ptr));
+    alt_u32 data_words_before = sys->get_crypto_data_word_count();
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_RECOVERY_MASK));
+    EXPECT_EQ(sys->get_crypto_data_word_count(), data_words_before);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_INVALID_UPDATE_INTENT));
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr,
+            MB_UPDATE_INTENT_BMC_ACTIVE_MASK | MB_UPDATE_INTENT_BMC_RECOVERY_MASK));
+    EXPECT_EQ(sys->get_crypto_data_word_count(), data_words_before);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_INVALID_UPDATE_INTENT));
+
+    // The active firmware is not the base firmware
+    // Only the capsule PFM is hashed before the base is checked.
+    alt_u32 max_pfm_nwords = SIGNED_PFM_MAX_SIZE / 4;
+    pbc->base_pfm_hash[0] = ~pbc->base_pfm_hash[0];
+    data_words_before = sys->get_crypto_data_word_count();
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_ACTIVE_MASK));
+    EXPECT_LE(sys->get_crypto_data_word_count() - data_words_before, max_pfm_nwords);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_DELTA_CAPSULE_BASE_MISMATCH));
+    EXPECT_EQ(get_current_spi_flash_type(), m_spi_flash_in_use);
+
+    // With the right base, the capsule goes on to authentication. Its signature no longer covers the modified PBC header.
+    pbc->base_pfm_hash[0] = ~pbc->base_pfm_hash[0];
+    data_words_before = sys->get_crypto_data_word_count();
+    EXPECT_FALSE(check_capsule_before_update(SPI_FLASH_BMC, m_flash_x86_ptr, MB_UPDATE_INTENT_BMC_ACTIVE_MASK));
+    EXPECT_GT(sys->get_crypto_data_word_count() - data_words_before, max_pfm_nwords);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_AUTHENTICATION_FAILED));
+    EXPECT_EQ(get_current_spi_flash_type(), m_spi_flash_in_use);
+}
@@ -98,6 +98,10 @@ TEST_F(CPLDUpdateFlowTest, test_cpld_update_from_bmc_failed_authentication)
     write_to_mailbox(MB_BMC_UPDATE_INTENT, MB_UPDATE_INTENT_CPLD_ACTIVE_MASK);
     ASSERT_DURATION_LE(1, act_on_bmc_update_intent());
 
+    // The CPLD update is left for the end of the T-1 cycle
+    EXPECT_EQ(read_from_mailbox(MB_BMC_UPDATE_INTENT), alt_u32(MB_UPDATE_INTENT_CPLD_ACTIVE_MASK));
+    ASSERT_DURATION_LE(1, act_on_cpld_update_intent());
+
     // Check that no CFM switch has occurred
     EXPECT_EQ(alt_u32(0), IORD(U_DUAL_CONFIG_BASE, 0));
     EXPECT_EQ(alt_u32(0), IORD(U_DUAL_CONFIG_BASE, 1));
@@ -556,14 +560,13 @@ TEST_F(CPLDUpdateFlowTest, test_cpld_active_update)
     }
 
     // Make sure CPLD staging region is writable in T0
-    alt_u32* we_mem_ptr = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0);
     alt_u32 bmc_cpld_staging_capsule_location_in_we_mem = (get_ufm_pfr_data()->bmc_staging_region + BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET) >> 19;
-    EXPECT_EQ(IORD(we_mem_ptr, bmc_cpld_staging_capsule_location_in_we_mem), alt_u32(0xffffffff));
-    EXPECT_EQ(IORD(we_mem_ptr, bmc_cpld_staging_capsule_location_in_we_mem + 4), alt_u32(0xffffffff));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, bmc_cpld_staging_capsule_location_in_we_mem), alt_u32(0xffffffff));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, bmc_cpld_staging_capsule_location_in_we_mem + 4), alt_u32(0xffffffff));
 
     // Make sure  CPLD recovery region is read-only in T0
-    EXPECT_EQ(IORD(we_mem_ptr, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM), alt_u32(0));
-    EXPECT_EQ(IORD(we_mem_ptr, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM + 4), alt_u32(0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM), alt_u32(0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM + 4), alt_u32(0));
 
     /*
      * Clean up
@@ -670,14 +673,13 @@ TEST_F(CPLDUpdateFlowTest, test_cpld_recovery_update)
     }
 
     // Make sure CPLD staging region is writable in T0 after Nios has completed the update
-    alt_u32* we_mem_ptr = __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0);
     alt_u32 bmc_cpld_staging_capsule_location_in_we_mem = (get_ufm_pfr_data()->bmc_staging_region + BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET) >> 19;
-    EXPECT_EQ(IORD(we_mem_ptr, bmc_cpld_staging_capsule_location_in_we_mem), alt_u32(0xffffffff));
-    EXPECT_EQ(IORD(we_mem_ptr, bmc_cpld_staging_capsule_location_in_we_mem + 4), alt_u32(0xffffffff));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, bmc_cpld_staging_capsule_location_in_we_mem), alt_u32(0xffffffff));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, bmc_cpld_staging_capsule_location_in_we_mem + 4), alt_u32(0xffffffff));
 
     // Make sure  CPLD recovery region is read-onlyin T0 after Nios has completed the update
-    EXPECT_EQ(IORD(we_mem_ptr, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM), alt_u32(0));
-    EXPECT_EQ(IORD(we_mem_ptr, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM + 4), alt_u32(0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM), alt_u32(0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, BMC_CPLD_RECOVERY_LOCATION_IN_WE_MEM + 4), alt_u32(0));
 
     /*
      * Clean up
@@ -198,6 +198,7 @@ TEST_F(PFRCryptoTest, test_single_block_pattern_sha_and_ec)
                                                   0xc9, 0xe3, 0x17, 0xb9, 0x12, 0x24, 0x33, 0x25,
                                                   0xf2, 0x73, 0x85, 0x5a, 0x66, 0xc7, 0x6d, 0x5e};
 
+    reset_io_counters();
     EXPECT_EQ(alt_u32(1),
               verify_ecdsa_and_sha((alt_u32*) test_pubkey_cx,
                                    (alt_u32*) test_pubkey_cy,
@@ -205,4 +206,94 @@ TEST_F(PFRCryptoTest, test_single_block_pattern_sha_and_ec)
                                    (alt_u32*) test_sig_s,
                                    (alt_u32*) test_data,
                                    test_data_size));
+
+    // The ECDSA operation and its data are counted
+    EXPECT_EQ(io_counters[IO_COUNTER_ECDSA_OPS], alt_u32(1));
+    EXPECT_EQ(io_counters[IO_COUNTER_BYTES_HASHED], test_data_size);
+}
+
+TEST_F(PFRCryptoTest, test_sha_context_with_non_contiguous_ranges)
+{
+    // Same test data as test_single_block_pattern_sha_only, split into three non-contiguous buffers
+    const alt_u8 td_crypto_data_part1[32] = {
+        0x44, 0xbd, 0x53, 0x17, 0x98, 0x83, 0x65, 0xa3, 0x92, 0x4c, 0xd7, 0x2e, 0xe0, 0xc8, 0xec, 0x39,
+        0x40, 0x24, 0xf6, 0x23, 0x6d, 0x17, 0x3b, 0x3b, 0xe4, 0xf3, 0xef, 0xcb, 0x51, 0x0b, 0x34, 0xca};
+    const alt_u8 td_crypto_data_part2[64] = {
+        0x9e, 0xf2, 0xf3, 0xbf, 0xf6, 0xc4, 0x8e, 0x2a, 0xd7, 0x72, 0x58, 0x0f, 0xb2, 0x7d, 0x41, 0x60,
+        0xab, 0x8f, 0x26, 0xb1, 0xb6, 0x1d, 0x87, 0x6c, 0x6c, 0x73, 0xf7, 0x5a, 0x1f, 0x78, 0x9c, 0xff,
+        0xe4, 0xd3, 0xdb, 0x20, 0x75, 0x1a, 0xf8, 0x7e, 0x91, 0x72, 0xe9, 0xa7, 0x5b, 0xdc, 0x99, 0xfd,
+        0x96, 0x41, 0x08, 0xb7, 0xe7, 0xb7, 0xd2, 0xf4, 0x3f, 0x06, 0x5a, 0xa5, 0xfe, 0xee, 0xde, 0x89};
+    const alt_u8 td_crypto_data_part3[32] = {
+        0x9c, 0xe3, 0x4e, 0x4c, 0x4b, 0x13, 0x6c, 0xb8, 0xf8, 0xad, 0xf8, 0xb3, 0x53, 0x87, 0x31, 0x23,
+        0x1c, 0xa8, 0x7a, 0x01, 0x42, 0x52, 0x99, 0xb7, 0xdc, 0x7b, 0x7e, 0x05, 0x22, 0xc8, 0x59, 0xec};
+
+    const alt_u8 td_expected_hash[PFR_CRYPTO_LENGTH] = {
+        0xa3, 0x7c, 0x4f, 0xd5, 0xf1, 0xf4, 0x6d, 0x46, 0x20, 0x91, 0xb9,
+        0xe9, 0x2d, 0x22, 0xc6, 0xe9, 0xce, 0x30, 0x97, 0xef, 0xe9, 0xcd,
+        0x4b, 0x25, 0xe8, 0xf2, 0x3a, 0x2d, 0xdd, 0x36, 0xdd, 0xfc};
+
+    CRYPTO_SHA_CONTEXT sha_ctx;
+    sha_init(&sha_ctx, 128);
+    sha_update(&sha_ctx, (alt_u32*) td_crypto_data_part1, 32);
+    sha_update(&sha_ctx, (alt_u32*) td_crypto_data_part2, 64);
+    sha_update(&sha_ctx, (alt_u32*) td_crypto_data_part3, 32);
+    EXPECT_EQ(alt_u32(1), sha_final_and_verify(&sha_ctx, (alt_u32*) td_expected_hash));
+
+    // All three ranges should have been hashed in one crypto job
+    EXPECT_EQ(alt_u32(1), SYSTEM_MOCK::get()->get_crypto_sha_job_count());
+}
+
+TEST_F(PFRCryptoTest, test_sha_context_matches_one_shot_sha)
+{
+    const alt_u32 td_data_size = 0x2000;
+    alt_u32 td_data[td_data_size / 4];
+    for (alt_u32 word_i = 0; word_i < td_data_size / 4; word_i++)
+    {
+        td_data[word_i] = (word_i * 0x9e3779b9) ^ 0xdeadbeef;
+    }
+
+    alt_u32 one_shot_hash[PFR_CRYPTO_LENGTH / 4] = {};
+    calculate_and_save_sha(one_shot_hash, td_data, td_data_size);
+
+    // Send the same bytes through several updates of uneven sizes
+    alt_u32 streamed_hash[PFR_CRYPTO_LENGTH / 4] = {};
+    CRYPTO_SHA_CONTEXT sha_ctx;
+    sha_init(&sha_ctx, td_data_size);
+    sha_update(&sha_ctx, td_data, 4);
+    sha_update(&sha_ctx, &td_data[1], 0x100 - 4);
+    sha_update(&sha_ctx, &td_data[0x100 / 4], 0);
+    sha_update(&sha_ctx, &td_data[0x100 / 4], td_data_size - 0x100);
+    sha_final_and_save(&sha_ctx, streamed_hash);
+
+    for (alt_u32 word_i = 0; word_i < PFR_CRYPTO_LENGTH / 4; word_i++)
+    {
+        EXPECT_EQ(one_shot_hash[word_i], streamed_hash[word_i]);
+    }
+    reset_io_counters();
+    EXPECT_EQ(alt_u32(1), verify_sha(streamed_hash, td_data, td_data_size));
+    EXPECT_EQ(alt_u32(3), SYSTEM_MOCK::get()->get_crypto_sha_job_count());
+
+    // Every byte sent to the crypto block is counted
+    EXPECT_EQ(io_counters[IO_COUNTER_BYTES_HASHED], td_data_size);
+    EXPECT_EQ(io_counters[IO_COUNTER_ECDSA_OPS], alt_u32(0));
+}
+
+TEST_F(PFRCryptoTest, test_sha_context_rejects_size_mismatch)
+{
+    // Set asserts to throw as opposed to abort
+    SYSTEM_MOCK::get()->set_assert_to_throw();
+
+    alt_u32 td_data[32] = {};
+    CRYPTO_SHA_CONTEXT sha_ctx;
+
+    // Sending more data than what was declared in sha_init is illegal
+    sha_init(&sha_ctx, 64);
+    sha_update(&sha_ctx, td_data, 64);
+    EXPECT_ANY_THROW(sha_update(&sha_ctx, td_data, 64));
+    sha_final(&sha_ctx);
+
+    // Finalizing before all the declared data is sent is illegal
+    sha_init(&sha_ctx, 128);
+    sha_update(&sha_ctx, td_data, 64);
+    EXPECT_ANY_THROW(sha_final(&sha_ctx));
 }
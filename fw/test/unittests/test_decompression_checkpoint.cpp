@@ -0,0 +1,403 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+#include <iostream>
+#include <vector>
+
+// Include the GTest headers
+#include "gtest_headers.h"
+
+// Include the SYSTEM MOCK and PFR headers
+#include "ut_nios_wrapper.h"
+#include "testdata_info.h"
+
+
+class DecompressionCheckpointTest : public testing::Test
+{
+public:
+    alt_u32* m_flash_x86_ptr = nullptr;
+
+    // For simplicity, use PCH flash for all tests.
+    SPI_FLASH_TYPE_ENUM m_spi_flash_in_use = SPI_FLASH_PCH;
+
+    // Recover with differential decompression, as in a recovery after an authentication failure
+    alt_u32 m_is_diff_mode = 1;
+
+    virtual void SetUp()
+    {
+        SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
+        sys->reset();
+        ut_reset_nios_fw();
+        sys->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+
+        m_flash_x86_ptr = sys->get_x86_ptr_to_spi_flash(m_spi_flash_in_use);
+        switch_spi_flash(m_spi_flash_in_use);
+        prepare_flash();
+    }
+
+    virtual void TearDown() {}
+
+    /**
+     * Load the full PCH image and overwrite its static and dynamic regions with old content.
+     * Recovering this flash erases and programs every page of these regions.
+     */
+    void prepare_flash()
+    {
+        SYSTEM_MOCK::get()->reset_spi_flash(m_spi_flash_in_use);
+        SYSTEM_MOCK::get()->load_to_flash(m_spi_flash_in_use, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        for (alt_u32 region_i = 0; region_i < PCH_NUM_STATIC_REGIONS; region_i++)
+        {
+            std::fill(m_flash_x86_ptr + (testdata_pch_static_regions_start_addr[region_i] >> 2),
+                    m_flash_x86_ptr + (testdata_pch_static_regions_end_addr[region_i] >> 2), 0);
+        }
+        for (alt_u32 region_i = 0; region_i < PCH_NUM_DYNAMIC_REGIONS; region_i++)
+        {
+            std::fill(m_flash_x86_ptr + (testdata_pch_dynamic_regions_start_addr[region_i] >> 2),
+                    m_flash_x86_ptr + (testdata_pch_dynamic_regions_end_addr[region_i] >> 2), 0);
+        }
+    }
+
+    void recover_flash(DECOMPRESSION_TYPE_MASK_ENUM decomp_type = DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK)
+    {
+        decompress_capsule(get_spi_recovery_region_ptr(m_spi_flash_in_use), m_spi_flash_in_use, decomp_type, m_is_diff_mode);
+    }
+
+    /**
+     * Start the recovery and lose power at the given simulated time. Then, reset Nios as it would be after power up.
+     */
+    void recover_flash_until_power_loss(alt_u64 power_loss_at_ns)
+    {
+        SYSTEM_MOCK::get()->set_power_loss_at_sim_time_ns(power_loss_at_ns);
+        EXPECT_THROW(recover_flash(), SYSTEM_MOCK::POWER_LOSS);
+
+        ut_reset_nios_fw();
+        switch_spi_flash(m_spi_flash_in_use);
+    }
+
+    /**
+     * Return the number of sessions in the checkpoint journal.
+     */
+    alt_u32 get_num_checkpoint_sessions()
+    {
+        alt_u32* journal = get_decompression_checkpoint_journal();
+        alt_u32 num_sessions = 0;
+        alt_u32 index = 0;
+        while ((index < DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS) && (journal[index] != 0xFFFFFFFF))
+        {
+            if ((journal[index] & DECOMPRESSION_CHECKPOINT_TAG_MASK) == DECOMPRESSION_CHECKPOINT_TAG)
+            {
+                num_sessions++;
+                index += DECOMPRESSION_CHECKPOINT_HEADER_NWORDS;
+            }
+            else
+            {
+                index++;
+            }
+        }
+        return num_sessions;
+    }
+};
+
+TEST_F(DecompressionCheckpointTest, test_journal_records_decompression_progress)
+{
+    recover_flash();
+    EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+
+    // The session header identifies the target flash, type of decompression and the capsule
+    alt_u32* journal = get_decompression_checkpoint_journal();
+    KCH_SIGNATURE* capsule_sig = (KCH_SIGNATURE*) get_spi_recovery_region_ptr(m_spi_flash_in_use);
+    EXPECT_EQ(journal[0], alt_u32(DECOMPRESSION_CHECKPOINT_TAG | (SPI_FLASH_PCH << 8) | DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK));
+    for (alt_u32 word_i = 0; word_i < (SHA256_LENGTH / 4); word_i++)
+    {
+        EXPECT_EQ(journal[1 + word_i], capsule_sig->b0.pc_hash256[word_i]);
+    }
+
+    // Checkpoints only move forward and they are at multiples of the checkpoint interval
+    alt_u32 index = DECOMPRESSION_CHECKPOINT_HEADER_NWORDS;
+    alt_u32 prev_progress = 0;
+    alt_u32 num_erase_checkpoints = 0;
+    alt_u32 num_copy_checkpoints = 0;
+    while (journal[index] != 0xFFFFFFFF)
+    {
+        alt_u32 phase = journal[index] & DECOMPRESSION_CHECKPOINT_PHASE_MASK;
+        alt_u32 done_addr = journal[index] & ~DECOMPRESSION_CHECKPOINT_PHASE_MASK;
+        EXPECT_EQ(done_addr % DECOMPRESSION_CHECKPOINT_INTERVAL, alt_u32(0));
+        EXPECT_GT((phase << 28) | (done_addr >> 4), prev_progress);
+        prev_progress = (phase << 28) | (done_addr >> 4);
+
+        num_erase_checkpoints += (phase == DECOMPRESSION_CHECKPOINT_PHASE_ERASE);
+        num_copy_checkpoints += (phase == DECOMPRESSION_CHECKPOINT_PHASE_COPY);
+        index++;
+    }
+    EXPECT_GT(num_erase_checkpoints, alt_u32(1));
+    EXPECT_GT(num_copy_checkpoints, alt_u32(1));
+    EXPECT_EQ(journal[index - 2], alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_PFM_COPY));
+    EXPECT_EQ(journal[index - 1], alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_DONE));
+
+    // The next decompression starts a new session
+    recover_flash();
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(2));
+    EXPECT_EQ(journal[2 * index - 1], alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_DONE));
+}
+
+TEST_F(DecompressionCheckpointTest, test_resumed_decompression_matches_uninterrupted_decompression)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+
+    // Reference run
+    recover_flash();
+    alt_u64 full_time_ns = SYSTEM_MOCK::get()->get_sim_time_ns();
+    std::vector<alt_u32> expected_flash(m_flash_x86_ptr, m_flash_x86_ptr + PCH_SPI_FLASH_SIZE / 4);
+
+    // Lose power in the erase pass, in the copy pass and while erasing the active PFM
+    const std::pair<alt_u64, alt_u32> power_losses[] = {
+        {full_time_ns / 10, DECOMPRESSION_CHECKPOINT_PHASE_ERASE},
+        {full_time_ns - SIM_TIME_NS_SPI_64KB_ERASE - 100 * SIM_TIME_NS_SPI_STATUS_READ, DECOMPRESSION_CHECKPOINT_PHASE_COPY},
+        {full_time_ns - SIM_TIME_NS_SPI_64KB_ERASE / 2, DECOMPRESSION_CHECKPOINT_PHASE_PFM_COPY},
+    };
+    for (const std::pair<alt_u64, alt_u32>& power_loss : power_losses)
+    {
+        prepare_flash();
+        ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+        SYSTEM_MOCK::get()->enable_sim_time();
+
+        recover_flash_until_power_loss(power_loss.first);
+        DECOMPRESSION_CHECKPOINT checkpoint;
+        load_decompression_checkpoint(&checkpoint);
+        EXPECT_EQ(checkpoint.phase, power_loss.second);
+
+        recover_flash();
+        EXPECT_TRUE(std::equal(expected_flash.begin(), expected_flash.end(), m_flash_x86_ptr));
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+
+        // The interrupted session was resumed
+        EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(1));
+    }
+}
+
+TEST_F(DecompressionCheckpointTest, test_blank_check_does_not_skip_interrupted_erase)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+    set_spi_erase_blank_check(1);
+    recover_flash();
+    alt_u64 full_time_ns = SYSTEM_MOCK::get()->get_sim_time_ns();
+
+    // Lose power in the erase pass. The sectors erased since the last checkpoint read blank now.
+    prepare_flash();
+    ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+    SYSTEM_MOCK::get()->enable_sim_time();
+    set_spi_erase_blank_check(1);
+    recover_flash_until_power_loss(full_time_ns / 10);
+    DECOMPRESSION_CHECKPOINT checkpoint;
+    load_decompression_checkpoint(&checkpoint);
+    EXPECT_EQ(checkpoint.phase, alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_ERASE));
+
+    // When resuming, those sectors are erased again
+    set_spi_erase_blank_check(1);
+    alt_u32 blank_erases_before = SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count();
+    recover_flash();
+    EXPECT_GT(SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count(), blank_erases_before);
+    EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(1));
+
+    // The blank check is back on for the next decompression
+    EXPECT_EQ(get_spi_erase_blank_check(), alt_u32(1));
+    blank_erases_before = SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count();
+    recover_flash();
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count(), blank_erases_before);
+}
+
+TEST_F(DecompressionCheckpointTest, test_blank_check_is_suspended_after_other_interrupted_decompression)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+    recover_flash_until_power_loss(1000000000);
+
+    // A different type of decompression can't resume the interrupted one. It doesn't trust the blank check at all.
+    set_spi_erase_blank_check(1);
+    alt_u32 blank_erases_before = SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count();
+    recover_flash(DECOMPRESSION_STATIC_REGIONS_MASK);
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(2));
+    EXPECT_GT(SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count(), blank_erases_before);
+    EXPECT_EQ(get_spi_erase_blank_check(), alt_u32(1));
+}
+
+TEST_F(DecompressionCheckpointTest, test_power_loss_benchmark)
+{
+    // Simulated time only includes the erase and program operations. Without a checkpoint, Nios can't tell which
+    // pages were cut short by the power loss. Then, it can't trust the blank check or differential decompression
+    // and it erases and programs every page again. When it resumes, it only does that until the next checkpoint.
+    // Afterwards, skipping the pages that are already done mostly costs the time to read them back, which isn't
+    // simulated.
+    for (alt_u32 is_diff_mode : {0, 1})
+    {
+        m_is_diff_mode = is_diff_mode;
+        prepare_flash();
+        SYSTEM_MOCK::get()->enable_sim_time();
+        recover_flash();
+        alt_u64 full_time_ns = SYSTEM_MOCK::get()->get_sim_time_ns();
+
+        // After losing power, either start over or resume from the last checkpoint
+        alt_u64 remaining_time_ns[2];
+        for (alt_u32 resume : {0, 1})
+        {
+            prepare_flash();
+            ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+            SYSTEM_MOCK::get()->enable_sim_time();
+            recover_flash_until_power_loss(full_time_ns * 3 / 4);
+            if (!resume)
+            {
+                ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+                ut_interrupt_other_decompression();
+            }
+
+            alt_u64 time_before = SYSTEM_MOCK::get()->get_sim_time_ns();
+            recover_flash();
+            remaining_time_ns[resume] = SYSTEM_MOCK::get()->get_sim_time_ns() - time_before;
+            EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+        }
+
+        EXPECT_LE(remaining_time_ns[0], full_time_ns);
+        EXPECT_LT(remaining_time_ns[1] * 2, full_time_ns);
+        EXPECT_LT(remaining_time_ns[1] * 2, remaining_time_ns[0]);
+    }
+}
+
+TEST_F(DecompressionCheckpointTest, test_checkpoint_of_other_decompression_is_not_resumed)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+    recover_flash_until_power_loss(1000000000);
+    alt_u32 num_words_before = 0;
+    alt_u32* journal = get_decompression_checkpoint_journal();
+    while (journal[num_words_before] != 0xFFFFFFFF)
+    {
+        num_words_before++;
+    }
+
+    // A static only recovery closes the interrupted session and starts over in a new session
+    recover_flash(DECOMPRESSION_STATIC_REGIONS_MASK);
+    EXPECT_EQ(journal[num_words_before], alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_DONE));
+    EXPECT_EQ(journal[num_words_before + 1],
+            alt_u32(DECOMPRESSION_CHECKPOINT_TAG | (SPI_FLASH_PCH << 8) | DECOMPRESSION_STATIC_REGIONS_MASK));
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(2));
+    EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+}
+
+TEST_F(DecompressionCheckpointTest, test_booting_pch_abandons_interrupted_decompression)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+    recover_flash_until_power_loss(1000000000);
+
+    DECOMPRESSION_CHECKPOINT checkpoint;
+    load_decompression_checkpoint(&checkpoint);
+    EXPECT_EQ(checkpoint.phase, alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_ERASE));
+
+    // Giving the other flash back doesn't affect this session
+    abandon_decompression_checkpoint(SPI_FLASH_BMC);
+    load_decompression_checkpoint(&checkpoint);
+    EXPECT_EQ(checkpoint.phase, alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_ERASE));
+
+    // Once PCH can write to its flash, the session can't be resumed
+    tmin1_boot_pch();
+    load_decompression_checkpoint(&checkpoint);
+    EXPECT_EQ(checkpoint.phase, alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_DONE));
+
+    recover_flash();
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(2));
+    EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+}
+
+TEST_F(DecompressionCheckpointTest, test_full_journal_is_erased)
+{
+    // Fill the journal with completed sessions, until there's no room for another session
+    alt_u32* journal = get_decompression_checkpoint_journal();
+    auto fill_journal = [journal]() {
+        alt_u32 index = 0;
+        while (index + DECOMPRESSION_CHECKPOINT_MIN_SESSION_NWORDS <= DECOMPRESSION_CHECKPOINT_JOURNAL_NWORDS)
+        {
+            journal[index] = DECOMPRESSION_CHECKPOINT_TAG | (SPI_FLASH_BMC << 8) | DECOMPRESSION_STATIC_REGIONS_MASK;
+            index += DECOMPRESSION_CHECKPOINT_HEADER_NWORDS;
+            journal[index] = DECOMPRESSION_CHECKPOINT_PHASE_DONE;
+            index++;
+        }
+    };
+    fill_journal();
+    alt_u32 num_sessions = get_num_checkpoint_sessions();
+
+    // While a CPLD recovery update is in progress, the journal is kept and no checkpoint is recorded
+    set_cpld_rc_update_in_progress_ufm_flag();
+    recover_flash();
+    EXPECT_TRUE(is_cpld_rc_update_in_progress());
+    EXPECT_EQ(get_num_checkpoint_sessions(), num_sessions);
+    EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+
+    // Otherwise, the journal is erased for the new session
+    ufm_erase_sector(UFM_CPLD_UPDATE_STATUS_SECTOR_ID);
+    fill_journal();
+    recover_flash();
+    EXPECT_FALSE(is_cpld_rc_update_in_progress());
+    EXPECT_EQ(journal[0], alt_u32(DECOMPRESSION_CHECKPOINT_TAG | (SPI_FLASH_PCH << 8) | DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK));
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(1));
+    EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(m_spi_flash_in_use)));
+}
+
+TEST_F(DecompressionCheckpointTest, test_interrupted_session_survives_cpld_update_status_erase)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+    recover_flash();
+    alt_u64 full_time_ns = SYSTEM_MOCK::get()->get_sim_time_ns();
+    std::vector<alt_u32> expected_flash(m_flash_x86_ptr, m_flash_x86_ptr + PCH_SPI_FLASH_SIZE / 4);
+
+    prepare_flash();
+    SYSTEM_MOCK::get()->enable_sim_time();
+    recover_flash_until_power_loss(full_time_ns / 2);
+    DECOMPRESSION_CHECKPOINT interrupted_checkpoint;
+    load_decompression_checkpoint(&interrupted_checkpoint);
+    EXPECT_NE(interrupted_checkpoint.phase, alt_u32(DECOMPRESSION_CHECKPOINT_PHASE_DONE));
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(2));
+
+    // Promote a staged CPLD capsule. This erases the CPLD update status word, which shares the UFM sector with the journal.
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, SIGNED_CAPSULE_CPLD_FILE,
+            SIGNED_CAPSULE_CPLD_FILE_SIZE, get_ufm_pfr_data()->bmc_staging_region
+            + BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET);
+    set_cpld_rc_update_in_progress_ufm_flag();
+    perform_cpld_recovery_update();
+    EXPECT_FALSE(is_cpld_rc_update_in_progress());
+
+    // Only the interrupted session is kept, with its last checkpoint
+    DECOMPRESSION_CHECKPOINT checkpoint;
+    EXPECT_EQ(load_decompression_checkpoint(&checkpoint), alt_u32(0));
+    EXPECT_EQ(checkpoint.phase, interrupted_checkpoint.phase);
+    EXPECT_EQ(checkpoint.done_addr, interrupted_checkpoint.done_addr);
+    EXPECT_EQ(checkpoint.next_index, alt_u32(DECOMPRESSION_CHECKPOINT_HEADER_NWORDS + 1));
+
+    // The decompression is resumed and the blank check is not trusted until the next checkpoint
+    switch_spi_flash(m_spi_flash_in_use);
+    set_spi_erase_blank_check(1);
+    alt_u32 blank_erases_before = SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count();
+    recover_flash();
+    EXPECT_GT(SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count(), blank_erases_before);
+    EXPECT_TRUE(std::equal(expected_flash.begin(), expected_flash.end(), m_flash_x86_ptr));
+    EXPECT_EQ(get_num_checkpoint_sessions(), alt_u32(1));
+
+    // Once no session is interrupted, the erase leaves an empty journal
+    erase_cpld_update_status_sector();
+    EXPECT_EQ(get_decompression_checkpoint_journal()[0], alt_u32(0xFFFFFFFF));
+}
@@ -20,12 +20,14 @@
  * DEALINGS IN THE SOFTWARE.
  ******************************************************************************/
 #include <iostream>
+#include <vector>
 
 // Include the GTest headers
 #include "gtest_headers.h"
 
 // Include the SYSTEM MOCK and PFR headers
 #include "ut_nios_wrapper.h"
+#include "pbc_encoder.h"
 #include "testdata_info.h"
 
 
@@ -94,7 +96,7 @@ TEST_F(DecompressionFlowTest, test_authentication_after_decompressing_bmc_capsul
     // Perform the decompression
     alt_u32* active_pfm = get_spi_active_pfm_ptr(SPI_FLASH_BMC);
     alt_u32* signed_capsule = get_spi_recovery_region_ptr(SPI_FLASH_BMC);
-    decompress_capsule(signed_capsule, SPI_FLASH_BMC, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK);
+    decompress_capsule(signed_capsule, SPI_FLASH_BMC, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 0);
 
     // Authenticate the active region after decompression
     alt_u32 is_active_valid = is_active_region_valid(active_pfm);
@@ -111,9 +113,474 @@ TEST_F(DecompressionFlowTest, test_authentication_after_decompressing_pch_capsul
     // Perform the decompression
     alt_u32* active_pfm = get_spi_active_pfm_ptr(SPI_FLASH_PCH);
     alt_u32* signed_capsule = get_spi_recovery_region_ptr(SPI_FLASH_PCH);
-    decompress_capsule(signed_capsule, SPI_FLASH_PCH, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK);
+    decompress_capsule(signed_capsule, SPI_FLASH_PCH, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 0);
 
     // Authenticate the active region after decompression
     alt_u32 is_active_valid = is_active_region_valid(active_pfm);
     EXPECT_TRUE(is_active_valid);
 }
+
+TEST_F(DecompressionFlowTest, test_blank_check_skips_erase_of_blank_sectors)
+{
+    alt_u32 erase_count[2];
+    for (alt_u32 run_i = 0; run_i < 2; run_i++)
+    {
+        // Start with a PCH flash that has the full image except for a few erased regions
+        SYSTEM_MOCK::get()->reset();
+        SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+        if (run_i == 0)
+        {
+            // First run always erases, since another decompression was interrupted. Second run skips the sectors that are already blank.
+            ut_interrupt_other_decompression();
+        }
+        SYSTEM_MOCK::get()->reset_spi_flash(m_spi_flash_in_use);
+        SYSTEM_MOCK::get()->load_to_flash(m_spi_flash_in_use, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        for (alt_u32 region_i = 0; region_i < PCH_NUM_STATIC_REGIONS; region_i++)
+        {
+            erase_spi_region(testdata_pch_static_regions_start_addr[region_i],
+                    testdata_pch_static_regions_end_addr[region_i] - testdata_pch_static_regions_start_addr[region_i]);
+        }
+        alt_u32 erase_count_before = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) + SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE);
+        alt_u32 blank_erase_count_before = SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count();
+
+        // Recover the PCH active firmware, erasing and programming every page in the bitmaps
+        decompress_capsule(get_spi_recovery_region_ptr(SPI_FLASH_PCH), SPI_FLASH_PCH, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 0);
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(SPI_FLASH_PCH)));
+
+        erase_count[run_i] = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) + SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE) - erase_count_before;
+        if (run_i)
+        {
+            // No erase command should be sent to a blank sector
+            EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count() - blank_erase_count_before, alt_u32(0));
+        }
+    }
+
+    EXPECT_LT(erase_count[1], erase_count[0]);
+    EXPECT_EQ(get_spi_erase_blank_check(), alt_u32(0));
+}
+
+TEST_F(DecompressionFlowTest, test_diff_mode_only_updates_changed_pages)
+{
+    // Page in a static region that is changed on flash before decompression
+    alt_u32 changed_page_addr = testdata_pch_static_regions_start_addr[0] + PBC_EXPECTED_PAGE_SIZE;
+    alt_u32* changed_page_x86_ptr = m_flash_x86_ptr + (changed_page_addr >> 2);
+
+    alt_u32 erase_count[2];
+    alt_u64 decomp_time_ns[2];
+    for (alt_u32 run_i = 0; run_i < 2; run_i++)
+    {
+        // Start with a PCH flash that has the full image, except for one modified page
+        SYSTEM_MOCK::get()->reset();
+        SYSTEM_MOCK::get()->enable_sim_time();
+        SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+        SYSTEM_MOCK::get()->reset_spi_flash(m_spi_flash_in_use);
+        SYSTEM_MOCK::get()->load_to_flash(m_spi_flash_in_use, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        alt_u32 expected_word = changed_page_x86_ptr[0];
+        changed_page_x86_ptr[0] = ~expected_word;
+        alt_u32 erase_count_before = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) + SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE);
+        alt_u64 time_before = SYSTEM_MOCK::get()->get_sim_time_ns();
+
+        // Update the PCH active firmware. First run erases and programs every page. Second run only updates the changed page.
+        decompress_capsule(get_spi_recovery_region_ptr(SPI_FLASH_PCH), SPI_FLASH_PCH, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, run_i);
+        EXPECT_EQ(changed_page_x86_ptr[0], expected_word);
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(SPI_FLASH_PCH)));
+
+        erase_count[run_i] = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) + SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE) - erase_count_before;
+        decomp_time_ns[run_i] = SYSTEM_MOCK::get()->get_sim_time_ns() - time_before;
+    }
+
+    // Only the modified page and the active PFM should be erased
+    EXPECT_EQ(erase_count[1], alt_u32(2));
+    EXPECT_LT(erase_count[1], erase_count[0]);
+    EXPECT_LT(decomp_time_ns[1], decomp_time_ns[0]);
+}
+
+/**
+ * @brief Return the typical time (in microseconds) to erase the pages marked in the active bitmap of the capsule,
+ * in all static and dynamic SPI regions.
+ *
+ * If @p coalesce_regions is 1, pages of adjacent SPI regions are erased together. Otherwise, each SPI region is erased separately.
+ */
+static alt_u32 get_decompression_erase_time_us(alt_u32* signed_capsule, alt_u32 staging_region_addr,
+        const SPI_ERASE_TIME_TABLE* erase_time_table, alt_u32 coalesce_regions)
+{
+    alt_u8* active_bitmap = (alt_u8*) get_active_bitmap(get_pbc_ptr_from_signed_capsule(signed_capsule));
+    alt_u32 time_us = 0;
+    alt_u32 run_start_addr = 0;
+    alt_u32 run_end_addr = 0;
+
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, 0, get_capsule_pfm(signed_capsule));
+    for (PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter); entry; entry = get_next_pfm_region(&iter))
+    {
+        if (is_spi_region_in_decompression(entry, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, staging_region_addr))
+        {
+            for (alt_u32 page_addr = entry->start_addr; page_addr < entry->end_addr; page_addr += PBC_EXPECTED_PAGE_SIZE)
+            {
+                alt_u32 bit_in_bitmap = page_addr / PBC_EXPECTED_PAGE_SIZE;
+                if (active_bitmap[bit_in_bitmap >> 3] & (1 << (7 - (bit_in_bitmap % 8))))
+                {
+                    if (page_addr != run_end_addr)
+                    {
+                        time_us += get_planned_spi_erase_time_us(run_start_addr, run_end_addr, erase_time_table);
+                        run_start_addr = page_addr;
+                    }
+                    run_end_addr = page_addr + PBC_EXPECTED_PAGE_SIZE;
+                }
+            }
+
+            if (!coalesce_regions)
+            {
+                time_us += get_planned_spi_erase_time_us(run_start_addr, run_end_addr, erase_time_table);
+                run_start_addr = run_end_addr;
+            }
+        }
+    }
+    return time_us + get_planned_spi_erase_time_us(run_start_addr, run_end_addr, erase_time_table);
+}
+
+TEST_F(DecompressionFlowTest, test_erase_planner_benchmark)
+{
+    SPI_FLASH_TYPE_ENUM spi_flash_types[2] = {SPI_FLASH_BMC, SPI_FLASH_PCH};
+    for (SPI_FLASH_TYPE_ENUM spi_flash_type : spi_flash_types)
+    {
+        SYSTEM_MOCK::get()->reset();
+        SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+        if (spi_flash_type == SPI_FLASH_BMC)
+        {
+            SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+        }
+        else
+        {
+            SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        }
+        switch_spi_flash(spi_flash_type);
+
+        alt_u32* signed_capsule = get_spi_recovery_region_ptr(spi_flash_type);
+        alt_u32 staging_region_addr = get_staging_region_offset(spi_flash_type);
+        SPI_ERASE_TIME_TABLE* erase_time_table = get_spi_erase_time_table(spi_flash_type);
+
+        // Previously, each SPI region was erased separately with only 4KB and 64KB erases
+        SPI_ERASE_TIME_TABLE legacy_erase_time_table = {erase_time_table->erase_4kb_time_us, 0, erase_time_table->erase_64kb_time_us};
+        alt_u32 legacy_time_us = get_decompression_erase_time_us(signed_capsule, staging_region_addr, &legacy_erase_time_table, 0);
+        alt_u32 planned_time_us = get_decompression_erase_time_us(signed_capsule, staging_region_addr, erase_time_table, 1);
+
+        EXPECT_LE(planned_time_us, legacy_time_us);
+
+        // Erase every page in the active bitmap, even the blank ones. Decompression should send exactly the planned
+        // erase commands, plus the erase of the active PFM.
+        ut_interrupt_other_decompression();
+        decompress_capsule(signed_capsule, spi_flash_type, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 0);
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(spi_flash_type)));
+
+        alt_u32 active_pfm_addr = (spi_flash_type == SPI_FLASH_BMC) ? get_ufm_pfr_data()->bmc_active_pfm : get_ufm_pfr_data()->pch_active_pfm;
+        alt_u32 erase_time_us =
+                SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) * erase_time_table->erase_4kb_time_us +
+                SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE) * erase_time_table->erase_32kb_time_us +
+                SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE) * erase_time_table->erase_64kb_time_us;
+        EXPECT_EQ(erase_time_us, planned_time_us +
+                get_planned_spi_erase_time_us(active_pfm_addr, active_pfm_addr + SIGNED_PFM_MAX_SIZE, erase_time_table));
+    }
+}
+
+/**
+ * @brief Reference decompression of all static and dynamic SPI regions into an x86 image of the flash.
+ * As Nios used to do, the bitmaps are walked bit by bit from page 0 for every SPI region.
+ */
+static void decompress_capsule_bit_by_bit(alt_u32* signed_capsule, alt_u32 staging_region_addr, alt_u32 active_pfm_addr, alt_u32* image)
+{
+    PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+    alt_u8* active_bitmap = (alt_u8*) get_active_bitmap(pbc);
+    alt_u8* comp_bitmap = (alt_u8*) get_compression_bitmap(pbc);
+
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, 0, get_capsule_pfm(signed_capsule));
+    for (PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter); entry; entry = get_next_pfm_region(&iter))
+    {
+        if (is_spi_region_in_decompression(entry, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, staging_region_addr))
+        {
+            alt_u32* src_ptr = get_compressed_payload(pbc);
+            for (alt_u32 bit_in_bitmap = 0; bit_in_bitmap < entry->end_addr / PBC_EXPECTED_PAGE_SIZE; bit_in_bitmap++)
+            {
+                alt_u32 bit_mask = 1 << (7 - (bit_in_bitmap % 8));
+                alt_u32* page_ptr = image + bit_in_bitmap * (PBC_EXPECTED_PAGE_SIZE >> 2);
+                if (entry->start_addr <= bit_in_bitmap * PBC_EXPECTED_PAGE_SIZE)
+                {
+                    if (active_bitmap[bit_in_bitmap >> 3] & bit_mask)
+                    {
+                        std::fill(page_ptr, page_ptr + (PBC_EXPECTED_PAGE_SIZE >> 2), 0xFFFFFFFF);
+                    }
+                    if (comp_bitmap[bit_in_bitmap >> 3] & bit_mask)
+                    {
+                        std::copy(src_ptr, src_ptr + (PBC_EXPECTED_PAGE_SIZE >> 2), page_ptr);
+                    }
+                }
+                if (comp_bitmap[bit_in_bitmap >> 3] & bit_mask)
+                {
+                    src_ptr = incr_alt_u32_ptr(src_ptr, PBC_EXPECTED_PAGE_SIZE);
+                }
+            }
+        }
+    }
+
+    // The capsule PFM replaces the active PFM
+    alt_u32* pfm_ptr = image + (active_pfm_addr >> 2);
+    std::fill(pfm_ptr, pfm_ptr + (SIGNED_PFM_MAX_SIZE >> 2), 0xFFFFFFFF);
+    alt_u32* signed_capsule_pfm = incr_alt_u32_ptr(signed_capsule, SIGNATURE_SIZE);
+    std::copy(signed_capsule_pfm, signed_capsule_pfm + (get_signed_payload_size(signed_capsule_pfm) >> 2), pfm_ptr);
+}
+
+/**
+ * @brief Locate the compressed payload of every page to be copied, by walking the compression bitmap bit by bit
+ * from page 0 for every SPI region. The HW watchdog is reset every 8 pages, as Nios used to do.
+ * Return the sum of the payload offsets.
+ */
+static alt_u64 locate_pages_bit_by_bit(alt_u32* signed_capsule, alt_u32 staging_region_addr)
+{
+    PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+    alt_u8* comp_bitmap = (alt_u8*) get_compression_bitmap(pbc);
+    alt_u64 offset_sum = 0;
+
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, 0, get_capsule_pfm(signed_capsule));
+    for (PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter); entry; entry = get_next_pfm_region(&iter))
+    {
+        if (is_spi_region_in_decompression(entry, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, staging_region_addr))
+        {
+            alt_u32 payload_offset = 0;
+            for (alt_u32 bit_in_bitmap = 0; bit_in_bitmap < entry->end_addr / PBC_EXPECTED_PAGE_SIZE; bit_in_bitmap++)
+            {
+                if (comp_bitmap[bit_in_bitmap >> 3] & (1 << (7 - (bit_in_bitmap % 8))))
+                {
+                    if (entry->start_addr <= bit_in_bitmap * PBC_EXPECTED_PAGE_SIZE)
+                    {
+                        offset_sum += payload_offset;
+                    }
+                    payload_offset += PBC_EXPECTED_PAGE_SIZE;
+                }
+                if ((bit_in_bitmap % 8) == 7)
+                {
+                    reset_hw_watchdog();
+                }
+            }
+        }
+    }
+    return offset_sum;
+}
+
+/**
+ * @brief Locate the compressed payload of every page to be copied with a decompression cursor, going through
+ * the SPI regions in address order. Return the sum of the payload offsets.
+ */
+static alt_u64 locate_pages_with_cursor(alt_u32* signed_capsule, alt_u32 staging_region_addr)
+{
+    alt_u64 offset_sum = 0;
+    DECOMPRESSION_CURSOR cursor;
+    init_decompression_cursor(&cursor, signed_capsule);
+
+    PFM_REGION_TABLE_ENTRY region;
+    alt_u32 has_region = get_next_spi_region_in_decompression(
+            signed_capsule, 0, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, staging_region_addr, 0, &region);
+    while (has_region)
+    {
+        alt_u32 region_start_bit = region.start_addr / PBC_EXPECTED_PAGE_SIZE;
+        alt_u32 region_end_bit = region.end_addr / PBC_EXPECTED_PAGE_SIZE;
+        for (alt_u32 word_index = region_start_bit >> 5; (word_index << 5) < region_end_bit; word_index++)
+        {
+            alt_u32 marked_pages = get_pbc_bitmap_word(cursor.comp_bitmap, cursor.bitmap_nbytes, word_index) &
+                    get_bitmap_word_mask(word_index, region_start_bit, region_end_bit);
+            while (marked_pages)
+            {
+                seek_decompression_cursor(&cursor, pop_next_marked_page(&marked_pages, word_index));
+                offset_sum += cursor.comp_page_index * PBC_EXPECTED_PAGE_SIZE;
+            }
+            reset_hw_watchdog();
+        }
+        has_region = get_next_spi_region_in_decompression(signed_capsule, 0,
+                DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, staging_region_addr, region.start_addr + 1, &region);
+    }
+    return offset_sum;
+}
+
+TEST_F(DecompressionFlowTest, test_decompression_matches_bit_by_bit_reference)
+{
+    SPI_FLASH_TYPE_ENUM spi_flash_types[2] = {SPI_FLASH_BMC, SPI_FLASH_PCH};
+    for (SPI_FLASH_TYPE_ENUM spi_flash_type : spi_flash_types)
+    {
+        SYSTEM_MOCK::get()->reset();
+        SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+        alt_u32 image_size = FULL_PFR_IMAGE_PCH_FILE_SIZE;
+        if (spi_flash_type == SPI_FLASH_BMC)
+        {
+            image_size = FULL_PFR_IMAGE_BMC_FILE_SIZE;
+            SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+        }
+        else
+        {
+            SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        }
+        switch_spi_flash(spi_flash_type);
+
+        alt_u32* flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(spi_flash_type);
+        alt_u32* signed_capsule = get_spi_recovery_region_ptr(spi_flash_type);
+        alt_u32 recovery_region_addr = (alt_u8*) signed_capsule - (alt_u8*) flash_x86_ptr;
+        alt_u32 staging_region_addr = get_staging_region_offset(spi_flash_type);
+        alt_u32 active_pfm_addr = (spi_flash_type == SPI_FLASH_BMC) ? get_ufm_pfr_data()->bmc_active_pfm : get_ufm_pfr_data()->pch_active_pfm;
+
+        // Modify two out of every three pages before the recovery region
+        for (alt_u32 page_addr = 0; page_addr < recovery_region_addr; page_addr += PBC_EXPECTED_PAGE_SIZE)
+        {
+            if ((page_addr / PBC_EXPECTED_PAGE_SIZE) % 3)
+            {
+                std::fill(flash_x86_ptr + (page_addr >> 2), flash_x86_ptr + ((page_addr + PBC_EXPECTED_PAGE_SIZE) >> 2), page_addr);
+            }
+        }
+
+        std::vector<alt_u32> expected_image(flash_x86_ptr, flash_x86_ptr + (image_size >> 2));
+        decompress_capsule_bit_by_bit(signed_capsule, staging_region_addr, active_pfm_addr, expected_image.data());
+
+        decompress_capsule(signed_capsule, spi_flash_type, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 1);
+        EXPECT_TRUE(std::equal(expected_image.begin(), expected_image.end(), flash_x86_ptr));
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(spi_flash_type)));
+    }
+}
+
+TEST_F(DecompressionFlowTest, test_decompression_walk_matches_bit_by_bit_reference)
+{
+    SPI_FLASH_TYPE_ENUM spi_flash_types[2] = {SPI_FLASH_BMC, SPI_FLASH_PCH};
+    for (SPI_FLASH_TYPE_ENUM spi_flash_type : spi_flash_types)
+    {
+        SYSTEM_MOCK::get()->reset();
+        SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+        if (spi_flash_type == SPI_FLASH_BMC)
+        {
+            SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+        }
+        else
+        {
+            SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        }
+        switch_spi_flash(spi_flash_type);
+
+        alt_u32* signed_capsule = get_spi_recovery_region_ptr(spi_flash_type);
+        alt_u32 staging_region_addr = get_staging_region_offset(spi_flash_type);
+
+        // Both walks locate the same pages in the compressed payload
+        alt_u64 cursor_sum = locate_pages_with_cursor(signed_capsule, staging_region_addr);
+        EXPECT_NE(cursor_sum, alt_u64(0));
+        EXPECT_EQ(locate_pages_bit_by_bit(signed_capsule, staging_region_addr), cursor_sum);
+    }
+}
+
+TEST_F(DecompressionFlowTest, test_decompress_capsule_with_per_page_lz)
+{
+    SPI_FLASH_TYPE_ENUM spi_flash_types[2] = {SPI_FLASH_BMC, SPI_FLASH_PCH};
+    for (SPI_FLASH_TYPE_ENUM spi_flash_type : spi_flash_types)
+    {
+        alt_u32 image_size = (spi_flash_type == SPI_FLASH_BMC) ? FULL_PFR_IMAGE_BMC_FILE_SIZE : FULL_PFR_IMAGE_PCH_FILE_SIZE;
+        alt_u32 capsule_size = (spi_flash_type == SPI_FLASH_BMC) ? SIGNED_CAPSULE_BMC_FILE_SIZE : SIGNED_CAPSULE_PCH_FILE_SIZE;
+
+        // Decompress the version 2 capsule first, and then the same capsule in version 3
+        std::vector<alt_u32> decompressed_image[2];
+        for (alt_u32 run_i = 0; run_i < 2; run_i++)
+        {
+            SYSTEM_MOCK::get()->reset();
+            SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+            if (spi_flash_type == SPI_FLASH_BMC)
+            {
+                SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+            }
+            else
+            {
+                SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+            }
+            switch_spi_flash(spi_flash_type);
+
+            alt_u32* flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(spi_flash_type);
+            alt_u32* signed_capsule = get_spi_recovery_region_ptr(spi_flash_type);
+            alt_u32 recovery_region_addr = (alt_u8*) signed_capsule - (alt_u8*) flash_x86_ptr;
+
+            // Modify every other page before the recovery region
+            for (alt_u32 page_addr = 0; page_addr < recovery_region_addr; page_addr += 2 * PBC_EXPECTED_PAGE_SIZE)
+            {
+                flash_x86_ptr[page_addr >> 2] = ~flash_x86_ptr[page_addr >> 2];
+            }
+
+            PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+            if (run_i)
+            {
+                std::vector<alt_u32> pbc_v3 = PBC_ENCODER::convert_to_per_page_lz(pbc);
+                alt_u32 pbc_offset = (alt_u8*) pbc - (alt_u8*) signed_capsule;
+                EXPECT_LT(pbc_offset + pbc_v3.size() * 4, capsule_size);
+
+                // Replace the PBC structure of the capsule in the recovery region
+                std::fill((alt_u32*) pbc, signed_capsule + (capsule_size >> 2), 0xFFFFFFFF);
+                std::copy(pbc_v3.begin(), pbc_v3.end(), (alt_u32*) pbc);
+                EXPECT_TRUE(is_pbc_valid(pbc));
+            }
+
+            decompress_capsule(signed_capsule, spi_flash_type, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 1);
+            EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(spi_flash_type)));
+
+            // Save the flash content, except for the recovery region
+            decompressed_image[run_i].assign(flash_x86_ptr, flash_x86_ptr + (recovery_region_addr >> 2));
+            decompressed_image[run_i].insert(decompressed_image[run_i].end(),
+                    flash_x86_ptr + ((recovery_region_addr + capsule_size) >> 2), flash_x86_ptr + (image_size >> 2));
+        }
+        EXPECT_TRUE(decompressed_image[0] == decompressed_image[1]);
+    }
+}
+
+TEST_F(DecompressionFlowTest, test_decompress_delta_capsule)
+{
+    alt_u32 image_size = FULL_PFR_IMAGE_PCH_FILE_SIZE;
+    alt_u32 capsule_size = SIGNED_CAPSULE_PCH_FILE_SIZE;
+
+    // Decompress the full capsule first, and then a delta capsule that only carries the modified pages
+    std::vector<alt_u32> decompressed_image[2];
+    alt_u32 pages_programmed[2];
+    for (alt_u32 run_i = 0; run_i < 2; run_i++)
+    {
+        SYSTEM_MOCK::get()->reset();
+        SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+        SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        switch_spi_flash(SPI_FLASH_PCH);
+
+        alt_u32* flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_PCH);
+        alt_u32* signed_capsule = get_spi_recovery_region_ptr(SPI_FLASH_PCH);
+        alt_u32 recovery_region_addr = (alt_u8*) signed_capsule - (alt_u8*) flash_x86_ptr;
+
+        // The base image has every 32nd page before the recovery region modified
+        for (alt_u32 page_addr = 0; page_addr < recovery_region_addr; page_addr += 32 * PBC_EXPECTED_PAGE_SIZE)
+        {
+            flash_x86_ptr[page_addr >> 2] = ~flash_x86_ptr[page_addr >> 2];
+        }
+
+        PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+        if (run_i)
+        {
+            KCH_SIGNATURE* active_pfm = (KCH_SIGNATURE*) get_spi_active_pfm_ptr(SPI_FLASH_PCH);
+            std::vector<alt_u32> pbc_delta = PBC_ENCODER::convert_to_delta(pbc, flash_x86_ptr, active_pfm->b0.pc_hash256);
+            alt_u32 pbc_offset = (alt_u8*) pbc - (alt_u8*) signed_capsule;
+            EXPECT_LT((pbc_offset + pbc_delta.size() * 4) * 8, capsule_size);
+
+            // Replace the PBC structure of the capsule in the recovery region
+            std::fill((alt_u32*) pbc, signed_capsule + (capsule_size >> 2), 0xFFFFFFFF);
+            std::copy(pbc_delta.begin(), pbc_delta.end(), (alt_u32*) pbc);
+            EXPECT_TRUE(is_pbc_valid(pbc));
+            EXPECT_TRUE(is_delta_pbc(pbc));
+        }
+
+        reset_io_counters();
+        decompress_capsule(signed_capsule, SPI_FLASH_PCH, DECOMPRESSION_STATIC_AND_DYNAMIC_REGIONS_MASK, 1);
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(SPI_FLASH_PCH)));
+        pages_programmed[run_i] = io_counters[IO_COUNTER_PAGES_PROGRAMMED];
+
+        // Save the flash content, except for the recovery region
+        decompressed_image[run_i].assign(flash_x86_ptr, flash_x86_ptr + (recovery_region_addr >> 2));
+        decompressed_image[run_i].insert(decompressed_image[run_i].end(),
+                flash_x86_ptr + ((recovery_region_addr + capsule_size) >> 2), flash_x86_ptr + (image_size >> 2));
+    }
+    EXPECT_TRUE(decompressed_image[0] == decompressed_image[1]);
+    EXPECT_LE(pages_programmed[1], pages_programmed[0]);
+}
@@ -19,13 +19,16 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
  * DEALINGS IN THE SOFTWARE.
  ******************************************************************************/
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 // Include the GTest headers
 #include "gtest_headers.h"
 
 // Include the SYSTEM MOCK and PFR headers
 #include "ut_nios_wrapper.h"
+#include "pbc_encoder.h"
 #include "testdata_info.h"
 
 
@@ -196,7 +199,8 @@ TEST_F(DecompressionUtilsTest, test_decompression_erase_function_case_2)
     }
 
     // Check SPI Erase command counts
-    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(16));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(8));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(1));
     EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(1));
 }
 
@@ -409,3 +413,150 @@ TEST_F(DecompressionUtilsTest, test_decompression_copy_function_case_2)
         }
     }
 }
+
+/**
+ * @brief Decode an LZ compressed page one chunk at a time, as Nios does, into a page buffer.
+ */
+static void decode_pbc_lz_page(alt_u8* src_ptr, alt_u32 src_nbytes, alt_u32* dest_ptr)
+{
+    PBC_LZ_DECODER decoder;
+    init_pbc_lz_decoder(&decoder, src_ptr, src_nbytes, (alt_u8*) dest_ptr);
+    for (alt_u32 chunk_offset = 0; chunk_offset < PBC_EXPECTED_PAGE_SIZE; chunk_offset += PBC_LZ_CHUNK_SIZE)
+    {
+        decode_pbc_lz_chunk(&decoder, incr_alt_u32_ptr(dest_ptr, chunk_offset));
+    }
+}
+
+TEST_F(DecompressionUtilsTest, test_decode_pbc_lz_page_round_trip)
+{
+    std::vector<alt_u8> page(PBC_EXPECTED_PAGE_SIZE);
+    alt_u32 decoded_page[PBC_EXPECTED_PAGE_SIZE / 4];
+
+    // A page of zeros, a page of repeated records, a page without any repetition and a page that
+    // repeats its first 1KB. The last one has matches that reach back to earlier chunks.
+    for (alt_u32 pattern_i = 0; pattern_i < 4; pattern_i++)
+    {
+        for (alt_u32 byte_i = 0; byte_i < PBC_EXPECTED_PAGE_SIZE; byte_i++)
+        {
+            if (pattern_i == 0)
+            {
+                page[byte_i] = 0;
+            }
+            else if (pattern_i == 1)
+            {
+                page[byte_i] = (byte_i % 37 < 20) ? alt_u8(byte_i / 37) : alt_u8(byte_i % 37);
+            }
+            else
+            {
+                page[byte_i] = alt_u8(((byte_i % ((pattern_i == 2) ? PBC_EXPECTED_PAGE_SIZE : 1024)) * 2654435761u) >> 24);
+            }
+        }
+
+        std::vector<alt_u8> stream = PBC_ENCODER::compress_page(page.data());
+        if (pattern_i < 2)
+        {
+            EXPECT_LT(stream.size(), alt_u32(PBC_EXPECTED_PAGE_SIZE / 4));
+        }
+        else if (pattern_i == 3)
+        {
+            EXPECT_LT(stream.size(), alt_u32(PBC_EXPECTED_PAGE_SIZE / 2));
+        }
+
+        decode_pbc_lz_page(stream.data(), stream.size(), decoded_page);
+        EXPECT_EQ(std::memcmp(decoded_page, page.data(), PBC_EXPECTED_PAGE_SIZE), 0);
+    }
+}
+
+TEST_F(DecompressionUtilsTest, test_decode_pbc_lz_page_with_overlapping_match)
+{
+    // Literal 'A', followed by a copy of 10 bytes from 1 byte back
+    alt_u8 stream[] = {0x00, 'A', PBC_LZ_MATCH_TOKEN_MASK | (10 - PBC_LZ_MIN_MATCH_LEN), 0x00, 0x00};
+    alt_u32 decoded_page[PBC_EXPECTED_PAGE_SIZE / 4];
+    decode_pbc_lz_page(stream, sizeof(stream), decoded_page);
+
+    alt_u8* decoded_bytes = (alt_u8*) decoded_page;
+    for (alt_u32 byte_i = 0; byte_i < PBC_EXPECTED_PAGE_SIZE; byte_i++)
+    {
+        // The stream ends early. The rest of the page is blank.
+        ASSERT_EQ(decoded_bytes[byte_i], (byte_i < 11) ? alt_u8('A') : alt_u8(0xFF));
+    }
+}
+
+TEST_F(DecompressionUtilsTest, test_decode_pbc_lz_page_with_bad_stream)
+{
+    alt_u32 decoded_page[PBC_EXPECTED_PAGE_SIZE / 4];
+    alt_u8* decoded_bytes = (alt_u8*) decoded_page;
+
+    // Copy from before the start of the page
+    alt_u8 bad_distance_stream[] = {0x01, 'A', 'B', PBC_LZ_MATCH_TOKEN_MASK, 0x02, 0x00};
+    decode_pbc_lz_page(bad_distance_stream, sizeof(bad_distance_stream), decoded_page);
+    EXPECT_EQ(decoded_bytes[0], alt_u8('A'));
+    EXPECT_EQ(decoded_bytes[1], alt_u8('B'));
+    EXPECT_EQ(decoded_bytes[2], alt_u8(0xFF));
+
+    // Long runs never write beyond the page
+    std::vector<alt_u8> long_stream = {0x00, 0x5A};
+    for (alt_u32 match_i = 0; match_i < 64; match_i++)
+    {
+        long_stream.insert(long_stream.end(), {0xFF, 0x00, 0x00});
+    }
+    decode_pbc_lz_page(long_stream.data(), long_stream.size(), decoded_page);
+    EXPECT_EQ(decoded_bytes[PBC_EXPECTED_PAGE_SIZE - 1], alt_u8(0x5A));
+}
+
+TEST_F(DecompressionUtilsTest, test_decompression_copy_function_with_per_page_lz)
+{
+    alt_u32* signed_capsule = get_spi_recovery_region_ptr(m_spi_flash_in_use);
+    PBC_HEADER* pbc = get_pbc_ptr_from_signed_capsule(signed_capsule);
+    alt_u8* active_bitmap = (alt_u8*) get_active_bitmap(pbc);
+    alt_u8* comp_bitmap = (alt_u8*) get_compression_bitmap(pbc);
+    alt_u32* compressed_payload = get_compressed_payload(pbc);
+
+    // Erase and copy to page 2 - page 9. Nothing else.
+    for (alt_u32 byte_i = 0; byte_i < (pbc->bitmap_nbit / 8); byte_i++)
+    {
+        active_bitmap[byte_i] = 0;
+        comp_bitmap[byte_i] = 0;
+    }
+    active_bitmap[0] = 0b00111111;
+    active_bitmap[1] = 0b11000000;
+    comp_bitmap[0] = 0b00111111;
+    comp_bitmap[1] = 0b11000000;
+
+    // Even pages repeat the page ID. Odd pages are not compressible.
+    for (alt_u32 page_i = 0; page_i < 8; page_i++)
+    {
+        for (alt_u32 word_i = 0; word_i < (PBC_EXPECTED_PAGE_SIZE >> 2); word_i++)
+        {
+            alt_u32 word = (page_i % 2) ? (page_i << 24) ^ (word_i * 2654435761u) : page_i;
+            compressed_payload[page_i * (PBC_EXPECTED_PAGE_SIZE >> 2) + word_i] = word;
+        }
+    }
+    std::vector<alt_u32> expected_pages(compressed_payload, compressed_payload + 8 * (PBC_EXPECTED_PAGE_SIZE >> 2));
+
+    // Replace the PBC structure with a version 3 one
+    pbc->tag = PBC_EXPECTED_TAG;
+    pbc->version = PBC_EXPECTED_VERSION;
+    std::vector<alt_u32> pbc_v3 = PBC_ENCODER::convert_to_per_page_lz(pbc);
+    EXPECT_LT(pbc_v3.size() * 4, sizeof(PBC_HEADER) + 2 * get_bitmap_size(pbc) + 8 * PBC_EXPECTED_PAGE_SIZE);
+    std::copy(pbc_v3.begin(), pbc_v3.end(), (alt_u32*) pbc);
+    EXPECT_TRUE(is_pbc_valid(pbc));
+
+    // Perform the decompression
+    decompress_spi_region_from_capsule(0, 40 * PBC_EXPECTED_PAGE_SIZE, signed_capsule);
+
+    // Compare against expected data
+    for (alt_u32 page_id = 0; page_id < 40; page_id++)
+    {
+        alt_u32* spi_ptr = get_spi_flash_ptr_with_offset(page_id * PBC_EXPECTED_PAGE_SIZE);
+        for (alt_u32 word_i = 0; word_i < (PBC_EXPECTED_PAGE_SIZE >> 2); word_i++)
+        {
+            alt_u32 expected_word = 0xFFFFFFFF;
+            if ((page_id >= 2) && (page_id < 10))
+            {
+                expected_word = expected_pages[(page_id - 2) * (PBC_EXPECTED_PAGE_SIZE >> 2) + word_i];
+            }
+            ASSERT_EQ(spi_ptr[word_i], expected_word);
+        }
+    }
+}
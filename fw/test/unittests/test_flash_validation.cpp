@@ -20,12 +20,14 @@
  * DEALINGS IN THE SOFTWARE.
  ******************************************************************************/
 #include <iostream>
+#include <vector>
 
 // Include the GTest headers
 #include "gtest_headers.h"
 
 // Include the SYSTEM MOCK and PFR headers
 #include "ut_nios_wrapper.h"
+#include "testdata_info.h"
 
 class FlashValidationTest : public testing::Test
 {
@@ -87,3 +89,196 @@ TEST_F(FlashValidationTest, test_validate_full_bmc_image)
     EXPECT_TRUE(is_active_valid);
     EXPECT_TRUE(is_recovery_valid);
 }
+
+TEST_F(FlashValidationTest, test_auth_cache_skips_static_regions_in_second_authentication)
+{
+    ut_reset_nios_fw();
+    SYSTEM_MOCK::get()->load_to_flash(m_spi_flash_in_use, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+    // Verify the PFM signature once, so that the CSK entry is already cached in the counts below
+    EXPECT_TRUE(is_signature_valid((KCH_SIGNATURE*) get_spi_active_pfm_ptr(SPI_FLASH_PCH)));
+
+    // First authentication hashes every static region
+    alt_u32 sha_jobs_before = SYSTEM_MOCK::get()->get_crypto_sha_job_count();
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+    alt_u32 first_auth_sha_jobs = SYSTEM_MOCK::get()->get_crypto_sha_job_count() - sha_jobs_before;
+    EXPECT_EQ(get_spi_region_auth_cache(SPI_FLASH_PCH)->num_entries, alt_u32(PCH_NUM_STATIC_REGIONS));
+
+    // Second authentication only verifies the PFM signature
+    sha_jobs_before = SYSTEM_MOCK::get()->get_crypto_sha_job_count();
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+    alt_u32 second_auth_sha_jobs = SYSTEM_MOCK::get()->get_crypto_sha_job_count() - sha_jobs_before;
+
+    EXPECT_EQ(first_auth_sha_jobs - second_auth_sha_jobs, alt_u32(PCH_NUM_STATIC_REGIONS));
+
+    // The uncached path always hashes every static region
+    sha_jobs_before = SYSTEM_MOCK::get()->get_crypto_sha_job_count();
+    EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(SPI_FLASH_PCH)));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_sha_job_count() - sha_jobs_before, first_auth_sha_jobs);
+}
+
+TEST_F(FlashValidationTest, test_auth_cache_is_invalidated_by_erase)
+{
+    ut_reset_nios_fw();
+    SYSTEM_MOCK::get()->load_to_flash(m_spi_flash_in_use, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+
+    // Erase the first page of a static region. Nios must hash this region again and catch the change.
+    erase_spi_region(testdata_pch_static_regions_start_addr[1], SPI_FLASH_PAGE_SIZE_OF_4KB);
+    EXPECT_EQ(get_spi_region_auth_cache(SPI_FLASH_PCH)->num_entries, alt_u32(PCH_NUM_STATIC_REGIONS - 1));
+    EXPECT_FALSE(is_spi_region_auth_cached(get_spi_region_auth_cache(SPI_FLASH_PCH),
+            testdata_pch_static_regions_start_addr[1], testdata_pch_static_regions_end_addr[1]));
+
+    EXPECT_FALSE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+}
+
+TEST_F(FlashValidationTest, test_auth_cache_skips_new_entries_when_full)
+{
+    ut_reset_nios_fw();
+    SPI_REGION_AUTH_CACHE* cache = get_spi_region_auth_cache(SPI_FLASH_PCH);
+    for (alt_u32 entry_i = 0; entry_i <= SPI_REGION_AUTH_CACHE_MAX_ENTRIES; entry_i++)
+    {
+        add_spi_region_auth_cache_entry(cache, entry_i * 0x10000, entry_i * 0x10000 + 0x8000);
+    }
+
+    // The last region is not cached. It will be hashed again.
+    EXPECT_EQ(cache->num_entries, alt_u32(SPI_REGION_AUTH_CACHE_MAX_ENTRIES));
+    EXPECT_TRUE(is_spi_region_auth_cached(cache, 0, 0x8000));
+    EXPECT_FALSE(is_spi_region_auth_cached(cache, SPI_REGION_AUTH_CACHE_MAX_ENTRIES * 0x10000,
+            SPI_REGION_AUTH_CACHE_MAX_ENTRIES * 0x10000 + 0x8000));
+}
+
+TEST_F(FlashValidationTest, test_auth_cache_is_invalidated_by_writable_16kb_page)
+{
+    ut_reset_nios_fw();
+    SPI_REGION_AUTH_CACHE* cache = get_spi_region_auth_cache(SPI_FLASH_PCH);
+    add_spi_region_auth_cache_entry(cache, 0x10000, 0x15000);
+    add_spi_region_auth_cache_entry(cache, 0x20000, 0x30000);
+
+    // A writable region which ends before 0x20000 but shares a 16KB page with the first entry
+    invalidate_spi_region_auth_cache_for_writable_range(SPI_FLASH_PCH, 0x16000, 0x1F000);
+    EXPECT_FALSE(is_spi_region_auth_cached(cache, 0x10000, 0x15000));
+    EXPECT_TRUE(is_spi_region_auth_cached(cache, 0x20000, 0x30000));
+    EXPECT_EQ(cache->num_entries, alt_u32(1));
+
+    // A different PFM drops everything
+    alt_u32 pfm_hash[PFR_CRYPTO_LENGTH / 4] = {0x12345678};
+    prepare_spi_region_auth_cache(SPI_FLASH_PCH, pfm_hash);
+    EXPECT_EQ(cache->num_entries, alt_u32(0));
+}
+
+/**
+ * @brief Return the number of SPI region and SMBus rule definitions in the PFM body.
+ */
+static alt_u32 get_num_pfm_definitions(PFM* pfm)
+{
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, 0, pfm);
+    alt_u32 num_defs = 0;
+    while (get_next_pfm_region(&iter))
+    {
+        num_defs++;
+    }
+    return num_defs;
+}
+
+TEST_F(FlashValidationTest, test_pfm_region_table_is_compiled_once_per_pfm)
+{
+    ut_reset_nios_fw();
+    SYSTEM_MOCK::get()->load_to_flash(m_spi_flash_in_use, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+    EXPECT_EQ(get_active_pfm_region_table(SPI_FLASH_PCH), (PFM_REGION_TABLE*) 0);
+
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+    PFM_REGION_TABLE* table = get_active_pfm_region_table(SPI_FLASH_PCH);
+    ASSERT_NE(table, (PFM_REGION_TABLE*) 0);
+    EXPECT_EQ(table->num_entries, get_num_pfm_definitions(get_active_pfm(SPI_FLASH_PCH)));
+    for (alt_u32 entry_i = 1; entry_i < table->num_entries; entry_i++)
+    {
+        EXPECT_LE(table->entries[entry_i - 1].end_addr, table->entries[entry_i].start_addr);
+    }
+
+    // The second authentication goes through the same table
+    table->entries[0].flags |= 0x80000000;
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+    EXPECT_EQ(get_active_pfm_region_table(SPI_FLASH_PCH), table);
+    EXPECT_TRUE(table->entries[0].flags & 0x80000000);
+    table->entries[0].flags &= ~0x80000000;
+
+    // A PFM that fails authentication is dropped
+    alt_u32* active_pfm_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_PCH) + (get_ufm_pfr_data()->pch_active_pfm >> 2);
+    active_pfm_x86_ptr[(SIGNATURE_SIZE + PFM_HEADER_SIZE) / 4 + 2] ^= 0x1000;
+    EXPECT_FALSE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+    EXPECT_FALSE(table->is_compiled);
+}
+
+TEST_F(FlashValidationTest, test_write_protection_from_pfm_region_table_matches_pfm_body)
+{
+    SPI_FLASH_TYPE_ENUM spi_flash_types[2] = {SPI_FLASH_BMC, SPI_FLASH_PCH};
+    for (SPI_FLASH_TYPE_ENUM spi_flash_type : spi_flash_types)
+    {
+        ut_reset_nios_fw();
+        SYSTEM_MOCK::get()->reset_spi_flash(spi_flash_type);
+        if (spi_flash_type == SPI_FLASH_BMC)
+        {
+            SYSTEM_MOCK::get()->load_to_flash(spi_flash_type, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+        }
+        else
+        {
+            SYSTEM_MOCK::get()->load_to_flash(spi_flash_type, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        }
+        switch_spi_flash(spi_flash_type);
+
+        // Apply the rules from the PFM body in flash
+        apply_spi_write_protection_and_smbus_rules(spi_flash_type);
+        std::vector<alt_u32> expected_writable_pages;
+        for (alt_u32 addr = 0; addr < PCH_SPI_FLASH_SIZE; addr += 0x4000)
+        {
+            expected_writable_pages.push_back(ut_is_16kb_page_writable(spi_flash_type, addr));
+        }
+
+        // Apply the rules from the compiled PFM
+        EXPECT_TRUE(is_active_region_valid_with_auth_cache(spi_flash_type));
+        ASSERT_NE(get_active_pfm_region_table(spi_flash_type), (PFM_REGION_TABLE*) 0);
+        apply_spi_write_protection_and_smbus_rules(spi_flash_type);
+        for (alt_u32 addr = 0; addr < PCH_SPI_FLASH_SIZE; addr += 0x4000)
+        {
+            EXPECT_EQ(ut_is_16kb_page_writable(spi_flash_type, addr), expected_writable_pages[addr / 0x4000]);
+        }
+    }
+}
+
+TEST_F(FlashValidationTest, test_recovered_pfm_uses_capsule_pfm_region_table)
+{
+    ut_reset_nios_fw();
+    SYSTEM_MOCK::get()->load_to_flash(m_spi_flash_in_use, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+    EXPECT_EQ(get_active_pfm_region_table(SPI_FLASH_PCH), (PFM_REGION_TABLE*) 0);
+
+    // After a static recovery, the active PFM is the capsule PFM. Its table can be used right away.
+    decompress_capsule(get_spi_recovery_region_ptr(SPI_FLASH_PCH), SPI_FLASH_PCH, DECOMPRESSION_STATIC_REGIONS_MASK, 1);
+    PFM_REGION_TABLE* table = get_active_pfm_region_table(SPI_FLASH_PCH);
+    ASSERT_NE(table, (PFM_REGION_TABLE*) 0);
+    EXPECT_EQ(table->num_entries, get_num_pfm_definitions(get_active_pfm(SPI_FLASH_PCH)));
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+}
+
+TEST_F(FlashValidationTest, test_pfm_region_table_holds_one_pfm_at_a_time)
+{
+    ut_reset_nios_fw();
+    SYSTEM_MOCK::get()->reset_spi_flash(SPI_FLASH_BMC);
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+
+    switch_spi_flash(SPI_FLASH_BMC);
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_BMC));
+    EXPECT_EQ(get_active_pfm_region_table(SPI_FLASH_BMC), get_pfm_region_table());
+
+    // The PCH PFM replaces the BMC PFM in the table
+    switch_spi_flash(SPI_FLASH_PCH);
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_PCH));
+    EXPECT_EQ(get_active_pfm_region_table(SPI_FLASH_PCH), get_pfm_region_table());
+
+    // Nios walks the BMC PFM body in flash instead, until the BMC PFM is compiled again
+    switch_spi_flash(SPI_FLASH_BMC);
+    EXPECT_EQ(get_active_pfm_region_table(SPI_FLASH_BMC), (PFM_REGION_TABLE*) 0);
+    EXPECT_TRUE(is_active_region_valid_with_auth_cache(SPI_FLASH_BMC));
+    EXPECT_EQ(get_active_pfm_region_table(SPI_FLASH_BMC), get_pfm_region_table());
+}
@@ -230,7 +230,7 @@ TEST_F(RecoveryFlowTest, test_static_recovery_on_corrupted_pfm_bmc)
      * Perform the recovery
      */
     alt_u32* recovery_region_ptr = get_spi_recovery_region_ptr(SPI_FLASH_BMC);
-    decompress_capsule(recovery_region_ptr, SPI_FLASH_BMC, DECOMPRESSION_STATIC_REGIONS_MASK);
+    decompress_capsule(recovery_region_ptr, SPI_FLASH_BMC, DECOMPRESSION_STATIC_REGIONS_MASK, 0);
 
     /*
      * Verify recovered data
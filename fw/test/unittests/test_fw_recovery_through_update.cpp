@@ -679,6 +679,10 @@ TEST_F(FWRecoveryThroughUpdateTest, test_recover_bmc_recovery_region_through_fw_
     // Recovery image should now be valid
     EXPECT_TRUE(is_signature_valid((KCH_SIGNATURE*) signed_recovery_capsule));
 
+    // Only the corrupted sector of the recovery image has been rewritten in the last T-1
+    EXPECT_EQ(io_counters[IO_COUNTER_4KB_ERASES] + io_counters[IO_COUNTER_32KB_ERASES] + io_counters[IO_COUNTER_64KB_ERASES], alt_u32(1));
+    EXPECT_EQ(io_counters[IO_COUNTER_PAGES_PROGRAMMED], alt_u32(SPI_FLASH_PAGE_SIZE_OF_4KB / SPI_FLASH_PAGE_SIZE));
+
     delete[] full_image;
 }
 
@@ -1555,3 +1555,210 @@ TEST_F(FWUpdateFlowTest, test_oob_bmc_recovery_update_and_pch_active_update)
     delete[] bmc_update_capsule;
 }
 
+
+/*
+ * This test runs the T-1 routines of a BMC recovery update directly.
+ * The staging capsule is authenticated in the T-1 cycle of the active update. It's write protected until
+ * the T-1 cycle of the recovery update, which doesn't hash it again.
+ */
+TEST_F(FWUpdateFlowTest, test_recovery_update_bmc_reuses_staging_capsule_authentication)
+{
+    ut_prep_nios_gpi_signals();
+
+    alt_u32 staging_start_addr = get_staging_region_offset(SPI_FLASH_BMC);
+    alt_u32 staging_end_addr = staging_start_addr + SIGNED_CAPSULE_BMC_V14_FILE_SIZE;
+    alt_u32 staging_we_word_pos = staging_start_addr >> SPI_WE_MEM_WORD_SHIFT;
+    alt_u32 staging_we_bit = 0b1 << ((staging_start_addr >> SPI_WE_MEM_PAGE_SHIFT) & 0x1f);
+
+    /*
+     * T-1 cycle of the active update
+     */
+    write_to_mailbox(MB_BMC_UPDATE_INTENT, MB_UPDATE_INTENT_BMC_RECOVERY_MASK);
+    act_on_bmc_update_intent();
+    authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+
+    EXPECT_EQ(read_from_mailbox(MB_MAJOR_ERROR_CODE), alt_u32(0));
+    EXPECT_TRUE(check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK));
+
+    // The staging capsule is read-only, although the PFM allows writes to the staging region
+    EXPECT_TRUE(is_spi_we_mem_range_write_protected(SPI_FLASH_BMC, staging_start_addr, staging_end_addr));
+    EXPECT_FALSE(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, staging_we_word_pos) & staging_we_bit);
+
+    /*
+     * T-1 cycle of the recovery update
+     */
+    // The staging capsule is trusted without any crypto operation
+    alt_u32 data_words_before = SYSTEM_MOCK::get()->get_crypto_data_word_count();
+    EXPECT_TRUE(check_capsule_before_fw_recovery_update(SPI_FLASH_BMC, 0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_data_word_count(), data_words_before);
+
+    process_pending_recovery_update(SPI_FLASH_BMC);
+    EXPECT_FALSE(check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK));
+    EXPECT_EQ(num_failed_update_attempts_from_bmc, alt_u32(0));
+    EXPECT_TRUE(is_capsule_valid(get_spi_recovery_region_ptr(SPI_FLASH_BMC)));
+
+    // With the recovery update done, the staging region is writable again
+    authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+    EXPECT_EQ(get_spi_region_auth_cache(SPI_FLASH_BMC)->staging_capsule_end_addr, alt_u32(0));
+    EXPECT_TRUE(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, staging_we_word_pos) & staging_we_bit);
+
+    EXPECT_EQ(read_from_mailbox(MB_BMC_PFM_RECOVERY_MAJOR_VER), alt_u32(SIGNED_CAPSULE_BMC_V14_FILE_PFM_MAJOR_VER));
+    EXPECT_EQ(read_from_mailbox(MB_BMC_PFM_RECOVERY_MINOR_VER), alt_u32(SIGNED_CAPSULE_BMC_V14_FILE_PFM_MINOR_VER));
+}
+
+/*
+ * The staging capsule is only write protected while its recovery update is pending. Once the pending flag is cleared
+ * (here, because the recovery update fails), the staging region is writable again, as the active PFM specifies.
+ */
+TEST_F(FWUpdateFlowTest, test_recovery_update_bmc_lifts_staging_capsule_write_protection_when_no_longer_pending)
+{
+    ut_prep_nios_gpi_signals();
+
+    alt_u32 staging_start_addr = get_staging_region_offset(SPI_FLASH_BMC);
+    alt_u32 staging_last_page_addr = staging_start_addr + SIGNED_CAPSULE_BMC_V14_FILE_SIZE - 1;
+
+    // T-1 cycle of the active update
+    write_to_mailbox(MB_BMC_UPDATE_INTENT, MB_UPDATE_INTENT_BMC_RECOVERY_MASK);
+    act_on_bmc_update_intent();
+    authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+    EXPECT_TRUE(check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK));
+    EXPECT_FALSE(ut_is_16kb_page_writable(SPI_FLASH_BMC, staging_start_addr));
+    EXPECT_FALSE(ut_is_16kb_page_writable(SPI_FLASH_BMC, staging_last_page_addr));
+
+    // Make the recovery update fail: Block 0 of the staging capsule no longer matches the cached result or the signature
+    alt_u32* bmc_flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    KCH_BLOCK0* staging_b0 = (KCH_BLOCK0*) &bmc_flash_x86_ptr[staging_start_addr >> 2];
+    staging_b0->pc_hash256[0] = ~staging_b0->pc_hash256[0];
+
+    // T-1 cycle of the recovery update
+    process_pending_recovery_update(SPI_FLASH_BMC);
+    EXPECT_FALSE(check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK));
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_RECOVERY_FW_UPDATE_AUTH_FAILED));
+
+    authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+    EXPECT_EQ(get_spi_region_auth_cache(SPI_FLASH_BMC)->staging_capsule_end_addr, alt_u32(0));
+    EXPECT_TRUE(ut_is_16kb_page_writable(SPI_FLASH_BMC, staging_start_addr));
+    EXPECT_TRUE(ut_is_16kb_page_writable(SPI_FLASH_BMC, staging_last_page_addr));
+}
+
+/*
+ * When the recovery capsule doesn't read back the same as the staging capsule, Nios erases and programs the whole
+ * recovery capsule once. It's read back again before the SVN policy is updated.
+ */
+TEST_F(FWUpdateFlowTest, test_recovery_update_bmc_rewrites_recovery_capsule_that_reads_back_differently)
+{
+    alt_u32 staging_start_addr = get_staging_region_offset(SPI_FLASH_BMC);
+    alt_u32 recovery_start_addr = get_recovery_region_offset(SPI_FLASH_BMC);
+    alt_u32* bmc_flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    alt_u32* staging_x86_ptr = &bmc_flash_x86_ptr[staging_start_addr >> 2];
+    alt_u32* recovery_x86_ptr = &bmc_flash_x86_ptr[recovery_start_addr >> 2];
+
+    // The recovery capsule already reads the same as the staging capsule. So, no sector is rewritten in the
+    // first attempt. A word of the first sector changes right after it has been compared, when the HW timer is pet.
+    std::copy(staging_x86_ptr, staging_x86_ptr + (SIGNED_CAPSULE_BMC_V14_FILE_SIZE >> 2), recovery_x86_ptr);
+    alt_u32 is_word_changed = 0;
+    SYSTEM_MOCK::get()->register_read_write_callback(
+            [&](SYSTEM_MOCK::READ_OR_WRITE read_or_write, void* addr, alt_u32 data) {
+        if ((read_or_write == SYSTEM_MOCK::READ_OR_WRITE::WRITE) && (addr == __IO_CALC_ADDRESS_NATIVE_ALT_U32(U_DUAL_CONFIG_BASE, 0)) && !is_word_changed)
+        {
+            recovery_x86_ptr[0x40] = ~recovery_x86_ptr[0x40];
+            is_word_changed = 1;
+        }
+    });
+
+    ut_reset_io_counters();
+    EXPECT_TRUE(perform_firmware_recovery_update(SPI_FLASH_BMC));
+    EXPECT_TRUE(std::equal(staging_x86_ptr, staging_x86_ptr + (SIGNED_CAPSULE_BMC_V14_FILE_SIZE >> 2), recovery_x86_ptr));
+    EXPECT_EQ(get_ufm_svn(UFM_SVN_POLICY_BMC), alt_u32(get_capsule_pfm(get_spi_staging_region_ptr(SPI_FLASH_BMC))->svn));
+
+    // Every sector of the recovery capsule has been erased once and programmed once
+    alt_u32 erased_nbytes = io_counters[IO_COUNTER_4KB_ERASES] * SPI_FLASH_PAGE_SIZE_OF_4KB +
+            io_counters[IO_COUNTER_32KB_ERASES] * SPI_FLASH_PAGE_SIZE_OF_32KB +
+            io_counters[IO_COUNTER_64KB_ERASES] * SPI_FLASH_PAGE_SIZE_OF_64KB;
+    EXPECT_EQ(erased_nbytes, alt_u32((SIGNED_CAPSULE_BMC_V14_FILE_SIZE + SPI_FLASH_PAGE_SIZE_OF_4KB - 1) & ~(SPI_FLASH_PAGE_SIZE_OF_4KB - 1)));
+    EXPECT_EQ(io_counters[IO_COUNTER_PAGES_PROGRAMMED], alt_u32((SIGNED_CAPSULE_BMC_V14_FILE_SIZE + SPI_FLASH_PAGE_SIZE - 1) / SPI_FLASH_PAGE_SIZE));
+}
+
+/*
+ * If the recovery capsule still doesn't read back the same as the staging capsule after it has been rewritten,
+ * the recovery update fails. The SVN policy is left as it is.
+ */
+TEST_F(FWUpdateFlowTest, test_recovery_update_bmc_fails_when_rewritten_recovery_capsule_reads_back_differently)
+{
+    ut_prep_nios_gpi_signals();
+
+    // T-1 cycle of the active update
+    write_to_mailbox(MB_BMC_UPDATE_INTENT, MB_UPDATE_INTENT_BMC_RECOVERY_MASK);
+    act_on_bmc_update_intent();
+    authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+    EXPECT_TRUE(check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK));
+    alt_u32 svn_before = get_ufm_svn(UFM_SVN_POLICY_BMC);
+
+    // A word of the recovery capsule never reads back as programmed
+    alt_u32* bmc_flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    alt_u32* staging_x86_ptr = &bmc_flash_x86_ptr[get_staging_region_offset(SPI_FLASH_BMC) >> 2];
+    alt_u32* recovery_x86_ptr = &bmc_flash_x86_ptr[get_recovery_region_offset(SPI_FLASH_BMC) >> 2];
+    SYSTEM_MOCK::get()->register_read_write_callback(
+            [&](SYSTEM_MOCK::READ_OR_WRITE read_or_write, void* addr, alt_u32 data) {
+        if ((read_or_write == SYSTEM_MOCK::READ_OR_WRITE::WRITE) && (recovery_x86_ptr[0x40] == staging_x86_ptr[0x40]))
+        {
+            recovery_x86_ptr[0x40] = ~staging_x86_ptr[0x40];
+        }
+    });
+
+    // T-1 cycle of the recovery update
+    process_pending_recovery_update(SPI_FLASH_BMC);
+    EXPECT_FALSE(check_spi_flash_state(SPI_FLASH_BMC, SPI_FLASH_STATE_HAS_PENDING_RECOVERY_FW_UPDATE_MASK));
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), alt_u32(MINOR_ERROR_RECOVERY_FW_UPDATE_AUTH_FAILED));
+    EXPECT_EQ(num_failed_update_attempts_from_bmc, alt_u32(1));
+    EXPECT_EQ(get_ufm_svn(UFM_SVN_POLICY_BMC), svn_before);
+}
+
+/*
+ * The staging capsule of a pending recovery update is hashed again, when Nios can't prove that it has been
+ * read-only since its authentication.
+ */
+TEST_F(FWUpdateFlowTest, test_recovery_update_bmc_rehashes_staging_capsule_when_not_write_protected)
+{
+    ut_prep_nios_gpi_signals();
+
+    alt_u32 staging_start_addr = get_staging_region_offset(SPI_FLASH_BMC);
+    alt_u32 staging_we_word_pos = staging_start_addr >> SPI_WE_MEM_WORD_SHIFT;
+
+    write_to_mailbox(MB_BMC_UPDATE_INTENT, MB_UPDATE_INTENT_BMC_RECOVERY_MASK);
+    act_on_bmc_update_intent();
+    authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+
+    alt_u32 data_words_before = SYSTEM_MOCK::get()->get_crypto_data_word_count();
+    EXPECT_TRUE(check_capsule_before_fw_recovery_update(SPI_FLASH_BMC, 0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_crypto_data_word_count(), data_words_before);
+
+    // Part of the staging capsule is made writable
+    commit_spi_we_mem_word(SPI_FLASH_BMC, staging_we_word_pos, 0xFFFFFFFF);
+    data_words_before = SYSTEM_MOCK::get()->get_crypto_data_word_count();
+    EXPECT_TRUE(check_capsule_before_fw_recovery_update(SPI_FLASH_BMC, 0));
+    EXPECT_GE(SYSTEM_MOCK::get()->get_crypto_data_word_count() - data_words_before, alt_u32(SIGNED_CAPSULE_BMC_V14_FILE_SIZE / 8));
+
+    // BMC is reset without Nios being involved
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+    invalidate_spi_region_auth_cache(SPI_FLASH_BMC);
+    data_words_before = SYSTEM_MOCK::get()->get_crypto_data_word_count();
+    EXPECT_TRUE(check_capsule_before_fw_recovery_update(SPI_FLASH_BMC, 0));
+    EXPECT_GE(SYSTEM_MOCK::get()->get_crypto_data_word_count() - data_words_before, alt_u32(SIGNED_CAPSULE_BMC_V14_FILE_SIZE / 8));
+
+    // Nios doesn't know what's in the write enable memory (e.g. after a CPLD reconfiguration)
+    write_to_mailbox(MB_BMC_UPDATE_INTENT, MB_UPDATE_INTENT_BMC_RECOVERY_MASK);
+    act_on_bmc_update_intent();
+    authenticate_and_recover_spi_flash(SPI_FLASH_BMC);
+    write_protect_staging_capsule(SPI_FLASH_BMC);
+    invalidate_spi_we_mem_shadow(SPI_FLASH_BMC);
+    data_words_before = SYSTEM_MOCK::get()->get_crypto_data_word_count();
+    EXPECT_TRUE(check_capsule_before_fw_recovery_update(SPI_FLASH_BMC, 0));
+    EXPECT_GE(SYSTEM_MOCK::get()->get_crypto_data_word_count() - data_words_before, alt_u32(SIGNED_CAPSULE_BMC_V14_FILE_SIZE / 8));
+}
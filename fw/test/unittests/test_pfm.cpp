@@ -20,6 +20,7 @@
  * DEALINGS IN THE SOFTWARE.
  ******************************************************************************/
 #include <iostream>
+#include <vector>
 
 // Include the GTest headers
 #include "gtest_headers.h"
@@ -73,3 +74,152 @@ TEST_F(PFMTest, test_pfm_spi_region_definition)
     EXPECT_EQ(rule_def->start_addr, alt_u32(0x4000));
     EXPECT_EQ(rule_def->end_addr, alt_u32(0x5C000));
 }
+
+/**
+ * @brief Build a PFM with a SMBus rule definition followed by SPI region definitions, in the given order.
+ * SPI region definitions have no hash. A dynamic region is followed by a static region.
+ */
+static std::vector<alt_u32> build_pfm(const std::vector<alt_u32>& region_start_addrs, alt_u32 region_size)
+{
+    std::vector<alt_u32> pfm(PFM_HEADER_SIZE / 4, 0);
+    pfm[0] = PFM_MAGIC;
+
+    // SMBus rule definition
+    pfm.push_back(SMBUS_RULE_DEF_TYPE);
+    pfm.push_back(0x0A010100);
+    pfm.insert(pfm.end(), SMBUS_NUM_BYTE_IN_WHITELIST / 4, 0xFFFFFFFF);
+
+    for (alt_u32 region_i = 0; region_i < region_start_addrs.size(); region_i++)
+    {
+        alt_u32 protection_mask = SPI_REGION_PROTECT_MASK_READ_ALLOWED;
+        if (region_i % 2 == 0)
+        {
+            protection_mask |= SPI_REGION_PROTECT_MASK_WRITE_ALLOWED | SPI_REGION_PROTECT_MASK_RECOVER_ON_FIRST_RECOVERY;
+        }
+        pfm.push_back(SPI_REGION_DEF_TYPE | (protection_mask << 8));
+        pfm.push_back(0);
+        pfm.push_back(region_start_addrs[region_i]);
+        pfm.push_back(region_start_addrs[region_i] + region_size);
+    }
+    pfm.push_back(0xFFFFFFFF);
+    pfm[7] = pfm.size() * 4;
+    return pfm;
+}
+
+TEST_F(PFMTest, test_compiled_pfm_matches_pfm_body)
+{
+    PFM* pfm = (PFM*) m_raw_pfm_x86;
+    alt_u32 pfm_hash[PFR_CRYPTO_LENGTH / 4] = {0x12345678};
+    PFM_REGION_TABLE table;
+    compile_pfm_region_table(&table, pfm, pfm_hash);
+    EXPECT_TRUE(table.is_compiled);
+    EXPECT_TRUE(is_pfm_region_table_for_pfm(&table, pfm_hash));
+
+    // Both ways of going through the PFM see the same definitions
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, 0, pfm);
+    alt_u32 num_defs = 0;
+    for (PFM_REGION_TABLE_ENTRY* entry = get_next_pfm_region(&iter); entry; entry = get_next_pfm_region(&iter))
+    {
+        if (entry->flags & PFM_REGION_TABLE_FLAG_SPI_REGION)
+        {
+            PFM_SPI_REGION_DEF* region_def = (PFM_SPI_REGION_DEF*) get_pfm_region_def(&iter, entry);
+            EXPECT_EQ(entry->start_addr, region_def->start_addr);
+            EXPECT_EQ(entry->end_addr, region_def->end_addr);
+            EXPECT_EQ(bool(entry->flags & PFM_REGION_TABLE_FLAG_STATIC), bool(is_spi_region_static(region_def)));
+            EXPECT_EQ(bool(entry->flags & PFM_REGION_TABLE_FLAG_DYNAMIC), bool(is_spi_region_dynamic(region_def)));
+        }
+
+        bool is_in_table = false;
+        for (alt_u32 entry_i = 0; entry_i < table.num_entries; entry_i++)
+        {
+            is_in_table |= (table.entries[entry_i].def_offset == entry->def_offset) &&
+                    (table.entries[entry_i].flags == entry->flags);
+        }
+        EXPECT_TRUE(is_in_table);
+        num_defs++;
+    }
+    EXPECT_EQ(table.num_entries, num_defs);
+
+    // The first definition of this PFM is the SPI region that starts at 0x4000
+    for (alt_u32 entry_i = 0; entry_i < table.num_entries; entry_i++)
+    {
+        if (table.entries[entry_i].def_offset == 0)
+        {
+            EXPECT_EQ(table.entries[entry_i].start_addr, alt_u32(0x4000));
+            EXPECT_TRUE(table.entries[entry_i].flags & PFM_REGION_TABLE_FLAG_SPI_REGION);
+        }
+    }
+}
+
+TEST_F(PFMTest, test_compiled_pfm_is_sorted_by_address)
+{
+    std::vector<alt_u32> raw_pfm = build_pfm({0x30000, 0x10000, 0x20000, 0x0}, 0x10000);
+    PFM* pfm = (PFM*) raw_pfm.data();
+    alt_u32 pfm_hash[PFR_CRYPTO_LENGTH / 4] = {};
+    PFM_REGION_TABLE table;
+    compile_pfm_region_table(&table, pfm, pfm_hash);
+    ASSERT_TRUE(table.is_compiled);
+    ASSERT_EQ(table.num_entries, alt_u32(5));
+
+    // The SMBus rule definition comes first
+    EXPECT_EQ(table.entries[0].flags, alt_u32(PFM_REGION_TABLE_FLAG_SMBUS_RULE));
+    EXPECT_EQ(table.entries[0].def_offset, alt_u32(0));
+    PFM_SMBUS_RULE_DEF* rule_def = (PFM_SMBUS_RULE_DEF*) incr_alt_u32_ptr(pfm->pfm_body, table.entries[0].def_offset);
+    EXPECT_EQ(rule_def->bus_id, alt_u8(1));
+    EXPECT_EQ(rule_def->rule_id, alt_u8(1));
+    EXPECT_EQ(rule_def->device_addr, alt_u8(0x0A));
+
+    for (alt_u32 entry_i = 1; entry_i < table.num_entries; entry_i++)
+    {
+        PFM_REGION_TABLE_ENTRY* entry = &table.entries[entry_i];
+        EXPECT_EQ(entry->start_addr, (entry_i - 1) * 0x10000);
+        EXPECT_EQ(entry->end_addr, entry_i * 0x10000);
+    }
+
+    // Region at 0x0 was the 4th SPI region definition, which is a static region
+    EXPECT_EQ(table.entries[1].def_offset, alt_u32(SMBUS_RULE_DEF_SIZE + 3 * SPI_REGION_DEF_MIN_SIZE));
+    EXPECT_EQ(table.entries[1].flags, alt_u32(PFM_REGION_TABLE_FLAG_SPI_REGION | PFM_REGION_TABLE_FLAG_STATIC |
+            SPI_REGION_PROTECT_MASK_READ_ALLOWED));
+    // Region at 0x30000 was the 1st SPI region definition, which is a dynamic region
+    EXPECT_EQ(table.entries[4].def_offset, alt_u32(SMBUS_RULE_DEF_SIZE));
+    EXPECT_EQ(table.entries[4].flags, alt_u32(PFM_REGION_TABLE_FLAG_SPI_REGION | PFM_REGION_TABLE_FLAG_DYNAMIC |
+            SPI_REGION_PROTECT_MASK_READ_ALLOWED | SPI_REGION_PROTECT_MASK_WRITE_ALLOWED |
+            SPI_REGION_PROTECT_MASK_RECOVER_ON_FIRST_RECOVERY));
+}
+
+TEST_F(PFMTest, test_pfm_with_too_many_definitions_is_not_compiled)
+{
+    // The SMBus rule definition takes one entry
+    std::vector<alt_u32> region_start_addrs;
+    for (alt_u32 region_i = 0; region_i < PFM_REGION_TABLE_MAX_ENTRIES; region_i++)
+    {
+        region_start_addrs.push_back(region_i * 0x1000);
+    }
+    std::vector<alt_u32> raw_pfm = build_pfm(region_start_addrs, 0x1000);
+    PFM* pfm = (PFM*) raw_pfm.data();
+    alt_u32 pfm_hash[PFR_CRYPTO_LENGTH / 4] = {};
+
+    PFM_REGION_TABLE table;
+    compile_pfm_region_table(&table, pfm, pfm_hash);
+    EXPECT_FALSE(table.is_compiled);
+    EXPECT_FALSE(is_pfm_region_table_for_pfm(&table, pfm_hash));
+    EXPECT_EQ(prepare_pfm_region_table(pfm, pfm_hash), (PFM_REGION_TABLE*) 0);
+
+    // Nios falls back to the PFM body, which has every definition
+    PFM_REGION_ITER iter;
+    init_pfm_region_iter(&iter, 0, pfm);
+    alt_u32 num_defs = 0;
+    while (get_next_pfm_region(&iter))
+    {
+        num_defs++;
+    }
+    EXPECT_EQ(num_defs, alt_u32(PFM_REGION_TABLE_MAX_ENTRIES + 1));
+
+    // One less SPI region fits
+    raw_pfm = build_pfm(std::vector<alt_u32>(region_start_addrs.begin() + 1, region_start_addrs.end()), 0x1000);
+    pfm = (PFM*) raw_pfm.data();
+    EXPECT_EQ(prepare_pfm_region_table(pfm, pfm_hash), get_pfm_region_table());
+    EXPECT_EQ(get_pfm_region_table()->num_entries, alt_u32(PFM_REGION_TABLE_MAX_ENTRIES));
+    invalidate_pfm_region_table();
+}
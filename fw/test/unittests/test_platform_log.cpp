@@ -53,3 +53,87 @@ TEST_F(PlatformLogTest, test_log_wdt_recovery)
     EXPECT_EQ(read_from_mailbox(MB_PANIC_EVENT_COUNT), alt_u32(2));
     EXPECT_EQ(read_from_mailbox(MB_LAST_PANIC_REASON), alt_u32(LAST_PANIC_ME_WDT_EXPIRED));
 }
+
+/**
+ * @brief Read a 16-bit entry of the T-1 profile from the mailbox.
+ */
+static alt_u32 ut_read_tmin1_profile_mb_entry(alt_u32 phase)
+{
+    alt_u32 mb_offset = MB_TMIN1_PROFILE + phase * TMIN1_PROFILE_MB_ENTRY_SIZE;
+    return IORD(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset) | (IORD(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 1) << 8);
+}
+
+TEST_F(PlatformLogTest, test_tmin1_profile)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+
+    // Nothing is measured outside of T-1
+    switch_tmin1_phase(TMIN1_PHASE_PIT);
+    SYSTEM_MOCK::get()->advance_sim_time_ns(5000000);
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
+    EXPECT_EQ(tmin1_profile.ms[TMIN1_PHASE_PIT], alt_u32(0));
+    EXPECT_EQ(tmin1_profile.cycles[TMIN1_PHASE_PIT], alt_u32(0));
+
+    log_platform_state(PLATFORM_STATE_ENTER_TMIN1);
+    EXPECT_TRUE(tmin1_profile.is_running);
+
+    switch_tmin1_phase(TMIN1_PHASE_PIT);
+    SYSTEM_MOCK::get()->advance_sim_time_ns(3000000);
+
+    // Decompression within an update is only counted towards the decompression
+    switch_tmin1_phase(TMIN1_PHASE_UPDATE);
+    SYSTEM_MOCK::get()->advance_sim_time_ns(2000000);
+    TMIN1_PHASE_ENUM prev_phase = switch_tmin1_phase(TMIN1_PHASE_DECOMPRESSION);
+    EXPECT_EQ(prev_phase, TMIN1_PHASE_UPDATE);
+    SYSTEM_MOCK::get()->advance_sim_time_ns(7000000);
+    switch_tmin1_phase(prev_phase);
+    SYSTEM_MOCK::get()->advance_sim_time_ns(1000000);
+
+    // Time outside of any phase is only counted towards the whole T-1
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
+    SYSTEM_MOCK::get()->advance_sim_time_ns(4000000);
+
+    // The mailbox is only updated at the end of T-1
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_NONE), alt_u32(0));
+    log_platform_state(PLATFORM_STATE_ENTER_T0);
+    EXPECT_FALSE(tmin1_profile.is_running);
+
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_NONE), alt_u32(17));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_PIT), alt_u32(3));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_WDT_RECOVERY), alt_u32(0));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_UPDATE), alt_u32(3));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_ACTIVE_AUTH), alt_u32(0));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_RECOVERY_AUTH), alt_u32(0));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_DECOMPRESSION), alt_u32(7));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_RULES), alt_u32(0));
+
+    // Logging T0 again doesn't change the results
+    SYSTEM_MOCK::get()->advance_sim_time_ns(4000000);
+    log_platform_state(PLATFORM_STATE_ENTER_T0);
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_NONE), alt_u32(17));
+
+    // Long durations are saturated
+    EXPECT_EQ(get_tmin1_profile_mb_value(0xFFFFFFFF), alt_u32(TMIN1_PROFILE_MB_MAX_VALUE));
+}
+
+TEST_F(PlatformLogTest, test_tmin1_profile_of_phase_longer_than_cycle_counter_wrap_around)
+{
+    SYSTEM_MOCK::get()->enable_sim_time();
+    log_platform_state(PLATFORM_STATE_ENTER_TMIN1);
+    switch_tmin1_phase(TMIN1_PHASE_DECOMPRESSION);
+
+    // Spend 100 seconds in one phase, while petting the HW watchdog every half a second
+    for (alt_u32 i = 0; i < 200; i++)
+    {
+        SYSTEM_MOCK::get()->advance_sim_time_ns(500000000);
+        reset_hw_watchdog();
+    }
+    switch_tmin1_phase(TMIN1_PHASE_NONE);
+    log_platform_state(PLATFORM_STATE_ENTER_T0);
+
+    // The cycle counter has wrapped around, but the profile hasn't
+    EXPECT_GE(tmin1_profile.ms[TMIN1_PHASE_DECOMPRESSION], alt_u32(100000));
+    EXPECT_LT(tmin1_profile.ms[TMIN1_PHASE_DECOMPRESSION], alt_u32(100010));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_DECOMPRESSION), alt_u32(TMIN1_PROFILE_MB_MAX_VALUE));
+    EXPECT_EQ(ut_read_tmin1_profile_mb_entry(TMIN1_PHASE_NONE), alt_u32(TMIN1_PROFILE_MB_MAX_VALUE));
+}
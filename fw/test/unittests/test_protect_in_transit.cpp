@@ -544,3 +544,206 @@ TEST_F(PFRProtectInTransitTest, test_pit_l2_lockdown_with_tampered_bmc_flash)
     // Check UFM status register for PIT L2 result
     EXPECT_FALSE(read_from_mailbox(MB_PROVISION_STATUS) & MB_UFM_PROV_UFM_PIT_L2_PASSED_MASK);
 }
+
+TEST_F(PFRProtectInTransitTest, test_pit_l2_chunked_happy_path)
+{
+    /*
+     * Flow preparation
+     */
+    // Set asserts to throw as opposed to abort
+    SYSTEM_MOCK::get()->set_assert_to_throw();
+    // Expect that Nios firmware will stuck in the never_exit_loop.
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::THROW_FROM_NEVER_EXIT_LOOP);
+    // Insert the T0_OPERATIONS code block (break out of T0 loop)
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS);
+
+    /*
+     * Step 1.
+     * Provision PIT ID and enable PIT L1.
+     */
+    const alt_u8 pit_id[8] = {
+            0xec, 0xa0, 0xb4, 0xed, 0x14, 0x12, 0xea, 0xe6,
+    };
+    for (int i = 0; i < 8; i++)
+    {
+        IOWR(U_MAILBOX_AVMM_BRIDGE_ADDR, MB_UFM_WRITE_FIFO, pit_id[i]);
+    }
+
+    ut_send_in_ufm_command(MB_UFM_PROV_PIT_ID);
+    ASSERT_DURATION_LE(1, pfr_main());
+
+    ut_send_in_ufm_command(MB_UFM_PROV_ENABLE_PIT_L1);
+    ASSERT_DURATION_LE(1, pfr_main());
+    EXPECT_FALSE(ut_check_ufm_prov_status(MB_UFM_PROV_CMD_ERROR_MASK));
+
+    /*
+     * Step 2.
+     * Enable PIT L2 with chunked firmware sealing
+     */
+    ut_send_in_ufm_command(MB_UFM_PROV_ENABLE_PIT_L2_CHUNKED);
+    ASSERT_DURATION_LE(200, EXPECT_ANY_THROW({ pfr_main(); }));
+
+    EXPECT_FALSE(ut_check_ufm_prov_status(MB_UFM_PROV_CMD_ERROR_MASK));
+    EXPECT_TRUE(check_ufm_status(UFM_STATUS_PIT_L2_ENABLE_BIT_MASK));
+    EXPECT_TRUE(check_ufm_status(UFM_STATUS_PIT_L2_CHUNKED_BIT_MASK));
+    EXPECT_TRUE(check_ufm_status(UFM_STATUS_PIT_HASH_STORED_BIT_MASK));
+
+    // UFM stores the Merkle roots of the chunk hash tables
+    switch_spi_flash(SPI_FLASH_BMC);
+    EXPECT_TRUE(verify_sha(get_ufm_pfr_data()->pit_pch_fw_hash,
+            get_spi_flash_ptr_with_offset(PIT_L2_PCH_CHUNK_HASH_TABLE_OFFSET), (PCH_SPI_FLASH_SIZE / PIT_L2_CHUNK_SIZE) * PFR_CRYPTO_LENGTH));
+    EXPECT_TRUE(verify_sha(get_ufm_pfr_data()->pit_bmc_fw_hash,
+            get_spi_flash_ptr_with_offset(PIT_L2_BMC_CHUNK_HASH_TABLE_OFFSET), (BMC_SPI_FLASH_SIZE / PIT_L2_CHUNK_SIZE) * PFR_CRYPTO_LENGTH));
+
+    // Each table entry is the hash of a chunk
+    switch_spi_flash(SPI_FLASH_PCH);
+    EXPECT_TRUE(verify_sha(SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC) + PIT_L2_PCH_CHUNK_HASH_TABLE_OFFSET / 4,
+            get_spi_flash_ptr(), PIT_L2_CHUNK_SIZE));
+
+    /*
+     * Step 3.
+     * Reboot the platform. The chunk hashes match.
+     */
+    ASSERT_DURATION_LE(200, pfr_main());
+    EXPECT_TRUE(check_ufm_status(UFM_STATUS_PIT_L2_PASSED_BIT_MASK));
+    EXPECT_EQ(ut_get_global_state(), (alt_u32) PLATFORM_STATE_ENTER_T0);
+    EXPECT_TRUE(read_from_mailbox(MB_PROVISION_STATUS) & MB_UFM_PROV_UFM_PIT_L2_PASSED_MASK);
+}
+
+TEST_F(PFRProtectInTransitTest, test_pit_l2_chunked_lockdown_reports_tampered_chunk)
+{
+    /*
+     * Flow preparation
+     */
+    // Set asserts to throw as opposed to abort
+    SYSTEM_MOCK::get()->set_assert_to_throw();
+    // Expect that Nios firmware will stuck in the never_exit_loop.
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::THROW_FROM_NEVER_EXIT_LOOP);
+    // Insert the T0_OPERATIONS code block (break out of T0 loop)
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS);
+
+    /*
+     * Step 1.
+     * Provision PIT ID, enable PIT L1 and then enable PIT L2 with chunked firmware sealing
+     */
+    const alt_u8 pit_id[8] = {
+            0xec, 0xa0, 0xb4, 0xed, 0x14, 0x12, 0xea, 0xe6,
+    };
+    for (int i = 0; i < 8; i++)
+    {
+        IOWR(U_MAILBOX_AVMM_BRIDGE_ADDR, MB_UFM_WRITE_FIFO, pit_id[i]);
+    }
+
+    ut_send_in_ufm_command(MB_UFM_PROV_PIT_ID);
+    ASSERT_DURATION_LE(1, pfr_main());
+    ut_send_in_ufm_command(MB_UFM_PROV_ENABLE_PIT_L1);
+    ASSERT_DURATION_LE(1, pfr_main());
+    ut_send_in_ufm_command(MB_UFM_PROV_ENABLE_PIT_L2_CHUNKED);
+    ASSERT_DURATION_LE(200, EXPECT_ANY_THROW({ pfr_main(); }));
+    EXPECT_FALSE(ut_check_ufm_prov_status(MB_UFM_PROV_CMD_ERROR_MASK));
+
+    /*
+     * Step 2.
+     * Tamper the BMC active PFM and power cycle the platform.
+     * Nios should report the chunk that contains the BMC active PFM.
+     */
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS);
+    alt_u32 bmc_active_pfm_addr = get_ufm_pfr_data()->bmc_active_pfm;
+    switch_spi_flash(SPI_FLASH_BMC);
+    *get_spi_flash_ptr_with_offset(bmc_active_pfm_addr) = 0xffffffff;
+
+    ASSERT_DURATION_LE(200, EXPECT_ANY_THROW({ pfr_main(); }));
+    EXPECT_FALSE(check_ufm_status(UFM_STATUS_PIT_L2_PASSED_BIT_MASK));
+    EXPECT_EQ(ut_get_global_state(), (alt_u32) PLATFORM_STATE_PIT_L2_BMC_HASH_MISMATCH_LOCKDOWN);
+    EXPECT_EQ(read_from_mailbox(MB_MAJOR_ERROR_CODE), (alt_u32) MAJOR_ERROR_PIT_L2_FW_SEAL_MISMATCH);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), bmc_active_pfm_addr / PIT_L2_CHUNK_SIZE);
+
+    /*
+     * Step 3.
+     * Tamper the PCH chunk hash table and power cycle the platform.
+     */
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS);
+    *get_spi_flash_ptr_with_offset(PIT_L2_PCH_CHUNK_HASH_TABLE_OFFSET) ^= 0x1;
+
+    ASSERT_DURATION_LE(200, EXPECT_ANY_THROW({ pfr_main(); }));
+    EXPECT_EQ(ut_get_global_state(), (alt_u32) PLATFORM_STATE_PIT_L2_PCH_HASH_MISMATCH_LOCKDOWN);
+    EXPECT_EQ(read_from_mailbox(MB_MAJOR_ERROR_CODE), (alt_u32) MAJOR_ERROR_PIT_L2_FW_SEAL_MISMATCH);
+    EXPECT_EQ(read_from_mailbox(MB_MINOR_ERROR_CODE), (alt_u32) MINOR_ERROR_PIT_L2_CHUNK_HASH_TABLE_MISMATCH);
+}
+
+TEST_F(PFRProtectInTransitTest, test_pit_l2_chunk_hash_tables_survive_cpld_recovery_update)
+{
+    /*
+     * Flow preparation
+     */
+    // Set asserts to throw as opposed to abort
+    SYSTEM_MOCK::get()->set_assert_to_throw();
+    // Expect that Nios firmware will stuck in the never_exit_loop.
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::THROW_FROM_NEVER_EXIT_LOOP);
+    // Insert the T0_OPERATIONS code block (break out of T0 loop)
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS);
+
+    // Stage a CPLD update capsule in BMC flash
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, SIGNED_CAPSULE_CPLD_FILE,
+            SIGNED_CAPSULE_CPLD_FILE_SIZE, get_ufm_pfr_data()->bmc_staging_region
+            + BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET);
+
+    /*
+     * Step 1.
+     * Provision PIT ID, enable PIT L1 and then enable PIT L2 with chunked firmware sealing
+     */
+    const alt_u8 pit_id[8] = {
+            0xec, 0xa0, 0xb4, 0xed, 0x14, 0x12, 0xea, 0xe6,
+    };
+    for (int i = 0; i < 8; i++)
+    {
+        IOWR(U_MAILBOX_AVMM_BRIDGE_ADDR, MB_UFM_WRITE_FIFO, pit_id[i]);
+    }
+
+    ut_send_in_ufm_command(MB_UFM_PROV_PIT_ID);
+    ASSERT_DURATION_LE(1, pfr_main());
+    ut_send_in_ufm_command(MB_UFM_PROV_ENABLE_PIT_L1);
+    ASSERT_DURATION_LE(1, pfr_main());
+    ut_send_in_ufm_command(MB_UFM_PROV_ENABLE_PIT_L2_CHUNKED);
+    ASSERT_DURATION_LE(200, EXPECT_ANY_THROW({ pfr_main(); }));
+    EXPECT_TRUE(check_ufm_status(UFM_STATUS_PIT_HASH_STORED_BIT_MASK));
+
+    // The chunk hash tables are outside of the CPLD recovery image
+    EXPECT_TRUE((BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET + BMC_PIT_L2_CHUNK_HASH_TABLE_SIZE <= BMC_CPLD_RECOVERY_IMAGE_OFFSET) ||
+            (BMC_CPLD_RECOVERY_IMAGE_OFFSET + MAX_CPLD_UPDATE_CAPSULE_SIZE <= BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET));
+
+    alt_u32* x86_table_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC) + BMC_PIT_L2_CHUNK_HASH_TABLE_OFFSET / 4;
+    alt_u32* table_before_update = new alt_u32[BMC_PIT_L2_CHUNK_HASH_TABLE_SIZE / 4];
+    for (alt_u32 word_i = 0; word_i < BMC_PIT_L2_CHUNK_HASH_TABLE_SIZE / 4; word_i++)
+    {
+        table_before_update[word_i] = x86_table_ptr[word_i];
+    }
+
+    /*
+     * Step 2.
+     * Promote the staged CPLD capsule to the CPLD recovery image
+     */
+    ASSERT_DURATION_LE(16, perform_cpld_recovery_update());
+
+    // The CPLD recovery image has been rewritten
+    switch_spi_flash(SPI_FLASH_BMC);
+    alt_u32* x86_cpld_staging_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC)
+            + (get_ufm_pfr_data()->bmc_staging_region + BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET) / 4;
+    alt_u32* x86_cpld_recovery_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC) + BMC_CPLD_RECOVERY_IMAGE_OFFSET / 4;
+    for (alt_u32 word_i = 0; word_i < SIGNED_CAPSULE_CPLD_FILE_SIZE / 4; word_i++)
+    {
+        ASSERT_EQ(x86_cpld_staging_ptr[word_i], x86_cpld_recovery_ptr[word_i]);
+    }
+
+    // The chunk hash tables are intact and still match the Merkle roots in UFM
+    for (alt_u32 word_i = 0; word_i < BMC_PIT_L2_CHUNK_HASH_TABLE_SIZE / 4; word_i++)
+    {
+        ASSERT_EQ(table_before_update[word_i], x86_table_ptr[word_i]);
+    }
+    EXPECT_TRUE(verify_sha(get_ufm_pfr_data()->pit_pch_fw_hash,
+            get_spi_flash_ptr_with_offset(PIT_L2_PCH_CHUNK_HASH_TABLE_OFFSET), (PCH_SPI_FLASH_SIZE / PIT_L2_CHUNK_SIZE) * PFR_CRYPTO_LENGTH));
+    EXPECT_TRUE(verify_sha(get_ufm_pfr_data()->pit_bmc_fw_hash,
+            get_spi_flash_ptr_with_offset(PIT_L2_BMC_CHUNK_HASH_TABLE_OFFSET), (BMC_SPI_FLASH_SIZE / PIT_L2_CHUNK_SIZE) * PFR_CRYPTO_LENGTH));
+
+    delete[] table_before_update;
+}
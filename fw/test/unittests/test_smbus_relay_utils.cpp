@@ -89,6 +89,7 @@ public:
     {
         SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
         sys->reset();
+        ut_reset_nios_fw();
 
         m_relay1 = sys->smbus_relay_mock_ptr->get_cmd_enable_memory_for_smbus(1);
         m_relay2 = sys->smbus_relay_mock_ptr->get_cmd_enable_memory_for_smbus(2);
@@ -235,6 +236,81 @@ TEST_F(SMBusUtilsTest, test_apply_smbus_rules_from_pch)
     }
 }
 
+/**
+ * @brief Check that the whitelists of rule IDs, that are no longer in the BMC PFM, are cleared.
+ */
+TEST_F(SMBusUtilsTest, test_apply_smbus_rules_clears_removed_rules)
+{
+    // Provision the system
+    SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+
+    // Save the PFM in the SPI flash
+    alt_u32* pfm_ptr = (alt_u32*) get_active_pfm(SPI_FLASH_BMC);
+    alt_u32_memcpy(pfm_ptr, (alt_u32*) m_raw_pfm_x86, 256);
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(m_relay1[8], ((alt_u32*) m_expected_cmd_whitelist_bus1_rule2)[0]);
+
+    // Without the hash of the BMC PFM, Nios can't tell whether it has changed. The rules are written again.
+    m_relay1[8] = 0x12345678;
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(m_relay1[8], ((alt_u32*) m_expected_cmd_whitelist_bus1_rule2)[0]);
+
+    // Words that are 0 in both the old and new whitelist are not written
+    m_relay1[9] = 0x12345678;
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(m_relay1[9], alt_u32(0x12345678));
+    m_relay1[9] = 0;
+
+    // Move the bus 3 rule from rule ID 1 to rule ID 2. The whitelist of rule ID 1 is cleared.
+    alt_u8* bus3_rule_def = ((alt_u8*) pfm_ptr) + PFM_HEADER_SIZE + 2 * SMBUS_RULE_DEF_SIZE + sizeof(PFM_SPI_REGION_DEF);
+    EXPECT_EQ(bus3_rule_def[0], alt_u8(SMBUS_RULE_DEF_TYPE));
+    EXPECT_EQ(bus3_rule_def[6], alt_u8(1));
+    bus3_rule_def[6] = 2;
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    for (int i = 0; i < 8; i++)
+    {
+        EXPECT_EQ(m_relay3[i], alt_u32(0));
+        EXPECT_EQ(m_relay3[8 + i], ((alt_u32*) m_expected_cmd_whitelist_bus3_rule1)[i]);
+        EXPECT_EQ(m_relay1[8 + i], ((alt_u32*) m_expected_cmd_whitelist_bus1_rule2)[i]);
+    }
+}
+
+/**
+ * @brief Check that the SMBus rules are not applied again from an authenticated BMC PFM that hasn't changed.
+ */
+TEST_F(SMBusUtilsTest, test_apply_smbus_rules_is_skipped_for_same_pfm)
+{
+    // Provision the system
+    SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
+
+    // Save the PFM in the SPI flash, and compile it as if it has been authenticated
+    KCH_SIGNATURE* pfm_sig = (KCH_SIGNATURE*) get_spi_active_pfm_ptr(SPI_FLASH_BMC);
+    for (alt_u32 word_i = 0; word_i < (PFR_CRYPTO_LENGTH / 4); word_i++)
+    {
+        pfm_sig->b0.pc_hash256[word_i] = 0xA5A5A5A5 + word_i;
+    }
+    alt_u32* pfm_ptr = (alt_u32*) get_active_pfm(SPI_FLASH_BMC);
+    alt_u32_memcpy(pfm_ptr, (alt_u32*) m_raw_pfm_x86, 256);
+    ASSERT_NE(prepare_pfm_region_table((PFM*) pfm_ptr, pfm_sig->b0.pc_hash256), (PFM_REGION_TABLE*) 0);
+
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(m_relay3[0], ((alt_u32*) m_expected_cmd_whitelist_bus3_rule1)[0]);
+
+    // The command enable memories are not touched again for the same PFM
+    m_relay3[0] = 0x12345678;
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(m_relay3[0], alt_u32(0x12345678));
+
+    // A new PFM with a different whitelist for bus 3 is applied
+    PFM_SMBUS_RULE_DEF* bus3_rule_def = (PFM_SMBUS_RULE_DEF*) (((alt_u8*) pfm_ptr) + PFM_HEADER_SIZE + 2 * SMBUS_RULE_DEF_SIZE + sizeof(PFM_SPI_REGION_DEF));
+    EXPECT_EQ(bus3_rule_def->bus_id, alt_u8(3));
+    bus3_rule_def->cmd_whitelist[0] = 0x0F;
+    pfm_sig->b0.pc_hash256[0]++;
+    ASSERT_NE(prepare_pfm_region_table((PFM*) pfm_ptr, pfm_sig->b0.pc_hash256), (PFM_REGION_TABLE*) 0);
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(m_relay3[0], alt_u32(0x0000000F));
+}
+
 TEST_F(SMBusUtilsTest, test_filter_disabled_in_permissive_mode)
 {
     ut_prep_nios_gpi_signals();
@@ -0,0 +1,121 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+#include <iostream>
+
+// Include the GTest headers
+#include "gtest_headers.h"
+
+// Include the SYSTEM MOCK and PFR headers
+#include "ut_nios_wrapper.h"
+
+
+class SPIErasePlannerTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        SYSTEM_MOCK::get()->reset();
+        SYSTEM_MOCK::get()->reset_spi_flash(SPI_FLASH_BMC);
+        switch_spi_flash(SPI_FLASH_BMC);
+        ut_reset_nios_fw();
+    }
+
+    virtual void TearDown() {}
+};
+
+TEST_F(SPIErasePlannerTest, test_get_spi_erase_size)
+{
+    EXPECT_EQ(get_spi_erase_size(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(0x1000));
+    EXPECT_EQ(get_spi_erase_size(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(0x8000));
+    EXPECT_EQ(get_spi_erase_size(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(0x10000));
+}
+
+TEST_F(SPIErasePlannerTest, test_plan_with_all_erase_commands)
+{
+    SPI_ERASE_TIME_TABLE erase_time_table = {50000, 110000, 150000};
+
+    // Aligned 64KB blocks are erased with 64KB erase
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x10000, 0x30000, &erase_time_table), SPI_CMD_64KB_SECTOR_ERASE);
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x20000, 0x30000, &erase_time_table), SPI_CMD_64KB_SECTOR_ERASE);
+
+    // Aligned 32KB blocks are erased with 32KB erase
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x18000, 0x30000, &erase_time_table), SPI_CMD_32KB_SECTOR_ERASE);
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x10000, 0x18000, &erase_time_table), SPI_CMD_32KB_SECTOR_ERASE);
+
+    // Use 4KB erase when there's less than 32KB to erase or the address is not 32KB aligned
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x10000, 0x17000, &erase_time_table), SPI_CMD_4KB_SECTOR_ERASE);
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x11000, 0x30000, &erase_time_table), SPI_CMD_4KB_SECTOR_ERASE);
+
+    // [0x7000, 0x20000) is erased with one 4KB erase, one 32KB erase and one 64KB erase
+    EXPECT_EQ(get_planned_spi_erase_time_us(0x7000, 0x20000, &erase_time_table), alt_u32(50000 + 110000 + 150000));
+}
+
+TEST_F(SPIErasePlannerTest, test_plan_without_32kb_erase)
+{
+    // This flash device doesn't support 32KB erase
+    SPI_ERASE_TIME_TABLE erase_time_table = {50000, 0, 150000};
+
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x18000, 0x30000, &erase_time_table), SPI_CMD_4KB_SECTOR_ERASE);
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x20000, 0x30000, &erase_time_table), SPI_CMD_64KB_SECTOR_ERASE);
+    EXPECT_EQ(get_planned_spi_erase_time_us(0x18000, 0x30000, &erase_time_table), alt_u32(8 * 50000 + 150000));
+}
+
+TEST_F(SPIErasePlannerTest, test_plan_with_slow_large_erase_commands)
+{
+    // On this flash device, a 64KB erase takes longer than two 32KB erases
+    SPI_ERASE_TIME_TABLE erase_time_table = {20000, 100000, 250000};
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x10000, 0x30000, &erase_time_table), SPI_CMD_32KB_SECTOR_ERASE);
+    EXPECT_EQ(get_planned_spi_erase_time_us(0x10000, 0x30000, &erase_time_table), alt_u32(4 * 100000));
+
+    // On this flash device, a 32KB erase takes longer than eight 4KB erases
+    erase_time_table = {10000, 100000, 150000};
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x18000, 0x20000, &erase_time_table), SPI_CMD_4KB_SECTOR_ERASE);
+    EXPECT_EQ(get_planned_spi_erase_cmd(0x10000, 0x20000, &erase_time_table), SPI_CMD_64KB_SECTOR_ERASE);
+}
+
+TEST_F(SPIErasePlannerTest, test_erase_spi_region_with_32kb_erase)
+{
+    alt_u32* flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    for (alt_u32 word_i = 0; word_i < (0x40000 >> 2); word_i++)
+    {
+        flash_x86_ptr[word_i] = 0;
+    }
+
+    // Erase [0x8000, 0x38000) with the BMC erase time table
+    erase_spi_region(0x8000, 0x30000);
+
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(2));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(2));
+
+    for (alt_u32 word_i = 0; word_i < (0x40000 >> 2); word_i++)
+    {
+        if (((0x8000 >> 2) <= word_i) && (word_i < (0x38000 >> 2)))
+        {
+            ASSERT_EQ(flash_x86_ptr[word_i], alt_u32(0xFFFFFFFF));
+        }
+        else
+        {
+            ASSERT_EQ(flash_x86_ptr[word_i], alt_u32(0));
+        }
+    }
+}
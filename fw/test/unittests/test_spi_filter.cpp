@@ -34,6 +34,7 @@ public:
     virtual void SetUp()
     {
         SYSTEM_MOCK::get()->reset();
+        ut_reset_nios_fw();
 
         // Perform provisioning
         SYSTEM_MOCK::get()->provision_ufm_data(UFM_PFR_DATA_EXAMPLE_KEY_FILE);
@@ -98,30 +99,30 @@ TEST_F(SPIFilterTest, test_spi_filtering_with_custom_pfm_case1)
     apply_spi_write_protection_and_smbus_rules(SPI_FLASH_PCH);
 
     // SPI regions 1 & 2
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 0), alt_u32(0xFF800000));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 0), alt_u32(0xFF800000));
     // SPI region 2
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 1), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 1), alt_u32(0xFFFFFFFF));
     // SPI region 2 & 3
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 2), alt_u32(0x0000003F));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 2), alt_u32(0x0000003F));
     // SPI region 3
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 3), alt_u32(0x00000000));
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 4), alt_u32(0x00000000));
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 5), alt_u32(0x00000000));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 3), alt_u32(0x00000000));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 4), alt_u32(0x00000000));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 5), alt_u32(0x00000000));
     // SPI region 3 & 4
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 6), alt_u32(0xFFFFFF80));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 6), alt_u32(0xFFFFFF80));
 
     // SPI region 4
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 7), alt_u32(0xFFFFFFFF));
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 8), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 7), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, 8), alt_u32(0xFFFFFFFF));
     // Expected maximum size of PCH flash is PCH_SPI_FLASH_SIZE
     alt_u32 last_word_pos_for_pch_flash_in_we_mem = PCH_SPI_FLASH_SIZE >> (14 + 5);
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, last_word_pos_for_pch_flash_in_we_mem - 2), alt_u32(0xFFFFFFFF));
-    EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, last_word_pos_for_pch_flash_in_we_mem - 1), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, last_word_pos_for_pch_flash_in_we_mem - 2), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, last_word_pos_for_pch_flash_in_we_mem - 1), alt_u32(0xFFFFFFFF));
 
     // Ensure that BMC rules are untouched
     for (alt_u32 word_i = 0; word_i < U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_SPAN / 4; word_i++)
     {
-        EXPECT_EQ(IORD(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, word_i), alt_u32(0));
+        EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, word_i), alt_u32(0));
     }
 }
 
@@ -175,18 +176,91 @@ TEST_F(SPIFilterTest, test_spi_filtering_with_custom_pfm_case2)
     apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
 
     // SPI regions 1/2/3
-    EXPECT_EQ(IORD(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0), alt_u32(0xC000000F));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, 0), alt_u32(0xC000000F));
     // SPI region 3
-    EXPECT_EQ(IORD(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 1), alt_u32(0xFFFFFFFF));
-    EXPECT_EQ(IORD(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 2), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, 1), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, 2), alt_u32(0xFFFFFFFF));
     // Expected maximum size of BMC flash is BMC_SPI_FLASH_SIZE
     alt_u32 last_word_pos_for_bmc_flash_in_we_mem = BMC_SPI_FLASH_SIZE >> (14 + 5);
-    EXPECT_EQ(IORD(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, last_word_pos_for_bmc_flash_in_we_mem - 2), alt_u32(0xFFFFFFFF));
-    EXPECT_EQ(IORD(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, last_word_pos_for_bmc_flash_in_we_mem - 1), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, last_word_pos_for_bmc_flash_in_we_mem - 2), alt_u32(0xFFFFFFFF));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, last_word_pos_for_bmc_flash_in_we_mem - 1), alt_u32(0xFFFFFFFF));
 
     // Ensure that PCH rules are untouched
     for (alt_u32 word_i = 0; word_i < U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_SPAN / 4; word_i++)
     {
-        EXPECT_EQ(IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, word_i), alt_u32(0));
+        EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_PCH, word_i), alt_u32(0));
     }
 }
+
+/*
+ * Test that only the changed words of the write enable memory are written, when the write protection is applied again.
+ */
+TEST_F(SPIFilterTest, test_spi_filtering_only_commits_changed_words)
+{
+    switch_spi_flash(SPI_FLASH_BMC);
+
+    // Define a custom PFM for BMC
+    //   SPI Region 1: 0x0000 - 0x10000 is RW
+    //   SPI Region 2: 0x10000 - 0x78000 is RO
+    //   SPI Region 3: 0x78000 - 0x8000000 is RW
+    alt_u32 pfm_data[64];
+    for (alt_u32 word_i = 0; word_i < 64; word_i++)
+    {
+        pfm_data[word_i] = 0xFFFFFFFF;
+    }
+    pfm_data[0] = PFM_MAGIC;
+    pfm_data[1] = 0x00010103;
+    pfm_data[7] = sizeof(pfm_data);
+    alt_u32 region_defs[12] = {
+        0x00000301, 0xFFFFFFFF, 0x00000000, 0x00010000,
+        0x00000101, 0xFFFFFFFF, 0x00010000, 0x00078000,
+        0x00000301, 0xFFFFFFFF, 0x00078000, 0x08000000,
+    };
+    alt_u32_memcpy(&pfm_data[PFM_HEADER_SIZE / 4], region_defs, sizeof(region_defs));
+    alt_u32* pfm_ptr = (alt_u32*) get_active_pfm(SPI_FLASH_BMC);
+    alt_u32_memcpy(pfm_ptr, pfm_data, sizeof(pfm_data));
+
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, 0), alt_u32(0xC000000F));
+    for (alt_u32 word_i = 1; word_i < (BMC_SPI_FLASH_SIZE >> (14 + 5)); word_i++)
+    {
+        EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, word_i), alt_u32(0xFFFFFFFF));
+    }
+
+    // An unchanged protection layout writes nothing
+    alt_u32 we_mem_writes_before = SYSTEM_MOCK::get()->get_spi_we_mem_write_count();
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_write_count(), we_mem_writes_before);
+
+    // Make SPI region 1 read-only. Only the first word is written.
+    pfm_ptr[PFM_HEADER_SIZE / 4] = 0x00000101;
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_write_count(), we_mem_writes_before + 1);
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, 0), alt_u32(0xC0000000));
+
+    // Once the shadow is invalid (e.g. after a CPLD reconfiguration), every word is written again
+    invalidate_spi_we_mem_shadow(SPI_FLASH_BMC);
+    we_mem_writes_before = SYSTEM_MOCK::get()->get_spi_we_mem_write_count();
+    apply_spi_write_protection_and_smbus_rules(SPI_FLASH_BMC);
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_write_count(), we_mem_writes_before + BMC_SPI_WE_MEM_NWORDS);
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_word(SPI_FLASH_BMC, 0), alt_u32(0xC0000000));
+
+    // The CPLD recovery region is always locked, even if the shadow says it's locked already
+    write_protect_cpld_recovery_region();
+    we_mem_writes_before = SYSTEM_MOCK::get()->get_spi_we_mem_write_count();
+    write_protect_cpld_recovery_region();
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_we_mem_write_count(), we_mem_writes_before + 2);
+}
+
+/*
+ * Test that Nios never reads the write enable memory, which the SPI filter doesn't support.
+ */
+TEST_F(SPIFilterTest, test_spi_filtering_never_reads_we_mem)
+{
+    SYSTEM_MOCK::get()->set_assert_to_throw();
+    alt_u32 dummy = 0;
+    EXPECT_ANY_THROW(dummy = IORD(U_SPI_FILTER_BMC_WE_AVMM_BRIDGE_BASE, 0));
+    EXPECT_ANY_THROW(dummy = IORD(U_SPI_FILTER_PCH_WE_AVMM_BRIDGE_BASE, 0));
+    (void) dummy;
+    SYSTEM_MOCK::get()->set_assert_to_abort();
+}
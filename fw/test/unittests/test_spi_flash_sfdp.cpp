@@ -0,0 +1,146 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+#include <iostream>
+
+// Include the GTest headers
+#include "gtest_headers.h"
+
+// Include the SYSTEM MOCK and PFR headers
+#include "ut_nios_wrapper.h"
+
+
+class SPIFlashSFDPTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        SYSTEM_MOCK::get()->reset();
+        ut_reset_nios_fw();
+    }
+
+    virtual void TearDown() {}
+};
+
+TEST_F(SPIFlashSFDPTest, test_default_caps_before_discovery)
+{
+    SPI_FLASH_CAPS* caps = get_spi_flash_caps(SPI_FLASH_BMC);
+    EXPECT_EQ(caps->is_discovered, alt_u32(0));
+    EXPECT_EQ(caps->read_instruction, alt_u32(BMC_SPI_READ_INSTRUCTION_DEFAULT));
+
+    SPI_ERASE_TIME_TABLE* erase_time_table = get_spi_erase_time_table(SPI_FLASH_PCH);
+    EXPECT_EQ(erase_time_table->erase_4kb_time_us, alt_u32(30000));
+    EXPECT_EQ(erase_time_table->erase_32kb_time_us, alt_u32(150000));
+    EXPECT_EQ(erase_time_table->erase_64kb_time_us, alt_u32(280000));
+}
+
+TEST_F(SPIFlashSFDPTest, test_discover_micron_flash)
+{
+    takeover_spi_ctrl(SPI_FLASH_BMC);
+
+    // Without USE_QUAD_IO, the read instruction is not changed
+    SPI_FLASH_CAPS* caps = get_spi_flash_caps(SPI_FLASH_BMC);
+    EXPECT_EQ(caps->is_discovered, alt_u32(1));
+    EXPECT_EQ(caps->read_instruction, alt_u32(BMC_SPI_READ_INSTRUCTION_DEFAULT));
+
+    SPI_ERASE_TIME_TABLE* erase_time_table = get_spi_erase_time_table(SPI_FLASH_BMC);
+    EXPECT_EQ(erase_time_table->erase_4kb_time_us, alt_u32(48000));
+    EXPECT_EQ(erase_time_table->erase_32kb_time_us, alt_u32(112000));
+    EXPECT_EQ(erase_time_table->erase_64kb_time_us, alt_u32(144000));
+
+    // The SPI control block is back to the default operating protocols after reading SFDP
+    EXPECT_EQ(read_from_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_READ_INSTRUCTION_OFST), alt_u32(BMC_SPI_READ_INSTRUCTION_DEFAULT));
+    EXPECT_EQ(read_from_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST), alt_u32(SPI_OPERATING_PROTOCOLS_DEFAULT));
+
+    // PCH flash hasn't been discovered
+    EXPECT_EQ(get_spi_flash_caps(SPI_FLASH_PCH)->is_discovered, alt_u32(0));
+}
+
+TEST_F(SPIFlashSFDPTest, test_discover_macronix_flash)
+{
+    takeover_spi_ctrl(SPI_FLASH_PCH);
+
+    SPI_ERASE_TIME_TABLE* erase_time_table = get_spi_erase_time_table(SPI_FLASH_PCH);
+    EXPECT_EQ(erase_time_table->erase_4kb_time_us, alt_u32(30000));
+    EXPECT_EQ(erase_time_table->erase_32kb_time_us, alt_u32(144000));
+    EXPECT_EQ(erase_time_table->erase_64kb_time_us, alt_u32(288000));
+}
+
+TEST_F(SPIFlashSFDPTest, test_discover_winbond_flash)
+{
+    SYSTEM_MOCK::get()->set_spi_flash_sfdp_profile(SPI_FLASH_PCH, SPI_CONTROL_MOCK::SFDP_PROFILE::WINBOND_W25Q);
+    takeover_spi_ctrl(SPI_FLASH_PCH);
+
+    SPI_FLASH_CAPS* caps = get_spi_flash_caps(SPI_FLASH_PCH);
+    EXPECT_EQ(caps->read_instruction, alt_u32(PCH_SPI_READ_INSTRUCTION_DEFAULT));
+
+    SPI_ERASE_TIME_TABLE* erase_time_table = get_spi_erase_time_table(SPI_FLASH_PCH);
+    EXPECT_EQ(erase_time_table->erase_4kb_time_us, alt_u32(48000));
+    EXPECT_EQ(erase_time_table->erase_32kb_time_us, alt_u32(112000));
+    EXPECT_EQ(erase_time_table->erase_64kb_time_us, alt_u32(144000));
+}
+
+TEST_F(SPIFlashSFDPTest, test_flash_without_sfdp_keeps_default_caps)
+{
+    SYSTEM_MOCK::get()->set_spi_flash_sfdp_profile(SPI_FLASH_BMC, SPI_CONTROL_MOCK::SFDP_PROFILE::NONE);
+    takeover_spi_ctrl(SPI_FLASH_BMC);
+
+    SPI_FLASH_CAPS* caps = get_spi_flash_caps(SPI_FLASH_BMC);
+    EXPECT_EQ(caps->is_discovered, alt_u32(1));
+    EXPECT_EQ(caps->read_instruction, alt_u32(BMC_SPI_READ_INSTRUCTION_DEFAULT));
+
+    SPI_ERASE_TIME_TABLE* erase_time_table = get_spi_erase_time_table(SPI_FLASH_BMC);
+    EXPECT_EQ(erase_time_table->erase_4kb_time_us, alt_u32(50000));
+    EXPECT_EQ(erase_time_table->erase_32kb_time_us, alt_u32(110000));
+    EXPECT_EQ(erase_time_table->erase_64kb_time_us, alt_u32(150000));
+}
+
+TEST_F(SPIFlashSFDPTest, test_switch_spi_flash_uses_caps_of_each_flash)
+{
+    takeover_spi_ctrls();
+    get_spi_flash_caps(SPI_FLASH_BMC)->read_instruction = SPI_FLASH_QUAD_READ_PROTOCOL_MICRON;
+
+    switch_spi_flash(SPI_FLASH_BMC);
+    EXPECT_EQ(read_from_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_READ_INSTRUCTION_OFST), alt_u32(SPI_FLASH_QUAD_READ_PROTOCOL_MICRON));
+    switch_spi_flash(SPI_FLASH_PCH);
+    EXPECT_EQ(read_from_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_READ_INSTRUCTION_OFST), alt_u32(PCH_SPI_READ_INSTRUCTION_DEFAULT));
+
+    // Status register is always read with the default operating protocols
+    write_to_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST, 0x11000);
+    read_spi_status_register();
+    EXPECT_EQ(read_from_spi_ctrl_1_csr(SPI_CONTROL_1_CSR_CS_OPERATING_PROTOCOLS_OFST), alt_u32(SPI_OPERATING_PROTOCOLS_DEFAULT));
+}
+
+TEST_F(SPIFlashSFDPTest, test_sfdp_is_only_read_once)
+{
+    takeover_spi_ctrl(SPI_FLASH_BMC);
+    EXPECT_EQ(get_spi_erase_time_table(SPI_FLASH_BMC)->erase_4kb_time_us, alt_u32(48000));
+
+    // Subsequent takeovers keep the discovered capabilities
+    SYSTEM_MOCK::get()->set_spi_flash_sfdp_profile(SPI_FLASH_BMC, SPI_CONTROL_MOCK::SFDP_PROFILE::MACRONIX_MX25L);
+    takeover_spi_ctrl(SPI_FLASH_BMC);
+    EXPECT_EQ(get_spi_erase_time_table(SPI_FLASH_BMC)->erase_4kb_time_us, alt_u32(48000));
+
+    // SFDP is read again after the capabilities are reset
+    reset_spi_flash_caps(SPI_FLASH_BMC);
+    takeover_spi_ctrl(SPI_FLASH_BMC);
+    EXPECT_EQ(get_spi_erase_time_table(SPI_FLASH_BMC)->erase_4kb_time_us, alt_u32(30000));
+}
@@ -156,6 +156,34 @@ TEST_F(SPIFlashRWTest, test_erase_spi_region)
 }
 
 TEST_F(SPIFlashRWTest, test_erase_spi_region_with_4kb_erase)
+{
+    // Get pointer to the SPI flash
+    switch_spi_flash(SPI_FLASH_BMC);
+    alt_u32* bmc_flash_ptr = get_spi_flash_ptr();
+    bmc_flash_ptr[0] = 0x12345678;
+    bmc_flash_ptr[1] = 0xdeadbeef;
+    // 16KB boundary
+    bmc_flash_ptr[4095] = 0xabcdabcd;
+    bmc_flash_ptr[4096] = BLOCK1_MAGIC;
+
+    // Erase the first four page
+    erase_spi_region(0, 0x4000);
+
+    // The first four page should be cleared now
+    for (alt_u32 i = 0; i < (0x4000 >> 2); i++)
+    {
+        EXPECT_EQ(bmc_flash_ptr[i], 0xFFFFFFFF);
+    }
+    // The 5th page should remain untouched
+    EXPECT_EQ(bmc_flash_ptr[4096], alt_u32(BLOCK1_MAGIC));
+
+    // Check SPI Erase command counts
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(4));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(0));
+}
+
+TEST_F(SPIFlashRWTest, test_erase_spi_region_with_32kb_erase)
 {
     // Get pointer to the SPI flash
     switch_spi_flash(SPI_FLASH_BMC);
@@ -178,7 +206,8 @@ TEST_F(SPIFlashRWTest, test_erase_spi_region_with_4kb_erase)
     EXPECT_EQ(bmc_flash_ptr[8192], alt_u32(BLOCK1_MAGIC));
 
     // Check SPI Erase command counts
-    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(8));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(0));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(1));
     EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(0));
 }
 
@@ -210,7 +239,7 @@ TEST_F(SPIFlashRWTest, test_erase_spi_region_with_64kb_erase)
     EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(1));
 }
 
-TEST_F(SPIFlashRWTest, test_erase_spi_region_with_mix_of_4kb_and_64kb_erase)
+TEST_F(SPIFlashRWTest, test_erase_spi_region_with_mix_of_4kb_32kb_and_64kb_erase)
 {
     // Test setting
     //   Erasing 47 pages starting at a certain offset
@@ -246,7 +275,8 @@ TEST_F(SPIFlashRWTest, test_erase_spi_region_with_mix_of_4kb_and_64kb_erase)
     EXPECT_EQ(bmc_flash_ptr[region_end_word_i + 1], 0xDEADBEEF);
 
     // Check SPI Erase command counts
-    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(15));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(7));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(1));
     EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(2));
 }
 
@@ -286,7 +316,8 @@ TEST_F(SPIFlashRWTest, test_erase_64kb_spi_region_which_is_not_64kb_aligned)
     EXPECT_EQ(bmc_flash_ptr[region_end_word_i + 1], 0xDEADBEEF);
 
     // Check SPI Erase command counts
-    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(16));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(8));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(1));
     EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(0));
 }
 
@@ -326,7 +357,8 @@ TEST_F(SPIFlashRWTest, test_erase_120kb_spi_region_which_is_not_64kb_aligned)
     EXPECT_EQ(bmc_flash_ptr[region_end_word_i + 1], 0xDEADBEEF);
 
     // Check SPI Erase command counts
-    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(30));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE), alt_u32(14));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE), alt_u32(2));
     EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE), alt_u32(0));
 }
 
@@ -366,6 +398,38 @@ TEST_F(SPIFlashRWTest, test_memcpy_signed_payload_with_bmc_capsule)
               expected_num_64kb_erases);
 }
 
+TEST_F(SPIFlashRWTest, test_memcpy_signed_payload_with_blank_check)
+{
+    // A valid capsule is available from the beginning of the BMC flash
+    alt_u32* bmc_flash_ptr = get_spi_flash_ptr();
+    EXPECT_EQ(*bmc_flash_ptr, alt_u32(BLOCK0_MAGIC));
+
+    // Erase the target SPI region, with a stale word left in its first sector
+    erase_spi_region(0x2a00000, SIGNED_CAPSULE_BMC_FILE_SIZE);
+    bmc_flash_ptr[0x2a00000 >> 2] = 0;
+    alt_u32 num_4kb_erases_before = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE);
+    alt_u32 num_32kb_erases_before = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE);
+    alt_u32 num_64kb_erases_before = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE);
+    alt_u32 num_blank_erases_before = SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count();
+
+    // Copy this capsule to the target SPI region, skipping the erase of blank sectors
+    set_spi_erase_blank_check(1);
+    memcpy_signed_payload(0x2a00000, bmc_flash_ptr);
+    set_spi_erase_blank_check(0);
+
+    // Ensure the whole capsule has been copied over.
+    for (alt_u32 word_i = 0; word_i < (SIGNED_CAPSULE_BMC_FILE_SIZE >> 2); word_i++)
+    {
+        ASSERT_EQ(bmc_flash_ptr[word_i], bmc_flash_ptr[word_i + (0x2a00000 >> 2)]);
+    }
+
+    // Only the sector with the stale word has been erased
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) - num_4kb_erases_before +
+            SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE) - num_32kb_erases_before +
+            SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE) - num_64kb_erases_before, alt_u32(1));
+    EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_blank_sector_erase_count(), num_blank_erases_before);
+}
+
 TEST_F(SPIFlashRWTest, test_memcpy_signed_payload_with_pch_pfm)
 {
     alt_u32* bmc_flash_ptr = get_spi_flash_ptr();
@@ -482,3 +546,94 @@ TEST_F(SPIFlashRWTest, test_memcpy_signed_payload_with_cpld_capsule)
     EXPECT_EQ(SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE),
               expected_num_64kb_erases);
 }
+
+TEST_F(SPIFlashRWTest, test_copy_between_flashes_with_bmc_capsule)
+{
+    alt_u32* bmc_flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    alt_u32* pch_flash_x86_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_PCH);
+    EXPECT_EQ(*bmc_flash_x86_ptr, alt_u32(BLOCK0_MAGIC));
+
+    // Copy the BMC capsule to the PCH flash
+    SYSTEM_MOCK::get()->enable_sim_time();
+    alt_u64 time_before = SYSTEM_MOCK::get()->get_sim_time_ns();
+    copy_between_flashes(0x2a00000, 0, SPI_FLASH_PCH, SPI_FLASH_BMC, SIGNED_CAPSULE_BMC_FILE_SIZE);
+    alt_u64 copy_time_ns = SYSTEM_MOCK::get()->get_sim_time_ns() - time_before;
+
+    // Ensure the whole capsule has been copied over.
+    for (alt_u32 word_i = 0; word_i < (SIGNED_CAPSULE_BMC_FILE_SIZE >> 2); word_i++)
+    {
+        ASSERT_EQ(bmc_flash_x86_ptr[word_i], pch_flash_x86_ptr[word_i + (0x2a00000 >> 2)]);
+    }
+
+    // The erase time is the same regardless of the copy method. Only look at the program time.
+    alt_u32 num_erases = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) + SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE);
+    alt_u64 erase_time_ns = SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE) * alt_u64(SIM_TIME_NS_SPI_4KB_ERASE) +
+            SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE) * alt_u64(SIM_TIME_NS_SPI_64KB_ERASE);
+    alt_u64 program_time_ns = copy_time_ns - erase_time_ns;
+
+    // Each chunk costs one status register read, on top of the final status register read of each erase.
+    // A word by word copy would need one status register read per word.
+    alt_u64 num_chunks = (SIGNED_CAPSULE_BMC_FILE_SIZE + SPI_FLASH_COPY_BUFFER_SIZE - 1) / SPI_FLASH_COPY_BUFFER_SIZE;
+    alt_u64 word_by_word_program_time_ns = (SIGNED_CAPSULE_BMC_FILE_SIZE >> 2) * alt_u64(SIM_TIME_NS_SPI_STATUS_READ);
+
+    EXPECT_LE(program_time_ns, (num_chunks + num_erases) * SIM_TIME_NS_SPI_STATUS_READ);
+    EXPECT_LT(program_time_ns, word_by_word_program_time_ns);
+}
+
+/**
+ * @brief When the destination already holds an older copy of the signed payload, only the sectors
+ * that differ are erased and programmed.
+ */
+TEST_F(SPIFlashRWTest, test_memcpy_signed_payload_only_rewrites_differing_sectors)
+{
+    alt_u32* bmc_flash_ptr = get_spi_flash_ptr();
+    alt_u32 dest_addr = 0x2a00000;
+    memcpy_signed_payload(dest_addr, bmc_flash_ptr);
+
+    // Copying the same payload again rewrites nothing
+    reset_io_counters();
+    memcpy_signed_payload(dest_addr, bmc_flash_ptr);
+    EXPECT_EQ(io_counters[IO_COUNTER_4KB_ERASES] + io_counters[IO_COUNTER_32KB_ERASES] + io_counters[IO_COUNTER_64KB_ERASES], alt_u32(0));
+    EXPECT_EQ(io_counters[IO_COUNTER_PAGES_PROGRAMMED], alt_u32(0));
+
+    // Modify two adjacent sectors, a sector far away and the last word of the payload
+    alt_u32 sector_nwords = SPI_FLASH_PAGE_SIZE_OF_4KB >> 2;
+    bmc_flash_ptr[sector_nwords] = ~bmc_flash_ptr[sector_nwords];
+    bmc_flash_ptr[2 * sector_nwords + 4] = ~bmc_flash_ptr[2 * sector_nwords + 4];
+    bmc_flash_ptr[100 * sector_nwords + 8] = ~bmc_flash_ptr[100 * sector_nwords + 8];
+    bmc_flash_ptr[(SIGNED_CAPSULE_BMC_FILE_SIZE >> 2) - 1] = ~bmc_flash_ptr[(SIGNED_CAPSULE_BMC_FILE_SIZE >> 2) - 1];
+
+    reset_io_counters();
+    memcpy_signed_payload(dest_addr, bmc_flash_ptr);
+    for (alt_u32 word_i = 0; word_i < (SIGNED_CAPSULE_BMC_FILE_SIZE >> 2); word_i++)
+    {
+        ASSERT_EQ(bmc_flash_ptr[word_i], bmc_flash_ptr[word_i + (dest_addr >> 2)]);
+    }
+
+    // Only the four modified sectors are erased and programmed
+    EXPECT_EQ(io_counters[IO_COUNTER_4KB_ERASES], alt_u32(4));
+    EXPECT_EQ(io_counters[IO_COUNTER_32KB_ERASES] + io_counters[IO_COUNTER_64KB_ERASES], alt_u32(0));
+    alt_u32 last_sector_npages = ((SIGNED_CAPSULE_BMC_FILE_SIZE - 1) % SPI_FLASH_PAGE_SIZE_OF_4KB) / SPI_FLASH_PAGE_SIZE + 1;
+    EXPECT_EQ(io_counters[IO_COUNTER_PAGES_PROGRAMMED], 3 * (SPI_FLASH_PAGE_SIZE_OF_4KB / SPI_FLASH_PAGE_SIZE) + last_sector_npages);
+}
+
+TEST_F(SPIFlashRWTest, test_io_counters_of_copy_between_flashes)
+{
+    reset_io_counters();
+    copy_between_flashes(0x2a00000, 0, SPI_FLASH_PCH, SPI_FLASH_BMC, SIGNED_CAPSULE_BMC_FILE_SIZE);
+
+    // Every erase command is counted
+    EXPECT_EQ(io_counters[IO_COUNTER_4KB_ERASES], SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_4KB_SECTOR_ERASE));
+    EXPECT_EQ(io_counters[IO_COUNTER_32KB_ERASES], SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_32KB_SECTOR_ERASE));
+    EXPECT_EQ(io_counters[IO_COUNTER_64KB_ERASES], SYSTEM_MOCK::get()->get_spi_cmd_count(SPI_CMD_64KB_SECTOR_ERASE));
+
+    // Each chunk is one page. Nios switches to the destination and back for each chunk.
+    alt_u32 num_chunks = (SIGNED_CAPSULE_BMC_FILE_SIZE + SPI_FLASH_PAGE_SIZE - 1) / SPI_FLASH_PAGE_SIZE;
+    EXPECT_EQ(io_counters[IO_COUNTER_PAGES_PROGRAMMED], num_chunks);
+    EXPECT_EQ(io_counters[IO_COUNTER_SPI_FLASH_SWITCHES], 2 + 2 * num_chunks);
+    EXPECT_GE(io_counters[IO_COUNTER_STATUS_POLLS], num_chunks);
+
+    // Nothing is hashed
+    EXPECT_EQ(io_counters[IO_COUNTER_BYTES_HASHED], alt_u32(0));
+    EXPECT_EQ(io_counters[IO_COUNTER_ECDSA_OPS], alt_u32(0));
+}
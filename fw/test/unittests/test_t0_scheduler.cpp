@@ -0,0 +1,164 @@
+/******************************************************************************
+ * Copyright (c) 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ ******************************************************************************/
+// Include the GTest headers
+#include "gtest_headers.h"
+
+// Include the SYSTEM MOCK and PFR headers
+#include "ut_nios_wrapper.h"
+
+class PFRT0SchedulerTest : public testing::Test
+{
+public:
+    virtual void SetUp()
+    {
+        SYSTEM_MOCK::get()->reset();
+        ut_reset_nios_fw();
+    }
+
+    virtual void TearDown() {}
+};
+
+TEST_F(PFRT0SchedulerTest, test_periodic_task_is_due_once_per_period)
+{
+    start_t0_scheduler();
+
+    alt_u32 num_polls = 0;
+    for (alt_u32 spin = 0; spin < 4 * T0_UPDATE_INTENT_POLL_PERIOD; spin++)
+    {
+        if (is_t0_task_due(T0_TASK_UPDATE_INTENT))
+        {
+            // Every task is polled in the first spin after entering T0
+            EXPECT_EQ(spin % T0_UPDATE_INTENT_POLL_PERIOD, alt_u32(0));
+            num_polls++;
+        }
+        advance_t0_scheduler();
+    }
+    EXPECT_EQ(num_polls, alt_u32(4));
+
+    // Tasks with a period of 1 spin are due in every spin
+    for (alt_u32 spin = 0; spin < 8; spin++)
+    {
+        EXPECT_TRUE(is_t0_task_due(T0_TASK_PLTRST));
+        advance_t0_scheduler();
+    }
+}
+
+TEST_F(PFRT0SchedulerTest, test_wake_task)
+{
+    start_t0_scheduler();
+    EXPECT_TRUE(is_t0_task_due(T0_TASK_UPDATE_INTENT));
+    advance_t0_scheduler();
+    EXPECT_FALSE(is_t0_task_due(T0_TASK_UPDATE_INTENT));
+    advance_t0_scheduler();
+
+    // A woken task is due right away and then follows its period again
+    wake_t0_task(T0_TASK_UPDATE_INTENT);
+    EXPECT_TRUE(is_t0_task_due(T0_TASK_UPDATE_INTENT));
+    advance_t0_scheduler();
+    EXPECT_FALSE(is_t0_task_due(T0_TASK_UPDATE_INTENT));
+}
+
+TEST_F(PFRT0SchedulerTest, test_max_latency)
+{
+    start_t0_scheduler();
+    for (alt_u32 spin = 0; spin < 5 * T0_PROVISIONING_POLL_PERIOD; spin++)
+    {
+        if (is_t0_task_due(T0_TASK_PROVISIONING))
+        {
+            // Only the last poll picks up an event
+            record_t0_task_poll(T0_TASK_PROVISIONING, spin == (4 * T0_PROVISIONING_POLL_PERIOD));
+        }
+        advance_t0_scheduler();
+    }
+    EXPECT_EQ(get_t0_task_max_latency(T0_TASK_PROVISIONING), alt_u32(T0_PROVISIONING_POLL_PERIOD));
+
+    // Polls without an event don't count
+    EXPECT_EQ(get_t0_task_max_latency(T0_TASK_UPDATE_INTENT), alt_u32(0));
+
+    // Re-entering T0 doesn't count the time spent in T-1
+    start_t0_scheduler();
+    record_t0_task_poll(T0_TASK_PROVISIONING, 1);
+    EXPECT_EQ(get_t0_task_max_latency(T0_TASK_PROVISIONING), alt_u32(T0_PROVISIONING_POLL_PERIOD));
+
+    reset_t0_scheduler();
+    EXPECT_EQ(get_t0_task_max_latency(T0_TASK_PROVISIONING), alt_u32(0));
+}
+
+TEST_F(PFRT0SchedulerTest, test_t0_profile_histogram_bucket)
+{
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0), alt_u32(0));
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0xFF), alt_u32(0));
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0x100), alt_u32(1));
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0xFFF), alt_u32(1));
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0x1000), alt_u32(2));
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0xFFFF), alt_u32(2));
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0x10000), alt_u32(3));
+    EXPECT_EQ(get_t0_profile_histogram_bucket(0xFFFFFFFF), alt_u32(3));
+}
+
+TEST_F(PFRT0SchedulerTest, test_t0_profile_drops_sample_across_tmin1)
+{
+    T0_PROFILE_SAMPLE sample;
+    start_t0_scheduler();
+
+    start_t0_profile_sample(&sample);
+    end_t0_profile_sample(T0_TASK_BMC_RESET, &sample);
+    EXPECT_EQ(t0_profile.histogram[T0_TASK_BMC_RESET][0], alt_u32(1));
+
+    // Nios went through T-1 and entered T0 again during this sample
+    start_t0_profile_sample(&sample);
+    start_t0_scheduler();
+    end_t0_profile_sample(T0_TASK_BMC_RESET, &sample);
+    EXPECT_EQ(t0_profile.histogram[T0_TASK_BMC_RESET][0], alt_u32(1));
+}
+
+TEST_F(PFRT0SchedulerTest, test_t0_profile_in_t0_loop)
+{
+    // Exit after 50 iterations in the T0 loop
+    SYSTEM_MOCK::get()->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS_END_AFTER_50_ITERS);
+    perform_t0_operations();
+
+    // Every spin is measured
+    alt_u32 num_spins = 0;
+    for (alt_u32 bucket = 0; bucket < T0_PROFILE_HISTOGRAM_NUM_BUCKETS; bucket++)
+    {
+        num_spins += t0_profile.histogram[T0_PROFILE_LOOP][bucket];
+    }
+    EXPECT_EQ(num_spins, t0_scheduler.tick);
+    EXPECT_GT(t0_profile.min_cycles[T0_PROFILE_LOOP], alt_u32(0));
+    EXPECT_GE(t0_profile.max_cycles[T0_PROFILE_LOOP], t0_profile.min_cycles[T0_PROFILE_LOOP]);
+
+    // The provisioning handler is measured whenever it's polled
+    alt_u32 num_polls = 0;
+    for (alt_u32 bucket = 0; bucket < T0_PROFILE_HISTOGRAM_NUM_BUCKETS; bucket++)
+    {
+        num_polls += t0_profile.histogram[T0_TASK_PROVISIONING][bucket];
+    }
+    EXPECT_EQ(num_polls, (num_spins + T0_PROVISIONING_POLL_PERIOD - 1) / T0_PROVISIONING_POLL_PERIOD);
+
+    // The profile of the first spin has been published to the mailbox
+    alt_u32 mb_offset = MB_T0_PROFILE + T0_PROFILE_LOOP * T0_PROFILE_MB_ENTRY_SIZE;
+    alt_u32 mb_max = IORD(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 2) | (IORD(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 3) << 8);
+    EXPECT_GT(mb_max, alt_u32(0));
+    EXPECT_LE(mb_max, t0_profile.max_cycles[T0_PROFILE_LOOP] >> T0_PROFILE_MB_CYCLES_SHIFT);
+    EXPECT_EQ(IORD(U_MAILBOX_AVMM_BRIDGE_BASE, MB_T0_LOOP_HISTOGRAM), alt_u32(1));
+}
@@ -102,3 +102,19 @@ TEST_F(PFRTimerUtilsTest, test_restart_timer)
     EXPECT_TRUE(IORD(U_TIMER_BANK_TIMER3_ADDR, 0) & U_TIMER_BANK_TIMER_ACTIVE_MASK);
     EXPECT_TRUE(check_bit(U_TIMER_BANK_TIMER3_ADDR, U_TIMER_BANK_TIMER_ACTIVE_BIT));
 }
+
+TEST_F(PFRTimerUtilsTest, test_cycle_counter)
+{
+    alt_u32 start_cycle = get_cycle_count();
+
+    // Each AVMM access costs a fixed number of cycles in the mock
+    for (alt_u32 i = 0; i < 10; i++)
+    {
+        IORD(U_TIMER_BANK_TIMER1_ADDR, 0);
+    }
+    EXPECT_EQ(get_cycle_count() - start_cycle, alt_u32(11 * SIM_CYCLES_PER_AVMM_ACCESS));
+
+    // The cycle counter is read-only
+    IOWR(U_TIMER_BANK_CYCLE_COUNTER_ADDR, 0, 0);
+    EXPECT_GT(get_cycle_count() - start_cycle, alt_u32(11 * SIM_CYCLES_PER_AVMM_ACCESS));
+}
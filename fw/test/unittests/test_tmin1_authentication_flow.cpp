@@ -283,3 +283,233 @@ TEST_F(Tmin1AuthenticationFlowTest, test_completely_corrupted_bmc_and_pch_flashe
     major_err_matches_expectation |= read_from_mailbox(MB_MAJOR_ERROR_CODE) == MAJOR_ERROR_PCH_AUTH_FAILED;
     EXPECT_TRUE(major_err_matches_expectation);
 }
+
+/**
+ * @brief Compare the duration of T-1 operations (in simulated time) with and without
+ * the background authentication of PCH static regions, while BMC active firmware is being recovered.
+ */
+TEST_F(Tmin1AuthenticationFlowTest, test_bg_pch_auth_during_bmc_recovery_saves_time)
+{
+    alt_u32* bmc_flash_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    alt_u32* pch_flash_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_PCH);
+
+    ut_prep_nios_gpi_signals();
+
+    alt_u64 tmin1_time_ns[2];
+    for (alt_u32 run_i = 0; run_i < 2; run_i++)
+    {
+        // Corrupt BMC firmware
+        SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+        SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+        switch_spi_flash(SPI_FLASH_BMC);
+        erase_spi_region(testdata_bmc_static_regions_start_addr[1], testdata_bmc_static_regions_end_addr[1] - testdata_bmc_static_regions_start_addr[1]);
+
+        ut_reset_nios_fw();
+        write_to_mailbox(MB_RECOVERY_COUNT, 0);
+        SYSTEM_MOCK::get()->enable_sim_time();
+
+        if (run_i == 0)
+        {
+            // PCH static regions are authenticated while BMC flash is busy
+            perform_tmin1_operations();
+        }
+        else
+        {
+            // No background job
+            perform_tmin1_operations_for_bmc();
+            perform_tmin1_operations_for_pch();
+        }
+        tmin1_time_ns[run_i] = SYSTEM_MOCK::get()->get_sim_time_ns();
+
+        // Both flashes should be authentic after T-1
+        EXPECT_EQ(read_from_mailbox(MB_PANIC_EVENT_COUNT), alt_u32(0));
+        EXPECT_EQ(read_from_mailbox(MB_RECOVERY_COUNT), alt_u32(1));
+        EXPECT_EQ(read_from_mailbox(MB_LAST_RECOVERY_REASON), alt_u32(LAST_RECOVERY_BMC_ACTIVE));
+        switch_spi_flash(SPI_FLASH_BMC);
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(SPI_FLASH_BMC)));
+        switch_spi_flash(SPI_FLASH_PCH);
+        EXPECT_TRUE(is_active_region_valid(get_spi_active_pfm_ptr(SPI_FLASH_PCH)));
+
+        // Nios should not leave a background job behind
+        EXPECT_EQ(tmin1_bg_auth_job.state, TMIN1_BG_JOB_IDLE);
+    }
+
+    EXPECT_LT(tmin1_time_ns[0], tmin1_time_ns[1]);
+
+    // Verify recovered data
+    alt_u32 *full_image = new alt_u32[FULL_PFR_IMAGE_BMC_FILE_SIZE/4];
+    SYSTEM_MOCK::get()->init_x86_mem_from_file(FULL_PFR_IMAGE_BMC_FILE, full_image);
+    for (alt_u32 region_i = 0; region_i < BMC_NUM_STATIC_REGIONS; region_i++)
+    {
+        for (alt_u32 word_i = testdata_bmc_static_regions_start_addr[region_i] >> 2;
+                word_i < testdata_bmc_static_regions_end_addr[region_i] >> 2; word_i++)
+        {
+            ASSERT_EQ(full_image[word_i], bmc_flash_ptr[word_i]);
+        }
+    }
+    delete[] full_image;
+
+    full_image = new alt_u32[FULL_PFR_IMAGE_PCH_FILE_SIZE/4];
+    SYSTEM_MOCK::get()->init_x86_mem_from_file(FULL_PFR_IMAGE_PCH_FILE, full_image);
+    for (alt_u32 region_i = 0; region_i < PCH_NUM_STATIC_REGIONS; region_i++)
+    {
+        for (alt_u32 word_i = testdata_pch_static_regions_start_addr[region_i] >> 2;
+                word_i < testdata_pch_static_regions_end_addr[region_i] >> 2; word_i++)
+        {
+            ASSERT_EQ(full_image[word_i], pch_flash_ptr[word_i]);
+        }
+    }
+    delete[] full_image;
+}
+
+/**
+ * @brief Check the T-1 profile after BMC active firmware is recovered.
+ */
+TEST_F(Tmin1AuthenticationFlowTest, test_tmin1_profile_of_bmc_active_recovery)
+{
+    // Corrupt BMC firmware
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+    switch_spi_flash(SPI_FLASH_BMC);
+    erase_spi_region(testdata_bmc_static_regions_start_addr[1], testdata_bmc_static_regions_end_addr[1] - testdata_bmc_static_regions_start_addr[1]);
+
+    ut_prep_nios_gpi_signals();
+    ut_reset_nios_fw();
+    SYSTEM_MOCK::get()->enable_sim_time();
+
+    log_platform_state(PLATFORM_STATE_ENTER_TMIN1);
+    perform_tmin1_operations();
+    log_platform_state(PLATFORM_STATE_ENTER_T0);
+
+    EXPECT_EQ(read_from_mailbox(MB_LAST_RECOVERY_REASON), alt_u32(LAST_RECOVERY_BMC_ACTIVE));
+
+    // Every phase of this T-1, except for the WDT recovery, has taken some time
+    alt_u32 sum_ms = 0;
+    alt_u32 sum_cycles = 0;
+    for (alt_u32 phase = 0; phase < TMIN1_NUM_PHASES; phase++)
+    {
+        if ((phase != TMIN1_PHASE_WDT_RECOVERY) && (phase != TMIN1_PHASE_UPDATE))
+        {
+            EXPECT_GT(tmin1_profile.ms[phase] * SYS_CLK_CYCLES_PER_MS + tmin1_profile.cycles[phase], alt_u32(0));
+        }
+        EXPECT_LT(tmin1_profile.cycles[phase], alt_u32(SYS_CLK_CYCLES_PER_MS));
+        sum_ms += tmin1_profile.ms[phase];
+        sum_cycles += tmin1_profile.cycles[phase];
+    }
+    EXPECT_EQ(tmin1_profile.phase, TMIN1_PHASE_NONE);
+
+    // The results in the mailbox are in milliseconds
+    alt_u32 decomp_mb_offset = MB_TMIN1_PROFILE + TMIN1_PHASE_DECOMPRESSION * TMIN1_PROFILE_MB_ENTRY_SIZE;
+    alt_u32 decomp_ms = IORD(U_MAILBOX_AVMM_BRIDGE_BASE, decomp_mb_offset) | (IORD(U_MAILBOX_AVMM_BRIDGE_BASE, decomp_mb_offset + 1) << 8);
+    EXPECT_EQ(decomp_ms, get_tmin1_profile_mb_value(tmin1_profile.ms[TMIN1_PHASE_DECOMPRESSION]));
+    EXPECT_GT(decomp_ms, alt_u32(0));
+
+    alt_u32 total_ms = IORD(U_MAILBOX_AVMM_BRIDGE_BASE, MB_TMIN1_PROFILE) | (IORD(U_MAILBOX_AVMM_BRIDGE_BASE, MB_TMIN1_PROFILE + 1) << 8);
+    EXPECT_EQ(total_ms, get_tmin1_profile_mb_value(sum_ms + sum_cycles / SYS_CLK_CYCLES_PER_MS));
+}
+
+/**
+ * @brief Check the T-1 profile after the whole BMC active firmware is recovered.
+ *
+ * This recovery takes longer than the wrap-around period of the cycle counter (about 85 seconds).
+ */
+TEST_F(Tmin1AuthenticationFlowTest, test_tmin1_profile_of_full_bmc_active_recovery)
+{
+    // Corrupt every sector in the static regions of BMC firmware, so that all of them are erased and programmed again
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+    alt_u32* bmc_flash_ptr = SYSTEM_MOCK::get()->get_x86_ptr_to_spi_flash(SPI_FLASH_BMC);
+    for (alt_u32 region_i = 0; region_i < BMC_NUM_STATIC_REGIONS; region_i++)
+    {
+        for (alt_u32 addr = testdata_bmc_static_regions_start_addr[region_i];
+                addr < testdata_bmc_static_regions_end_addr[region_i]; addr += SPI_FLASH_PAGE_SIZE_OF_4KB)
+        {
+            bmc_flash_ptr[addr >> 2] ^= 0x1;
+        }
+    }
+
+    ut_prep_nios_gpi_signals();
+    ut_reset_nios_fw();
+    SYSTEM_MOCK::get()->enable_sim_time();
+
+    // Programming a SPI page typically takes 700us. Charge that time to every word written to SPI flash.
+    SYSTEM_MOCK::get()->register_read_write_callback(
+            [](SYSTEM_MOCK::READ_OR_WRITE read_or_write, void* addr, alt_u32 data) {
+        alt_u32* spi_flash_ptr = get_spi_flash_ptr();
+        if ((read_or_write == SYSTEM_MOCK::READ_OR_WRITE::WRITE) &&
+                ((alt_u32*) addr >= spi_flash_ptr) && ((alt_u32*) addr < spi_flash_ptr + (BMC_SPI_FLASH_SIZE >> 2)))
+        {
+            SYSTEM_MOCK::get()->advance_sim_time_ns(700000 / (SPI_FLASH_PAGE_SIZE >> 2));
+        }
+    });
+
+    log_platform_state(PLATFORM_STATE_ENTER_TMIN1);
+    perform_tmin1_operations();
+    log_platform_state(PLATFORM_STATE_ENTER_T0);
+    alt_u64 sim_time_ms = SYSTEM_MOCK::get()->get_sim_time_ns() / 1000000;
+
+    EXPECT_EQ(read_from_mailbox(MB_LAST_RECOVERY_REASON), alt_u32(LAST_RECOVERY_BMC_ACTIVE));
+
+    // The decompression alone lasts longer than the wrap-around period of the cycle counter
+    alt_u32 wrap_around_ms = 0xFFFFFFFF / SYS_CLK_CYCLES_PER_MS;
+    EXPECT_GT(tmin1_profile.ms[TMIN1_PHASE_DECOMPRESSION], wrap_around_ms);
+
+    // The profile covers at least the simulated time (the cycle counter also counts AVMM accesses)
+    alt_u32 sum_ms = 0;
+    for (alt_u32 phase = 0; phase < TMIN1_NUM_PHASES; phase++)
+    {
+        sum_ms += tmin1_profile.ms[phase];
+    }
+    EXPECT_GE(alt_u64(sum_ms) + 1, sim_time_ms);
+
+    // The mailbox holds saturated values
+    alt_u32 decomp_mb_offset = MB_TMIN1_PROFILE + TMIN1_PHASE_DECOMPRESSION * TMIN1_PROFILE_MB_ENTRY_SIZE;
+    alt_u32 decomp_ms = IORD(U_MAILBOX_AVMM_BRIDGE_BASE, decomp_mb_offset) | (IORD(U_MAILBOX_AVMM_BRIDGE_BASE, decomp_mb_offset + 1) << 8);
+    EXPECT_EQ(decomp_ms, get_tmin1_profile_mb_value(tmin1_profile.ms[TMIN1_PHASE_DECOMPRESSION]));
+    alt_u32 total_ms = IORD(U_MAILBOX_AVMM_BRIDGE_BASE, MB_TMIN1_PROFILE) | (IORD(U_MAILBOX_AVMM_BRIDGE_BASE, MB_TMIN1_PROFILE + 1) << 8);
+    EXPECT_EQ(total_ms, alt_u32(TMIN1_PROFILE_MB_MAX_VALUE));
+}
+
+/**
+ * @brief Check the I/O counters in the mailbox after BMC active firmware is recovered.
+ */
+TEST_F(Tmin1AuthenticationFlowTest, test_io_counters_of_bmc_active_recovery)
+{
+    // Corrupt BMC firmware
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_PCH, FULL_PFR_IMAGE_PCH_FILE, FULL_PFR_IMAGE_PCH_FILE_SIZE);
+    SYSTEM_MOCK::get()->load_to_flash(SPI_FLASH_BMC, FULL_PFR_IMAGE_BMC_FILE, FULL_PFR_IMAGE_BMC_FILE_SIZE);
+    switch_spi_flash(SPI_FLASH_BMC);
+    erase_spi_region(testdata_bmc_static_regions_start_addr[1], testdata_bmc_static_regions_end_addr[1] - testdata_bmc_static_regions_start_addr[1]);
+
+    ut_prep_nios_gpi_signals();
+    ut_reset_nios_fw();
+
+    // Operations before T-1 are not counted
+    log_platform_state(PLATFORM_STATE_ENTER_TMIN1);
+    EXPECT_EQ(io_counters[IO_COUNTER_4KB_ERASES], alt_u32(0));
+    EXPECT_EQ(io_counters[IO_COUNTER_SPI_FLASH_SWITCHES], alt_u32(0));
+
+    perform_tmin1_operations();
+    log_platform_state(PLATFORM_STATE_ENTER_T0);
+    EXPECT_EQ(read_from_mailbox(MB_LAST_RECOVERY_REASON), alt_u32(LAST_RECOVERY_BMC_ACTIVE));
+
+    // The recovery erases and programs the corrupted static region. Blank pages in the capsule are not programmed.
+    alt_u32 region_size = testdata_bmc_static_regions_end_addr[1] - testdata_bmc_static_regions_start_addr[1];
+    EXPECT_GT(io_counters[IO_COUNTER_PAGES_PROGRAMMED], alt_u32(0));
+    EXPECT_LE(io_counters[IO_COUNTER_PAGES_PROGRAMMED] * SPI_FLASH_PAGE_SIZE, region_size);
+    EXPECT_GT(io_counters[IO_COUNTER_4KB_ERASES] + io_counters[IO_COUNTER_32KB_ERASES] + io_counters[IO_COUNTER_64KB_ERASES],
+            alt_u32(0));
+    EXPECT_GT(io_counters[IO_COUNTER_BYTES_HASHED], region_size);
+    EXPECT_GT(io_counters[IO_COUNTER_ECDSA_OPS], alt_u32(0));
+    EXPECT_GT(io_counters[IO_COUNTER_STATUS_POLLS], alt_u32(0));
+    EXPECT_GT(io_counters[IO_COUNTER_SPI_FLASH_SWITCHES], alt_u32(0));
+
+    // Each counter is published in the mailbox
+    for (alt_u32 counter = 0; counter < IO_NUM_COUNTERS; counter++)
+    {
+        alt_u32 mb_offset = MB_TMIN1_IO_COUNTERS + counter * IO_COUNTER_MB_ENTRY_SIZE;
+        alt_u32 mb_value = IORD(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset) | (IORD(U_MAILBOX_AVMM_BRIDGE_BASE, mb_offset + 1) << 8);
+        EXPECT_EQ(mb_value, get_io_counter_mb_value((IO_COUNTER_ENUM) counter));
+    }
+    EXPECT_EQ(get_io_counter_mb_value(IO_COUNTER_BYTES_HASHED), io_counters[IO_COUNTER_BYTES_HASHED] >> 12);
+}
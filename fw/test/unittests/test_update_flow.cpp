@@ -552,3 +552,97 @@ TEST_F(UpdateFlowTest, test_oob_bmc_pch_cpld_recovery_update_at_once)
     delete[] bmc_update_capsule;
     delete[] cpld_update_capsule;
 }
+
+/*
+ * This test sends a BMC update intent that requests BMC active and CPLD active update, and a PCH update intent that
+ * requests PCH active update, at the same time. All three updates are done in a single T-1 cycle.
+ */
+TEST_F(UpdateFlowTest, test_bmc_pch_cpld_active_update_intents_batched_in_one_tmin1)
+{
+    SYSTEM_MOCK* sys = SYSTEM_MOCK::get();
+
+    // Load the BMC and CPLD update capsules to BMC staging region, and the PCH update capsule to PCH staging region
+    sys->load_to_flash(SPI_FLASH_BMC, SIGNED_CAPSULE_BMC_V14_FILE,
+            SIGNED_CAPSULE_BMC_V14_FILE_SIZE, get_ufm_pfr_data()->bmc_staging_region);
+    sys->load_to_flash(SPI_FLASH_BMC, SIGNED_CAPSULE_CPLD_FILE,
+            SIGNED_CAPSULE_CPLD_FILE_SIZE, get_ufm_pfr_data()->bmc_staging_region + BMC_STAGING_REGION_CPLD_UPDATE_CAPSULE_OFFSET);
+    sys->load_to_flash(SPI_FLASH_PCH, SIGNED_CAPSULE_PCH_V03P12_FILE,
+            SIGNED_CAPSULE_PCH_V03P12_FILE_SIZE, get_ufm_pfr_data()->pch_staging_region);
+
+    /*
+     * Flow preparation
+     */
+    sys->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::T0_OPERATIONS_END_AFTER_50_ITERS);
+
+    // Set asserts to throw as opposed to abort
+    sys->set_assert_to_throw();
+    // Throw after performing CFM switch
+    sys->insert_code_block(SYSTEM_MOCK::CODE_BLOCK_TYPES::THROW_AFTER_CFM_SWITCH);
+
+    ut_run_main(CPLD_CFM0, true);
+
+    // Send both update intents once the platform has booted
+    sys->register_read_write_callback(
+            [](SYSTEM_MOCK::READ_OR_WRITE read_or_write, void* addr, alt_u32 data) {
+        if (read_or_write == SYSTEM_MOCK::READ_OR_WRITE::READ)
+        {
+            alt_u32* bmc_update_intent_addr = U_MAILBOX_AVMM_BRIDGE_ADDR + MB_BMC_UPDATE_INTENT;
+            if (addr == bmc_update_intent_addr)
+            {
+                if ((read_from_mailbox(MB_PLATFORM_STATE) == PLATFORM_STATE_T0_BOOT_COMPLETE) && (read_from_mailbox(MB_PANIC_EVENT_COUNT) == 0))
+                {
+                    SYSTEM_MOCK::get()->set_mem_word(bmc_update_intent_addr,
+                            MB_UPDATE_INTENT_BMC_ACTIVE_MASK | MB_UPDATE_INTENT_CPLD_ACTIVE_MASK, true);
+                    SYSTEM_MOCK::get()->set_mem_word(U_MAILBOX_AVMM_BRIDGE_ADDR + MB_PCH_UPDATE_INTENT,
+                            MB_UPDATE_INTENT_PCH_ACTIVE_MASK, true);
+                }
+            }
+        }
+    });
+
+    // The mock resets the T-1 counters and the mailbox after the CFM switch. Save them when the CFM switch is requested.
+    alt_u32 num_tmin1 = 0;
+    alt_u32 num_tmin1_bmc_only = 0;
+    alt_u32 num_tmin1_pch_only = 0;
+    alt_u32 mb_before_cfm_switch[U_MAILBOX_AVMM_BRIDGE_SPAN / 4] = {};
+    sys->register_read_write_callback(
+            [&](SYSTEM_MOCK::READ_OR_WRITE read_or_write, void* addr, alt_u32 data) {
+        if ((read_or_write == SYSTEM_MOCK::READ_OR_WRITE::WRITE) && (addr == __IO_CALC_ADDRESS_NATIVE(U_DUAL_CONFIG_BASE, 1)))
+        {
+            num_tmin1 = SYSTEM_MOCK::get()->get_t_minus_1_counter();
+            num_tmin1_bmc_only = SYSTEM_MOCK::get()->get_t_minus_1_bmc_only_counter();
+            num_tmin1_pch_only = SYSTEM_MOCK::get()->get_t_minus_1_pch_only_counter();
+            for (alt_u32 offset = 0; offset < U_MAILBOX_AVMM_BRIDGE_SPAN / 4; offset++)
+            {
+                mb_before_cfm_switch[offset] = read_from_mailbox((MB_REGFILE_OFFSET_ENUM) offset);
+            }
+        }
+    });
+
+    // The CPLD update ends the flow with a CFM switch
+    ut_run_main(CPLD_CFM1, true);
+
+    /*
+     * Check result
+     */
+    // One T-1 cycle after the power-on T-1 cycle, instead of a BMC-only, a PCH-only and a platform T-1 cycle
+    EXPECT_EQ(num_tmin1, alt_u32(2));
+    EXPECT_EQ(num_tmin1_bmc_only, alt_u32(0));
+    EXPECT_EQ(num_tmin1_pch_only, alt_u32(0));
+    EXPECT_EQ(mb_before_cfm_switch[MB_PANIC_EVENT_COUNT], alt_u32(1));
+    EXPECT_EQ(mb_before_cfm_switch[MB_LAST_PANIC_REASON], alt_u32(LAST_PANIC_BMC_UPDATE_INTENT));
+
+    // Both firmware updates are done before the CPLD update
+    EXPECT_EQ(mb_before_cfm_switch[MB_BMC_PFM_ACTIVE_MAJOR_VER], alt_u32(SIGNED_CAPSULE_BMC_V14_FILE_PFM_MAJOR_VER));
+    EXPECT_EQ(mb_before_cfm_switch[MB_BMC_PFM_ACTIVE_MINOR_VER], alt_u32(SIGNED_CAPSULE_BMC_V14_FILE_PFM_MINOR_VER));
+    EXPECT_EQ(mb_before_cfm_switch[MB_PCH_PFM_ACTIVE_MAJOR_VER], alt_u32(SIGNED_CAPSULE_PCH_V03P12_FILE_PFM_MAJOR_VER));
+    EXPECT_EQ(mb_before_cfm_switch[MB_PCH_PFM_ACTIVE_MINOR_VER], alt_u32(SIGNED_CAPSULE_PCH_V03P12_FILE_PFM_MINOR_VER));
+    EXPECT_EQ(mb_before_cfm_switch[MB_BMC_UPDATE_INTENT], alt_u32(0));
+    EXPECT_EQ(mb_before_cfm_switch[MB_PCH_UPDATE_INTENT], alt_u32(0));
+    EXPECT_EQ(mb_before_cfm_switch[MB_MAJOR_ERROR_CODE], alt_u32(0));
+    EXPECT_EQ(mb_before_cfm_switch[MB_MINOR_ERROR_CODE], alt_u32(0));
+
+    // Nios has switched to the CPLD ROM image to perform the CPLD update
+    EXPECT_EQ(mb_before_cfm_switch[MB_PLATFORM_STATE], alt_u32(PLATFORM_STATE_CPLD_UPDATE));
+    EXPECT_EQ(alt_u32(0x1), sys->get_mem_word((void*) (U_DUAL_CONFIG_BASE + 4)));
+}
@@ -133,6 +133,23 @@ TEST_F(UtilsTest, test_alt_u32_memcpy)
     EXPECT_EQ(dest_ptr[2], (alt_u32) 0);
 }
 
+TEST_F(UtilsTest, test_count_set_bits)
+{
+    EXPECT_EQ(count_set_bits(0), (alt_u32) 0);
+    EXPECT_EQ(count_set_bits(0x80000000), (alt_u32) 1);
+    EXPECT_EQ(count_set_bits(0xF0F00001), (alt_u32) 9);
+    EXPECT_EQ(count_set_bits(0xFFFFFFFF), (alt_u32) 32);
+}
+
+TEST_F(UtilsTest, test_count_leading_zeros)
+{
+    EXPECT_EQ(count_leading_zeros(0), (alt_u32) 32);
+    EXPECT_EQ(count_leading_zeros(1), (alt_u32) 31);
+    EXPECT_EQ(count_leading_zeros(0x00010000), (alt_u32) 15);
+    EXPECT_EQ(count_leading_zeros(0x0F000000), (alt_u32) 4);
+    EXPECT_EQ(count_leading_zeros(0x80000001), (alt_u32) 0);
+}
+
 TEST(SanityTest, test_alt_u32_memcpy_non_incr_bad_num_words)
 {
     // Set asserts to throw as opposed to abort
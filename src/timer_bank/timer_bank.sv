@@ -26,6 +26,9 @@
 // This module implements the a bank of 20ms timers. Each word represents an
 // independent timer. The timer value is bits 19:0. The start/stop bit is
 // bit 28.
+//
+// The word after the last timer is a free-running count of clk cycles. It is
+// read-only and wraps around at 32 bits.
 
 `timescale 1 ps / 1 ps
 `default_nettype none
@@ -50,6 +53,8 @@ module timer_bank (
 
 	reg [1:0] edge_tracker_20msCE;
 
+	reg [31:0] cycle_count;
+
 	// Track the rising edge of the 20msCE. Since this is
 	// synchronous to clk, we don't need extra synchronization
 	always_ff @(posedge clk or posedge areset) begin
@@ -84,7 +89,7 @@ module timer_bank (
 			end
 
 			// AVMM Write will overwrite any timer activity from above
-			if (avmm_write) begin
+			if (avmm_write && (avmm_address[CEIL_LOG2_NUM_TIMERS-1:0] < NUM_TIMERS)) begin
 				timers[avmm_address[CEIL_LOG2_NUM_TIMERS-1:0]] <= avmm_writedata[TIMER_WIDTH-1:0];
 				timer_active[avmm_address[CEIL_LOG2_NUM_TIMERS-1:0]] <= avmm_writedata[28];
 			end
@@ -93,9 +98,22 @@ module timer_bank (
 	end
 
 
+	// Free-running cycle counter
+	always_ff @(posedge clk or posedge areset) begin
+		if (areset) begin
+			cycle_count <= 32'b0;
+		end
+		else begin
+			cycle_count <= cycle_count + 1'b1;
+		end
+	end
+
 	// AVMM read interface
 	always_comb begin
-		if (avmm_read) begin
+		if (avmm_read && (avmm_address[CEIL_LOG2_NUM_TIMERS-1:0] == NUM_TIMERS)) begin
+			avmm_readdata <= cycle_count;
+		end
+		else if (avmm_read) begin
 			avmm_readdata <= {3'b0, timer_active[avmm_address[CEIL_LOG2_NUM_TIMERS-1:0]], {(28-TIMER_WIDTH){1'b0}}, timers[avmm_address[CEIL_LOG2_NUM_TIMERS-1:0]]};
 		end
 		else begin